@@ -34,6 +34,7 @@ const char kPostinstallDefaultScript[] = "postinst";
 
 // Constants defining keys for the persisted state of update engine.
 const char kPrefsAllowRepeatedUpdates[] = "allow-repeated-updates";
+const char kPrefsApplyTraceEnabled[] = "apply-trace-enabled";
 const char kPrefsAttemptInProgress[] = "attempt-in-progress";
 const char kPrefsBackoffExpiryTime[] = "backoff-expiry-time";
 const char kPrefsBootId[] = "boot-id";
@@ -46,6 +46,7 @@ extern const char kStatefulPartition[];
 
 // Constants related to preferences.
 extern const char kPrefsAllowRepeatedUpdates[];
+extern const char kPrefsApplyTraceEnabled[];
 extern const char kPrefsAttemptInProgress[];
 extern const char kPrefsBackoffExpiryTime[];
 extern const char kPrefsBootId[];
@@ -151,8 +151,8 @@ class DownloadAction : public InstallPlanAction, public HttpFetcherDelegate {
   std::unique_ptr<MultiRangeHttpFetcher> http_fetcher_;
 
   // If |true|, the update is user initiated (vs. periodic update checks). Hence
-  // the |delta_performer_| can decide not to use O_DSYNC flag for faster
-  // update.
+  // the |delta_performer_| can decide not to sync the written data before
+  // checkpointing for faster update.
   bool interactive_;
 
   // The FileWriter that downloaded data should be written to. It will
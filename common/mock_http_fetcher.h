@@ -107,6 +107,9 @@ class MockHttpFetcher : public HttpFetcher {
   // Resume the mock transfer.
   void Unpause() override;
 
+  // Whether the mock transfer is paused.
+  bool paused() const { return paused_; }
+
   // Fail the transfer. This simulates a network failure.
   void FailTransfer(int http_response_code);
 
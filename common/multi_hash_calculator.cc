@@ -0,0 +1,568 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/common/multi_hash_calculator.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <optional>
+
+#include <base/logging.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/utils.h"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86_64 1
+#endif  // __x86_64__
+
+namespace chromeos_update_engine {
+
+namespace {
+
+const size_t kBlockSize = 64;
+const size_t kHashSize = 32;
+const size_t kNumLanes = 8;
+
+const uint32_t kInitialState[8] = {0x6a09e667,
+                                   0xbb67ae85,
+                                   0x3c6ef372,
+                                   0xa54ff53a,
+                                   0x510e527f,
+                                   0x9b05688c,
+                                   0x1f83d9ab,
+                                   0x5be0cd19};
+
+alignas(16) const uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+// Applies the SHA-256 compression function to |num_blocks| consecutive blocks
+// of |data|, updating |state|.
+using CompressFunction = void (*)(uint32_t* state,
+                                  const uint8_t* data,
+                                  size_t num_blocks);
+
+inline uint32_t RotateRight(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t LoadBigEndian32(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+void CompressPortable(uint32_t* state, const uint8_t* data, size_t num_blocks) {
+  for (; num_blocks > 0; num_blocks--, data += kBlockSize) {
+    uint32_t w[64];
+    for (int t = 0; t < 16; t++)
+      w[t] = LoadBigEndian32(data + 4 * t);
+    for (int t = 16; t < 64; t++) {
+      uint32_t s0 = RotateRight(w[t - 15], 7) ^ RotateRight(w[t - 15], 18) ^
+                    (w[t - 15] >> 3);
+      uint32_t s1 = RotateRight(w[t - 2], 17) ^ RotateRight(w[t - 2], 19) ^
+                    (w[t - 2] >> 10);
+      w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; t++) {
+      uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = h + s1 + ch + kRoundConstants[t] + w[t];
+      uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + s0 + maj;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#if SHA256_X86_64
+
+bool CpuSupportsShaNi() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+  bool ssse3_sse41 = (ecx & bit_SSSE3) && (ecx & bit_SSE4_1);
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return false;
+  return ssse3_sse41 && (ebx & bit_SHA);
+}
+
+bool CpuSupportsAvx2() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE))
+    return false;
+  // The OS must save the YMM registers.
+  unsigned int xcr0_low, xcr0_high;
+  __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+  if ((xcr0_low & 0x6) != 0x6)
+    return false;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return false;
+  return ebx & bit_AVX2;
+}
+
+// The SHA extensions keep the state as the ABEF and CDGH words and process
+// four rounds per pair of SHA256RNDS2 instructions.
+__attribute__((target("sha,sse4.1,ssse3"))) void CompressShaNi(
+    uint32_t* state, const uint8_t* data, size_t num_blocks) {
+  const __m128i kByteSwap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+  __m128i state1 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+  tmp = _mm_shuffle_epi32(tmp, 0xb1);        // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1b);  // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);       // CDGH
+
+  for (; num_blocks > 0; num_blocks--, data += kBlockSize) {
+    __m128i abef_save = state0;
+    __m128i cdgh_save = state1;
+    __m128i msgs[4];
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) {
+      __m128i& msg = msgs[i % 4];
+      if (i < 4) {
+        msg = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)),
+            kByteSwap);
+      } else {
+        // W[t..t+3] from W[t-16..t-1], held in the previous four messages.
+        __m128i w = _mm_sha256msg1_epu32(msg, msgs[(i + 1) % 4]);
+        w = _mm_add_epi32(
+            w, _mm_alignr_epi8(msgs[(i + 3) % 4], msgs[(i + 2) % 4], 4));
+        msg = _mm_sha256msg2_epu32(w, msgs[(i + 3) % 4]);
+      }
+      __m128i wk = _mm_add_epi32(
+          msg,
+          _mm_load_si128(
+              reinterpret_cast<const __m128i*>(&kRoundConstants[4 * i])));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+      wk = _mm_shuffle_epi32(wk, 0x0e);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+    }
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);        // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xb1);     // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xf0);  // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);     // HGFE
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+__attribute__((target("avx2"))) inline __m256i RotateRight8(__m256i x, int n) {
+  return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+// Transposes the 8x8 matrix of 32 bits words in |rows|, so the i-th word of
+// each row ends up in the i-th row.
+__attribute__((target("avx2"))) void Transpose8x8(__m256i* rows) {
+  __m256i t[8], u[8];
+  for (int i = 0; i < 8; i += 2) {
+    t[i] = _mm256_unpacklo_epi32(rows[i], rows[i + 1]);
+    t[i + 1] = _mm256_unpackhi_epi32(rows[i], rows[i + 1]);
+  }
+  for (int i = 0; i < 8; i += 4) {
+    u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+    u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+    u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+    u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+  }
+  for (int i = 0; i < 4; i++) {
+    rows[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+    rows[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+  }
+}
+
+// Applies the compression function to one block of each of the eight
+// interleaved streams. |state| holds the i-th state word of all the streams in
+// its i-th row.
+__attribute__((target("avx2"))) void CompressAvx2x8(
+    uint32_t (*state)[kNumLanes], const uint8_t* const* blocks) {
+  const __m256i kByteSwap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                              0x0405060700010203ULL,
+                                              0x0c0d0e0f08090a0bULL,
+                                              0x0405060700010203ULL);
+  __m256i w[64];
+  for (int half = 0; half < 2; half++) {
+    for (size_t lane = 0; lane < kNumLanes; lane++) {
+      w[8 * half + lane] = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(blocks[lane] + 32 * half));
+    }
+    Transpose8x8(&w[8 * half]);
+  }
+  for (int t = 0; t < 16; t++)
+    w[t] = _mm256_shuffle_epi8(w[t], kByteSwap);
+  for (int t = 16; t < 64; t++) {
+    __m256i s0 = _mm256_xor_si256(
+        _mm256_xor_si256(RotateRight8(w[t - 15], 7), RotateRight8(w[t - 15], 18)),
+        _mm256_srli_epi32(w[t - 15], 3));
+    __m256i s1 = _mm256_xor_si256(
+        _mm256_xor_si256(RotateRight8(w[t - 2], 17), RotateRight8(w[t - 2], 19)),
+        _mm256_srli_epi32(w[t - 2], 10));
+    w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0),
+                            _mm256_add_epi32(w[t - 7], s1));
+  }
+
+  __m256i v[8];
+  for (int i = 0; i < 8; i++)
+    v[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state[i]));
+  __m256i a = v[0], b = v[1], c = v[2], d = v[3];
+  __m256i e = v[4], f = v[5], g = v[6], h = v[7];
+  for (int t = 0; t < 64; t++) {
+    __m256i s1 = _mm256_xor_si256(
+        _mm256_xor_si256(RotateRight8(e, 6), RotateRight8(e, 11)),
+        RotateRight8(e, 25));
+    __m256i ch =
+        _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+    __m256i t1 = _mm256_add_epi32(
+        _mm256_add_epi32(h, s1),
+        _mm256_add_epi32(
+            ch,
+            _mm256_add_epi32(w[t], _mm256_set1_epi32(kRoundConstants[t]))));
+    __m256i s0 = _mm256_xor_si256(
+        _mm256_xor_si256(RotateRight8(a, 2), RotateRight8(a, 13)),
+        RotateRight8(a, 22));
+    __m256i maj = _mm256_or_si256(
+        _mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+    h = g;
+    g = f;
+    f = e;
+    e = _mm256_add_epi32(d, t1);
+    d = c;
+    c = b;
+    b = a;
+    a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+  }
+  __m256i results[8] = {a, b, c, d, e, f, g, h};
+  for (int i = 0; i < 8; i++) {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(state[i]),
+                       _mm256_add_epi32(v[i], results[i]));
+  }
+}
+
+#endif  // SHA256_X86_64
+
+// The fastest way to hash a single stream with the given backend.
+CompressFunction SingleStreamCompress(MultiHashCalculator::Backend backend) {
+#if SHA256_X86_64
+  if (backend == MultiHashCalculator::Backend::kShaNi ||
+      (backend == MultiHashCalculator::Backend::kAvx2 &&
+       MultiHashCalculator::IsSupported(
+           MultiHashCalculator::Backend::kShaNi))) {
+    return CompressShaNi;
+  }
+#endif  // SHA256_X86_64
+  return CompressPortable;
+}
+
+void StoreHash(const uint32_t* state, brillo::Blob* hash) {
+  hash->resize(kHashSize);
+  for (int i = 0; i < 8; i++) {
+    (*hash)[4 * i] = state[i] >> 24;
+    (*hash)[4 * i + 1] = state[i] >> 16;
+    (*hash)[4 * i + 2] = state[i] >> 8;
+    (*hash)[4 * i + 3] = state[i];
+  }
+}
+
+}  // namespace
+
+// Iterates over the blocks of a stream, followed by its padding. Blocks are
+// returned in place unless they span several pieces of the stream.
+class MultiHashCalculator::StreamReader {
+ public:
+  explicit StreamReader(const Stream& stream)
+      : stream_(stream), remaining_(stream.length) {}
+  StreamReader(const StreamReader&) = delete;
+  StreamReader& operator=(const StreamReader&) = delete;
+
+  // Points |blocks| to up to |max_blocks| consecutive blocks and returns their
+  // number, or 0 once the whole stream was returned.
+  size_t NextBlocks(size_t max_blocks, const uint8_t** blocks) {
+    if (remaining_ >= kBlockSize) {
+      const auto& piece = stream_.pieces[piece_];
+      size_t num_blocks =
+          std::min((piece.second - offset_) / kBlockSize, max_blocks);
+      if (num_blocks > 0) {
+        *blocks = piece.first + offset_;
+        Skip(num_blocks * kBlockSize);
+        return num_blocks;
+      }
+      Copy(block_, kBlockSize);
+      *blocks = block_;
+      return 1;
+    }
+
+    if (!num_padding_blocks_) {
+      // The rest of the data, followed by a 1 bit, zeros and the length in
+      // bits, as a big endian 64 bits number, fill one or two blocks.
+      size_t length = remaining_;
+      memset(padding_, 0, sizeof(padding_));
+      Copy(padding_, length);
+      padding_[length] = 0x80;
+      num_padding_blocks_ = length + 9 <= kBlockSize ? 1 : 2;
+      uint64_t bits = stream_.length * 8;
+      uint8_t* end = padding_ + num_padding_blocks_ * kBlockSize;
+      for (int i = 1; i <= 8; i++, bits >>= 8)
+        end[-i] = bits & 0xff;
+    }
+    size_t num_blocks =
+        std::min(num_padding_blocks_ - next_padding_block_, max_blocks);
+    *blocks = padding_ + next_padding_block_ * kBlockSize;
+    next_padding_block_ += num_blocks;
+    return num_blocks;
+  }
+
+ private:
+  // Moves |length| bytes forward in the stream.
+  void Skip(size_t length) {
+    remaining_ -= length;
+    offset_ += length;
+    while (piece_ < stream_.pieces.size() &&
+           offset_ == stream_.pieces[piece_].second) {
+      piece_++;
+      offset_ = 0;
+    }
+  }
+
+  // Copies the next |length| bytes of the stream to |out| and skips them.
+  void Copy(uint8_t* out, size_t length) {
+    while (length > 0) {
+      const auto& piece = stream_.pieces[piece_];
+      size_t count = std::min(piece.second - offset_, length);
+      memcpy(out, piece.first + offset_, count);
+      out += count;
+      length -= count;
+      Skip(count);
+    }
+  }
+
+  const Stream& stream_;
+  uint64_t remaining_;
+  size_t piece_{0};
+  size_t offset_{0};
+
+  uint8_t block_[kBlockSize];
+  uint8_t padding_[2 * kBlockSize];
+  size_t num_padding_blocks_{0};
+  size_t next_padding_block_{0};
+};
+
+MultiHashCalculator::Backend MultiHashCalculator::DefaultBackend() {
+  // A single SHA-NI stream outruns the eight interleaved AVX2 ones.
+  if (IsSupported(Backend::kShaNi))
+    return Backend::kShaNi;
+  if (IsSupported(Backend::kAvx2))
+    return Backend::kAvx2;
+  // OpenSSL has optimized implementations for the other architectures.
+  return Backend::kOpenSSL;
+}
+
+bool MultiHashCalculator::IsSupported(Backend backend) {
+  switch (backend) {
+    case Backend::kOpenSSL:
+    case Backend::kPortable:
+      return true;
+#if SHA256_X86_64
+    case Backend::kShaNi: {
+      static const bool supported = CpuSupportsShaNi();
+      return supported;
+    }
+    case Backend::kAvx2: {
+      static const bool supported = CpuSupportsAvx2();
+      return supported;
+    }
+#else
+    case Backend::kShaNi:
+    case Backend::kAvx2:
+      return false;
+#endif  // SHA256_X86_64
+  }
+  return false;
+}
+
+const char* MultiHashCalculator::BackendName(Backend backend) {
+  switch (backend) {
+    case Backend::kOpenSSL:
+      return "openssl";
+    case Backend::kPortable:
+      return "portable";
+    case Backend::kShaNi:
+      return "sha-ni";
+    case Backend::kAvx2:
+      return "avx2x8";
+  }
+  return "unknown";
+}
+
+MultiHashCalculator::MultiHashCalculator(Backend backend)
+    : backend_(IsSupported(backend) ? backend : Backend::kPortable) {
+  LOG_IF(WARNING, backend_ != backend)
+      << "The " << BackendName(backend)
+      << " hash backend isn't supported, using the portable one.";
+}
+
+size_t MultiHashCalculator::AddStream() {
+  DCHECK(!finalized_);
+  streams_.emplace_back();
+  return streams_.size() - 1;
+}
+
+void MultiHashCalculator::Update(const void* data, size_t length) {
+  DCHECK(!streams_.empty());
+  if (length == 0)
+    return;
+  Stream& stream = streams_.back();
+  stream.pieces.emplace_back(reinterpret_cast<const uint8_t*>(data), length);
+  stream.length += length;
+}
+
+bool MultiHashCalculator::Finalize() {
+  TEST_AND_RETURN_FALSE(!finalized_);
+  finalized_ = true;
+  raw_hashes_.resize(streams_.size());
+  if (backend_ == Backend::kAvx2 && streams_.size() > 1) {
+    HashStreamsInterleaved();
+    return true;
+  }
+  for (size_t i = 0; i < streams_.size(); i++) {
+    if (backend_ == Backend::kOpenSSL) {
+      HashCalculator calc;
+      for (const auto& piece : streams_[i].pieces)
+        TEST_AND_RETURN_FALSE(calc.Update(piece.first, piece.second));
+      TEST_AND_RETURN_FALSE(calc.Finalize());
+      raw_hashes_[i] = calc.raw_hash();
+    } else {
+      HashStream(streams_[i], &raw_hashes_[i]);
+    }
+  }
+  return true;
+}
+
+void MultiHashCalculator::HashStream(const Stream& stream,
+                                     brillo::Blob* hash) const {
+  CompressFunction compress = SingleStreamCompress(backend_);
+  uint32_t state[8];
+  memcpy(state, kInitialState, sizeof(state));
+  StreamReader reader(stream);
+  const uint8_t* blocks;
+  while (size_t num_blocks = reader.NextBlocks(SIZE_MAX, &blocks))
+    compress(state, blocks, num_blocks);
+  StoreHash(state, hash);
+}
+
+void MultiHashCalculator::HashStreamsInterleaved() {
+#if SHA256_X86_64
+  alignas(32) uint32_t state[8][kNumLanes];
+  std::optional<StreamReader> readers[kNumLanes];
+  size_t lane_streams[kNumLanes];
+  size_t next_stream = 0;
+  static const uint8_t kUnusedBlock[kBlockSize] = {};
+
+  // Starts hashing the next stream, if any, in |lane|.
+  auto start_lane = [&](size_t lane) {
+    readers[lane].reset();
+    if (next_stream == streams_.size())
+      return;
+    readers[lane].emplace(streams_[next_stream]);
+    lane_streams[lane] = next_stream++;
+    for (int i = 0; i < 8; i++)
+      state[i][lane] = kInitialState[i];
+  };
+  for (size_t lane = 0; lane < kNumLanes; lane++)
+    start_lane(lane);
+
+  while (true) {
+    const uint8_t* blocks[kNumLanes];
+    size_t num_active = 0, last_active = 0;
+    for (size_t lane = 0; lane < kNumLanes; lane++) {
+      while (readers[lane] && !readers[lane]->NextBlocks(1, &blocks[lane])) {
+        uint32_t lane_state[8];
+        for (int i = 0; i < 8; i++)
+          lane_state[i] = state[i][lane];
+        StoreHash(lane_state, &raw_hashes_[lane_streams[lane]]);
+        start_lane(lane);
+      }
+      if (!readers[lane]) {
+        blocks[lane] = kUnusedBlock;
+        continue;
+      }
+      num_active++;
+      last_active = lane;
+    }
+    if (num_active == 0)
+      break;
+
+    // The last stream is hashed on its own, rather than in one of eight lanes.
+    if (num_active == 1) {
+      CompressFunction compress = SingleStreamCompress(backend_);
+      uint32_t lane_state[8];
+      for (int i = 0; i < 8; i++)
+        lane_state[i] = state[i][last_active];
+      const uint8_t* lane_blocks = blocks[last_active];
+      size_t num_blocks = 1;
+      do {
+        compress(lane_state, lane_blocks, num_blocks);
+      } while ((num_blocks =
+                    readers[last_active]->NextBlocks(SIZE_MAX, &lane_blocks)));
+      StoreHash(lane_state, &raw_hashes_[lane_streams[last_active]]);
+      break;
+    }
+
+    CompressAvx2x8(state, blocks);
+  }
+#else
+  NOTREACHED();
+#endif  // SHA256_X86_64
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,97 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_COMMON_MULTI_HASH_CALCULATOR_H_
+#define UPDATE_ENGINE_COMMON_MULTI_HASH_CALCULATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include <brillo/secure_blob.h>
+
+namespace chromeos_update_engine {
+
+// Computes the SHA-256 hashes of several independent streams of data at once,
+// such as the source data of a run of operations. Depending on the backend,
+// the streams are hashed one after the other or interleaved in the lanes of
+// vector registers, which keeps the CPU busy while hashing many short streams.
+//
+// As with HashCalculator, the methods must be called in order: AddStream() and
+// Update() for each stream, then Finalize(), then raw_hashes(). The data passed
+// to Update() isn't copied and must remain valid until Finalize() returns.
+class MultiHashCalculator {
+ public:
+  enum class Backend {
+    // Each stream through OpenSSL, as HashCalculator does.
+    kOpenSSL,
+    // Each stream through a portable C implementation.
+    kPortable,
+    // Each stream through the x86 SHA extensions.
+    kShaNi,
+    // Eight streams at a time interleaved in AVX2 registers.
+    kAvx2,
+  };
+
+  // The fastest backend supported by the CPU.
+  static Backend DefaultBackend();
+  static bool IsSupported(Backend backend);
+  static const char* BackendName(Backend backend);
+
+  explicit MultiHashCalculator(Backend backend = DefaultBackend());
+  MultiHashCalculator(const MultiHashCalculator&) = delete;
+  MultiHashCalculator& operator=(const MultiHashCalculator&) = delete;
+
+  // Starts a new stream, whose hash will be stored at the returned index of
+  // raw_hashes().
+  size_t AddStream();
+
+  // Appends |length| bytes of |data| to the last stream added.
+  void Update(const void* data, size_t length);
+
+  // Hashes all the streams. Returns true on success.
+  bool Finalize();
+
+  const std::vector<brillo::Blob>& raw_hashes() const { return raw_hashes_; }
+
+  Backend backend() const { return backend_; }
+
+ private:
+  // The data of a stream, as the list of its pieces.
+  struct Stream {
+    std::vector<std::pair<const uint8_t*, size_t>> pieces;
+    uint64_t length{0};
+  };
+
+  class StreamReader;
+
+  // Hashes |stream| on its own into |hash|.
+  void HashStream(const Stream& stream, brillo::Blob* hash) const;
+
+  // Hashes all the streams with the AVX2 backend.
+  void HashStreamsInterleaved();
+
+  const Backend backend_;
+  std::vector<Stream> streams_;
+  std::vector<brillo::Blob> raw_hashes_;
+  bool finalized_{false};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_COMMON_MULTI_HASH_CALCULATOR_H_
@@ -0,0 +1,114 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <brillo/flag_helper.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/multi_hash_calculator.h"
+
+// This program compares the throughput of the SHA-256 backends of
+// MultiHashCalculator with the HashCalculator, OpenSSL based, path on small and
+// large buffers.
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+// Returns the throughput in MiB/s of hashing |data| in buffers of
+// |buffer_size| bytes, |num_streams| buffers at a time, with |backend|, or
+// with HashCalculator if |backend| is null.
+double Measure(const brillo::Blob& data,
+               size_t buffer_size,
+               size_t num_streams,
+               const MultiHashCalculator::Backend* backend) {
+  size_t num_buffers = data.size() / buffer_size;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t first = 0; first < num_buffers; first += num_streams) {
+    size_t last = std::min(first + num_streams, num_buffers);
+    if (!backend) {
+      for (size_t i = first; i < last; i++) {
+        brillo::Blob hash;
+        CHECK(HashCalculator::RawHashOfBytes(
+            data.data() + i * buffer_size, buffer_size, &hash));
+      }
+      continue;
+    }
+    MultiHashCalculator calc(*backend);
+    for (size_t i = first; i < last; i++) {
+      calc.AddStream();
+      calc.Update(data.data() + i * buffer_size, buffer_size);
+    }
+    CHECK(calc.Finalize());
+  }
+  double seconds = (base::TimeTicks::Now() - start).InSecondsF();
+  return num_buffers * buffer_size / (1024.0 * 1024.0) / seconds;
+}
+
+int Main(int argc, char** argv) {
+  DEFINE_int32(data_mib, 256, "Amount of data hashed per measurement, in MiB.");
+  DEFINE_int32(streams, 8, "Number of buffers hashed together.");
+  brillo::FlagHelper::Init(
+      argc,
+      argv,
+      "Compares the SHA-256 backends on 4 KiB blocks and 1 MiB buffers.");
+  CHECK_GT(FLAGS_data_mib, 0);
+  CHECK_GT(FLAGS_streams, 0);
+
+  brillo::Blob data(static_cast<size_t>(FLAGS_data_mib) * 1024 * 1024);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = (i * 37 + i / 4096) & 0xff;
+
+  const vector<MultiHashCalculator::Backend> backends = {
+      MultiHashCalculator::Backend::kOpenSSL,
+      MultiHashCalculator::Backend::kPortable,
+      MultiHashCalculator::Backend::kShaNi,
+      MultiHashCalculator::Backend::kAvx2,
+  };
+  printf("Default backend: %s\n",
+         MultiHashCalculator::BackendName(MultiHashCalculator::DefaultBackend()));
+  for (size_t buffer_size : {4096, 1024 * 1024}) {
+    double baseline = Measure(data, buffer_size, FLAGS_streams, nullptr);
+    printf("\n%zu bytes buffers, %d at a time:\n", buffer_size, FLAGS_streams);
+    printf("  %-16s %10.1f MiB/s\n", "HashCalculator", baseline);
+    for (MultiHashCalculator::Backend backend : backends) {
+      if (!MultiHashCalculator::IsSupported(backend))
+        continue;
+      double throughput = Measure(data, buffer_size, FLAGS_streams, &backend);
+      printf("  %-16s %10.1f MiB/s  x%.2f\n",
+             MultiHashCalculator::BackendName(backend),
+             throughput,
+             throughput / baseline);
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+}  // namespace chromeos_update_engine
+
+int main(int argc, char** argv) {
+  return chromeos_update_engine::Main(argc, argv);
+}
@@ -0,0 +1,109 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/common/multi_hash_calculator.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+class MultiHashCalculatorTest
+    : public ::testing::TestWithParam<MultiHashCalculator::Backend> {
+ protected:
+  void SetUp() override {
+    if (!MultiHashCalculator::IsSupported(GetParam()))
+      GTEST_SKIP() << "Backend not supported by this CPU.";
+    data_.resize(1024 * 1024 + 100);
+    test_utils::FillWithData(&data_);
+  }
+
+  // Returns the hash of |length| bytes of |data_| at |offset|.
+  brillo::Blob ExpectedHash(size_t offset, size_t length) {
+    brillo::Blob hash;
+    EXPECT_TRUE(
+        HashCalculator::RawHashOfBytes(data_.data() + offset, length, &hash));
+    return hash;
+  }
+
+  brillo::Blob data_;
+};
+
+TEST_P(MultiHashCalculatorTest, PaddingLengthsTest) {
+  // Lengths around the block size exercise both padding cases.
+  const vector<size_t> lengths = {0, 1, 55, 56, 63, 64, 65, 119, 120, 4096};
+  MultiHashCalculator calc(GetParam());
+  EXPECT_EQ(GetParam(), calc.backend());
+  for (size_t length : lengths) {
+    calc.AddStream();
+    calc.Update(data_.data(), length);
+  }
+  EXPECT_TRUE(calc.Finalize());
+  ASSERT_EQ(lengths.size(), calc.raw_hashes().size());
+  for (size_t i = 0; i < lengths.size(); i++)
+    EXPECT_EQ(ExpectedHash(0, lengths[i]), calc.raw_hashes()[i]) << lengths[i];
+}
+
+TEST_P(MultiHashCalculatorTest, PiecesTest) {
+  // A stream made of pieces not aligned to the block size.
+  MultiHashCalculator calc(GetParam());
+  calc.AddStream();
+  calc.Update(data_.data(), 10);
+  calc.Update(data_.data() + 10, 0);
+  calc.Update(data_.data() + 10, 100);
+  calc.Update(data_.data() + 110, 4096);
+  calc.Update(data_.data() + 4206, 3);
+  EXPECT_TRUE(calc.Finalize());
+  EXPECT_EQ(ExpectedHash(0, 4209), calc.raw_hashes()[0]);
+  // Nothing can be hashed twice.
+  EXPECT_FALSE(calc.Finalize());
+}
+
+TEST_P(MultiHashCalculatorTest, ManyStreamsTest) {
+  // More streams than lanes, of various lengths, including a long one.
+  MultiHashCalculator calc(GetParam());
+  vector<std::pair<size_t, size_t>> streams;
+  for (size_t i = 0; i < 21; i++) {
+    size_t offset = i * 1000;
+    size_t length = i == 3 ? data_.size() - offset : 4096 * (i % 5) + i;
+    streams.emplace_back(offset, length);
+    calc.AddStream();
+    calc.Update(data_.data() + offset, length);
+  }
+  EXPECT_TRUE(calc.Finalize());
+  ASSERT_EQ(streams.size(), calc.raw_hashes().size());
+  for (size_t i = 0; i < streams.size(); i++) {
+    EXPECT_EQ(ExpectedHash(streams[i].first, streams[i].second),
+              calc.raw_hashes()[i])
+        << "stream " << i;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllBackends,
+    MultiHashCalculatorTest,
+    ::testing::Values(MultiHashCalculator::Backend::kOpenSSL,
+                      MultiHashCalculator::Backend::kPortable,
+                      MultiHashCalculator::Backend::kShaNi,
+                      MultiHashCalculator::Backend::kAvx2));
+
+}  // namespace chromeos_update_engine
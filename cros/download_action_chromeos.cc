@@ -23,7 +23,9 @@
 
 #include <base/check.h>
 #include <base/files/file_path.h>
+#include <base/functional/bind.h>
 #include <base/logging.h>
+#include <base/metrics/histogram_macros_local.h>
 #include <base/metrics/statistics_recorder.h>
 #include <base/strings/stringprintf.h>
 
@@ -44,6 +46,13 @@ using std::string;
 
 namespace chromeos_update_engine {
 
+namespace {
+// Maximum amount of payload data buffered while it waits to be applied. The
+// transfer is paused when the buffer is full, and resumed when it is half
+// empty.
+const size_t kPayloadBufferSize = 4 * 1024 * 1024;  // 4MB
+}  // namespace
+
 DownloadActionChromeos::DownloadActionChromeos(
     std::unique_ptr<HttpFetcher> http_fetcher, bool interactive)
     : http_fetcher_(new MultiRangeHttpFetcher(http_fetcher.release())),
@@ -256,6 +265,8 @@ void DownloadActionChromeos::StartDownloading() {
     }
   }
 
+  // Drop what is left of the previous payload before replacing its writer.
+  async_writer_.reset();
   if (writer_ && writer_ != delta_performer_.get()) {
     LOG(INFO) << "Using writer for test.";
   } else {
@@ -269,6 +280,11 @@ void DownloadActionChromeos::StartDownloading() {
                            interactive_));
     writer_ = delta_performer_.get();
   }
+  async_writer_ =
+      std::make_unique<AsyncFileWriter>(writer_, kPayloadBufferSize);
+  async_writer_->set_drained_callback(
+      base::BindRepeating(&DownloadActionChromeos::OnPayloadBufferDrained,
+                          base::Unretained(this)));
 
   if (SystemState::Get() != nullptr) {
     // Close any previous P2P sharing. It will be a no-op if there were no
@@ -317,11 +333,15 @@ void DownloadActionChromeos::StartDownloading() {
 }
 
 void DownloadActionChromeos::SuspendAction() {
-  http_fetcher_->Pause();
+  suspended_ = true;
+  if (!paused_for_payload_buffer_)
+    http_fetcher_->Pause();
 }
 
 void DownloadActionChromeos::ResumeAction() {
-  http_fetcher_->Unpause();
+  suspended_ = false;
+  if (!paused_for_payload_buffer_)
+    http_fetcher_->Unpause();
 }
 
 void DownloadActionChromeos::TerminateProcessing() {
@@ -331,6 +351,9 @@ void DownloadActionChromeos::TerminateProcessing() {
   }
   terminate_requested_ = true;
 
+  // Don't apply the payload still buffered.
+  if (async_writer_)
+    async_writer_->Cancel();
   if (writer_) {
     writer_->Close();
     writer_ = nullptr;
@@ -360,21 +383,17 @@ bool DownloadActionChromeos::ReceivedBytes(HttpFetcher* fetcher,
   if (delegate_ && download_active_) {
     delegate_->BytesReceived(length, bytes_downloaded_total, bytes_total_);
   }
-  if (writer_ && !writer_->Write(bytes, length, &code_)) {
-    if (code_ != ErrorCode::kSuccess) {
-      LOG(ERROR) << "Error " << utils::ErrorCodeToString(code_) << " (" << code_
-                 << ") in DeltaPerformer's Write method when "
-                 << "processing the received payload -- Terminating processing";
-    }
-    // Delete p2p file, if applicable.
-    if (!p2p_file_id_.empty())
-      CloseP2PSharingFd(true);
-    // Don't tell the action processor that the action is complete until we get
-    // the TransferTerminated callback. Otherwise, this and the HTTP fetcher
-    // objects may get destroyed before all callbacks are complete.
-    TerminateProcessing();
+  if (writer_ && !async_writer_->Write(bytes, length, &code_)) {
+    TerminateOnWriteError();
     return false;
   }
+  if (writer_) {
+    LOCAL_HISTOGRAM_PERCENTAGE(
+        "UpdateEngine.DownloadActionChromeos.PayloadBufferFillLevel",
+        async_writer_->buffered_bytes() * 100 / async_writer_->capacity());
+    if (async_writer_->IsFull())
+      PauseForPayloadBuffer();
+  }
 
   // Call p2p_manager_->FileMakeVisible() when we've successfully
   // verified the manifest!
@@ -389,7 +408,32 @@ bool DownloadActionChromeos::ReceivedBytes(HttpFetcher* fetcher,
 
 void DownloadActionChromeos::TransferComplete(HttpFetcher* fetcher,
                                               bool successful) {
+  // The transfer can end while paused for the payload buffer, which isn't
+  // refilled anymore.
+  if (paused_for_payload_buffer_) {
+    payload_buffer_stall_time_ +=
+        base::TimeTicks::Now() - payload_buffer_stall_start_;
+    paused_for_payload_buffer_ = false;
+  }
+  // Finish applying the payload still buffered before closing it, without
+  // blocking the message loop meanwhile.
   if (writer_) {
+    async_writer_->Finish(
+        base::BindOnce(&DownloadActionChromeos::OnPayloadApplied,
+                       base::Unretained(this),
+                       successful));
+    return;
+  }
+  OnPayloadApplied(successful, ErrorCode::kSuccess);
+}
+
+void DownloadActionChromeos::OnPayloadApplied(bool successful,
+                                              ErrorCode write_error) {
+  if (writer_) {
+    LOG(INFO) << "Payload buffer: transfer paused for "
+              << utils::FormatTimeDelta(payload_buffer_stall_time_)
+              << ", up to " << async_writer_->max_buffered_bytes()
+              << " bytes buffered.";
     LOG_IF(WARNING, writer_->Close() != 0) << "Error closing the writer.";
     if (delta_performer_.get() == writer_) {
       // no delta_performer_ in tests, so leave the test writer in place
@@ -399,6 +443,15 @@ void DownloadActionChromeos::TransferComplete(HttpFetcher* fetcher,
   download_active_ = false;
   ErrorCode code =
       successful ? ErrorCode::kSuccess : ErrorCode::kDownloadTransferError;
+  if (write_error != ErrorCode::kSuccess) {
+    LOG(ERROR) << "Error " << utils::ErrorCodeToString(write_error) << " ("
+               << write_error << ") in DeltaPerformer's Write method when "
+               << "processing the received payload.";
+    code = write_error;
+    // Delete p2p file, if applicable.
+    if (!p2p_file_id_.empty())
+      CloseP2PSharingFd(true);
+  }
   if (code == ErrorCode::kSuccess) {
     if (delta_performer_ && !payload_->already_applied)
       code = delta_performer_->VerifyPayload(payload_->hash, payload_->size);
@@ -452,6 +505,52 @@ void DownloadActionChromeos::TransferTerminated(HttpFetcher* fetcher) {
   }
 }
 
+void DownloadActionChromeos::TerminateOnWriteError() {
+  if (code_ != ErrorCode::kSuccess) {
+    LOG(ERROR) << "Error " << utils::ErrorCodeToString(code_) << " (" << code_
+               << ") in DeltaPerformer's Write method when "
+               << "processing the received payload -- Terminating processing";
+  }
+  // Delete p2p file, if applicable.
+  if (!p2p_file_id_.empty())
+    CloseP2PSharingFd(true);
+  // Don't tell the action processor that the action is complete until we get
+  // the TransferTerminated callback. Otherwise, this and the HTTP fetcher
+  // objects may get destroyed before all callbacks are complete.
+  TerminateProcessing();
+}
+
+void DownloadActionChromeos::PauseForPayloadBuffer() {
+  if (paused_for_payload_buffer_)
+    return;
+  paused_for_payload_buffer_ = true;
+  payload_buffer_stall_start_ = base::TimeTicks::Now();
+  if (!suspended_)
+    http_fetcher_->Pause();
+}
+
+void DownloadActionChromeos::OnPayloadBufferDrained() {
+  if (async_writer_->HasFailed(&code_)) {
+    TerminateOnWriteError();
+    return;
+  }
+  if (!paused_for_payload_buffer_)
+    return;
+
+  base::TimeDelta stall_time =
+      base::TimeTicks::Now() - payload_buffer_stall_start_;
+  payload_buffer_stall_time_ += stall_time;
+  LOCAL_HISTOGRAM_CUSTOM_TIMES(
+      "UpdateEngine.DownloadActionChromeos.PayloadBufferStallTime",
+      stall_time,
+      base::Milliseconds(1),
+      base::Minutes(1),
+      50);
+  paused_for_payload_buffer_ = false;
+  if (!suspended_)
+    http_fetcher_->Unpause();
+}
+
 void DownloadActionChromeos::StartMonitoringRestrictedIntervals() {
   update_time_restrictions_monitor_ =
       SystemState::Get()
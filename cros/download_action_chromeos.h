@@ -24,10 +24,13 @@
 #include <memory>
 #include <string>
 
+#include <base/time/time.h>
+
 #include "update_engine/common/action.h"
 #include "update_engine/common/download_action.h"
 #include "update_engine/common/http_fetcher.h"
 #include "update_engine/common/multi_range_http_fetcher.h"
+#include "update_engine/payload_consumer/async_file_writer.h"
 #include "update_engine/payload_consumer/delta_performer.h"
 #include "update_engine/payload_consumer/install_plan.h"
 #include "update_engine/update_manager/update_time_restrictions_monitor.h"
@@ -115,6 +118,24 @@ class DownloadActionChromeos
   // events of started intervals.
   void StartMonitoringRestrictedIntervals();
 
+  // Logs the |code_| reported by the writer and terminates the processing.
+  void TerminateOnWriteError();
+
+  // Pauses the transfer until the payload buffered in |async_writer_| is
+  // drained.
+  void PauseForPayloadBuffer();
+
+  // Called by |async_writer_| once it was drained after being full, or when
+  // applying the payload failed. Resumes the transfer or terminates the
+  // processing.
+  void OnPayloadBufferDrained();
+
+  // Called once the transfer is complete and the payload buffered in
+  // |async_writer_| was applied, with the error reported by |writer_| if it
+  // failed. Verifies the payload and moves to the next one or completes the
+  // action.
+  void OnPayloadApplied(bool successful, ErrorCode write_error);
+
   // Pointer to the current payload in install_plan_.payloads.
   InstallPlan::Payload* payload_{nullptr};
 
@@ -122,8 +143,8 @@ class DownloadActionChromeos
   std::unique_ptr<MultiRangeHttpFetcher> http_fetcher_;
 
   // If |true|, the update is user initiated (vs. periodic update checks). Hence
-  // the |delta_performer_| can decide not to use O_DSYNC flag for faster
-  // update.
+  // the |delta_performer_| can decide not to sync the written data before
+  // checkpointing for faster update.
   bool interactive_;
 
   // The FileWriter that downloaded data should be written to. It will
@@ -132,6 +153,22 @@ class DownloadActionChromeos
 
   std::unique_ptr<DeltaPerformer> delta_performer_;
 
+  // Buffers the payload received and feeds it to |writer_| from tasks of the
+  // message loop, so the transfer keeps receiving data while the operations
+  // are applied. Declared after |delta_performer_| so its pending writes are
+  // dropped first.
+  std::unique_ptr<AsyncFileWriter> async_writer_;
+
+  // Whether the transfer is paused because |async_writer_| is full, or because
+  // the action was suspended. The transfer only resumes when neither is set.
+  bool paused_for_payload_buffer_{false};
+  bool suspended_{false};
+
+  // When the current pause for |async_writer_| started, and the total time the
+  // transfer was paused for it.
+  base::TimeTicks payload_buffer_stall_start_;
+  base::TimeDelta payload_buffer_stall_time_;
+
   // Used by TransferTerminated to figure if this action terminated itself or
   // was terminated by the action processor.
   ErrorCode code_;
@@ -410,6 +410,87 @@ TEST(DownloadActionTest, TerminateEarlyNoDownloadDelegateTest) {
   TestTerminateEarly(false);
 }
 
+namespace {
+// Feeds more payload than the payload buffer holds before any of it is
+// applied, and checks the transfer is paused until half of it was applied.
+// If |suspend| is true, the action is also suspended meanwhile.
+void TestPayloadBufferPause(bool suspend) {
+  FakeSystemState::CreateInstance();
+  brillo::FakeMessageLoop loop(nullptr);
+  loop.SetAsCurrent();
+
+  ScopedTempFile output_temp_file;
+  DirectFileWriter writer;
+  EXPECT_EQ(
+      0, writer.Open(output_temp_file.path().c_str(), O_WRONLY | O_CREAT, 0));
+
+  brillo::Blob data(2 * kMockHttpFetcherChunkSize, 'a');
+  InstallPlan install_plan;
+  install_plan.payloads.push_back(
+      {.size = data.size(), .type = InstallPayloadType::kDelta});
+  install_plan.source_slot = 0;
+  install_plan.target_slot = 1;
+
+  auto feeder_action = std::make_unique<ObjectFeederAction<InstallPlan>>();
+  feeder_action->set_obj(install_plan);
+  auto http_fetcher =
+      std::make_unique<MockHttpFetcher>(data.data(), data.size(), nullptr);
+  auto http_fetcher_ptr = http_fetcher.get();
+  auto download_action = std::make_unique<DownloadActionChromeos>(
+      std::move(http_fetcher), /*interactive=*/false);
+  auto download_action_ptr = download_action.get();
+  download_action->SetTestFileWriter(&writer);
+  BondActions(feeder_action.get(), download_action.get());
+  DownloadActionTestProcessorDelegate delegate;
+  delegate.path_ = output_temp_file.path();
+  ActionProcessor processor;
+  processor.set_delegate(&delegate);
+  processor.EnqueueAction(std::move(feeder_action));
+  processor.EnqueueAction(std::move(download_action));
+  processor.StartProcessing();
+
+  // The message loop doesn't run in between, so nothing is applied and the
+  // four blocks fill the 4MB payload buffer.
+  const brillo::Blob block(1024 * 1024, 'b');
+  for (int i = 0; i < 4; i++) {
+    EXPECT_FALSE(http_fetcher_ptr->paused());
+    EXPECT_TRUE(download_action_ptr->ReceivedBytes(
+        http_fetcher_ptr, block.data(), block.size()));
+    delegate.expected_data_.insert(
+        delegate.expected_data_.end(), block.begin(), block.end());
+  }
+  EXPECT_TRUE(http_fetcher_ptr->paused());
+  if (suspend)
+    download_action_ptr->SuspendAction();
+
+  // Each task applies one block. The transfer stays paused until the buffer
+  // is half empty.
+  EXPECT_TRUE(loop.RunOnce(false));
+  EXPECT_TRUE(http_fetcher_ptr->paused());
+  EXPECT_TRUE(loop.RunOnce(false));
+  EXPECT_EQ(suspend, http_fetcher_ptr->paused());
+  if (suspend) {
+    download_action_ptr->ResumeAction();
+    EXPECT_FALSE(http_fetcher_ptr->paused());
+  }
+
+  // The rest of the transfer is applied after the blocks buffered.
+  delegate.expected_data_.insert(
+      delegate.expected_data_.end(), data.begin(), data.end());
+  loop.Run();
+  EXPECT_FALSE(loop.PendingTasks());
+  EXPECT_TRUE(delegate.processing_done_called_);
+}
+}  // namespace
+
+TEST(DownloadActionTest, PayloadBufferPauseTest) {
+  TestPayloadBufferPause(false);
+}
+
+TEST(DownloadActionTest, PayloadBufferPauseWhileSuspendedTest) {
+  TestPayloadBufferPause(true);
+}
+
 class DownloadActionTestAction;
 
 template <>
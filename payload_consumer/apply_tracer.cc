@@ -0,0 +1,137 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/apply_tracer.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+
+#include <utility>
+
+#include <base/json/string_escape.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <base/threading/platform_thread.h>
+
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/payload_constants.h"
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+namespace {
+// Amount of events buffered before they are written to the file.
+const size_t kMaxPendingBytes = 64 * 1024;
+}  // namespace
+
+const char ApplyTracer::kDefaultPath[] =
+    "/var/log/update_engine/apply_trace.json";
+
+std::unique_ptr<ApplyTracer> ApplyTracer::Create(const string& path) {
+  FileDescriptorPtr fd(new EintrSafeFileDescriptor());
+  if (!fd->Open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) {
+    PLOG(ERROR) << "Unable to create the apply trace " << path;
+    return nullptr;
+  }
+  return std::unique_ptr<ApplyTracer>(new ApplyTracer(std::move(fd)));
+}
+
+ApplyTracer::ApplyTracer(FileDescriptorPtr fd)
+    : fd_(std::move(fd)), origin_(base::TimeTicks::Now()), pending_("[\n") {}
+
+ApplyTracer::~ApplyTracer() {
+  base::AutoLock auto_lock(lock_);
+  pending_ += num_events_ ? "\n]\n" : "]\n";
+  WritePending();
+  if (!fd_->Close())
+    PLOG(ERROR) << "Error closing the apply trace";
+}
+
+void ApplyTracer::AddOperation(const InstallOperation& operation,
+                               size_t operation_num,
+                               uint32_t block_size,
+                               base::TimeTicks start,
+                               base::TimeTicks end,
+                               base::TimeDelta queue_wait) {
+  string args = base::StringPrintf(
+      "\"num\":%zu,\"src_extents\":%d,\"src_bytes\":%" PRIu64
+      ",\"dst_extents\":%d,\"dst_bytes\":%" PRIu64 ",\"data_bytes\":%" PRIu64
+      ",\"queue_wait_us\":%" PRId64,
+      operation_num,
+      operation.src_extents_size(),
+      utils::BlocksInExtents(operation.src_extents()) * block_size,
+      operation.dst_extents_size(),
+      utils::BlocksInExtents(operation.dst_extents()) * block_size,
+      operation.data_length(),
+      queue_wait.InMicroseconds());
+  base::AutoLock auto_lock(lock_);
+  AppendEvent(InstallOperationTypeName(operation.type()),
+              "operation",
+              start,
+              end,
+              args);
+}
+
+void ApplyTracer::AddStep(const string& name,
+                          base::TimeTicks start,
+                          base::TimeTicks end) {
+  base::AutoLock auto_lock(lock_);
+  AppendEvent(name, "step", start, end, "");
+}
+
+bool ApplyTracer::Flush() {
+  base::AutoLock auto_lock(lock_);
+  return WritePending();
+}
+
+void ApplyTracer::AppendEvent(const string& name,
+                              const char* category,
+                              base::TimeTicks start,
+                              base::TimeTicks end,
+                              const string& args) {
+  if (write_failed_)
+    return;
+  // All the events but the first one follow a comma.
+  if (num_events_++ > 0)
+    pending_ += ",\n";
+  base::StringAppendF(
+      &pending_,
+      "{\"name\":%s,\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64
+      ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":%d,\"args\":{%s}}",
+      base::GetQuotedJSONString(name).c_str(),
+      category,
+      (start - origin_).InMicroseconds(),
+      (end - start).InMicroseconds(),
+      static_cast<int>(base::PlatformThread::CurrentId()),
+      args.c_str());
+  if (pending_.size() >= kMaxPendingBytes)
+    WritePending();
+}
+
+bool ApplyTracer::WritePending() {
+  if (write_failed_)
+    return false;
+  if (!utils::WriteAll(fd_, pending_.data(), pending_.size())) {
+    PLOG(ERROR) << "Unable to write the apply trace, dropping it";
+    write_failed_ = true;
+    return false;
+  }
+  pending_.clear();
+  return true;
+}
+
+}  // namespace chromeos_update_engine
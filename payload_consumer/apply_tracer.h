@@ -0,0 +1,104 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_APPLY_TRACER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_APPLY_TRACER_H_
+
+#include <memory>
+#include <string>
+
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// Records where the time applying a payload goes, as a trace in the Chrome
+// JSON trace format, which chrome://tracing and Perfetto open. Each applied
+// operation is an event on the thread which applied it, with its sizes,
+// number of extents and, for the operations run by the workers, how long it
+// waited for one. The other steps of the apply, such as verifying the data of
+// an operation or syncing the target, are events of their own.
+//
+// The events are written in the array form of the format, which doesn't
+// require the closing bracket, so the trace of an interrupted update can still
+// be opened. This class is thread safe.
+class ApplyTracer {
+ public:
+  // Where the trace is written when kPrefsApplyTraceEnabled is set, next to
+  // the update_engine logs.
+  static const char kDefaultPath[];
+
+  // Creates a tracer writing to |path|, replacing any previous trace. Returns
+  // null if the file can't be created.
+  static std::unique_ptr<ApplyTracer> Create(const std::string& path);
+
+  ApplyTracer(const ApplyTracer&) = delete;
+  ApplyTracer& operator=(const ApplyTracer&) = delete;
+
+  // Writes the remaining events and closes the trace.
+  ~ApplyTracer();
+
+  // Records the |operation_num|-th operation of the payload, |operation|,
+  // applied from |start| to |end| on the calling thread after waiting
+  // |queue_wait| to be run.
+  void AddOperation(const InstallOperation& operation,
+                    size_t operation_num,
+                    uint32_t block_size,
+                    base::TimeTicks start,
+                    base::TimeTicks end,
+                    base::TimeDelta queue_wait = base::TimeDelta());
+
+  // Records the step |name| of the apply, from |start| to |end| on the calling
+  // thread.
+  void AddStep(const std::string& name,
+               base::TimeTicks start,
+               base::TimeTicks end);
+
+  // Writes the events recorded so far to the file.
+  bool Flush();
+
+ private:
+  explicit ApplyTracer(FileDescriptorPtr fd);
+
+  // Appends an event of |name| and |category| with the JSON object members in
+  // |args|, which may be empty. Called with |lock_| held.
+  void AppendEvent(const std::string& name,
+                   const char* category,
+                   base::TimeTicks start,
+                   base::TimeTicks end,
+                   const std::string& args);
+
+  // Writes |pending_| to the file. Called with |lock_| held.
+  bool WritePending();
+
+  FileDescriptorPtr fd_;
+  // The events are timed from the creation of the tracer.
+  const base::TimeTicks origin_;
+
+  // Protects the members below.
+  base::Lock lock_;
+  // The events not written yet.
+  std::string pending_;
+  size_t num_events_{0};
+  bool write_failed_{false};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_APPLY_TRACER_H_
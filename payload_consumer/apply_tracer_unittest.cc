@@ -0,0 +1,92 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/apply_tracer.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+class ApplyTracerTest : public ::testing::Test {
+ protected:
+  string ReadTrace() {
+    string trace;
+    EXPECT_TRUE(utils::ReadFile(trace_file_.path(), &trace));
+    return trace;
+  }
+
+  ScopedTempFile trace_file_{"ApplyTracerTest.XXXXXX"};
+};
+
+TEST_F(ApplyTracerTest, EventsTest) {
+  auto tracer = ApplyTracer::Create(trace_file_.path());
+  ASSERT_NE(nullptr, tracer);
+
+  InstallOperation op;
+  op.set_type(InstallOperation::SOURCE_BSDIFF);
+  *op.add_src_extents() = ExtentForRange(10, 2);
+  *op.add_src_extents() = ExtentForRange(20, 1);
+  *op.add_dst_extents() = ExtentForRange(0, 4);
+  op.set_data_length(123);
+  base::TimeTicks start = base::TimeTicks::Now();
+  tracer->AddOperation(op,
+                       7,
+                       4096,
+                       start + base::Microseconds(10),
+                       start + base::Microseconds(30),
+                       base::Microseconds(5));
+  tracer->AddStep("Sync \"root\"", start, start + base::Microseconds(40));
+  EXPECT_TRUE(tracer->Flush());
+
+  // The events are written once flushed, without the closing bracket.
+  string trace = ReadTrace();
+  EXPECT_EQ(0U, trace.find("[\n{\"name\":\"SOURCE_BSDIFF\""));
+  EXPECT_NE(string::npos,
+            trace.find("\"args\":{\"num\":7,\"src_extents\":2,"
+                       "\"src_bytes\":12288,\"dst_extents\":1,"
+                       "\"dst_bytes\":16384,\"data_bytes\":123,"
+                       "\"queue_wait_us\":5}}"));
+  EXPECT_NE(string::npos, trace.find("\"dur\":20,"));
+  EXPECT_NE(string::npos,
+            trace.find("},\n{\"name\":\"Sync \\\"root\\\"\",\"cat\":\"step\""));
+  EXPECT_EQ(string::npos, trace.find(']'));
+
+  tracer.reset();
+  trace = ReadTrace();
+  EXPECT_EQ("}\n]\n", trace.substr(trace.size() - 4));
+}
+
+TEST_F(ApplyTracerTest, EmptyTraceTest) {
+  auto tracer = ApplyTracer::Create(trace_file_.path());
+  ASSERT_NE(nullptr, tracer);
+  EXPECT_TRUE(tracer->Flush());
+  tracer.reset();
+  EXPECT_EQ("[\n]\n", ReadTrace());
+}
+
+TEST_F(ApplyTracerTest, InvalidPathTest) {
+  EXPECT_EQ(nullptr, ApplyTracer::Create("/non/existent/path/trace.json"));
+}
+
+}  // namespace chromeos_update_engine
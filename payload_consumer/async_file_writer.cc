@@ -0,0 +1,137 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/async_file_writer.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <base/functional/bind.h>
+#include <base/logging.h>
+
+using brillo::MessageLoop;
+
+namespace chromeos_update_engine {
+
+AsyncFileWriter::AsyncFileWriter(FileWriter* writer, size_t capacity)
+    : writer_(writer), capacity_(capacity) {
+  CHECK(writer_);
+  CHECK_GT(capacity_, 0U);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  Cancel();
+}
+
+bool AsyncFileWriter::Write(const void* bytes, size_t count) {
+  ErrorCode error;
+  return Write(bytes, count, &error);
+}
+
+bool AsyncFileWriter::Write(const void* bytes, size_t count, ErrorCode* error) {
+  *error = ErrorCode::kSuccess;
+  if (HasFailed(error))
+    return false;
+  if (closed_) {
+    LOG(ERROR) << "Writing to a closed AsyncFileWriter.";
+    *error = ErrorCode::kDownloadWriteError;
+    return false;
+  }
+  if (!count)
+    return true;
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(bytes);
+  chunks_.emplace_back(data, data + count);
+  buffered_bytes_ += count;
+  max_buffered_bytes_ = std::max(max_buffered_bytes_, buffered_bytes_);
+  if (IsFull())
+    was_full_ = true;
+  ScheduleWrite();
+  return true;
+}
+
+int AsyncFileWriter::Close() {
+  Cancel();
+  closed_ = true;
+  return writer_->Close();
+}
+
+void AsyncFileWriter::Finish(base::OnceCallback<void(ErrorCode)> callback) {
+  finish_callback_ = std::move(callback);
+  ScheduleWrite();
+}
+
+void AsyncFileWriter::Cancel() {
+  if (write_task_ != MessageLoop::kTaskIdNull) {
+    MessageLoop::current()->CancelTask(write_task_);
+    write_task_ = MessageLoop::kTaskIdNull;
+  }
+  chunks_.clear();
+  buffered_bytes_ = 0;
+  finish_callback_.Reset();
+}
+
+bool AsyncFileWriter::HasFailed(ErrorCode* error) const {
+  if (failed_)
+    *error = error_;
+  return failed_;
+}
+
+void AsyncFileWriter::ScheduleWrite() {
+  if (write_task_ != MessageLoop::kTaskIdNull)
+    return;
+  write_task_ = MessageLoop::current()->PostTask(
+      FROM_HERE,
+      base::BindOnce(&AsyncFileWriter::WriteNextChunk,
+                     base::Unretained(this)));
+}
+
+void AsyncFileWriter::WriteNextChunk() {
+  write_task_ = MessageLoop::kTaskIdNull;
+  if (!chunks_.empty()) {
+    brillo::Blob chunk = std::move(chunks_.front());
+    chunks_.pop_front();
+    buffered_bytes_ -= chunk.size();
+    ErrorCode error = ErrorCode::kSuccess;
+    if (!writer_->Write(chunk.data(), chunk.size(), &error)) {
+      failed_ = true;
+      error_ = error;
+      // Nothing written after a failure can be used, drop it.
+      chunks_.clear();
+      buffered_bytes_ = 0;
+    }
+  }
+  if (!chunks_.empty()) {
+    // Let the message loop run the other tasks, such as receiving more data,
+    // before writing the next chunk.
+    ScheduleWrite();
+    if (!failed_ && (!was_full_ || buffered_bytes_ > capacity_ / 2))
+      return;
+  }
+
+  // The callbacks may destroy this object, so nothing is used after them.
+  if (finish_callback_) {
+    if (chunks_.empty())
+      std::move(finish_callback_).Run(error_);
+    return;
+  }
+  if ((was_full_ || failed_) && drained_callback_) {
+    was_full_ = false;
+    drained_callback_.Run();
+  }
+}
+
+}  // namespace chromeos_update_engine
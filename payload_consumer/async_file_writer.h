@@ -0,0 +1,121 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_ASYNC_FILE_WRITER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_ASYNC_FILE_WRITER_H_
+
+#include <deque>
+
+#include <base/functional/callback.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_consumer/file_writer.h"
+
+namespace chromeos_update_engine {
+
+// AsyncFileWriter is a FileWriter passing the data to another FileWriter from
+// tasks of the current message loop. Written data is copied into a bounded
+// buffer and the call returns right away, so the caller, typically the HTTP
+// fetcher, keeps receiving data while the underlying writer processes the
+// earlier chunks, one chunk per task. Write() never blocks: the caller is
+// expected to stop producing data while IsFull() and resume when the drained
+// callback runs.
+//
+// The underlying writer is only used from the thread of the message loop, like
+// this class. Errors of the underlying writer are reported by the next
+// Write(), the drained callback and Finish(); the data buffered after the
+// failure is dropped.
+class AsyncFileWriter : public FileWriter {
+ public:
+  // Wraps |writer|, which must outlive this object. The buffer is considered
+  // full once |capacity| bytes are waiting to be written.
+  AsyncFileWriter(FileWriter* writer, size_t capacity);
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  ~AsyncFileWriter() override;
+
+  // FileWriter overrides. Write() queues a copy of the data and only fails if
+  // the underlying writer already failed, in which case |error| is set to the
+  // error it reported. Close() drops the data still queued and closes the
+  // underlying writer.
+  bool Write(const void* bytes, size_t count) override;
+  bool Write(const void* bytes, size_t count, ErrorCode* error) override;
+  int Close() override;
+
+  // Sets the |callback| run once the buffer went back below half its capacity
+  // after IsFull(), or when the underlying writer failed. It may destroy this
+  // object.
+  void set_drained_callback(base::RepeatingClosure callback) {
+    drained_callback_ = std::move(callback);
+  }
+
+  // Runs |callback| from the message loop once all the queued data was
+  // written, with the error reported by the underlying writer if it failed or
+  // ErrorCode::kSuccess. The drained callback isn't run after this call. The
+  // |callback| may destroy this object.
+  void Finish(base::OnceCallback<void(ErrorCode)> callback);
+
+  // Drops the queued data and the pending Finish() callback, if any. The
+  // underlying writer isn't closed.
+  void Cancel();
+
+  // Whether the buffered data reached the capacity.
+  bool IsFull() const { return buffered_bytes_ >= capacity_; }
+
+  // Returns whether the underlying writer failed, and sets |error| to the
+  // error it reported if so.
+  bool HasFailed(ErrorCode* error) const;
+
+  size_t capacity() const { return capacity_; }
+  size_t buffered_bytes() const { return buffered_bytes_; }
+
+  // Largest amount of data buffered at once.
+  size_t max_buffered_bytes() const { return max_buffered_bytes_; }
+
+ private:
+  // Posts the task writing the next chunk, unless it is already posted.
+  void ScheduleWrite();
+
+  // Writes the next queued chunk to the underlying writer, then runs the
+  // callbacks due. Posted by ScheduleWrite().
+  void WriteNextChunk();
+
+  FileWriter* writer_;
+  const size_t capacity_;
+
+  // The chunks waiting to be written, and the number of bytes they hold.
+  std::deque<brillo::Blob> chunks_;
+  size_t buffered_bytes_{0};
+  size_t max_buffered_bytes_{0};
+
+  // The task running WriteNextChunk(), if any.
+  brillo::MessageLoop::TaskId write_task_{brillo::MessageLoop::kTaskIdNull};
+
+  base::RepeatingClosure drained_callback_;
+  base::OnceCallback<void(ErrorCode)> finish_callback_;
+  // Whether the buffer became full since the drained callback last ran.
+  bool was_full_{false};
+
+  bool closed_{false};
+  bool failed_{false};
+  ErrorCode error_{ErrorCode::kSuccess};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_ASYNC_FILE_WRITER_H_
@@ -0,0 +1,175 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/async_file_writer.h"
+
+#include <string>
+
+#include <base/functional/bind.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <gtest/gtest.h>
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+// A FileWriter collecting the written data, which can be made to fail.
+class TestFileWriter : public FileWriter {
+ public:
+  TestFileWriter() = default;
+  TestFileWriter(const TestFileWriter&) = delete;
+  TestFileWriter& operator=(const TestFileWriter&) = delete;
+
+  bool Write(const void* bytes, size_t count) override {
+    ErrorCode error;
+    return Write(bytes, count, &error);
+  }
+
+  bool Write(const void* bytes, size_t count, ErrorCode* error) override {
+    if (data_.size() + count > fail_after_) {
+      *error = ErrorCode::kDownloadOperationExecutionError;
+      return false;
+    }
+    data_.append(reinterpret_cast<const char*>(bytes), count);
+    return true;
+  }
+
+  int Close() override {
+    closed_ = true;
+    return 0;
+  }
+
+  // Fails the writes going past |size| bytes.
+  void set_fail_after(size_t size) { fail_after_ = size; }
+
+  const string& data() const { return data_; }
+  bool closed() const { return closed_; }
+
+ private:
+  size_t fail_after_{static_cast<size_t>(-1)};
+  string data_;
+  bool closed_{false};
+};
+
+}  // namespace
+
+class AsyncFileWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    loop_.SetAsCurrent();
+    writer_.set_drained_callback(base::BindRepeating(
+        [](int* num_drained) { (*num_drained)++; }, &num_drained_));
+  }
+
+  void TearDown() override { EXPECT_FALSE(loop_.PendingTasks()); }
+
+  // Finishes the writes and returns the error reported.
+  ErrorCode Finish() {
+    ErrorCode result = ErrorCode::kUmaReportedMax;
+    writer_.Finish(base::BindOnce(
+        [](ErrorCode* result, ErrorCode error) { *result = error; }, &result));
+    while (loop_.RunOnce(false)) {
+    }
+    return result;
+  }
+
+  brillo::FakeMessageLoop loop_{nullptr};
+  TestFileWriter test_writer_;
+  AsyncFileWriter writer_{&test_writer_, 16};
+  int num_drained_{0};
+};
+
+TEST_F(AsyncFileWriterTest, WritesInOrderTest) {
+  EXPECT_TRUE(writer_.Write("foo", 3));
+  EXPECT_TRUE(writer_.Write("", 0));
+  EXPECT_TRUE(writer_.Write("bar", 3));
+  // Nothing is written until the message loop runs.
+  EXPECT_EQ("", test_writer_.data());
+  EXPECT_EQ(6U, writer_.buffered_bytes());
+
+  EXPECT_EQ(ErrorCode::kSuccess, Finish());
+  EXPECT_EQ("foobar", test_writer_.data());
+  EXPECT_EQ(0U, writer_.buffered_bytes());
+  // The buffer was never full.
+  EXPECT_EQ(0, num_drained_);
+
+  EXPECT_EQ(0, writer_.Close());
+  EXPECT_TRUE(test_writer_.closed());
+  // Nothing can be written once closed.
+  EXPECT_FALSE(writer_.Write("baz", 3));
+}
+
+TEST_F(AsyncFileWriterTest, FullAndDrainedTest) {
+  EXPECT_TRUE(writer_.Write("0123456789", 10));
+  EXPECT_FALSE(writer_.IsFull());
+  // The buffer may go past its capacity, it is up to the caller to stop.
+  EXPECT_TRUE(writer_.Write("0123456789", 10));
+  EXPECT_TRUE(writer_.IsFull());
+  EXPECT_EQ(20U, writer_.max_buffered_bytes());
+
+  // One chunk is written per task, and the drained callback only runs once
+  // the buffer is back below half its capacity.
+  EXPECT_TRUE(loop_.RunOnce(false));
+  EXPECT_EQ(10U, writer_.buffered_bytes());
+  EXPECT_FALSE(writer_.IsFull());
+  EXPECT_EQ(0, num_drained_);
+  EXPECT_TRUE(loop_.RunOnce(false));
+  EXPECT_EQ(1, num_drained_);
+  EXPECT_EQ("01234567890123456789", test_writer_.data());
+  EXPECT_FALSE(loop_.PendingTasks());
+}
+
+TEST_F(AsyncFileWriterTest, WriteErrorTest) {
+  test_writer_.set_fail_after(4);
+  EXPECT_TRUE(writer_.Write("foo", 3));
+  EXPECT_TRUE(writer_.Write("bar", 3));
+  EXPECT_TRUE(writer_.Write("baz", 3));
+  EXPECT_TRUE(loop_.RunOnce(false));
+  EXPECT_TRUE(loop_.RunOnce(false));
+  // The failure is reported right away and the rest of the data dropped.
+  EXPECT_EQ(1, num_drained_);
+  ErrorCode error;
+  EXPECT_TRUE(writer_.HasFailed(&error));
+  EXPECT_EQ(ErrorCode::kDownloadOperationExecutionError, error);
+  EXPECT_EQ(0U, writer_.buffered_bytes());
+  EXPECT_EQ(ErrorCode::kDownloadOperationExecutionError, Finish());
+
+  // The error is reported to the following writes.
+  error = ErrorCode::kSuccess;
+  EXPECT_FALSE(writer_.Write("qux", 3, &error));
+  EXPECT_EQ(ErrorCode::kDownloadOperationExecutionError, error);
+  EXPECT_EQ("foo", test_writer_.data());
+}
+
+TEST_F(AsyncFileWriterTest, CancelTest) {
+  EXPECT_TRUE(writer_.Write("foo", 3));
+  EXPECT_TRUE(writer_.Write("bar", 3));
+  EXPECT_TRUE(loop_.RunOnce(false));
+  bool finished = false;
+  writer_.Finish(base::BindOnce(
+      [](bool* finished, ErrorCode error) { *finished = true; }, &finished));
+  writer_.Cancel();
+  // The queued data and the pending completion are dropped.
+  EXPECT_FALSE(loop_.PendingTasks());
+  EXPECT_FALSE(finished);
+  EXPECT_EQ("foo", test_writer_.data());
+  EXPECT_EQ(0U, writer_.buffered_bytes());
+  EXPECT_FALSE(test_writer_.closed());
+}
+
+}  // namespace chromeos_update_engine
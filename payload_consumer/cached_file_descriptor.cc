@@ -19,6 +19,8 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <iterator>
+#include <utility>
 
 #include <base/logging.h>
 
@@ -26,71 +28,153 @@
 
 namespace chromeos_update_engine {
 
+const base::TimeDelta CachedFileDescriptor::kDefaultMaxDirtyAge =
+    base::Seconds(1);
+
 off64_t CachedFileDescriptor::Seek(off64_t offset, int whence) {
   // Only support SEEK_SET and SEEK_CUR. I think these two would be enough. If
   // we want to support SEEK_END then we have to figure out the size of the
   // underlying file descriptor each time and it may not be a very good idea.
   CHECK(whence == SEEK_SET || whence == SEEK_CUR);
   off64_t next_offset = whence == SEEK_SET ? offset : offset_ + offset;
-
-  if (next_offset != offset_) {
-    // We sought somewhere other than what we are now. So we have to flush and
-    // move to the new offset.
-    if (!FlushCache()) {
-      return -1;
-    }
-    // Then we have to seek there.
-    if (fd_->Seek(next_offset, SEEK_SET) < 0) {
-      return -1;
-    }
-    offset_ = next_offset;
-  }
+  if (next_offset < 0)
+    return -1;
+  // The cached data stays in the cache, reads and writes of |fd_| are all
+  // done at an explicit offset.
+  offset_ = next_offset;
   return offset_;
 }
 
+ssize_t CachedFileDescriptor::Read(void* buf, size_t count) {
+  if (!FlushCache() || fd_->Seek(offset_, SEEK_SET) != offset_)
+    return -1;
+  ssize_t bytes_read = fd_->Read(buf, count);
+  if (bytes_read > 0)
+    offset_ += bytes_read;
+  return bytes_read;
+}
+
+bool CachedFileDescriptor::ReadBatch(const std::vector<ReadRequest>& requests) {
+  return FlushCache() && fd_->ReadBatch(requests);
+}
+
 ssize_t CachedFileDescriptor::Write(const void* buf, size_t count) {
-  auto bytes = static_cast<const uint8_t*>(buf);
-  size_t total_bytes_wrote = 0;
-  while (total_bytes_wrote < count) {
-    auto bytes_to_cache =
-        std::min(count - total_bytes_wrote, cache_.size() - bytes_cached_);
-    if (bytes_to_cache > 0) {  // Which means |cache_| is still have some space.
-      memcpy(cache_.data() + bytes_cached_,
-             bytes + total_bytes_wrote,
-             bytes_to_cache);
-      total_bytes_wrote += bytes_to_cache;
-      bytes_cached_ += bytes_to_cache;
-    }
-    if (bytes_cached_ == cache_.size()) {
-      // Cache is full; write it to the |fd_| as long as you can.
-      if (!FlushCache()) {
-        return -1;
-      }
+  if (!CacheWrite(offset_, static_cast<const uint8_t*>(buf), count))
+    return -1;
+  offset_ += count;
+  return count;
+}
+
+bool CachedFileDescriptor::WriteBatch(
+    const std::vector<WriteRequest>& requests) {
+  for (const WriteRequest& request : requests) {
+    if (!CacheWrite(request.offset,
+                    static_cast<const uint8_t*>(request.buf),
+                    request.count)) {
+      return false;
     }
   }
-  offset_ += total_bytes_wrote;
-  return total_bytes_wrote;
+  return true;
 }
 
 bool CachedFileDescriptor::Flush() {
   return FlushCache() && fd_->Flush();
 }
 
+bool CachedFileDescriptor::Sync() {
+  return FlushCache() && fd_->Sync();
+}
+
 bool CachedFileDescriptor::Close() {
   offset_ = 0;
   return FlushCache() && fd_->Close();
 }
 
-bool CachedFileDescriptor::FlushCache() {
-  size_t begin = 0;
-  while (begin < bytes_cached_) {
-    auto bytes_wrote = fd_->Write(cache_.data() + begin, bytes_cached_ - begin);
-    if (bytes_wrote < 0) {
-      PLOG(ERROR) << "Failed to flush cached data!";
+bool CachedFileDescriptor::CacheWrite(off64_t offset,
+                                      const uint8_t* data,
+                                      size_t count) {
+  size_t total_bytes_cached = 0;
+  while (total_bytes_cached < count) {
+    // Cache no more than the free space, so the cache never grows past
+    // |cache_size_|.
+    size_t bytes_to_cache =
+        std::min(count - total_bytes_cached,
+                 std::max<size_t>(cache_size_ - bytes_cached_, 1));
+    AddToCache(offset + total_bytes_cached,
+               data + total_bytes_cached,
+               bytes_to_cache);
+    total_bytes_cached += bytes_to_cache;
+    if (!MaybeFlushCache())
       return false;
+  }
+  return true;
+}
+
+void CachedFileDescriptor::AddToCache(off64_t offset,
+                                      const uint8_t* data,
+                                      size_t count) {
+  if (count == 0)
+    return;
+  if (cache_.empty())
+    oldest_write_time_ = base::TimeTicks::Now();
+  const off64_t end = offset + count;
+
+  // Extend the range ending at or past |offset|, if any, in place.
+  auto it = cache_.upper_bound(offset);
+  brillo::Blob merged;
+  off64_t merged_offset = offset;
+  if (it != cache_.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + static_cast<off64_t>(prev->second.size()) >= offset) {
+      merged_offset = prev->first;
+      merged = std::move(prev->second);
+      bytes_cached_ -= merged.size();
+      cache_.erase(prev);
     }
-    begin += bytes_wrote;
   }
+  size_t data_offset = offset - merged_offset;
+  if (merged.size() < data_offset + count)
+    merged.resize(data_offset + count);
+  memcpy(merged.data() + data_offset, data, count);
+
+  // Absorb the ranges starting within or right after the new data, keeping
+  // their part past it.
+  while (it != cache_.end() && it->first <= end) {
+    off64_t range_end = it->first + it->second.size();
+    if (range_end > end) {
+      merged.insert(merged.end(),
+                    it->second.begin() + (end - it->first),
+                    it->second.end());
+    }
+    bytes_cached_ -= it->second.size();
+    it = cache_.erase(it);
+  }
+  bytes_cached_ += merged.size();
+  cache_.emplace_hint(it, merged_offset, std::move(merged));
+}
+
+bool CachedFileDescriptor::MaybeFlushCache() {
+  if (bytes_cached_ >= cache_size_ ||
+      (!max_dirty_age_.is_zero() && !cache_.empty() &&
+       base::TimeTicks::Now() - oldest_write_time_ >= max_dirty_age_)) {
+    return FlushCache();
+  }
+  return true;
+}
+
+bool CachedFileDescriptor::FlushCache() {
+  if (cache_.empty())
+    return true;
+  requests_.clear();
+  for (const auto& range : cache_) {
+    requests_.push_back(
+        {range.second.data(), range.second.size(), range.first});
+  }
+  if (!fd_->WriteBatch(requests_)) {
+    PLOG(ERROR) << "Failed to flush cached data!";
+    return false;
+  }
+  cache_.clear();
   bytes_cached_ = 0;
   return true;
 }
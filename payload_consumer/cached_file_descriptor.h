@@ -20,20 +20,32 @@
 #include <errno.h>
 #include <sys/types.h>
 
+#include <map>
 #include <memory>
 #include <vector>
 
+#include <base/time/time.h>
 #include <brillo/secure_blob.h>
 
 #include "update_engine/payload_consumer/file_descriptor.h"
 
 namespace chromeos_update_engine {
 
+// A FileDescriptor caching the writes to |fd_| until up to |cache_size| bytes
+// are cached, the oldest cached data is older than the max dirty age, or the
+// descriptor is flushed. Writes anywhere in the file are cached, so scattered
+// writes, such as the ones to fragmented extents, are merged when they touch
+// and written together sorted by offset, in a single WriteBatch() call.
+//
+// Reads see the cached data, since the cache is written before any read.
 class CachedFileDescriptor : public FileDescriptor {
  public:
-  CachedFileDescriptor(FileDescriptorPtr fd, size_t cache_size) : fd_(fd) {
-    cache_.resize(cache_size);
-  }
+  // Default age of the oldest cached data after which the cache is written on
+  // the next write.
+  static const base::TimeDelta kDefaultMaxDirtyAge;
+
+  CachedFileDescriptor(FileDescriptorPtr fd, size_t cache_size)
+      : fd_(fd), cache_size_(cache_size) {}
   CachedFileDescriptor(const CachedFileDescriptor&) = delete;
   CachedFileDescriptor& operator=(const CachedFileDescriptor&) = delete;
 
@@ -45,30 +57,64 @@ class CachedFileDescriptor : public FileDescriptor {
   bool Open(const char* path, int flags) override {
     return fd_->Open(path, flags);
   }
-  ssize_t Read(void* buf, size_t count) override {
-    return fd_->Read(buf, count);
-  }
+  ssize_t Read(void* buf, size_t count) override;
+  bool ReadBatch(const std::vector<ReadRequest>& requests) override;
   ssize_t Write(const void* buf, size_t count) override;
+  bool WriteBatch(const std::vector<WriteRequest>& requests) override;
   off64_t Seek(off64_t offset, int whence) override;
   uint64_t BlockDevSize() override { return fd_->BlockDevSize(); }
+  // Writes the cache first, since the ioctls modify the data.
   bool BlkIoctl(int request,
                 uint64_t start,
                 uint64_t length,
                 int* result) override {
-    return fd_->BlkIoctl(request, start, length, result);
+    return FlushCache() && fd_->BlkIoctl(request, start, length, result);
   }
   bool Flush() override;
+  bool Sync() override;
   bool Close() override;
   bool IsSettingErrno() override { return fd_->IsSettingErrno(); }
   bool IsOpen() override { return fd_->IsOpen(); }
 
+  // Sets the age of the oldest cached data after which the cache is written on
+  // the next write. A zero |max_dirty_age| keeps the data cached until the
+  // cache is full or flushed.
+  void set_max_dirty_age(base::TimeDelta max_dirty_age) {
+    max_dirty_age_ = max_dirty_age;
+  }
+
+  // Number of bytes currently cached.
+  size_t bytes_cached() const { return bytes_cached_; }
+
  private:
+  // Writes the |count| bytes at |data| at |offset| through the cache, flushing
+  // it as it fills up.
+  bool CacheWrite(off64_t offset, const uint8_t* data, size_t count);
+
+  // Copies the |count| bytes at |data| into the cache at |offset|, merging
+  // them with the cached ranges they overlap or touch.
+  void AddToCache(off64_t offset, const uint8_t* data, size_t count);
+
+  // Writes the cache if it is full or too old.
+  bool MaybeFlushCache();
+
   // Internal flush without the need to call |fd_->Flush()|.
   bool FlushCache();
 
   FileDescriptorPtr fd_;
-  brillo::Blob cache_;
+  const size_t cache_size_;
+  base::TimeDelta max_dirty_age_{kDefaultMaxDirtyAge};
+
+  // The cached data as non-overlapping ranges that don't touch each other,
+  // keyed by their offset in the file.
+  std::map<off64_t, brillo::Blob> cache_;
   size_t bytes_cached_{0};
+  // When the oldest data in |cache_| was written.
+  base::TimeTicks oldest_write_time_;
+
+  // The requests of the last flush, kept to reuse their storage.
+  std::vector<WriteRequest> requests_;
+
   off64_t offset_{0};
 };
 
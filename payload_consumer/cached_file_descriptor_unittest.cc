@@ -17,9 +17,12 @@
 #include "update_engine/payload_consumer/cached_file_descriptor.h"
 
 #include <fcntl.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -93,6 +96,19 @@ TEST_F(CachedFileDescriptorTest, SimpleWriteTest) {
   EXPECT_EQ(blob_in, blob_out);
 }
 
+TEST_F(CachedFileDescriptorTest, SyncTest) {
+  EXPECT_EQ(cfd_->Seek(0, SEEK_SET), 0);
+  brillo::Blob blob_in(kCacheSize / 2, value_);
+  Write(blob_in.data(), blob_in.size());
+  // Syncing also writes the cached data.
+  EXPECT_TRUE(cfd_->Sync());
+
+  brillo::Blob blob_out;
+  EXPECT_TRUE(utils::ReadFile(temp_file_.path(), &blob_out));
+  EXPECT_EQ(blob_in,
+            brillo::Blob(blob_out.begin(), blob_out.begin() + blob_in.size()));
+}
+
 TEST_F(CachedFileDescriptorTest, OneBytePerWriteTest) {
   EXPECT_EQ(cfd_->Seek(0, SEEK_SET), 0);
   brillo::Blob blob_in(kFileSize, value_);
@@ -193,8 +209,97 @@ TEST_F(CachedFileDescriptorTest, SeekAfterWriteTest) {
   // We are writing less than  one cache size; then it should not be committed.
   Write(&blob_in[seek], less_than_cache_size);
 
-  // Then we seek, it should've written the cache after seek.
+  // Seeking elsewhere keeps the data cached.
   EXPECT_EQ(cfd_->Seek(200, SEEK_SET), 200);
+  brillo::Blob blob_out;
+  EXPECT_TRUE(utils::ReadFile(temp_file_.path(), &blob_out));
+  EXPECT_EQ(brillo::Blob(kFileSize, 0), blob_out);
+
+  EXPECT_TRUE(cfd_->Flush());
+  EXPECT_TRUE(utils::ReadFile(temp_file_.path(), &blob_out));
+  EXPECT_EQ(blob_in, blob_out);
+}
+
+TEST_F(CachedFileDescriptorTest, ReadCachedDataTest) {
+  brillo::Blob blob_in(10, value_);
+  EXPECT_EQ(cfd_->Seek(50, SEEK_SET), 50);
+  Write(blob_in.data(), blob_in.size());
+
+  // Reads see the cached data.
+  brillo::Blob blob_out(20);
+  EXPECT_EQ(cfd_->Seek(45, SEEK_SET), 45);
+  EXPECT_EQ(static_cast<ssize_t>(blob_out.size()),
+            cfd_->Read(blob_out.data(), blob_out.size()));
+  brillo::Blob expected(20, 0);
+  std::fill_n(&expected[5], blob_in.size(), value_);
+  EXPECT_EQ(expected, blob_out);
+  EXPECT_EQ(cfd_->Seek(0, SEEK_CUR), 65);
+}
+
+namespace {
+// Records the requests of each WriteBatch() call.
+class RecordingFileDescriptor : public EintrSafeFileDescriptor {
+ public:
+  bool WriteBatch(const vector<WriteRequest>& requests) override {
+    batches_.emplace_back();
+    for (const WriteRequest& request : requests)
+      batches_.back().emplace_back(request.offset, request.count);
+    return EintrSafeFileDescriptor::WriteBatch(requests);
+  }
+
+  vector<vector<std::pair<off64_t, size_t>>> batches_;
+};
+}  // namespace
+
+TEST_F(CachedFileDescriptorTest, ScatteredWritesTest) {
+  Close();
+  auto recording_fd = std::make_shared<RecordingFileDescriptor>();
+  fd_ = recording_fd;
+  Open();
+
+  // Scattered writes, some touching or overlapping others, written in an
+  // arbitrary order.
+  brillo::Blob blob_in(kFileSize, 0);
+  const vector<std::pair<off64_t, size_t>> writes = {
+      {500, 10}, {100, 20}, {520, 5}, {120, 4}, {110, 30}, {510, 10}};
+  for (const auto& write : writes) {
+    std::fill_n(&blob_in[write.first], write.second, value_++);
+    EXPECT_EQ(cfd_->Seek(write.first, SEEK_SET), write.first);
+    Write(&blob_in[write.first], write.second);
+  }
+  EXPECT_TRUE(recording_fd->batches_.empty());
+
+  // They are written merged and sorted, in a single batch.
+  EXPECT_TRUE(cfd_->Flush());
+  using Requests = vector<std::pair<off64_t, size_t>>;
+  EXPECT_EQ((vector<Requests>{{{100, 40}, {500, 25}}}),
+            recording_fd->batches_);
+  brillo::Blob blob_out;
+  EXPECT_TRUE(utils::ReadFile(temp_file_.path(), &blob_out));
+  EXPECT_EQ(blob_in, blob_out);
+
+  // Larger writes are written as the cache fills up.
+  recording_fd->batches_.clear();
+  auto cfd = static_cast<CachedFileDescriptor*>(cfd_.get());
+  brillo::Blob large(kCacheSize * 5 / 2, value_);
+  EXPECT_TRUE(cfd_->WriteBatch({{large.data(), large.size(), 300}}));
+  EXPECT_EQ((vector<Requests>{{{300, kCacheSize}}, {{400, kCacheSize}}}),
+            recording_fd->batches_);
+  EXPECT_EQ(kCacheSize / 2, cfd->bytes_cached());
+}
+
+TEST_F(CachedFileDescriptorTest, MaxDirtyAgeTest) {
+  auto cfd = static_cast<CachedFileDescriptor*>(cfd_.get());
+  cfd->set_max_dirty_age(base::Milliseconds(1));
+  brillo::Blob blob_in(kFileSize, 0);
+  std::fill_n(&blob_in[10], 2, value_);
+  EXPECT_EQ(cfd_->Seek(10, SEEK_SET), 10);
+  Write(&blob_in[10], 1);
+  EXPECT_EQ(1U, cfd->bytes_cached());
+  usleep(2000);
+  // The next write finds the cache too old.
+  Write(&blob_in[11], 1);
+  EXPECT_EQ(0U, cfd->bytes_cached());
 
   brillo::Blob blob_out;
   EXPECT_TRUE(utils::ReadFile(temp_file_.path(), &blob_out));
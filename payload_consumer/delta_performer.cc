@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <linux/fs.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <cstring>
@@ -31,6 +32,7 @@
 
 #include <base/files/file_util.h>
 #include <base/format_macros.h>
+#include <base/functional/bind.h>
 #include <base/logging.h>
 #include <base/metrics/histogram_macros.h>
 #include <base/strings/string_number_conversions.h>
@@ -38,9 +40,7 @@
 #include <base/strings/stringprintf.h>
 #include <base/time/time.h>
 #include <brillo/data_encoding.h>
-#include <bsdiff/bspatch.h>
 #include <google/protobuf/repeated_field.h>
-#include <puffin/puffpatch.h>
 
 #include "update_engine/common/constants.h"
 #include "update_engine/common/download_action.h"
@@ -50,20 +50,17 @@
 #include "update_engine/common/prefs_interface.h"
 #include "update_engine/common/subprocess.h"
 #include "update_engine/common/terminator.h"
-#include "update_engine/payload_consumer/bzip_extent_writer.h"
 #include "update_engine/payload_consumer/cached_file_descriptor.h"
 #include "update_engine/payload_consumer/certificate_parser_interface.h"
-#include "update_engine/payload_consumer/extent_reader.h"
-#include "update_engine/payload_consumer/extent_writer.h"
 #include "update_engine/payload_consumer/partition_update_generator_interface.h"
 #if USE_FEC
 #include "update_engine/payload_consumer/fec_file_descriptor.h"
 #endif  // USE_FEC
 #include "update_engine/payload_consumer/file_descriptor_utils.h"
+#include "update_engine/payload_consumer/io_uring_file_descriptor.h"
 #include "update_engine/payload_consumer/mount_history.h"
 #include "update_engine/payload_consumer/payload_constants.h"
 #include "update_engine/payload_consumer/payload_verifier.h"
-#include "update_engine/payload_consumer/xz_extent_writer.h"
 
 using google::protobuf::RepeatedPtrField;
 using std::min;
@@ -78,6 +75,10 @@ const unsigned DeltaPerformer::kProgressDownloadWeight = 50;
 const unsigned DeltaPerformer::kProgressOperationsWeight = 50;
 const base::TimeDelta DeltaPerformer::kCheckpointFrequencyTime =
     base::Seconds(1);
+const uint64_t DeltaPerformer::kCheckpointMaxUnsyncedBytes =
+    32 * 1024 * 1024;  // 32MB
+const uint64_t DeltaPerformer::kMinStreamedOperationSize =
+    1024 * 1024;  // 1MB
 
 namespace {
 const int kUpdateStateOperationInvalid = -1;
@@ -85,6 +86,22 @@ const int kMaxResumedUpdateFailures = 10;
 
 const uint64_t kCacheSize = 1024 * 1024;  // 1MB
 
+// Maximum number of threads used to apply the operations of a partition.
+const size_t kMaxApplyThreads = 4;
+
+// Maximum number of operations and of data bytes held in memory waiting for
+// the apply workers. Operations are applied, and the progress checkpointed, at
+// least this often.
+const size_t kMaxBatchOperations = 64;
+const size_t kMaxBatchBytes = 16 * 1024 * 1024;  // 16MB
+
+// Runs of SOURCE_COPY operations are applied together when they are at least
+// this long, up to a maximum number of operations whose source blocks fit in
+// the staging buffer.
+const size_t kMinPlannedSourceCopies = 2;
+const size_t kMaxPlannedSourceCopies = 256;
+const size_t kSourceCopyStagingSize = 8 * 1024 * 1024;  // 8MB
+
 // Opens path for read/write. On success returns an open FileDescriptor
 // and sets *err to 0. On failure, sets *err to errno and returns nullptr.
 FileDescriptorPtr OpenFile(const char* path,
@@ -96,7 +113,7 @@ FileDescriptorPtr OpenFile(const char* path,
   bool read_only = (mode & O_ACCMODE) == O_RDONLY;
   utils::SetBlockDeviceReadOnly(path, read_only);
 
-  FileDescriptorPtr fd(new EintrSafeFileDescriptor());
+  FileDescriptorPtr fd(new IoUringFileDescriptor());
   if (cache_writes && !read_only) {
     fd = FileDescriptorPtr(new CachedFileDescriptor(fd, kCacheSize));
     LOG(INFO) << "Caching writes.";
@@ -110,6 +127,18 @@ FileDescriptorPtr OpenFile(const char* path,
   return fd;
 }
 
+// Opens the error corrected device of the partition at |path|. Returns nullptr
+// if there is none.
+FileDescriptorPtr OpenECCFile(const string& path) {
+#if USE_FEC
+  FileDescriptorPtr fd(new FecFileDescriptor());
+  if (fd->Open(path.c_str(), O_RDONLY, 0))
+    return fd;
+  PLOG(ERROR) << "Unable to open ECC source partition " << path;
+#endif  // USE_FEC
+  return nullptr;
+}
+
 // Discard the tail of the block device referenced by |fd|, from the offset
 // |data_size| until the end of the block device. Returns whether the data was
 // discarded.
@@ -246,8 +275,8 @@ size_t DeltaPerformer::CopyDataToBuffer(const char** bytes_p,
   size_t read_len = min(count, max - buffer_.size());
   const char* bytes_start = *bytes_p;
   const char* bytes_end = bytes_start + read_len;
-  buffer_.reserve(max);
-  buffer_.insert(buffer_.end(), bytes_start, bytes_end);
+  buffer_.Reserve(max);
+  buffer_.AppendUnowned(bytes_start, read_len);
   *bytes_p = bytes_end;
   *count_p = count - read_len;
   return read_len;
@@ -255,6 +284,7 @@ size_t DeltaPerformer::CopyDataToBuffer(const char** bytes_p,
 
 bool DeltaPerformer::HandleOpResult(bool op_result,
                                     const char* op_type_name,
+                                    size_t operation_num,
                                     ErrorCode* error) {
   if (op_result)
     return true;
@@ -262,8 +292,8 @@ bool DeltaPerformer::HandleOpResult(bool op_result,
   size_t partition_first_op_num =
       current_partition_ ? acc_num_operations_[current_partition_ - 1] : 0;
   LOG(ERROR) << "Failed to perform " << op_type_name << " operation "
-             << next_operation_num_ << ", which is the operation "
-             << next_operation_num_ - partition_first_op_num
+             << operation_num << ", which is the operation "
+             << operation_num - partition_first_op_num
              << " in partition \""
              << partitions_[current_partition_].partition_name() << "\"";
   if (*error == ErrorCode::kSuccess)
@@ -282,11 +312,44 @@ int DeltaPerformer::Close() {
     if (err >= 0)
       err = 1;
   }
+  if (streamed_op_writer_) {
+    LOG(INFO) << "Discarding operation " << next_operation_num_
+              << " after applying " << streamed_op_bytes_
+              << " bytes of its data";
+    ResetStreamedOperation();
+    if (err >= 0)
+      err = 1;
+  }
   return -err;
 }
 
 int DeltaPerformer::CloseCurrentPartition() {
   int err = 0;
+  if (source_hash_prefetcher_) {
+    source_hash_prefetcher_->Stop();
+    LOG_IF(INFO, source_hash_prefetcher_->num_mismatches())
+        << "Source data of " << source_hash_prefetcher_->num_mismatches()
+        << " operations mismatched on the raw device.";
+    LOG(INFO) << "Source data of " << source_hash_prefetch_hits_
+              << " operations verified ahead so far.";
+    source_hash_prefetcher_.reset();
+  }
+  if (parallel_executor_ && !parallel_executor_->Close()) {
+    LOG(ERROR) << "Error closing the apply workers";
+    err = 1;
+  }
+  parallel_executor_.reset();
+  patch_arena_.reset();
+  source_mapping_.reset();
+  LOG_IF(INFO, source_data_cache_ && source_data_cache_->num_hits())
+      << "Reused the cached source data of " << source_data_cache_->num_hits()
+      << " operations so far.";
+  if (apply_tracer_ && current_partition_ < partitions_.size()) {
+    TraceStep("Partition " + partitions_[current_partition_].partition_name(),
+              partition_start_time_);
+    apply_tracer_->Flush();
+  }
+
   if (source_fd_ && !source_fd_->Close()) {
     err = errno;
     PLOG(ERROR) << "Error closing source partition";
@@ -304,6 +367,33 @@ int DeltaPerformer::CloseCurrentPartition() {
   source_ecc_open_failure_ = false;
   source_path_.clear();
 
+  // Later checkpoints cover the operations applied to this partition.
+  if (target_fd_ && !SyncTarget()) {
+    err = errno;
+    PLOG(ERROR) << "Error syncing target partition";
+    if (!err)
+      err = 1;
+  }
+  // The hash is only usable once all the operations of the partition were
+  // applied.
+  if (target_hasher_ && current_partition_ < partitions_.size() &&
+      next_operation_num_ >= acc_num_operations_[current_partition_]) {
+    size_t num_previous_partitions =
+        install_plan_->partitions.size() - partitions_.size();
+    InstallPlan::Partition& install_part =
+        install_plan_->partitions[num_previous_partitions + current_partition_];
+    if (target_hasher_->Finalize()) {
+      install_part.applied_target_hash = target_hasher_->raw_hash();
+      LOG(INFO) << "Hashed " << target_hasher_->hashed_while_writing()
+                << " bytes of partition " << install_part.name
+                << " while applying and read "
+                << target_hasher_->hashed_at_finalize() << " bytes at the end.";
+    } else {
+      LOG(WARNING) << "Unable to hash partition " << install_part.name
+                   << " while applying, it will be read back.";
+    }
+  }
+  target_hasher_.reset();
   if (target_fd_ && !target_fd_->Close()) {
     err = errno;
     PLOG(ERROR) << "Error closing target partition";
@@ -319,6 +409,7 @@ bool DeltaPerformer::OpenCurrentPartition() {
   if (current_partition_ >= partitions_.size())
     return false;
 
+  partition_start_time_ = base::TimeTicks::Now();
   const PartitionUpdate& partition = partitions_[current_partition_];
   size_t num_previous_partitions =
       install_plan_->partitions.size() - partitions_.size();
@@ -347,12 +438,12 @@ bool DeltaPerformer::OpenCurrentPartition() {
   target_path_ = install_part.target_path;
   int err;
 
+  // Rather than writing synchronously, the written data is synced to the
+  // storage before each checkpoint, see CheckpointUpdateProgress().
   int flags = O_RDWR;
-  if (!interactive_)
-    flags |= O_DSYNC;
 
   LOG(INFO) << "Opening " << target_path_ << " partition with"
-            << (interactive_ ? "out" : "") << " O_DSYNC";
+            << (interactive_ ? "out" : "") << " sync before checkpoints";
 
   target_fd_ = OpenFile(target_path_.c_str(), flags, true, &err);
   if (!target_fd_) {
@@ -370,6 +461,75 @@ bool DeltaPerformer::OpenCurrentPartition() {
   // Discard the end of the partition, but ignore failures.
   DiscardPartitionTail(target_fd_, install_part.target_size);
 
+  // The hasher reads the written data back through its own file descriptor,
+  // opened directly so the device isn't marked read-only. Failing to open it
+  // only leaves the hashing to FilesystemVerifierAction.
+  if (hash_target_while_applying_ && install_part.target_size > 0) {
+    FileDescriptorPtr hash_fd(new EintrSafeFileDescriptor());
+    if (hash_fd->Open(target_path_.c_str(), O_RDONLY)) {
+      target_hasher_ = std::make_unique<TargetHasher>(
+          hash_fd, block_size_, install_part.target_size);
+    } else {
+      PLOG(WARNING) << "Unable to open " << target_path_ << " for hashing";
+    }
+  }
+
+  // Reading the diff sources through a mapping saves a system call per read.
+  // Failing to map the source only reads it through |source_fd_|.
+  if (map_source_partition_ && source_fd_) {
+    source_mapping_ = MappedPartition::Map(source_path_);
+    LOG_IF(WARNING, !source_mapping_)
+        << "Reading " << source_path_ << " without mapping it.";
+    next_advised_operation_num_ = 0;
+  }
+
+  patch_arena_ = std::make_unique<PatchArena>(patch_arena_max_source_size_,
+                                              patch_arena_cache_size_);
+  if (source_mapping_)
+    patch_arena_->SetSourceMapping(source_mapping_, source_fd_);
+
+  // The workers open their own file descriptors on the same files. Failing to
+  // do so isn't fatal, the operations are then all applied on this thread.
+  if (max_apply_threads_ > 1) {
+    parallel_executor_ = std::make_unique<ParallelOperationExecutor>(
+        max_apply_threads_, block_size_);
+    parallel_executor_->set_patch_arena_sizes(patch_arena_max_source_size_,
+                                              patch_arena_cache_size_);
+    parallel_executor_->set_source_mapping(source_mapping_);
+    parallel_executor_->set_source_data_cache(source_data_cache_.get());
+    parallel_executor_->set_apply_tracer(apply_tracer_.get());
+    if (!parallel_executor_->Open(source_path_, target_path_, flags)) {
+      LOG(WARNING) << "Unable to start the apply workers, applying the "
+                   << "operations serially.";
+      parallel_executor_->Close();
+      parallel_executor_.reset();
+    }
+  }
+
+  // The prefetcher reads the source through its own file descriptors, so the
+  // error corrected device is decoded on its thread. It is only looked up by
+  // the operations applied on this thread. Failing to open the raw device only
+  // disables the prefetching.
+  if (source_hash_prefetch_depth_ > 0 && source_fd_ && !parallel_executor_) {
+    FileDescriptorPtr prefetch_fd =
+        OpenFile(source_path_.c_str(), O_RDONLY, false, &err);
+    if (prefetch_fd) {
+      // The results of operations already passed may still be looked up when
+      // they are retried after a run of planned copies.
+      size_t max_entries =
+          source_hash_prefetch_depth_ + kMaxPlannedSourceCopies;
+      // No support for ECC for full payloads.
+      base::OnceCallback<FileDescriptorPtr()> open_ecc_fd;
+      if (payload_->type != InstallPayloadType::kFull)
+        open_ecc_fd = base::BindOnce(&OpenECCFile, source_path_);
+      source_hash_prefetcher_ = std::make_unique<SourceHashPrefetcher>(
+          block_size_, prefetch_fd, std::move(open_ecc_fd), max_entries);
+      next_prefetched_operation_num_ = next_operation_num_;
+    } else {
+      LOG(WARNING) << "Not verifying the source data ahead.";
+    }
+  }
+
   return true;
 }
 
@@ -433,6 +593,13 @@ void LogPartitionInfo(const vector<PartitionUpdate>& partitions) {
 
 }  // namespace
 
+size_t DeltaPerformer::DefaultMaxApplyThreads() {
+  long nprocs = sysconf(_SC_NPROCESSORS_ONLN);  // NOLINT(runtime/int)
+  if (nprocs < 1)
+    return 1;
+  return min(static_cast<size_t>(nprocs), kMaxApplyThreads);
+}
+
 bool DeltaPerformer::IsHeaderParsed() const {
   return metadata_size_ != 0;
 }
@@ -549,8 +716,17 @@ MetadataParseResult DeltaPerformer::ParsePayloadMetadata(
 // were written, or false on any error, regardless of progress
 // and stores an action exit code in |error|.
 bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
+  bool result = ConsumeData(reinterpret_cast<const char*>(bytes), count, error);
+  // |buffer_| references |bytes| until here, keep a copy of what the next
+  // calls still need.
+  buffer_.Own();
+  return result;
+}
+
+bool DeltaPerformer::ConsumeData(const char* c_bytes,
+                                 size_t count,
+                                 ErrorCode* error) {
   *error = ErrorCode::kSuccess;
-  const char* c_bytes = reinterpret_cast<const char*>(bytes);
 
   // Update the total byte downloaded count and the progress logs.
   total_bytes_received_ += count;
@@ -566,7 +742,8 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
         (do_read_header ? kMaxPayloadHeaderSize
                         : metadata_size_ + metadata_signature_size_));
 
-    MetadataParseResult result = ParsePayloadMetadata(buffer_, error);
+    MetadataParseResult result =
+        ParsePayloadMetadata(buffer_.Coalesce(), error);
     if (result == MetadataParseResult::kError)
       return false;
     if (result == MetadataParseResult::kInsufficientData) {
@@ -583,13 +760,18 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
     manifest_valid_ = true;
 #ifndef __CHROMEOS__
     if (!install_plan_->is_resume) {
-      prefs_->SetString(kPrefsManifestBytes, {buffer_.begin(), buffer_.end()});
+      const brillo::Blob& manifest_bytes = buffer_.Coalesce();
+      prefs_->SetString(kPrefsManifestBytes,
+                        {manifest_bytes.begin(), manifest_bytes.end()});
     }
 #endif  // __CHROMEOS__
     // Clear the download buffer.
     DiscardBuffer(false, metadata_size_);
 
     block_size_ = manifest_.block_size();
+    executor_ = std::make_unique<InstallOperationExecutor>(block_size_);
+    source_copy_planner_ =
+        std::make_unique<SourceCopyPlanner>(block_size_, kSourceCopyStagingSize);
 
     // This populates |partitions_| and the |install_plan.partitions| with the
     // list of partitions from the manifest.
@@ -622,6 +804,33 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
       return false;
     }
 
+    // The apply can also be traced on a device by setting the pref.
+    bool apply_trace_enabled = false;
+    if (apply_trace_path_.empty() &&
+        prefs_->GetBoolean(kPrefsApplyTraceEnabled, &apply_trace_enabled) &&
+        apply_trace_enabled) {
+      apply_trace_path_ = ApplyTracer::kDefaultPath;
+    }
+    if (!apply_trace_path_.empty()) {
+      apply_tracer_ = ApplyTracer::Create(apply_trace_path_);
+      LOG_IF(WARNING, !apply_tracer_) << "Applying the update without tracing.";
+    }
+
+    // Count the source data used by the operations left to apply, in all
+    // the partitions, so it is only kept while it is used again.
+    if (source_data_cache_size_ > 0 &&
+        payload_->type != InstallPayloadType::kFull) {
+      source_data_cache_ =
+          std::make_unique<SourceDataCache>(source_data_cache_size_);
+      size_t operation_num = 0;
+      for (const auto& partition : partitions_) {
+        for (const InstallOperation& op : partition.operations()) {
+          if (operation_num++ >= next_operation_num_)
+            source_data_cache_->AddUse(op);
+        }
+      }
+    }
+
     if (next_operation_num_ < acc_num_operations_[current_partition_]) {
       if (!OpenCurrentPartition()) {
         *error = ErrorCode::kInstallDeviceOpenError;
@@ -644,6 +853,8 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
     // We know there are more operations to perform because we didn't reach the
     // |num_total_operations_| limit yet.
     if (next_operation_num_ >= acc_num_operations_[current_partition_]) {
+      if (!ApplyQueuedOperations(error))
+        return false;
       CloseCurrentPartition();
       // Skip until there are operations for current_partition_.
       while (next_operation_num_ >= acc_num_operations_[current_partition_]) {
@@ -661,70 +872,118 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
     const InstallOperation& op =
         partitions_[current_partition_].operations(partition_operation_num);
 
-    CopyDataToBuffer(&c_bytes, &count, op.data_length());
+    PrefetchSourceHashes(partition_operation_num);
+    AdviseNextSource(partition_operation_num);
+
+    CopyDataToBuffer(&c_bytes, &count, op.data_length() - streamed_op_bytes_);
 
-    // Check whether we received all of the next operation's data payload.
-    if (!CanPerformInstallOperation(op))
+    // Check whether we received all of the next operation's data payload. The
+    // queued operations are applied before waiting for more data so the
+    // progress is checkpointed. Large replace operations are applied as their
+    // data is received instead.
+    if (!CanPerformInstallOperation(op)) {
+      if (!ApplyQueuedOperations(error))
+        return false;
+      if (streamed_op_writer_ || CanStreamOperation(op))
+        return StreamOperationData(op, error);
       return true;
+    }
+
+    if (streamed_op_writer_) {
+      // Makes sure we unblock exit when this operation completes.
+      ScopedTerminatorExitUnblocker exit_unblocker =
+          ScopedTerminatorExitUnblocker();  // Avoids a compiler unused var bug.
+
+      if (!FinishStreamedOperation(op, error))
+        return false;
+      if (!target_fd_->Flush()) {
+        return false;
+      }
+      unsynced_bytes_ += utils::BlocksInExtents(op.dst_extents()) * block_size_;
+      HashAppliedOperations({&op});
+
+      next_operation_num_++;
+      UpdateOverallProgress(false, "Completed ");
+      CheckpointUpdateProgress(false);
+      continue;
+    }
 
     if (install_plan_->hash_checks_mandatory) {
       // Note: Validate must be called only if |CanPerformInstallOperation| is
       // called. Otherwise, we might be failing operations before even if there
       // isn't sufficient data to compute the proper hash.
+      base::TimeTicks verify_start_time = base::TimeTicks::Now();
       *error = ValidateOperationHash(op);
       if (*error != ErrorCode::kSuccess) {
         LOG(ERROR) << "Mandatory operation hash check failed";
         return false;
       }
+      TraceStep("VerifyData", verify_start_time);
+    }
+
+    // Runs of SOURCE_COPY operations read their source blocks together.
+    if (PlanSourceCopies(partition_operation_num) >= kMinPlannedSourceCopies) {
+      if (!ApplyQueuedOperations(error) || !ApplyPlannedSourceCopies(error))
+        return false;
+      continue;
+    }
+
+    if (CanQueueOperation(op)) {
+      ParallelOperationExecutor::Operation queued;
+      queued.operation_num = next_operation_num_;
+      queued.operation = op;
+      DiscardBuffer(true, buffer_.size(), &queued.data);
+      parallel_executor_->Queue(std::move(queued));
+      unsynced_bytes_ += utils::BlocksInExtents(op.dst_extents()) * block_size_;
+
+      next_operation_num_++;
+      UpdateOverallProgress(false, "Completed ");
+      if (parallel_executor_->num_queued() >= kMaxBatchOperations ||
+          parallel_executor_->queued_bytes() >= kMaxBatchBytes) {
+        if (!ApplyQueuedOperations(error))
+          return false;
+      }
+      continue;
     }
 
+    // The operation may depend on the result of the queued ones.
+    if (!ApplyQueuedOperations(error))
+      return false;
+
     // Makes sure we unblock exit when this operation completes.
     ScopedTerminatorExitUnblocker exit_unblocker =
         ScopedTerminatorExitUnblocker();  // Avoids a compiler unused var bug.
 
+    // Since we delete data off the beginning of the buffer as we use it,
+    // the data we need should be exactly at the beginning of the buffer.
     base::TimeTicks op_start_time = base::TimeTicks::Now();
-
-    bool op_result;
-    switch (op.type()) {
-      case InstallOperation::REPLACE:
-      case InstallOperation::REPLACE_BZ:
-      case InstallOperation::REPLACE_XZ:
-        op_result = PerformReplaceOperation(op);
-        OP_DURATION_HISTOGRAM("REPLACE", op_start_time);
-        break;
-      case InstallOperation::ZERO:
-      case InstallOperation::DISCARD:
-        op_result = PerformZeroOrDiscardOperation(op);
-        OP_DURATION_HISTOGRAM("ZERO_OR_DISCARD", op_start_time);
-        break;
-      case InstallOperation::SOURCE_COPY:
-        op_result = PerformSourceCopyOperation(op, error);
-        OP_DURATION_HISTOGRAM("SOURCE_COPY", op_start_time);
-        break;
-      case InstallOperation::SOURCE_BSDIFF:
-      case InstallOperation::BROTLI_BSDIFF:
-        op_result = PerformSourceBsdiffOperation(op, error);
-        OP_DURATION_HISTOGRAM("SOURCE_BSDIFF", op_start_time);
-        break;
-      case InstallOperation::PUFFDIFF:
-        op_result = PerformPuffDiffOperation(op, error);
-        OP_DURATION_HISTOGRAM("PUFFDIFF", op_start_time);
-        break;
-      default:
-        op_result = false;
-    }
-    if (!HandleOpResult(op_result, InstallOperationTypeName(op.type()), error))
+    bool op_result =
+        (!op.data_length() || buffer_offset_ == op.data_offset()) &&
+        PerformBufferedOperation(op, error);
+    if (!HandleOpResult(op_result,
+                        InstallOperationTypeName(op.type()),
+                        next_operation_num_,
+                        error))
       return false;
+    TraceOperation(op, next_operation_num_, op_start_time);
+    DiscardBuffer(true, buffer_.size());
 
+    base::TimeTicks flush_start_time = base::TimeTicks::Now();
     if (!target_fd_->Flush()) {
       return false;
     }
+    TraceStep("Flush", flush_start_time);
+    unsynced_bytes_ += utils::BlocksInExtents(op.dst_extents()) * block_size_;
+    HashAppliedOperations({&op});
 
     next_operation_num_++;
     UpdateOverallProgress(false, "Completed ");
     CheckpointUpdateProgress(false);
   }
 
+  if (!ApplyQueuedOperations(error))
+    return false;
+
   // In major version 2, we don't add unused operation to the payload.
   // If we already extracted the signature we should skip this step.
   if (manifest_.has_signatures_offset() && manifest_.has_signatures_size() &&
@@ -968,8 +1227,9 @@ bool DeltaPerformer::CanPerformInstallOperation(
   if (!operation.has_data_offset() && !operation.has_data_length())
     return true;
 
-  // See if we have the entire data blob in the buffer
-  if (operation.data_offset() < buffer_offset_) {
+  // See if we have the entire data blob in the buffer, the data of a streamed
+  // operation was already discarded from it as it was applied.
+  if (operation.data_offset() + streamed_op_bytes_ < buffer_offset_) {
     LOG(ERROR) << "we threw away data it seems?";
     return false;
   }
@@ -978,75 +1238,372 @@ bool DeltaPerformer::CanPerformInstallOperation(
           buffer_offset_ + buffer_.size());
 }
 
-bool DeltaPerformer::PerformReplaceOperation(
-    const InstallOperation& operation) {
-  CHECK(operation.type() == InstallOperation::REPLACE ||
-        operation.type() == InstallOperation::REPLACE_BZ ||
-        operation.type() == InstallOperation::REPLACE_XZ);
+bool DeltaPerformer::PerformOperation(const InstallOperation& operation,
+                                      const void* data,
+                                      size_t count,
+                                      ErrorCode* error) {
+  base::TimeTicks op_start_time = base::TimeTicks::Now();
+
+  bool op_result;
+  switch (operation.type()) {
+    case InstallOperation::REPLACE:
+    case InstallOperation::REPLACE_BZ:
+    case InstallOperation::REPLACE_XZ:
+    case InstallOperation::REPLACE_ZSTD:
+      op_result = PerformReplaceOperation(operation, data, count);
+      OP_DURATION_HISTOGRAM("REPLACE", op_start_time);
+      break;
+    case InstallOperation::ZERO:
+    case InstallOperation::DISCARD:
+      op_result = PerformZeroOrDiscardOperation(operation);
+      OP_DURATION_HISTOGRAM("ZERO_OR_DISCARD", op_start_time);
+      break;
+    case InstallOperation::SOURCE_COPY:
+      op_result = PerformSourceCopyOperation(operation, error);
+      OP_DURATION_HISTOGRAM("SOURCE_COPY", op_start_time);
+      break;
+    case InstallOperation::SOURCE_BSDIFF:
+    case InstallOperation::BROTLI_BSDIFF:
+      op_result = PerformSourceBsdiffOperation(operation, data, count, error);
+      OP_DURATION_HISTOGRAM("SOURCE_BSDIFF", op_start_time);
+      break;
+    case InstallOperation::PUFFDIFF:
+      op_result = PerformPuffDiffOperation(operation, data, count, error);
+      OP_DURATION_HISTOGRAM("PUFFDIFF", op_start_time);
+      break;
+    default:
+      op_result = false;
+  }
+  return op_result;
+}
 
-  // Since we delete data off the beginning of the buffer as we use it,
-  // the data we need should be exactly at the beginning of the buffer.
-  TEST_AND_RETURN_FALSE(buffer_offset_ == operation.data_offset());
-  TEST_AND_RETURN_FALSE(buffer_.size() >= operation.data_length());
+bool DeltaPerformer::CanQueueOperation(const InstallOperation& operation) {
+  if (!parallel_executor_ || !parallel_executor_->CanQueue(operation))
+    return false;
+  if (operation.data_length() && buffer_offset_ != operation.data_offset())
+    return false;
+  // Operations the device wants to optimize are left to the serial path.
+  return !IsOptimizedSourceCopy(operation);
+}
+
+bool DeltaPerformer::IsOptimizedSourceCopy(const InstallOperation& operation) {
+  if (operation.type() != InstallOperation::SOURCE_COPY)
+    return false;
+  const PartitionUpdate& partition = partitions_[current_partition_];
+  InstallOperation optimized;
+  return boot_control_->GetDynamicPartitionControl()->OptimizeOperation(
+      partition.partition_name(), operation, &optimized);
+}
+
+size_t DeltaPerformer::PlanSourceCopies(size_t partition_operation_num) {
+  source_copy_planner_->Clear();
+  if (!source_fd_)
+    return 0;
+  const PartitionUpdate& partition = partitions_[current_partition_];
+  for (int i = partition_operation_num;
+       i < partition.operations_size() &&
+       source_copy_planner_->num_operations() < kMaxPlannedSourceCopies;
+       i++) {
+    const InstallOperation& op = partition.operations(i);
+    // Operations sharing their source data get it through the cache.
+    if (!source_copy_planner_->CanAdd(op) || IsOptimizedSourceCopy(op) ||
+        (source_data_cache_ && source_data_cache_->IsShared(op)))
+      break;
+    source_copy_planner_->Add(op);
+  }
+  return source_copy_planner_->num_operations();
+}
 
-  // Setup the ExtentWriter stack based on the operation type.
-  std::unique_ptr<ExtentWriter> writer = std::make_unique<DirectExtentWriter>();
+bool DeltaPerformer::ApplyPlannedSourceCopies(ErrorCode* error) {
+  // Makes sure we unblock exit when these operations complete.
+  ScopedTerminatorExitUnblocker exit_unblocker =
+      ScopedTerminatorExitUnblocker();  // Avoids a compiler unused var bug.
+
+  vector<bool> succeeded;
+  base::TimeTicks run_start_time = base::TimeTicks::Now();
+  source_copy_planner_->Run(source_fd_, target_fd_, &succeeded);
+  TraceStep("SourceCopyRun", run_start_time);
+  LOG(INFO) << "Applied " << succeeded.size() << " SOURCE_COPY operations "
+            << "reading their source with " << source_copy_planner_->num_reads()
+            << " requests.";
+
+  // The operations whose source didn't match are retried on their own, which
+  // falls back to the error corrected device.
+  const PartitionUpdate& partition = partitions_[current_partition_];
+  const size_t partition_first_op_num =
+      current_partition_ ? acc_num_operations_[current_partition_ - 1] : 0;
+  vector<const InstallOperation*> applied;
+  for (bool op_succeeded : succeeded) {
+    const InstallOperation& op =
+        partition.operations(next_operation_num_ - partition_first_op_num);
+    applied.push_back(&op);
+    if (!op_succeeded) {
+      LOG(INFO) << "Retrying operation " << next_operation_num_
+                << " (SOURCE_COPY) on its own.";
+      base::TimeTicks op_start_time = base::TimeTicks::Now();
+      if (!HandleOpResult(PerformOperation(op, nullptr, 0, error),
+                          InstallOperationTypeName(op.type()),
+                          next_operation_num_,
+                          error))
+        return false;
+      TraceOperation(op, next_operation_num_, op_start_time);
+    }
+    unsynced_bytes_ += utils::BlocksInExtents(op.dst_extents()) * block_size_;
+    next_operation_num_++;
+    UpdateOverallProgress(false, "Completed ");
+  }
 
-  if (operation.type() == InstallOperation::REPLACE_BZ) {
-    writer.reset(new BzipExtentWriter(std::move(writer)));
-  } else if (operation.type() == InstallOperation::REPLACE_XZ) {
-    writer.reset(new XzExtentWriter(std::move(writer)));
+  if (!target_fd_->Flush()) {
+    return false;
   }
+  HashAppliedOperations(applied);
+  CheckpointUpdateProgress(false);
+  return true;
+}
 
-  TEST_AND_RETURN_FALSE(
-      writer->Init(target_fd_, operation.dst_extents(), block_size_));
-  TEST_AND_RETURN_FALSE(writer->Write(buffer_.data(), operation.data_length()));
+void DeltaPerformer::PrefetchSourceHashes(size_t partition_operation_num) {
+  if (!source_hash_prefetcher_)
+    return;
+  const PartitionUpdate& partition = partitions_[current_partition_];
+  const size_t partition_first_op_num =
+      current_partition_ ? acc_num_operations_[current_partition_ - 1] : 0;
+  const size_t end = std::min<size_t>(
+      partition_operation_num + source_hash_prefetch_depth_,
+      partition.operations_size());
+  size_t i = std::max(next_prefetched_operation_num_ - partition_first_op_num,
+                      partition_operation_num);
+  for (; i < end; i++) {
+    const InstallOperation& op = partition.operations(i);
+    if (op.has_src_sha256_hash())
+      source_hash_prefetcher_->Prefetch(op);
+  }
+  next_prefetched_operation_num_ =
+      std::max(next_prefetched_operation_num_, partition_first_op_num + end);
+}
 
-  // Update buffer
-  DiscardBuffer(true, buffer_.size());
+void DeltaPerformer::AdviseNextSource(size_t partition_operation_num) {
+  if (!source_mapping_)
+    return;
+  const PartitionUpdate& partition = partitions_[current_partition_];
+  const size_t next = partition_operation_num + 1;
+  if (next >= static_cast<size_t>(partition.operations_size()) ||
+      next == next_advised_operation_num_) {
+    return;
+  }
+  next_advised_operation_num_ = next;
+  const InstallOperation& op = partition.operations(next);
+  switch (op.type()) {
+    case InstallOperation::SOURCE_BSDIFF:
+    case InstallOperation::BROTLI_BSDIFF:
+    case InstallOperation::PUFFDIFF:
+      source_mapping_->WillNeed(op.src_extents(), block_size_);
+      break;
+    default:
+      break;
+  }
+}
+
+bool DeltaPerformer::ApplyQueuedOperations(ErrorCode* error) {
+  if (!parallel_executor_ || parallel_executor_->num_queued() == 0)
+    return true;
+
+  // Makes sure we unblock exit when these operations complete.
+  ScopedTerminatorExitUnblocker exit_unblocker =
+      ScopedTerminatorExitUnblocker();  // Avoids a compiler unused var bug.
+
+  vector<ParallelOperationExecutor::Operation> operations;
+  base::TimeTicks batch_start_time = base::TimeTicks::Now();
+  if (!parallel_executor_->RunBatch(&operations))
+    return false;
+  TraceStep("Batch", batch_start_time);
+
+  // The workers don't fall back to the error corrected device, the operations
+  // they couldn't apply are retried here, in order, on the serial path.
+  for (const auto& operation : operations) {
+    if (operation.succeeded)
+      continue;
+    const InstallOperation& op = operation.operation;
+    LOG(INFO) << "Retrying operation " << operation.operation_num << " ("
+              << InstallOperationTypeName(op.type()) << ") serially.";
+    base::TimeTicks op_start_time = base::TimeTicks::Now();
+    if (!HandleOpResult(PerformOperation(op,
+                                         operation.data.data(),
+                                         operation.data.size(),
+                                         error),
+                        InstallOperationTypeName(op.type()),
+                        operation.operation_num,
+                        error))
+      return false;
+    TraceOperation(op, operation.operation_num, op_start_time);
+  }
+
+  base::TimeTicks flush_start_time = base::TimeTicks::Now();
+  if (!target_fd_->Flush()) {
+    return false;
+  }
+  TraceStep("Flush", flush_start_time);
+  vector<const InstallOperation*> applied;
+  for (const auto& operation : operations)
+    applied.push_back(&operation.operation);
+  HashAppliedOperations(applied);
+  CheckpointUpdateProgress(false);
   return true;
 }
 
-bool DeltaPerformer::PerformZeroOrDiscardOperation(
-    const InstallOperation& operation) {
-  CHECK(operation.type() == InstallOperation::DISCARD ||
-        operation.type() == InstallOperation::ZERO);
+void DeltaPerformer::HashAppliedOperations(
+    const vector<const InstallOperation*>& operations) {
+  if (!target_hasher_)
+    return;
+  base::TimeTicks hash_start_time = base::TimeTicks::Now();
+  for (const InstallOperation* op : operations)
+    target_hasher_->AddWrittenExtents(op->dst_extents());
+  if (!target_hasher_->HashWrittenData()) {
+    LOG(WARNING) << "Unable to hash the target partition while applying, it "
+                 << "will be read back after the update.";
+    target_hasher_.reset();
+  }
+  TraceStep("HashTarget", hash_start_time);
+}
+
+void DeltaPerformer::TraceOperation(const InstallOperation& operation,
+                                    size_t operation_num,
+                                    base::TimeTicks start) {
+  if (apply_tracer_) {
+    apply_tracer_->AddOperation(
+        operation, operation_num, block_size_, start, base::TimeTicks::Now());
+  }
+}
 
-  // These operations have no blob.
-  TEST_AND_RETURN_FALSE(!operation.has_data_offset());
-  TEST_AND_RETURN_FALSE(!operation.has_data_length());
+void DeltaPerformer::TraceStep(const string& name, base::TimeTicks start) {
+  if (apply_tracer_)
+    apply_tracer_->AddStep(name, start, base::TimeTicks::Now());
+}
 
-#ifdef BLKZEROOUT
-  bool attempt_ioctl = true;
-  int request =
-      (operation.type() == InstallOperation::ZERO ? BLKZEROOUT : BLKDISCARD);
-#else   // !defined(BLKZEROOUT)
-  bool attempt_ioctl = false;
-  int request = 0;
-#endif  // !defined(BLKZEROOUT)
-
-  brillo::Blob zeros;
-  for (const Extent& extent : operation.dst_extents()) {
-    const uint64_t start = extent.start_block() * block_size_;
-    const uint64_t length = extent.num_blocks() * block_size_;
-    if (attempt_ioctl) {
-      int result = 0;
-      if (target_fd_->BlkIoctl(request, start, length, &result) && result == 0)
-        continue;
-      attempt_ioctl = false;
+bool DeltaPerformer::PerformBufferedOperation(const InstallOperation& operation,
+                                              ErrorCode* error) {
+  // Replace operations can write the segments of the buffer one after the
+  // other, the other operations need their whole blob at once.
+  if (buffer_.num_segments() > 1 &&
+      (operation.type() == InstallOperation::REPLACE ||
+       operation.type() == InstallOperation::REPLACE_BZ ||
+       operation.type() == InstallOperation::REPLACE_XZ ||
+       operation.type() == InstallOperation::REPLACE_ZSTD)) {
+    base::TimeTicks op_start_time = base::TimeTicks::Now();
+    TEST_AND_RETURN_FALSE(buffer_.size() >= operation.data_length());
+    bool op_result =
+        executor_->ExecuteReplaceOperation(operation, target_fd_, buffer_);
+    OP_DURATION_HISTOGRAM("REPLACE", op_start_time);
+    return op_result;
+  }
+  return PerformOperation(operation, buffer_.data(), buffer_.size(), error);
+}
+
+bool DeltaPerformer::CanStreamOperation(const InstallOperation& operation) {
+  if (operation.type() != InstallOperation::REPLACE &&
+      operation.type() != InstallOperation::REPLACE_BZ &&
+      operation.type() != InstallOperation::REPLACE_XZ &&
+      operation.type() != InstallOperation::REPLACE_ZSTD) {
+    return false;
+  }
+  if (operation.data_length() < kMinStreamedOperationSize ||
+      buffer_offset_ != operation.data_offset()) {
+    return false;
+  }
+  // The hash is checked at the end of the operation, the mandatory checks
+  // failing upfront are left to the regular path.
+  return !install_plan_->hash_checks_mandatory ||
+         operation.has_data_sha256_hash();
+}
+
+bool DeltaPerformer::StreamOperationData(const InstallOperation& operation,
+                                         ErrorCode* error) {
+  if (!streamed_op_writer_) {
+    if (!HandleOpResult(executor_->InitReplaceWriter(
+                            operation, target_fd_, &streamed_op_writer_),
+                        InstallOperationTypeName(operation.type()),
+                        next_operation_num_,
+                        error)) {
+      ResetStreamedOperation();
+      return false;
     }
-    // In case of failure, we fall back to writing 0 to the selected region.
-    zeros.resize(16 * block_size_);
-    for (uint64_t offset = 0; offset < length; offset += zeros.size()) {
-      uint64_t chunk_length =
-          min(length - offset, static_cast<uint64_t>(zeros.size()));
-      TEST_AND_RETURN_FALSE(utils::PWriteAll(
-          target_fd_, zeros.data(), chunk_length, start + offset));
+    if (install_plan_->hash_checks_mandatory)
+      streamed_op_hash_calculator_ = std::make_unique<HashCalculator>();
+  }
+
+  bool op_result = true;
+  for (size_t i = 0; i < buffer_.num_segments() && op_result; i++) {
+    const uint8_t* data = buffer_.segment_data(i);
+    size_t size = buffer_.segment_size(i);
+    op_result = streamed_op_writer_->Write(data, size) &&
+                (!streamed_op_hash_calculator_ ||
+                 streamed_op_hash_calculator_->Update(data, size));
+  }
+  if (!HandleOpResult(op_result,
+                      InstallOperationTypeName(operation.type()),
+                      next_operation_num_,
+                      error)) {
+    ResetStreamedOperation();
+    return false;
+  }
+  streamed_op_bytes_ += buffer_.size();
+  DiscardBuffer(true, buffer_.size());
+  return true;
+}
+
+bool DeltaPerformer::FinishStreamedOperation(const InstallOperation& operation,
+                                             ErrorCode* error) {
+  if (!StreamOperationData(operation, error))
+    return false;
+  TEST_AND_RETURN_FALSE(streamed_op_bytes_ == operation.data_length());
+
+  // The data was already written to the target, a mismatching hash fails the
+  // update which resumes from the last checkpoint, before this operation.
+  if (streamed_op_hash_calculator_) {
+    if (!streamed_op_hash_calculator_->Finalize()) {
+      LOG(ERROR) << "Unable to compute actual hash of operation "
+                 << next_operation_num_;
+      *error = ErrorCode::kDownloadOperationHashVerificationError;
+    } else {
+      *error = CompareOperationHash(operation,
+                                    streamed_op_hash_calculator_->raw_hash());
+    }
+    if (*error != ErrorCode::kSuccess) {
+      LOG(ERROR) << "Mandatory operation hash check failed";
+      ResetStreamedOperation();
+      return false;
     }
   }
+  ResetStreamedOperation();
   return true;
 }
 
+void DeltaPerformer::ResetStreamedOperation() {
+  streamed_op_writer_.reset();
+  streamed_op_hash_calculator_.reset();
+  streamed_op_bytes_ = 0;
+}
+
+bool DeltaPerformer::PerformReplaceOperation(const InstallOperation& operation,
+                                             const void* data,
+                                             size_t count) {
+  CHECK(operation.type() == InstallOperation::REPLACE ||
+        operation.type() == InstallOperation::REPLACE_BZ ||
+        operation.type() == InstallOperation::REPLACE_XZ ||
+        operation.type() == InstallOperation::REPLACE_ZSTD);
+  TEST_AND_RETURN_FALSE(count >= operation.data_length());
+
+  return executor_->ExecuteReplaceOperation(
+      operation, target_fd_, data, operation.data_length());
+}
+
+bool DeltaPerformer::PerformZeroOrDiscardOperation(
+    const InstallOperation& operation) {
+  CHECK(operation.type() == InstallOperation::DISCARD ||
+        operation.type() == InstallOperation::ZERO);
+
+  return executor_->ExecuteZeroOrDiscardOperation(operation, target_fd_);
+}
+
 bool DeltaPerformer::ValidateSourceHash(const brillo::Blob& calculated_hash,
                                         const InstallOperation& operation,
                                         const FileDescriptorPtr source_fd,
@@ -1105,6 +1662,49 @@ bool DeltaPerformer::PerformSourceCopyOperation(
       partition.partition_name(), operation, &buf);
   const InstallOperation& optimized = should_optimize ? buf : operation;
 
+  // The source data may already be in memory, read by an earlier operation.
+  // An optimized operation doesn't read it, but it still counts as a use.
+  if (source_data_cache_ && should_optimize) {
+    source_data_cache_->SkipUse(operation);
+  } else if (source_data_cache_) {
+    std::shared_ptr<const brillo::Blob> source_data =
+        source_data_cache_->Get(operation, source_fd_, block_size_);
+    if (source_data) {
+      DirectExtentWriter writer;
+      TEST_AND_RETURN_FALSE(
+          writer.Init(target_fd_, operation.dst_extents(), block_size_) &&
+          writer.Write(source_data->data(), source_data->size()));
+      return true;
+    }
+  }
+
+  // The source data may already be verified, or repaired, in the background.
+  if (source_hash_prefetcher_ && !should_optimize) {
+    brillo::Blob repaired_data;
+    SourceHashPrefetcher::Result result =
+        source_hash_prefetcher_->Lookup(operation, &repaired_data);
+    if (result == SourceHashPrefetcher::Result::kRawMatches &&
+        fd_utils::CopyAndHashExtents(source_fd_,
+                                     operation.src_extents(),
+                                     target_fd_,
+                                     operation.dst_extents(),
+                                     block_size_,
+                                     nullptr /* skip hashing */)) {
+      source_hash_prefetch_hits_++;
+      return true;
+    }
+    if (result == SourceHashPrefetcher::Result::kEccMatches &&
+        !repaired_data.empty()) {
+      DirectExtentWriter writer;
+      TEST_AND_RETURN_FALSE(
+          writer.Init(target_fd_, operation.dst_extents(), block_size_) &&
+          writer.Write(repaired_data.data(), repaired_data.size()));
+      source_ecc_recovered_failures_++;
+      source_hash_prefetch_hits_++;
+      return true;
+    }
+  }
+
   if (operation.has_src_sha256_hash()) {
     bool read_ok;
     brillo::Blob source_hash;
@@ -1221,6 +1821,24 @@ FileDescriptorPtr DeltaPerformer::ChooseSourceFD(
     return source_fd_;
   }
 
+  if (source_hash_prefetcher_) {
+    switch (source_hash_prefetcher_->Lookup(operation, nullptr)) {
+      case SourceHashPrefetcher::Result::kRawMatches:
+        source_hash_prefetch_hits_++;
+        return source_fd_;
+      case SourceHashPrefetcher::Result::kEccMatches:
+        if (OpenCurrentECCPartition()) {
+          source_ecc_recovered_failures_++;
+          source_hash_prefetch_hits_++;
+          return source_ecc_fd_;
+        }
+        break;
+      default:
+        // Verify the source data below, which logs the mismatch.
+        break;
+    }
+  }
+
   brillo::Blob source_hash;
   brillo::Blob expected_source_hash(operation.src_sha256_hash().begin(),
                                     operation.src_sha256_hash().end());
@@ -1278,221 +1896,66 @@ bool DeltaPerformer::ExtentsToBsdiffPositionsString(
   return true;
 }
 
-namespace {
-
-class BsdiffExtentFile : public bsdiff::FileInterface {
- public:
-  BsdiffExtentFile(std::unique_ptr<ExtentReader> reader, size_t size)
-      : BsdiffExtentFile(std::move(reader), nullptr, size) {}
-  BsdiffExtentFile(std::unique_ptr<ExtentWriter> writer, size_t size)
-      : BsdiffExtentFile(nullptr, std::move(writer), size) {}
-  BsdiffExtentFile(const BsdiffExtentFile&) = delete;
-  BsdiffExtentFile& operator=(const BsdiffExtentFile&) = delete;
-
-  ~BsdiffExtentFile() override = default;
-
-  bool Read(void* buf, size_t count, size_t* bytes_read) override {
-    TEST_AND_RETURN_FALSE(reader_->Read(buf, count));
-    *bytes_read = count;
-    offset_ += count;
-    return true;
-  }
-
-  bool Write(const void* buf, size_t count, size_t* bytes_written) override {
-    TEST_AND_RETURN_FALSE(writer_->Write(buf, count));
-    *bytes_written = count;
-    offset_ += count;
-    return true;
-  }
-
-  bool Seek(off_t pos) override {
-    if (reader_ != nullptr) {
-      TEST_AND_RETURN_FALSE(reader_->Seek(pos));
-      offset_ = pos;
-    } else {
-      // For writes technically there should be no change of position, or it
-      // should be equivalent of current offset.
-      TEST_AND_RETURN_FALSE(offset_ == static_cast<uint64_t>(pos));
-    }
-    return true;
-  }
-
-  bool Close() override { return true; }
-
-  bool GetSize(uint64_t* size) override {
-    *size = size_;
-    return true;
-  }
-
- private:
-  BsdiffExtentFile(std::unique_ptr<ExtentReader> reader,
-                   std::unique_ptr<ExtentWriter> writer,
-                   size_t size)
-      : reader_(std::move(reader)),
-        writer_(std::move(writer)),
-        size_(size),
-        offset_(0) {}
-
-  std::unique_ptr<ExtentReader> reader_;
-  std::unique_ptr<ExtentWriter> writer_;
-  uint64_t size_;
-  uint64_t offset_;
-};
-
-}  // namespace
-
 bool DeltaPerformer::PerformSourceBsdiffOperation(
-    const InstallOperation& operation, ErrorCode* error) {
-  // Since we delete data off the beginning of the buffer as we use it,
-  // the data we need should be exactly at the beginning of the buffer.
-  TEST_AND_RETURN_FALSE(buffer_offset_ == operation.data_offset());
-  TEST_AND_RETURN_FALSE(buffer_.size() >= operation.data_length());
+    const InstallOperation& operation,
+    const void* data,
+    size_t count,
+    ErrorCode* error) {
+  TEST_AND_RETURN_FALSE(count >= operation.data_length());
   if (operation.has_src_length())
     TEST_AND_RETURN_FALSE(operation.src_length() % block_size_ == 0);
   if (operation.has_dst_length())
     TEST_AND_RETURN_FALSE(operation.dst_length() % block_size_ == 0);
 
-  FileDescriptorPtr source_fd = ChooseSourceFD(operation, error);
-  TEST_AND_RETURN_FALSE(source_fd != nullptr);
-
-  auto reader = std::make_unique<DirectExtentReader>();
-  TEST_AND_RETURN_FALSE(
-      reader->Init(source_fd, operation.src_extents(), block_size_));
-  auto src_file = std::make_unique<BsdiffExtentFile>(
-      std::move(reader),
-      utils::BlocksInExtents(operation.src_extents()) * block_size_);
-
-  auto writer = std::make_unique<DirectExtentWriter>();
-  TEST_AND_RETURN_FALSE(
-      writer->Init(target_fd_, operation.dst_extents(), block_size_));
-  auto dst_file = std::make_unique<BsdiffExtentFile>(
-      std::move(writer),
-      utils::BlocksInExtents(operation.dst_extents()) * block_size_);
-
-  TEST_AND_RETURN_FALSE(bsdiff::bspatch(std::move(src_file),
-                                        std::move(dst_file),
-                                        buffer_.data(),
-                                        buffer_.size()) == 0);
-  DiscardBuffer(true, buffer_.size());
-  return true;
-}
-
-namespace {
-
-// A class to be passed to |puffpatch| for reading from |source_fd_| and writing
-// into |target_fd_|.
-class PuffinExtentStream : public puffin::StreamInterface {
- public:
-  // Constructor for creating a stream for reading from an |ExtentReader|.
-  PuffinExtentStream(std::unique_ptr<ExtentReader> reader, uint64_t size)
-      : PuffinExtentStream(std::move(reader), nullptr, size) {}
-
-  // Constructor for creating a stream for writing to an |ExtentWriter|.
-  PuffinExtentStream(std::unique_ptr<ExtentWriter> writer, uint64_t size)
-      : PuffinExtentStream(nullptr, std::move(writer), size) {}
-
-  PuffinExtentStream(const PuffinExtentStream&) = delete;
-  PuffinExtentStream& operator=(const PuffinExtentStream&) = delete;
-
-  ~PuffinExtentStream() override = default;
-
-  bool GetSize(uint64_t* size) const override {
-    *size = size_;
-    return true;
-  }
-
-  bool GetOffset(uint64_t* offset) const override {
-    *offset = offset_;
-    return true;
-  }
-
-  bool Seek(uint64_t offset) override {
-    if (is_read_) {
-      TEST_AND_RETURN_FALSE(reader_->Seek(offset));
-      offset_ = offset;
-    } else {
-      // For writes technically there should be no change of position, or it
-      // should equivalent of current offset.
-      TEST_AND_RETURN_FALSE(offset_ == offset);
+  // The source data may already be in memory, read by an earlier operation.
+  if (source_data_cache_) {
+    std::shared_ptr<const brillo::Blob> source_data =
+        source_data_cache_->Get(operation, source_fd_, block_size_);
+    if (source_data) {
+      return executor_->ExecuteSourceBsdiffOperation(operation,
+                                                     target_fd_,
+                                                     *source_data,
+                                                     data,
+                                                     operation.data_length(),
+                                                     patch_arena_.get());
     }
-    return true;
   }
 
-  bool Read(void* buffer, size_t count) override {
-    TEST_AND_RETURN_FALSE(is_read_);
-    TEST_AND_RETURN_FALSE(reader_->Read(buffer, count));
-    offset_ += count;
-    return true;
-  }
-
-  bool Write(const void* buffer, size_t count) override {
-    TEST_AND_RETURN_FALSE(!is_read_);
-    TEST_AND_RETURN_FALSE(writer_->Write(buffer, count));
-    offset_ += count;
-    return true;
-  }
-
-  bool Close() override { return true; }
-
- private:
-  PuffinExtentStream(std::unique_ptr<ExtentReader> reader,
-                     std::unique_ptr<ExtentWriter> writer,
-                     uint64_t size)
-      : reader_(std::move(reader)),
-        writer_(std::move(writer)),
-        size_(size),
-        offset_(0),
-        is_read_(reader_ ? true : false) {}
-
-  std::unique_ptr<ExtentReader> reader_;
-  std::unique_ptr<ExtentWriter> writer_;
-  uint64_t size_;
-  uint64_t offset_;
-  bool is_read_;
-};
+  FileDescriptorPtr source_fd = ChooseSourceFD(operation, error);
+  TEST_AND_RETURN_FALSE(source_fd != nullptr);
 
-}  // namespace
+  return executor_->ExecuteSourceBsdiffOperation(operation,
+                                                 target_fd_,
+                                                 source_fd,
+                                                 data,
+                                                 operation.data_length(),
+                                                 patch_arena_.get());
+}
 
 bool DeltaPerformer::PerformPuffDiffOperation(const InstallOperation& operation,
+                                              const void* data,
+                                              size_t count,
                                               ErrorCode* error) {
-  // Since we delete data off the beginning of the buffer as we use it,
-  // the data we need should be exactly at the beginning of the buffer.
-  TEST_AND_RETURN_FALSE(buffer_offset_ == operation.data_offset());
-  TEST_AND_RETURN_FALSE(buffer_.size() >= operation.data_length());
+  TEST_AND_RETURN_FALSE(count >= operation.data_length());
 
   FileDescriptorPtr source_fd = ChooseSourceFD(operation, error);
   TEST_AND_RETURN_FALSE(source_fd != nullptr);
 
-  auto reader = std::make_unique<DirectExtentReader>();
-  TEST_AND_RETURN_FALSE(
-      reader->Init(source_fd, operation.src_extents(), block_size_));
-  puffin::UniqueStreamPtr src_stream(new PuffinExtentStream(
-      std::move(reader),
-      utils::BlocksInExtents(operation.src_extents()) * block_size_));
-
-  auto writer = std::make_unique<DirectExtentWriter>();
-  TEST_AND_RETURN_FALSE(
-      writer->Init(target_fd_, operation.dst_extents(), block_size_));
-  puffin::UniqueStreamPtr dst_stream(new PuffinExtentStream(
-      std::move(writer),
-      utils::BlocksInExtents(operation.dst_extents()) * block_size_));
-
-  const size_t kMaxCacheSize = 5 * 1024 * 1024;  // Total 5MB cache.
-  TEST_AND_RETURN_FALSE(puffin::PuffPatch(std::move(src_stream),
-                                          std::move(dst_stream),
-                                          buffer_.data(),
-                                          buffer_.size(),
-                                          kMaxCacheSize));
-  DiscardBuffer(true, buffer_.size());
-  return true;
+  return executor_->ExecutePuffDiffOperation(operation,
+                                             target_fd_,
+                                             source_fd,
+                                             data,
+                                             operation.data_length(),
+                                             patch_arena_.get());
 }
 
 bool DeltaPerformer::ExtractSignatureMessage() {
   TEST_AND_RETURN_FALSE(signatures_message_data_.empty());
   TEST_AND_RETURN_FALSE(buffer_offset_ == manifest_.signatures_offset());
   TEST_AND_RETURN_FALSE(buffer_.size() >= manifest_.signatures_size());
-  signatures_message_data_.assign(
-      buffer_.begin(), buffer_.begin() + manifest_.signatures_size());
+  const uint8_t* signatures = buffer_.data();
+  signatures_message_data_.assign(signatures,
+                                  signatures + manifest_.signatures_size());
 
   // Save the signature blob because if the update is interrupted after the
   // download phase we don't go through this path anymore. Some alternatives to
@@ -1610,6 +2073,14 @@ ErrorCode DeltaPerformer::ValidateManifest() {
                  << kMaxSupportedMinorPayloadVersion << "].";
       return ErrorCode::kUnsupportedMinorPayloadVersion;
     }
+    // The minor versions skipped before kZstdMinorPayloadVersion allow
+    // operations this client doesn't support.
+    if (manifest_.minor_version() > kPartialUpdateMinorPayloadVersion &&
+        manifest_.minor_version() < kZstdMinorPayloadVersion) {
+      LOG(ERROR) << "Manifest contains unsupported minor version "
+                 << manifest_.minor_version() << ".";
+      return ErrorCode::kUnsupportedMinorPayloadVersion;
+    }
   }
 
   ErrorCode error_code = CheckTimestampError();
@@ -1753,18 +2224,30 @@ ErrorCode DeltaPerformer::ValidateOperationHash(
     return ErrorCode::kSuccess;
   }
 
-  brillo::Blob expected_op_hash;
-  expected_op_hash.assign(operation.data_sha256_hash().data(),
-                          (operation.data_sha256_hash().data() +
-                           operation.data_sha256_hash().size()));
-
-  brillo::Blob calculated_op_hash;
-  if (!HashCalculator::RawHashOfBytes(
-          buffer_.data(), operation.data_length(), &calculated_op_hash)) {
+  // Hash the blob segment by segment so it doesn't need to be merged.
+  HashCalculator op_hash_calculator;
+  size_t left = operation.data_length();
+  for (size_t i = 0; i < buffer_.num_segments() && left > 0; i++) {
+    size_t hash_len = min(left, buffer_.segment_size(i));
+    if (!op_hash_calculator.Update(buffer_.segment_data(i), hash_len))
+      break;
+    left -= hash_len;
+  }
+  if (left > 0 || !op_hash_calculator.Finalize()) {
     LOG(ERROR) << "Unable to compute actual hash of operation "
                << next_operation_num_;
     return ErrorCode::kDownloadOperationHashVerificationError;
   }
+  return CompareOperationHash(operation, op_hash_calculator.raw_hash());
+}
+
+ErrorCode DeltaPerformer::CompareOperationHash(
+    const InstallOperation& operation,
+    const brillo::Blob& calculated_op_hash) {
+  brillo::Blob expected_op_hash;
+  expected_op_hash.assign(operation.data_sha256_hash().data(),
+                          (operation.data_sha256_hash().data() +
+                           operation.data_sha256_hash().size()));
 
   if (calculated_op_hash != expected_op_hash) {
     LOG(ERROR) << "Hash verification failed for operation "
@@ -1836,17 +2319,27 @@ ErrorCode DeltaPerformer::VerifyPayload(
 }
 
 void DeltaPerformer::DiscardBuffer(bool do_advance_offset,
-                                   size_t signed_hash_buffer_size) {
+                                   size_t signed_hash_buffer_size,
+                                   brillo::Blob* out_buffer) {
   // Update the buffer offset.
   if (do_advance_offset)
     buffer_offset_ += buffer_.size();
 
   // Hash the content.
-  payload_hash_calculator_.Update(buffer_.data(), buffer_.size());
-  signed_hash_calculator_.Update(buffer_.data(), signed_hash_buffer_size);
-
-  // Swap content with an empty vector to ensure that all memory is released.
-  brillo::Blob().swap(buffer_);
+  for (size_t i = 0; i < buffer_.num_segments(); i++) {
+    const uint8_t* data = buffer_.segment_data(i);
+    size_t size = buffer_.segment_size(i);
+    payload_hash_calculator_.Update(data, size);
+    size_t signed_len = min(size, signed_hash_buffer_size);
+    signed_hash_calculator_.Update(data, signed_len);
+    signed_hash_buffer_size -= signed_len;
+  }
+
+  // Release all the memory, or hand the content over to the caller.
+  if (out_buffer)
+    buffer_.Release(out_buffer);
+  else
+    buffer_.Clear();
 }
 
 bool DeltaPerformer::CanResumeUpdate(PrefsInterface* prefs,
@@ -1922,12 +2415,20 @@ bool DeltaPerformer::ResetUpdateProgress(
 
 bool DeltaPerformer::CheckpointUpdateProgress(bool force) {
   base::TimeTicks curr_time = base::TimeTicks::Now();
-  if (force || curr_time > update_checkpoint_time_) {
+  if (force || curr_time > update_checkpoint_time_ ||
+      (!interactive_ && unsynced_bytes_ >= max_unsynced_bytes_)) {
     update_checkpoint_time_ = curr_time + update_checkpoint_wait_;
   } else {
     return false;
   }
 
+  // The checkpoint must not cover operations whose data didn't reach the
+  // storage yet, otherwise they would be skipped when resuming after a crash.
+  if (target_fd_ && !SyncTarget()) {
+    PLOG(ERROR) << "Unable to sync the target partition, not checkpointing.";
+    return false;
+  }
+
   Terminator::set_exit_blocked(true);
   if (last_updated_buffer_offset_ != buffer_offset_) {
     // Resets the progress in case we die in the middle of the state update.
@@ -1962,6 +2463,21 @@ bool DeltaPerformer::CheckpointUpdateProgress(bool force) {
   return true;
 }
 
+bool DeltaPerformer::SyncTarget() {
+  if (interactive_ || unsynced_bytes_ == 0)
+    return true;
+  base::TimeTicks sync_start_time = base::TimeTicks::Now();
+  TEST_AND_RETURN_FALSE(target_fd_->Sync());
+  LOCAL_HISTOGRAM_CUSTOM_TIMES("UpdateEngine.DownloadAction.TargetSyncDuration",
+                               base::TimeTicks::Now() - sync_start_time,
+                               base::Milliseconds(1),
+                               base::Minutes(1),
+                               50);
+  TraceStep("Sync", sync_start_time);
+  unsynced_bytes_ = 0;
+  return true;
+}
+
 bool DeltaPerformer::PrimeUpdateState() {
   CHECK(manifest_valid_);
 
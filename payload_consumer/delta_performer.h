@@ -19,6 +19,7 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <limits>
 #include <memory>
 #include <string>
@@ -32,11 +33,22 @@
 
 #include "update_engine/common/hash_calculator.h"
 #include "update_engine/common/platform_constants.h"
+#include "update_engine/payload_consumer/apply_tracer.h"
+#include "update_engine/payload_consumer/extent_writer.h"
 #include "update_engine/payload_consumer/file_descriptor.h"
 #include "update_engine/payload_consumer/file_writer.h"
+#include "update_engine/payload_consumer/install_operation_executor.h"
 #include "update_engine/payload_consumer/install_plan.h"
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+#include "update_engine/payload_consumer/parallel_operation_executor.h"
+#include "update_engine/payload_consumer/patch_arena.h"
+#include "update_engine/payload_consumer/payload_buffer.h"
 #include "update_engine/payload_consumer/payload_metadata.h"
 #include "update_engine/payload_consumer/payload_verifier.h"
+#include "update_engine/payload_consumer/source_copy_planner.h"
+#include "update_engine/payload_consumer/source_data_cache.h"
+#include "update_engine/payload_consumer/source_hash_prefetcher.h"
+#include "update_engine/payload_consumer/target_hasher.h"
 #include "update_engine/update_metadata.pb.h"
 
 namespace chromeos_update_engine {
@@ -63,6 +75,13 @@ class DeltaPerformer : public FileWriter {
   static const unsigned kProgressDownloadWeight;
   static const unsigned kProgressOperationsWeight;
   static const base::TimeDelta kCheckpointFrequencyTime;
+  // Amount of data written to the target after which the progress is
+  // checkpointed, regardless of kCheckpointFrequencyTime.
+  static const uint64_t kCheckpointMaxUnsyncedBytes;
+
+  // Replace operations with a data blob of at least this size are applied as
+  // their data is received.
+  static const uint64_t kMinStreamedOperationSize;
 
   DeltaPerformer(PrefsInterface* prefs,
                  BootControlInterface* boot_control,
@@ -175,6 +194,61 @@ class DeltaPerformer : public FileWriter {
   // Return true if header parsing is finished and no errors occurred.
   bool IsHeaderParsed() const;
 
+  // Sets the number of threads used to apply the operations of a partition.
+  // Operations are all applied on the calling thread when set to 1. Takes
+  // effect the next time a partition is opened.
+  void set_max_apply_threads(size_t max_apply_threads) {
+    max_apply_threads_ = std::max<size_t>(max_apply_threads, 1);
+  }
+
+  // Sets the sizes of the PatchArena used to apply the diff operations, see
+  // PatchArena. Takes effect the next time a partition is opened.
+  void set_patch_arena_sizes(size_t max_source_size,
+                             size_t puffpatch_cache_size) {
+    patch_arena_max_source_size_ = max_source_size;
+    patch_arena_cache_size_ = puffpatch_cache_size;
+  }
+
+  // Sets how many operations ahead of the current one have their source data
+  // verified on a background thread, see SourceHashPrefetcher. Only used when
+  // the operations are applied on this thread, and disabled when set to 0.
+  // Takes effect the next time a partition is opened.
+  void set_source_hash_prefetch_depth(size_t depth) {
+    source_hash_prefetch_depth_ = depth;
+  }
+
+  // Sets whether the diff operations read their source through a memory
+  // mapping of the source partition, see MmapExtentReader. An I/O error on the
+  // source then raises SIGBUS instead of falling back to the error corrected
+  // device, so it is disabled by default. Takes effect the next time a
+  // partition is opened.
+  void set_map_source_partition(bool enabled) {
+    map_source_partition_ = enabled;
+  }
+
+  // Sets whether the target partitions are hashed while they are written, see
+  // TargetHasher, which spares FilesystemVerifierAction reading them back.
+  // Takes effect the next time a partition is opened.
+  void set_hash_target_while_applying(bool enabled) {
+    hash_target_while_applying_ = enabled;
+  }
+
+  // Sets the amount of source data kept in memory for the operations of any
+  // partition with the same source hash, see SourceDataCache. Defaults to
+  // SourceDataCache::kDefaultMaxBytes, and disabled when set to 0. Takes
+  // effect when the manifest is parsed.
+  void set_source_data_cache_size(size_t max_bytes) {
+    source_data_cache_size_ = max_bytes;
+  }
+
+  // Sets the file where the time spent applying the operations is traced, see
+  // ApplyTracer. When empty, the default, the apply is only traced to
+  // ApplyTracer::kDefaultPath if the kPrefsApplyTraceEnabled pref is true.
+  // Takes effect when the manifest is parsed.
+  void set_apply_trace_path(const std::string& path) {
+    apply_trace_path_ = path;
+  }
+
   // Compare |calculated_hash| with source hash in |operation|, return false and
   // dump hash and set |error| if don't match.
   // |source_fd| is the file descriptor of the source partition.
@@ -214,16 +288,23 @@ class DeltaPerformer : public FileWriter {
   // manifest to be parsed and valid.
   bool ParseManifestPartitions(ErrorCode* error);
 
+  // Does the work of Write(). |buffer_| may reference the |count| bytes of
+  // |c_bytes| when it returns.
+  bool ConsumeData(const char* c_bytes, size_t count, ErrorCode* error);
+
   // Appends up to |*count_p| bytes from |*bytes_p| to |buffer_|, but only to
   // the extent that the size of |buffer_| does not exceed |max|. Advances
-  // |*cbytes_p| and decreases |*count_p| by the actual number of bytes copied,
-  // and returns this number.
+  // |*cbytes_p| and decreases |*count_p| by the actual number of bytes
+  // appended, and returns this number. The data isn't copied until
+  // |buffer_.Own()| is called.
   size_t CopyDataToBuffer(const char** bytes_p, size_t* count_p, size_t max);
 
   // If |op_result| is false, emits an error message using |op_type_name| and
-  // sets |*error| accordingly. Otherwise does nothing. Returns |op_result|.
+  // the index |operation_num| of the failed operation, and sets |*error|
+  // accordingly. Otherwise does nothing. Returns |op_result|.
   bool HandleOpResult(bool op_result,
                       const char* op_type_name,
+                      size_t operation_num,
                       ErrorCode* error);
 
   // Logs the progress of downloading/applying an update.
@@ -245,21 +326,99 @@ class DeltaPerformer : public FileWriter {
   // Returns ErrorCode::kSuccess on match or a suitable error code otherwise.
   ErrorCode ValidateOperationHash(const InstallOperation& operation);
 
-  // Returns true on success.
-  bool PerformInstallOperation(const InstallOperation& operation);
+  // Compares |calculated_op_hash| to the hash of the |operation| data blob in
+  // the manifest.
+  ErrorCode CompareOperationHash(const InstallOperation& operation,
+                                 const brillo::Blob& calculated_op_hash);
+
+  // Applies |operation| on the calling thread using the |count| bytes of its
+  // data blob in |data|, falling back to the error corrected source device when
+  // needed. Returns true on success.
+  bool PerformOperation(const InstallOperation& operation,
+                        const void* data,
+                        size_t count,
+                        ErrorCode* error);
+
+  // Returns whether the data blob of |operation| is large enough to be written
+  // to the target as it is received rather than once complete, which is only
+  // supported for replace operations.
+  bool CanStreamOperation(const InstallOperation& operation);
+
+  // Writes the data of |operation| received so far in |buffer_| to the target
+  // and discards it. Returns false and resets the streamed operation on error.
+  bool StreamOperationData(const InstallOperation& operation,
+                           ErrorCode* error);
+
+  // Writes the end of the data blob of the streamed |operation| and checks its
+  // hash. The progress is only checkpointed once the operation completes, so
+  // an interrupted or failed operation restarts from its beginning.
+  bool FinishStreamedOperation(const InstallOperation& operation,
+                               ErrorCode* error);
+
+  // Drops the state of the streamed operation.
+  void ResetStreamedOperation();
+
+  // Same as PerformOperation() for the data blob in |buffer_|, which is only
+  // merged into a contiguous blob when the operation needs one.
+  bool PerformBufferedOperation(const InstallOperation& operation,
+                                ErrorCode* error);
 
   // These perform a specific type of operation and return true on success.
   // |error| will be set if source hash mismatch, otherwise |error| might not be
   // set even if it fails.
-  bool PerformReplaceOperation(const InstallOperation& operation);
+  bool PerformReplaceOperation(const InstallOperation& operation,
+                               const void* data,
+                               size_t count);
   bool PerformZeroOrDiscardOperation(const InstallOperation& operation);
   bool PerformSourceCopyOperation(const InstallOperation& operation,
                                   ErrorCode* error);
   bool PerformSourceBsdiffOperation(const InstallOperation& operation,
+                                    const void* data,
+                                    size_t count,
                                     ErrorCode* error);
   bool PerformPuffDiffOperation(const InstallOperation& operation,
+                                const void* data,
+                                size_t count,
                                 ErrorCode* error);
 
+  // Returns whether the device wants to optimize the SOURCE_COPY |operation|,
+  // which only the serial path knows how to apply.
+  bool IsOptimizedSourceCopy(const InstallOperation& operation);
+
+  // Returns whether |operation|, whose data blob is in |buffer_|, can be
+  // queued for the apply workers instead of being applied right away.
+  bool CanQueueOperation(const InstallOperation& operation);
+
+  // Plans the run of SOURCE_COPY operations of the current partition starting
+  // at |partition_operation_num| in |source_copy_planner_|. Returns the number
+  // of operations planned.
+  size_t PlanSourceCopies(size_t partition_operation_num);
+
+  // Applies the operations planned by PlanSourceCopies(), retries the ones
+  // that failed on their own and checkpoints the progress. Returns false if
+  // any of them couldn't be applied.
+  bool ApplyPlannedSourceCopies(ErrorCode* error);
+
+  // Queues the operations of the current partition up to
+  // |source_hash_prefetch_depth_| past |partition_operation_num| in
+  // |source_hash_prefetcher_|, if set.
+  void PrefetchSourceHashes(size_t partition_operation_num);
+
+  // Asks the kernel to read the source of the operation following
+  // |partition_operation_num| in the current partition, if it is a diff
+  // operation and |source_mapping_| is set.
+  void AdviseNextSource(size_t partition_operation_num);
+
+  // Applies the operations queued for the apply workers, retries the ones they
+  // failed on the calling thread and checkpoints the progress. Returns false
+  // if any of them couldn't be applied.
+  bool ApplyQueuedOperations(ErrorCode* error);
+
+  // Reports the target extents of |operations|, applied and flushed, to
+  // |target_hasher_|, if set.
+  void HashAppliedOperations(
+      const std::vector<const InstallOperation*>& operations);
+
   // For a given operation, choose the source fd to be used (raw device or error
   // correction device) based on the source operation hash.
   // Returns nullptr if the source hash mismatch cannot be corrected, and set
@@ -275,15 +434,32 @@ class DeltaPerformer : public FileWriter {
   // Updates the payload hash calculator with the bytes in |buffer_|, also
   // updates the signed hash calculator with the first |signed_hash_buffer_size|
   // bytes in |buffer_|. Then discard the content, ensuring that memory is being
-  // deallocated. If |do_advance_offset|, advances the internal offset counter
-  // accordingly.
-  void DiscardBuffer(bool do_advance_offset, size_t signed_hash_buffer_size);
+  // deallocated, or move it to |out_buffer| if not null. If
+  // |do_advance_offset|, advances the internal offset counter accordingly.
+  void DiscardBuffer(bool do_advance_offset,
+                     size_t signed_hash_buffer_size,
+                     brillo::Blob* out_buffer = nullptr);
 
   // Checkpoints the update progress into persistent storage to allow this
   // update attempt to be resumed after reboot.
   // If |force| is false, checkpoint may be throttled.
   bool CheckpointUpdateProgress(bool force);
 
+  // Records |operation|, the |operation_num|-th of the payload, applied on
+  // this thread since |start|, and the step |name| done since |start|, on
+  // |apply_tracer_| if set.
+  void TraceOperation(const InstallOperation& operation,
+                      size_t operation_num,
+                      base::TimeTicks start);
+  void TraceStep(const std::string& name, base::TimeTicks start);
+
+  // Waits for the data written to the target partition to reach the storage,
+  // unless the update is interactive. Returns false on error.
+  bool SyncTarget();
+
+  // Returns the default number of threads used to apply the operations.
+  static size_t DefaultMaxApplyThreads();
+
   // Primes the required update state. Returns true if the update state was
   // successfully initialized to a saved resume state or if the update is a new
   // update. Returns false otherwise.
@@ -361,6 +537,66 @@ class DeltaPerformer : public FileWriter {
   std::string source_path_;
   std::string target_path_;
 
+  // Applies the operations on the calling thread. Set once the block size is
+  // known.
+  std::unique_ptr<InstallOperationExecutor> executor_;
+
+  // Applies batches of non-overlapping operations of the current partition on
+  // worker threads. Only set while performing the operations of a partition
+  // and |max_apply_threads_| is greater than 1.
+  std::unique_ptr<ParallelOperationExecutor> parallel_executor_;
+  size_t max_apply_threads_{DefaultMaxApplyThreads()};
+
+  // The scratch objects used to apply the diff operations of the current
+  // partition on this thread.
+  std::unique_ptr<PatchArena> patch_arena_;
+  size_t patch_arena_max_source_size_{PatchArena::kDefaultMaxSourceSize};
+  size_t patch_arena_cache_size_{PatchArena::kDefaultPuffpatchCacheSize};
+
+  // Merges the source reads of runs of SOURCE_COPY operations. Set once the
+  // block size is known.
+  std::unique_ptr<SourceCopyPlanner> source_copy_planner_;
+
+  // Verifies the source data of the next |source_hash_prefetch_depth_|
+  // operations of the current partition in the background. Only set while
+  // performing the operations of a partition with a source, without
+  // |parallel_executor_|, whose workers verify their own source data.
+  std::unique_ptr<SourceHashPrefetcher> source_hash_prefetcher_;
+  size_t source_hash_prefetch_depth_{
+      SourceHashPrefetcher::kDefaultPrefetchDepth};
+  // Index in the whole payload of the next operation to prefetch.
+  size_t next_prefetched_operation_num_{0};
+  // Number of operations that used the source data verified ahead.
+  size_t source_hash_prefetch_hits_{0};
+
+  // Traces the apply to |apply_trace_path_|. Only set when the path isn't
+  // empty, once the manifest is parsed.
+  std::unique_ptr<ApplyTracer> apply_tracer_;
+  std::string apply_trace_path_;
+  // When the current partition was opened.
+  base::TimeTicks partition_start_time_;
+
+  // Shares the source data of the operations left to apply, across all the
+  // partitions. Only set for delta payloads, when |source_data_cache_size_| is
+  // not 0.
+  std::unique_ptr<SourceDataCache> source_data_cache_;
+  size_t source_data_cache_size_{SourceDataCache::kDefaultMaxBytes};
+
+  // The mapping of the source partition the diff sources are read from. Only
+  // set while performing the operations of a partition with a source, when
+  // |map_source_partition_| is true.
+  std::shared_ptr<const MappedPartition> source_mapping_;
+  bool map_source_partition_{false};
+  // Index in the current partition of the last operation whose source was
+  // advised to the kernel, or 0.
+  size_t next_advised_operation_num_{0};
+
+  // Hashes the target partition as its operations are applied. Only set while
+  // performing the operations of a partition. The resulting hash is stored in
+  // the install plan when the partition is closed.
+  std::unique_ptr<TargetHasher> target_hasher_;
+  bool hash_target_while_applying_{true};
+
   PayloadMetadata payload_metadata_;
 
   // Parsed manifest. Set after enough bytes to parse the manifest were
@@ -397,10 +633,18 @@ class DeltaPerformer : public FileWriter {
   // A buffer used for accumulating downloaded data. Initially, it stores the
   // payload metadata; once that's downloaded and parsed, it stores data for the
   // next update operation.
-  brillo::Blob buffer_;
+  PayloadBuffer buffer_;
   // Offset of buffer_ in the binary blobs section of the update.
   uint64_t buffer_offset_{0};
 
+  // The replace operation whose data blob is written to the target as it is
+  // received, if any: the writer, the number of bytes of the blob already
+  // written and discarded from |buffer_|, and the hash of these bytes when
+  // hash checks are mandatory.
+  std::unique_ptr<ExtentWriter> streamed_op_writer_;
+  uint64_t streamed_op_bytes_{0};
+  std::unique_ptr<HashCalculator> streamed_op_hash_calculator_;
+
   // Last |buffer_offset_| value updated as part of the progress update.
   uint64_t last_updated_buffer_offset_{std::numeric_limits<uint64_t>::max()};
 
@@ -443,10 +687,15 @@ class DeltaPerformer : public FileWriter {
   const base::TimeDelta forced_progress_log_wait_{kProgressLogTimeoutTime};
   base::TimeTicks forced_progress_log_time_;
 
-  // The frequency that we should write an update checkpoint (constant), and
-  // the point in time at which the next checkpoint should be written.
+  // The frequency that we should write an update checkpoint, and the point in
+  // time at which the next checkpoint should be written.
   const base::TimeDelta update_checkpoint_wait_{kCheckpointFrequencyTime};
   base::TimeTicks update_checkpoint_time_;
+
+  // The amount of data written to the target partition since it was last
+  // synced, and the amount after which a checkpoint is forced.
+  uint64_t unsynced_bytes_{0};
+  const uint64_t max_unsynced_bytes_{kCheckpointMaxUnsyncedBytes};
 };
 
 }  // namespace chromeos_update_engine
@@ -0,0 +1,397 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+
+#include <base/functional/callback.h>
+#include <base/json/json_reader.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <base/values.h>
+#include <brillo/flag_helper.h>
+#include <xz.h>
+
+#include "update_engine/common/fake_boot_control.h"
+#include "update_engine/common/fake_hardware.h"
+#include "update_engine/common/prefs.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/delta_performer.h"
+#include "update_engine/payload_consumer/install_plan.h"
+#include "update_engine/payload_consumer/payload_constants.h"
+#include "update_engine/payload_generator/delta_diff_generator.h"
+#include "update_engine/payload_generator/payload_generation_config.h"
+#include "update_engine/payload_generator/xz.h"
+
+// This program measures applying full and delta payloads end to end through
+// DeltaPerformer. It generates a source and a target image, or uses the ones
+// passed, builds both payloads with the generator and applies each of them to
+// a file-backed target, reporting the throughput, the CPU time and the peak
+// RSS of the apply, and where the time went by operation type.
+//
+// The synthetic images are made of 64 KiB regions of zeros, text-like and
+// random data. The target changes |churn_percent| of the regions by editing a
+// few bytes, rewriting them or moving them. The same seed always generates the
+// same images, hence the same payloads and operations, so runs can be compared
+// against a baseline.
+//
+// Each step runs in a child process, so the peak RSS is the one of the apply
+// alone.
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+const uint32_t kBlockSize = 4096;
+const size_t kRegionSize = 64 * 1024;
+const char kPartitionName[] = "root";
+
+// Words the text-like regions are made of.
+const char* const kWords[] = {"update", "engine", "payload", "partition",
+                              "block",  "extent", "source", "target",
+                              "hash",   "delta",  "\n",     " "};
+
+// Fills |region| with data of a kind picked by |random|.
+void FillRegion(std::mt19937* random, uint8_t* region) {
+  uint32_t kind = (*random)() % 10;
+  if (kind < 2) {
+    std::fill(region, region + kRegionSize, 0);
+  } else if (kind < 6) {
+    size_t offset = 0;
+    while (offset < kRegionSize) {
+      const char* word = kWords[(*random)() % std::size(kWords)];
+      for (; *word && offset < kRegionSize; word++)
+        region[offset++] = *word;
+    }
+  } else {
+    for (size_t offset = 0; offset < kRegionSize; offset++)
+      region[offset] = (*random)() & 0xff;
+  }
+}
+
+// Writes the synthetic source and target images of |size| bytes.
+bool GenerateImages(uint64_t size,
+                    int churn_percent,
+                    uint32_t seed,
+                    const string& source_path,
+                    const string& target_path) {
+  std::mt19937 random(seed);
+  brillo::Blob source(size);
+  for (uint64_t offset = 0; offset < size; offset += kRegionSize)
+    FillRegion(&random, source.data() + offset);
+
+  brillo::Blob target = source;
+  const uint64_t num_regions = size / kRegionSize;
+  for (uint64_t i = 0; i < num_regions; i++) {
+    if (static_cast<int>(random() % 100) >= churn_percent)
+      continue;
+    uint8_t* region = target.data() + i * kRegionSize;
+    switch (random() % 4) {
+      case 0:
+      case 1:
+        // A few bytes edited, as in a rebuilt binary.
+        for (int j = 0; j < 16; j++)
+          region[random() % kRegionSize] ^= 0x5a;
+        break;
+      case 2:
+        FillRegion(&random, region);
+        break;
+      case 3:
+        // Moved from another region of the source.
+        std::copy_n(source.data() + (random() % num_regions) * kRegionSize,
+                    kRegionSize,
+                    region);
+        break;
+    }
+  }
+  return utils::WriteFile(source_path.c_str(), source.data(), source.size()) &&
+         utils::WriteFile(target_path.c_str(), target.data(), target.size());
+}
+
+// Writes the full, or delta, payload from |source_path| to |target_path| in
+// |payload_path|.
+bool GeneratePayload(bool is_delta,
+                     const string& source_path,
+                     const string& target_path,
+                     const string& payload_path) {
+  XzCompressInit();
+  PayloadGenerationConfig config;
+  config.is_delta = is_delta;
+  config.block_size = kBlockSize;
+  config.version.major = kBrilloMajorPayloadVersion;
+  config.version.minor =
+      is_delta ? kMaxSupportedMinorPayloadVersion : kFullPayloadMinorVersion;
+  config.target.partitions.emplace_back(kPartitionName);
+  config.target.partitions.back().path = target_path;
+  TEST_AND_RETURN_FALSE(config.target.LoadImageSize());
+  if (is_delta) {
+    config.source.partitions.emplace_back(kPartitionName);
+    config.source.partitions.back().path = source_path;
+    TEST_AND_RETURN_FALSE(config.source.LoadImageSize());
+    for (PartitionConfig& part : config.source.partitions)
+      TEST_AND_RETURN_FALSE(part.OpenFilesystem());
+    for (PartitionConfig& part : config.target.partitions)
+      TEST_AND_RETURN_FALSE(part.OpenFilesystem());
+  }
+  config.rootfs_partition_size = config.target.partitions.back().size;
+  TEST_AND_RETURN_FALSE(config.Validate());
+  uint64_t metadata_size;
+  return GenerateUpdatePayloadFile(config, payload_path, "", &metadata_size);
+}
+
+// The settings of the DeltaPerformer.
+struct ApplySettings {
+  int apply_threads;
+  int prefetch_depth;
+  int source_data_cache_mib;
+  bool map_source;
+  size_t write_size;
+};
+
+// Time and amount of data written by the operations of one type.
+struct OperationStats {
+  int count{0};
+  double seconds{0};
+  double written_bytes{0};
+};
+
+// Sums the operation events of the trace at |trace_path| by type.
+std::map<string, OperationStats> ReadOperationStats(const string& trace_path) {
+  std::map<string, OperationStats> stats;
+  string trace;
+  if (!utils::ReadFile(trace_path, &trace))
+    return stats;
+  std::optional<base::Value> events = base::JSONReader::Read(trace);
+  if (!events || !events->is_list())
+    return stats;
+  for (const base::Value& event : events->GetList()) {
+    const base::Value::Dict& dict = event.GetDict();
+    const string* category = dict.FindString("cat");
+    const string* name = dict.FindString("name");
+    const base::Value::Dict* args = dict.FindDict("args");
+    if (!category || *category != "operation" || !name || !args)
+      continue;
+    OperationStats& type_stats = stats[*name];
+    type_stats.count++;
+    type_stats.seconds += dict.FindDouble("dur").value_or(0) / 1e6;
+    type_stats.written_bytes += args->FindDouble("dst_bytes").value_or(0);
+  }
+  return stats;
+}
+
+// Applies the payload at |payload_path| from |source_path|, if not empty, to
+// |target_path|, tracing the operations to |trace_path|.
+bool ApplyPayload(const string& payload_path,
+                  bool is_delta,
+                  const string& source_path,
+                  const string& target_path,
+                  const string& trace_path,
+                  const ApplySettings& settings) {
+  xz_crc32_init();
+  FakeBootControl boot_control;
+  FakeHardware hardware;
+  MemoryPrefs prefs;
+  InstallPlan install_plan;
+  install_plan.source_slot = is_delta ? 0 : BootControlInterface::kInvalidSlot;
+  install_plan.target_slot = 1;
+  install_plan.hash_checks_mandatory = true;
+  InstallPlan::Payload payload;
+  payload.size = utils::FileSize(payload_path);
+  payload.type =
+      is_delta ? InstallPayloadType::kDelta : InstallPayloadType::kFull;
+  install_plan.payloads = {payload};
+  boot_control.SetPartitionDevice(
+      kPartitionName, install_plan.target_slot, target_path);
+  if (is_delta) {
+    boot_control.SetPartitionDevice(
+        kPartitionName, install_plan.source_slot, source_path);
+  }
+
+  DeltaPerformer performer(&prefs,
+                           &boot_control,
+                           &hardware,
+                           nullptr,
+                           &install_plan,
+                           &install_plan.payloads[0],
+                           true /* interactive */);
+  performer.set_public_key_path("");
+  performer.set_max_apply_threads(settings.apply_threads);
+  performer.set_source_hash_prefetch_depth(settings.prefetch_depth);
+  performer.set_source_data_cache_size(
+      static_cast<size_t>(settings.source_data_cache_mib) * 1024 * 1024);
+  performer.set_map_source_partition(settings.map_source);
+  performer.set_apply_trace_path(trace_path);
+
+  FileDescriptorPtr payload_fd(new EintrSafeFileDescriptor());
+  TEST_AND_RETURN_FALSE(payload_fd->Open(payload_path.c_str(), O_RDONLY));
+  brillo::Blob buffer(settings.write_size);
+  ErrorCode error = ErrorCode::kSuccess;
+  for (;;) {
+    ssize_t count = payload_fd->Read(buffer.data(), buffer.size());
+    TEST_AND_RETURN_FALSE(count >= 0);
+    if (count == 0)
+      break;
+    if (!performer.Write(buffer.data(), count, &error)) {
+      LOG(ERROR) << "Applying " << payload_path << " failed with error "
+                 << static_cast<int>(error);
+      return false;
+    }
+  }
+  return performer.Close() == 0;
+}
+
+// Runs |step| in a child process and waits for it. Sets |usage|, if not null,
+// to the resources used by the child. Returns whether the step succeeded.
+bool RunInChild(base::OnceCallback<bool()> step, struct rusage* usage) {
+  fflush(stdout);
+  pid_t pid = fork();
+  PCHECK(pid >= 0) << "fork() failed";
+  if (pid == 0) {
+    bool success = std::move(step).Run();
+    fflush(stdout);
+    _exit(success ? 0 : 1);
+  }
+  int status;
+  struct rusage child_usage;
+  PCHECK(wait4(pid, &status, 0, &child_usage) == pid);
+  if (usage)
+    *usage = child_usage;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+double Seconds(const struct timeval& time) {
+  return time.tv_sec + time.tv_usec / 1e6;
+}
+
+int Main(int argc, char** argv) {
+  DEFINE_string(source_image,
+                "",
+                "Source image to use instead of a synthetic one, such as an "
+                "ext4 or squashfs image. Requires --target_image.");
+  DEFINE_string(target_image, "", "Target image to use with --source_image.");
+  DEFINE_int32(image_mib, 128, "Size of the synthetic images, in MiB.");
+  DEFINE_int32(churn_percent, 10, "Percentage of the regions changed.");
+  DEFINE_int32(seed, 1, "Seed of the synthetic images.");
+  DEFINE_int32(apply_threads, 1, "Threads applying the operations.");
+  DEFINE_int32(prefetch_depth, 0, "Operations whose source is verified ahead.");
+  DEFINE_int32(source_data_cache_mib, 0, "Shared source data kept, in MiB.");
+  DEFINE_bool(map_source, false, "Read the diff sources through a mapping.");
+  DEFINE_int32(write_kib, 1024, "Size of each write of the payload, in KiB.");
+  brillo::FlagHelper::Init(
+      argc,
+      argv,
+      "Measures applying full and delta payloads through DeltaPerformer.");
+  CHECK_GT(FLAGS_image_mib, 0);
+  CHECK(FLAGS_churn_percent >= 0 && FLAGS_churn_percent <= 100);
+  CHECK_GT(FLAGS_write_kib, 0);
+  CHECK_EQ(FLAGS_source_image.empty(), FLAGS_target_image.empty());
+
+  ScopedTempFile source_file("benchmark_source.XXXXXX");
+  ScopedTempFile target_file("benchmark_target.XXXXXX");
+  string source_path = FLAGS_source_image;
+  string target_path = FLAGS_target_image;
+  if (source_path.empty()) {
+    source_path = source_file.path();
+    target_path = target_file.path();
+    CHECK(RunInChild(base::BindOnce(&GenerateImages,
+                                    static_cast<uint64_t>(FLAGS_image_mib) *
+                                        1024 * 1024,
+                                    FLAGS_churn_percent,
+                                    FLAGS_seed,
+                                    source_path,
+                                    target_path),
+                     nullptr));
+  }
+  const uint64_t target_size = utils::FileSize(target_path);
+  CHECK_GT(target_size, 0U);
+
+  const ApplySettings settings = {
+      .apply_threads = FLAGS_apply_threads,
+      .prefetch_depth = FLAGS_prefetch_depth,
+      .source_data_cache_mib = FLAGS_source_data_cache_mib,
+      .map_source = FLAGS_map_source,
+      .write_size = static_cast<size_t>(FLAGS_write_kib) * 1024,
+  };
+  for (bool is_delta : {false, true}) {
+    ScopedTempFile payload_file("benchmark_payload.XXXXXX");
+    ScopedTempFile result_file("benchmark_result.XXXXXX");
+    ScopedTempFile trace_file("benchmark_trace.XXXXXX");
+    CHECK(RunInChild(base::BindOnce(&GeneratePayload,
+                                    is_delta,
+                                    source_path,
+                                    target_path,
+                                    payload_file.path()),
+                     nullptr));
+    CHECK_EQ(0, truncate(result_file.path().c_str(), target_size));
+
+    struct rusage usage;
+    base::TimeTicks start = base::TimeTicks::Now();
+    CHECK(RunInChild(base::BindOnce(&ApplyPayload,
+                                    payload_file.path(),
+                                    is_delta,
+                                    source_path,
+                                    result_file.path(),
+                                    trace_file.path(),
+                                    settings),
+                     &usage));
+    double seconds = (base::TimeTicks::Now() - start).InSecondsF();
+    brillo::Blob expected, actual;
+    CHECK(utils::ReadFile(target_path, &expected));
+    CHECK(utils::ReadFile(result_file.path(), &actual));
+    CHECK(expected == actual) << "The applied target doesn't match.";
+
+    printf("%s payload, %" PRIu64 " bytes:\n",
+           is_delta ? "Delta" : "Full",
+           utils::FileSize(payload_file.path()));
+    printf("  %10.1f MiB/s  %8.2f s wall  %8.2f s CPU  %8ld KiB peak RSS\n",
+           target_size / (1024.0 * 1024.0) / seconds,
+           seconds,
+           Seconds(usage.ru_utime) + Seconds(usage.ru_stime),
+           usage.ru_maxrss);
+    for (const auto& [type, stats] : ReadOperationStats(trace_file.path())) {
+      printf("  %-14s %6d ops %10.1f MiB %8.2f s  %10.1f MiB/s per thread\n",
+             type.c_str(),
+             stats.count,
+             stats.written_bytes / (1024 * 1024),
+             stats.seconds,
+             stats.seconds > 0
+                 ? stats.written_bytes / (1024 * 1024) / stats.seconds
+                 : 0.0);
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+}  // namespace chromeos_update_engine
+
+int main(int argc, char** argv) {
+  return chromeos_update_engine::Main(argc, argv);
+}
@@ -19,6 +19,7 @@
 #include <endian.h>
 #include <inttypes.h>
 
+#include <algorithm>
 #include <iterator>
 #include <memory>
 #include <string>
@@ -306,8 +307,16 @@ class DeltaPerformerTest : public ::testing::Test {
         kPartitionNameKernel, install_plan_.source_slot, "/dev/null");
     install_plan_.signature_checks_mandatory = false;
 
-    EXPECT_EQ(expect_success,
-              performer_.Write(payload_data.data(), payload_data.size()));
+    bool result = true;
+    size_t chunk_size =
+        write_chunk_size_ ? write_chunk_size_ : payload_data.size();
+    for (size_t offset = 0; offset < payload_data.size() && result;
+         offset += chunk_size) {
+      result = performer_.Write(
+          payload_data.data() + offset,
+          std::min(chunk_size, payload_data.size() - offset));
+    }
+    EXPECT_EQ(expect_success, result);
     EXPECT_EQ(0, performer_.Close());
 
     brillo::Blob partition_data;
@@ -433,6 +442,15 @@ class DeltaPerformerTest : public ::testing::Test {
     return performer_.source_ecc_recovered_failures_;
   }
 
+  size_t GetSourceHashPrefetchHits() const {
+    return performer_.source_hash_prefetch_hits_;
+  }
+
+  size_t GetSourceDataCacheHits() const {
+    const auto& cache = performer_.source_data_cache_;
+    return cache ? cache->num_hits() : 0;
+  }
+
   FakePrefs prefs_;
   InstallPlan install_plan_;
   InstallPlan::Payload payload_;
@@ -440,6 +458,9 @@ class DeltaPerformerTest : public ::testing::Test {
   FakeHardware fake_hardware_;
   MockDownloadActionDelegate mock_delegate_;
   FileDescriptorPtr fake_ecc_fd_;
+  // Size of the chunks passed to performer_.Write() when applying a payload,
+  // the whole payload is passed at once if 0.
+  size_t write_chunk_size_{0};
   DeltaPerformer performer_{&prefs_,
                             &fake_boot_control_,
                             &fake_hardware_,
@@ -515,6 +536,42 @@ TEST_F(DeltaPerformerTest, ReplaceOperationTest) {
   EXPECT_EQ(expected_data, ApplyPayload(payload_data, "/dev/null", true));
 }
 
+// Test that operations applied by the workers, including ones writing to the
+// same blocks, give the same result as applying them in order.
+TEST_F(DeltaPerformerTest, ParallelReplaceOperationsTest) {
+  const size_t kNumBlocks = 16;
+  brillo::Blob blob_data;
+  brillo::Blob expected_data(kNumBlocks * 4096);
+  vector<AnnotatedOperation> aops;
+  for (size_t i = 0; i < kNumBlocks; i++) {
+    AnnotatedOperation aop;
+    *(aop.op.add_dst_extents()) = ExtentForRange(i, 1);
+    aop.op.set_data_offset(blob_data.size());
+    aop.op.set_data_length(4096);
+    aop.op.set_type(InstallOperation::REPLACE);
+    aops.push_back(aop);
+    blob_data.insert(blob_data.end(), 4096, 'a' + i);
+  }
+  // Overwrite the first blocks, which must be done after the operations above.
+  AnnotatedOperation aop;
+  *(aop.op.add_dst_extents()) = ExtentForRange(0, 2);
+  aop.op.set_data_offset(blob_data.size());
+  aop.op.set_data_length(2 * 4096);
+  aop.op.set_type(InstallOperation::REPLACE);
+  aops.push_back(aop);
+  blob_data.insert(blob_data.end(), 2 * 4096, 'z');
+
+  std::copy(blob_data.begin(),
+            blob_data.begin() + expected_data.size(),
+            expected_data.begin());
+  std::fill(expected_data.begin(), expected_data.begin() + 2 * 4096, 'z');
+
+  brillo::Blob payload_data = GeneratePayload(blob_data, aops, false);
+
+  performer_.set_max_apply_threads(4);
+  EXPECT_EQ(expected_data, ApplyPayload(payload_data, "/dev/null", true));
+}
+
 TEST_F(DeltaPerformerTest, ReplaceBzOperationTest) {
   brillo::Blob expected_data =
       brillo::Blob(std::begin(kRandomString), std::end(kRandomString));
@@ -555,6 +612,52 @@ TEST_F(DeltaPerformerTest, ReplaceXzOperationTest) {
   EXPECT_EQ(expected_data, ApplyPayload(payload_data, "/dev/null", true));
 }
 
+// Test that a large replace operation received in several chunks is applied
+// as its data arrives, with its hash checked at the end.
+TEST_F(DeltaPerformerTest, StreamedReplaceOperationTest) {
+  brillo::Blob expected_data(DeltaPerformer::kMinStreamedOperationSize + 4096);
+  test_utils::FillWithData(&expected_data);
+
+  AnnotatedOperation aop;
+  *(aop.op.add_dst_extents()) = ExtentForRange(0, expected_data.size() / 4096);
+  aop.op.set_data_offset(0);
+  aop.op.set_data_length(expected_data.size());
+  aop.op.set_type(InstallOperation::REPLACE);
+  vector<AnnotatedOperation> aops = {aop};
+
+  brillo::Blob payload_data = GeneratePayload(expected_data, aops, false);
+
+  install_plan_.hash_checks_mandatory = true;
+  write_chunk_size_ = 64 * 1024;
+  EXPECT_EQ(expected_data, ApplyPayload(payload_data, "/dev/null", true));
+}
+
+TEST_F(DeltaPerformerTest, StreamedReplaceOperationHashMismatchTest) {
+  brillo::Blob blob_data(DeltaPerformer::kMinStreamedOperationSize);
+  test_utils::FillWithData(&blob_data);
+
+  AnnotatedOperation aop;
+  *(aop.op.add_dst_extents()) = ExtentForRange(0, blob_data.size() / 4096);
+  aop.op.set_data_offset(0);
+  aop.op.set_data_length(blob_data.size());
+  aop.op.set_type(InstallOperation::REPLACE);
+  vector<AnnotatedOperation> aops = {aop};
+
+  brillo::Blob payload_data = GeneratePayload(blob_data, aops, false);
+  // Corrupt the end of the data blob, which is only detected once the rest
+  // was written.
+  payload_data[payload_.metadata_size + blob_data.size() - 1] ^= 0xff;
+
+  install_plan_.hash_checks_mandatory = true;
+  write_chunk_size_ = 64 * 1024;
+  ApplyPayload(payload_data, "/dev/null", false);
+  // The progress wasn't checkpointed past the operation.
+  int64_t next_operation = 0;
+  EXPECT_FALSE(prefs_.GetInt64(kPrefsUpdateStateNextOperation,
+                               &next_operation) &&
+               next_operation > 0);
+}
+
 TEST_F(DeltaPerformerTest, ZeroOperationTest) {
   brillo::Blob existing_data = brillo::Blob(4096 * 10, 'a');
   brillo::Blob expected_data = existing_data;
@@ -602,6 +705,60 @@ TEST_F(DeltaPerformerTest, SourceCopyOperationTest) {
   EXPECT_EQ(expected_data, ApplyPayload(payload_data, source.path(), true));
 }
 
+// Test that the source data of an operation applied on this thread was
+// verified ahead, which is enabled by default.
+TEST_F(DeltaPerformerTest, SourceCopyOperationPrefetchTest) {
+  performer_.set_max_apply_threads(1);
+  constexpr size_t kCopyOperationSize = 4 * 4096;
+  brillo::Blob expected_data = FakeFileDescriptorData(kCopyOperationSize);
+  ScopedTempFile source("Source-XXXXXX");
+  EXPECT_TRUE(test_utils::WriteFileVector(source.path(), expected_data));
+
+  PartitionConfig old_part(kPartitionNameRoot);
+  old_part.path = source.path();
+  old_part.size = expected_data.size();
+
+  brillo::Blob payload_data =
+      GenerateSourceCopyPayload(expected_data, true, &old_part);
+  EXPECT_EQ(expected_data, ApplyPayload(payload_data, source.path(), true));
+  EXPECT_EQ(1U, GetSourceHashPrefetchHits());
+}
+
+// Test that the source data shared by two operations is only read once, which
+// is enabled by default.
+TEST_F(DeltaPerformerTest, SourceCopyOperationSharedSourceTest) {
+  performer_.set_max_apply_threads(1);
+  constexpr size_t kCopyOperationSize = 4 * 4096;
+  brillo::Blob source_data = FakeFileDescriptorData(kCopyOperationSize);
+  ScopedTempFile source("Source-XXXXXX");
+  EXPECT_TRUE(test_utils::WriteFileVector(source.path(), source_data));
+  brillo::Blob src_hash;
+  EXPECT_TRUE(HashCalculator::RawHashOfData(source_data, &src_hash));
+
+  // Both operations copy the same source blocks to different target blocks.
+  vector<AnnotatedOperation> aops;
+  for (uint64_t start_block : {0, 4}) {
+    AnnotatedOperation aop;
+    *(aop.op.add_src_extents()) = ExtentForRange(0, 4);
+    *(aop.op.add_dst_extents()) = ExtentForRange(start_block, 4);
+    aop.op.set_type(InstallOperation::SOURCE_COPY);
+    aop.op.set_src_sha256_hash(src_hash.data(), src_hash.size());
+    aops.push_back(aop);
+  }
+
+  PartitionConfig old_part(kPartitionNameRoot);
+  old_part.path = source.path();
+  old_part.size = source_data.size();
+
+  brillo::Blob payload_data =
+      GeneratePayload(brillo::Blob(), aops, false, &old_part);
+  brillo::Blob expected_data = source_data;
+  expected_data.insert(
+      expected_data.end(), source_data.begin(), source_data.end());
+  EXPECT_EQ(expected_data, ApplyPayload(payload_data, source.path(), true));
+  EXPECT_EQ(1U, GetSourceDataCacheHits());
+}
+
 TEST_F(DeltaPerformerTest, PuffdiffOperationTest) {
   AnnotatedOperation aop;
   *(aop.op.add_src_extents()) = ExtentForRange(0, 1);
@@ -631,6 +788,36 @@ TEST_F(DeltaPerformerTest, PuffdiffOperationTest) {
   EXPECT_EQ(dst, ApplyPayload(payload_data, source.path(), true));
 }
 
+TEST_F(DeltaPerformerTest, PuffdiffOperationMappedSourceTest) {
+  AnnotatedOperation aop;
+  *(aop.op.add_src_extents()) = ExtentForRange(0, 1);
+  *(aop.op.add_dst_extents()) = ExtentForRange(0, 1);
+  brillo::Blob puffdiff_payload(std::begin(puffdiff_patch),
+                                std::end(puffdiff_patch));
+  aop.op.set_data_offset(0);
+  aop.op.set_data_length(puffdiff_payload.size());
+  aop.op.set_type(InstallOperation::PUFFDIFF);
+  brillo::Blob src(std::begin(src_deflates), std::end(src_deflates));
+  src.resize(4096);  // block size
+  brillo::Blob src_hash;
+  EXPECT_TRUE(HashCalculator::RawHashOfData(src, &src_hash));
+  aop.op.set_src_sha256_hash(src_hash.data(), src_hash.size());
+
+  ScopedTempFile source("Source-XXXXXX");
+  EXPECT_TRUE(test_utils::WriteFileVector(source.path(), src));
+
+  PartitionConfig old_part(kPartitionNameRoot);
+  old_part.path = source.path();
+  old_part.size = src.size();
+
+  brillo::Blob payload_data =
+      GeneratePayload(puffdiff_payload, {aop}, false, &old_part);
+
+  performer_.set_map_source_partition(true);
+  brillo::Blob dst(std::begin(dst_deflates), std::end(dst_deflates));
+  EXPECT_EQ(dst, ApplyPayload(payload_data, source.path(), true));
+}
+
 TEST_F(DeltaPerformerTest, SourceHashMismatchTest) {
   brillo::Blob expected_data = {'f', 'o', 'o'};
   brillo::Blob actual_data = {'b', 'a', 'r'};
@@ -885,6 +1072,21 @@ TEST_F(DeltaPerformerTest, ValidateManifestBadMinorVersion) {
                         ErrorCode::kUnsupportedMinorPayloadVersion);
 }
 
+TEST_F(DeltaPerformerTest, ValidateManifestSkippedMinorVersion) {
+  // The Manifest we are validating.
+  DeltaArchiveManifest manifest;
+
+  // Minor version 9 is in the supported range, but was skipped.
+  manifest.set_minor_version(9);
+  // Mark the manifest as a delta payload by setting |old_partition_info|.
+  manifest.add_partitions()->mutable_old_partition_info();
+
+  RunManifestValidation(manifest,
+                        kMaxSupportedMajorPayloadVersion,
+                        InstallPayloadType::kDelta,
+                        ErrorCode::kUnsupportedMinorPayloadVersion);
+}
+
 TEST_F(DeltaPerformerTest, ValidateManifestDowngrade) {
   // The Manifest we are validating.
   DeltaArchiveManifest manifest;
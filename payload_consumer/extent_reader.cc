@@ -35,7 +35,11 @@ bool DirectExtentReader::Init(FileDescriptorPtr fd,
   extents_ = extents;
   block_size_ = block_size;
   cur_extent_ = extents_.begin();
+  cur_extent_bytes_read_ = 0;
+  offset_ = 0;
+  total_size_ = 0;
 
+  extents_upper_bounds_.clear();
   extents_upper_bounds_.reserve(extents_.size() + 1);
   // We add this pad as the first element to not bother with boundary checks
   // later.
@@ -66,6 +70,9 @@ bool DirectExtentReader::Seek(uint64_t offset) {
 
 bool DirectExtentReader::Read(void* buffer, size_t count) {
   auto bytes = reinterpret_cast<uint8_t*>(buffer);
+  // Read the parts of all the extents covered at once, so the file descriptor
+  // can submit them together.
+  requests_.clear();
   uint64_t bytes_read = 0;
   while (bytes_read < count) {
     if (cur_extent_ == extents_.end()) {
@@ -76,15 +83,11 @@ bool DirectExtentReader::Read(void* buffer, size_t count) {
     uint64_t bytes_to_read =
         std::min(count - bytes_read, cur_extent_bytes_left);
 
-    ssize_t out_bytes_read;
-    TEST_AND_RETURN_FALSE(utils::PReadAll(
-        fd_,
-        bytes + bytes_read,
-        bytes_to_read,
-        cur_extent_->start_block() * block_size_ + cur_extent_bytes_read_,
-        &out_bytes_read));
-    TEST_AND_RETURN_FALSE(out_bytes_read ==
-                          static_cast<ssize_t>(bytes_to_read));
+    requests_.push_back(
+        {bytes + bytes_read,
+         static_cast<size_t>(bytes_to_read),
+         static_cast<off64_t>(cur_extent_->start_block() * block_size_ +
+                              cur_extent_bytes_read_)});
 
     bytes_read += bytes_to_read;
     cur_extent_bytes_read_ += bytes_to_read;
@@ -95,7 +98,7 @@ bool DirectExtentReader::Read(void* buffer, size_t count) {
       cur_extent_bytes_read_ = 0;
     }
   }
-  return true;
+  return requests_.empty() || fd_->ReadBatch(requests_);
 }
 
 }  // namespace chromeos_update_engine
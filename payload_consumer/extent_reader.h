@@ -52,6 +52,8 @@ class DirectExtentReader : public ExtentReader {
 
   ~DirectExtentReader() override = default;
 
+  // Init() can be called again to read other extents, reusing the storage of
+  // the reader.
   bool Init(FileDescriptorPtr fd,
             const google::protobuf::RepeatedPtrField<Extent>& extents,
             uint32_t block_size) override;
@@ -76,6 +78,9 @@ class DirectExtentReader : public ExtentReader {
   // concatenated.
   std::vector<uint64_t> extents_upper_bounds_;
   uint64_t total_size_{0};
+
+  // The requests of the last Read(), kept to reuse their storage.
+  std::vector<FileDescriptor::ReadRequest> requests_;
 };
 
 }  // namespace chromeos_update_engine
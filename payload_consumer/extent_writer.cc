@@ -33,6 +33,9 @@ bool DirectExtentWriter::Write(const void* bytes, size_t count) {
   if (count == 0)
     return true;
   const char* c_bytes = reinterpret_cast<const char*>(bytes);
+  // Write the parts of all the extents covered at once, so the file
+  // descriptor can submit them together.
+  requests_.clear();
   size_t bytes_written = 0;
   while (bytes_written < count) {
     TEST_AND_RETURN_FALSE(cur_extent_ != extents_.end());
@@ -47,10 +50,7 @@ bool DirectExtentWriter::Write(const void* bytes, size_t count) {
     if (cur_extent_->start_block() != kSparseHole) {
       const off64_t offset =
           cur_extent_->start_block() * block_size_ + extent_bytes_written_;
-      TEST_AND_RETURN_FALSE_ERRNO(fd_->Seek(offset, SEEK_SET) !=
-                                  static_cast<off64_t>(-1));
-      TEST_AND_RETURN_FALSE(
-          utils::WriteAll(fd_, c_bytes + bytes_written, bytes_to_write));
+      requests_.push_back({c_bytes + bytes_written, bytes_to_write, offset});
     }
     bytes_written += bytes_to_write;
     extent_bytes_written_ += bytes_to_write;
@@ -62,7 +62,7 @@ bool DirectExtentWriter::Write(const void* bytes, size_t count) {
       cur_extent_++;
     }
   }
-  return true;
+  return requests_.empty() || fd_->WriteBatch(requests_);
 }
 
 }  // namespace chromeos_update_engine
@@ -19,6 +19,7 @@
 
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <base/logging.h>
 #include <brillo/secure_blob.h>
@@ -54,6 +55,8 @@ class DirectExtentWriter : public ExtentWriter {
   DirectExtentWriter() = default;
   ~DirectExtentWriter() override = default;
 
+  // Init() can be called again to write other extents, reusing the storage of
+  // the writer.
   bool Init(FileDescriptorPtr fd,
             const google::protobuf::RepeatedPtrField<Extent>& extents,
             uint32_t block_size) override {
@@ -61,6 +64,7 @@ class DirectExtentWriter : public ExtentWriter {
     block_size_ = block_size;
     extents_ = extents;
     cur_extent_ = extents_.begin();
+    extent_bytes_written_ = 0;
     return true;
   }
   bool Write(const void* bytes, size_t count) override;
@@ -74,6 +78,9 @@ class DirectExtentWriter : public ExtentWriter {
   google::protobuf::RepeatedPtrField<Extent> extents_;
   // The next call to write should correspond to |cur_extents_|.
   google::protobuf::RepeatedPtrField<Extent>::iterator cur_extent_;
+
+  // The requests of the last Write(), kept to reuse their storage.
+  std::vector<FileDescriptor::WriteRequest> requests_;
 };
 
 }  // namespace chromeos_update_engine
@@ -73,6 +73,7 @@ class FakeFileDescriptor : public FileDescriptor {
   }
 
   bool Flush() override { return open_; }
+  bool Sync() override { return open_; }
 
   bool Close() override {
     if (!open_)
@@ -0,0 +1,156 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/fec_encoder.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <base/logging.h>
+
+#include "update_engine/common/utils.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+// The number of symbols of a code, and the index form of 0.
+const unsigned kCodeSize = 255;
+const uint8_t kIndexOfZero = kCodeSize;
+// The primitive polynomial of GF(2^8) used by libfec.
+const unsigned kFieldPolynomial = 0x11d;
+
+// The log and exponential tables of GF(2^8).
+struct GaloisField {
+  GaloisField() {
+    index_of[0] = kIndexOfZero;
+    alpha_to[kIndexOfZero] = 0;
+    unsigned value = 1;
+    for (unsigned i = 0; i < kCodeSize; i++) {
+      index_of[value] = i;
+      alpha_to[i] = value;
+      value <<= 1;
+      if (value & 0x100)
+        value ^= kFieldPolynomial;
+    }
+  }
+
+  // Returns alpha to the power |exponent|, which is less than 2 * kCodeSize.
+  uint8_t Exp(unsigned exponent) const {
+    return alpha_to[exponent >= kCodeSize ? exponent - kCodeSize : exponent];
+  }
+
+  uint8_t alpha_to[kCodeSize + 1];
+  uint8_t index_of[kCodeSize + 1];
+};
+
+const GaloisField& Field() {
+  static const GaloisField field;
+  return field;
+}
+}  // namespace
+
+FecEncoder::FecEncoder(uint32_t block_size, uint32_t roots)
+    : block_size_(block_size), roots_(roots) {
+  if (roots_ == 0 || roots_ >= kCodeSize)
+    return;
+  const GaloisField& field = Field();
+  // The roots of the generator are alpha^0 to alpha^(roots - 1).
+  uint8_t generator[kCodeSize + 1] = {1};
+  for (uint32_t i = 0; i < roots_; i++) {
+    generator[i + 1] = 1;
+    for (uint32_t j = i; j > 0; j--) {
+      if (generator[j] != 0) {
+        generator[j] = generator[j - 1] ^
+                       field.Exp(field.index_of[generator[j]] + i);
+      } else {
+        generator[j] = generator[j - 1];
+      }
+    }
+    generator[0] = field.Exp(field.index_of[generator[0]] + i);
+  }
+  for (uint32_t i = 0; i <= roots_; i++)
+    generator_[i] = field.index_of[generator[i]];
+}
+
+uint64_t FecEncoder::CalculateSize(uint64_t data_size,
+                                   uint32_t block_size,
+                                   uint32_t roots) {
+  if (roots == 0 || roots >= kCodeSize || block_size == 0)
+    return 0;
+  uint64_t rounds =
+      utils::DivRoundUp(data_size / block_size, kCodeSize - roots);
+  return rounds * roots * block_size;
+}
+
+bool FecEncoder::Initialize(uint64_t data_size) {
+  TEST_AND_RETURN_FALSE(roots_ > 0 && roots_ < kCodeSize);
+  TEST_AND_RETURN_FALSE(block_size_ > 0 && data_size % block_size_ == 0);
+  num_blocks_ = data_size / block_size_;
+  rounds_ = utils::DivRoundUp(num_blocks_, kCodeSize - roots_);
+  next_block_ = 0;
+  partial_block_.clear();
+  parity_.assign(rounds_ * roots_ * block_size_, 0);
+  return true;
+}
+
+bool FecEncoder::Update(const uint8_t* data, size_t size) {
+  TEST_AND_RETURN_FALSE((next_block_ * block_size_ + partial_block_.size() +
+                         size) <= num_blocks_ * block_size_);
+  if (!partial_block_.empty()) {
+    size_t length = std::min(size, block_size_ - partial_block_.size());
+    partial_block_.insert(partial_block_.end(), data, data + length);
+    data += length;
+    size -= length;
+    if (partial_block_.size() < block_size_)
+      return true;
+    EncodeBlock(next_block_++, partial_block_.data());
+    partial_block_.clear();
+  }
+  for (; size >= block_size_; size -= block_size_, data += block_size_)
+    EncodeBlock(next_block_++, data);
+  partial_block_.assign(data, data + size);
+  return true;
+}
+
+bool FecEncoder::Finalize() {
+  TEST_AND_RETURN_FALSE(next_block_ == num_blocks_ && partial_block_.empty());
+  // The codes of the last rounds are padded with zeros.
+  uint64_t total_blocks = rounds_ * (kCodeSize - roots_);
+  for (; next_block_ < total_blocks; next_block_++)
+    EncodeBlock(next_block_, nullptr);
+  return true;
+}
+
+void FecEncoder::EncodeBlock(uint64_t block, const uint8_t* data) {
+  const GaloisField& field = Field();
+  uint8_t* parity = parity_.data() + (block % rounds_) * block_size_ * roots_;
+  // The shift register of the systematic encoder of each code, as in libfec's
+  // encode_rs_char().
+  for (uint32_t i = 0; i < block_size_; i++, parity += roots_) {
+    uint8_t symbol = data ? data[i] : 0;
+    uint8_t feedback = field.index_of[symbol ^ parity[0]];
+    if (feedback != kIndexOfZero) {
+      for (uint32_t j = 1; j < roots_; j++)
+        parity[j] ^= field.Exp(feedback + generator_[roots_ - j]);
+    }
+    memmove(parity, parity + 1, roots_ - 1);
+    parity[roots_ - 1] =
+        feedback != kIndexOfZero ? field.Exp(feedback + generator_[0]) : 0;
+  }
+}
+
+}  // namespace chromeos_update_engine
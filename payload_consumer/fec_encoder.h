@@ -0,0 +1,84 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_FEC_ENCODER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_FEC_ENCODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <brillo/secure_blob.h>
+
+namespace chromeos_update_engine {
+
+// Computes the Reed-Solomon error correction data of a partition in the
+// layout of libfec: RS(255, 255 - roots) codes over GF(2^8), where the data is
+// interleaved so that the symbols of each code come from blocks |rounds|
+// blocks apart. Code i of round r takes byte i of blocks r, r + rounds,
+// r + 2 * rounds, etc. and the parity bytes of each round fill |roots| blocks.
+//
+// Since the blocks feeding each code are visited in increasing order, the data
+// can be streamed through Update() in order, updating the parity of all the
+// codes at once. The memory used is the size of the resulting parity data.
+class FecEncoder {
+ public:
+  FecEncoder(uint32_t block_size, uint32_t roots);
+  FecEncoder(const FecEncoder&) = delete;
+  FecEncoder& operator=(const FecEncoder&) = delete;
+
+  // Returns the size of the parity data of |data_size| bytes of data, or 0 if
+  // the parameters aren't supported.
+  static uint64_t CalculateSize(uint64_t data_size,
+                                uint32_t block_size,
+                                uint32_t roots);
+
+  // Starts encoding |data_size| bytes of data, a multiple of the block size.
+  bool Initialize(uint64_t data_size);
+
+  // Appends |size| bytes of data.
+  bool Update(const uint8_t* data, size_t size);
+
+  // Encodes the zero padding past the data, once all the data was passed to
+  // Update(). The parity data is then available in parity().
+  bool Finalize();
+
+  const brillo::Blob& parity() const { return parity_; }
+
+ private:
+  // Feeds the data block |block|, at |data| or all zeros if null.
+  void EncodeBlock(uint64_t block, const uint8_t* data);
+
+  const uint32_t block_size_;
+  const uint32_t roots_;
+
+  uint64_t rounds_{0};
+  uint64_t num_blocks_{0};
+  uint64_t next_block_{0};
+
+  // The start of a data block split across calls to Update().
+  brillo::Blob partial_block_;
+
+  // The parity of the code of byte i of round r is at (r * block_size_ + i) *
+  // roots_, as in the final layout.
+  brillo::Blob parity_;
+
+  // The generator polynomial, in index form.
+  uint8_t generator_[256]{};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_FEC_ENCODER_H_
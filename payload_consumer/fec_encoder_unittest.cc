@@ -0,0 +1,117 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/fec_encoder.h"
+
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/test_utils.h"
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+// Small blocks keep the number of codes checked low.
+const uint32_t kBlockSize = 64;
+
+// Multiplies |a| and |b| in GF(2^8) with the polynomial used by libfec.
+uint8_t Multiply(uint8_t a, uint8_t b) {
+  unsigned result = 0;
+  unsigned value = a;
+  for (; b; b >>= 1) {
+    if (b & 1)
+      result ^= value;
+    value <<= 1;
+    if (value & 0x100)
+      value ^= 0x11d;
+  }
+  return result;
+}
+}  // namespace
+
+class FecEncoderTest
+    : public ::testing::TestWithParam<std::tuple<uint32_t, size_t>> {};
+
+TEST_P(FecEncoderTest, CodewordsTest) {
+  const uint32_t roots = std::get<0>(GetParam());
+  const size_t num_blocks = std::get<1>(GetParam());
+  const size_t data_symbols = 255 - roots;
+  brillo::Blob data(num_blocks * kBlockSize);
+  test_utils::FillWithData(&data);
+
+  FecEncoder encoder(kBlockSize, roots);
+  ASSERT_TRUE(encoder.Initialize(data.size()));
+  // Pieces not aligned to the blocks.
+  for (size_t offset = 0; offset < data.size(); offset += 100) {
+    EXPECT_TRUE(encoder.Update(data.data() + offset,
+                               std::min<size_t>(100, data.size() - offset)));
+  }
+  EXPECT_TRUE(encoder.Finalize());
+  const brillo::Blob& parity = encoder.parity();
+  const size_t rounds = (num_blocks + data_symbols - 1) / data_symbols;
+  ASSERT_EQ(rounds * roots * kBlockSize, parity.size());
+  EXPECT_EQ(parity.size(),
+            FecEncoder::CalculateSize(data.size(), kBlockSize, roots));
+
+  // Each code, made of its interleaved data bytes followed by its parity, is
+  // a multiple of the generator: it evaluates to 0 at each of its roots,
+  // alpha^0 to alpha^(roots - 1), with alpha = 2.
+  for (size_t round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < kBlockSize; i++) {
+      vector<uint8_t> code;
+      for (size_t j = 0; j < data_symbols; j++) {
+        size_t block = j * rounds + round;
+        code.push_back(block < num_blocks ? data[block * kBlockSize + i] : 0);
+      }
+      const uint8_t* code_parity =
+          parity.data() + (round * kBlockSize + i) * roots;
+      code.insert(code.end(), code_parity, code_parity + roots);
+
+      uint8_t root = 1;
+      for (uint32_t k = 0; k < roots; k++, root = Multiply(root, 2)) {
+        uint8_t value = 0;
+        for (uint8_t symbol : code)
+          value = Multiply(value, root) ^ symbol;
+        ASSERT_EQ(0, value) << "round " << round << ", byte " << i
+                            << ", root " << k;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Params,
+                         FecEncoderTest,
+                         ::testing::Values(std::make_tuple(2, 1),
+                                           std::make_tuple(2, 600),
+                                           std::make_tuple(16, 239),
+                                           std::make_tuple(24, 1000)));
+
+TEST(FecEncoderErrorTest, InvalidTest) {
+  EXPECT_EQ(0U, FecEncoder::CalculateSize(4096, 4096, 0));
+  EXPECT_EQ(0U, FecEncoder::CalculateSize(4096, 4096, 255));
+  FecEncoder encoder(kBlockSize, 2);
+  EXPECT_FALSE(encoder.Initialize(kBlockSize + 1));
+  ASSERT_TRUE(encoder.Initialize(kBlockSize));
+  brillo::Blob data(2 * kBlockSize);
+  EXPECT_FALSE(encoder.Finalize());
+  EXPECT_FALSE(encoder.Update(data.data(), data.size()));
+}
+
+}  // namespace chromeos_update_engine
@@ -47,6 +47,7 @@ class FecFileDescriptor : public FileDescriptor {
                 uint64_t length,
                 int* result) override;
   bool Flush() override { return true; }
+  bool Sync() override { return true; }
   bool Close() override;
   bool IsSettingErrno() override { return true; }
   bool IsOpen() override {
@@ -21,6 +21,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <base/logging.h>
 #include <base/posix/eintr_wrapper.h>
@@ -29,6 +30,38 @@
 
 namespace chromeos_update_engine {
 
+bool FileDescriptor::ReadBatch(const std::vector<ReadRequest>& requests) {
+  for (const ReadRequest& request : requests) {
+    TEST_AND_RETURN_FALSE_ERRNO(Seek(request.offset, SEEK_SET) ==
+                                request.offset);
+    uint8_t* buf = static_cast<uint8_t*>(request.buf);
+    size_t bytes_read = 0;
+    while (bytes_read < request.count) {
+      ssize_t rc = Read(buf + bytes_read, request.count - bytes_read);
+      TEST_AND_RETURN_FALSE_ERRNO(rc >= 0);
+      // Reached the end of the file.
+      TEST_AND_RETURN_FALSE(rc > 0);
+      bytes_read += rc;
+    }
+  }
+  return true;
+}
+
+bool FileDescriptor::WriteBatch(const std::vector<WriteRequest>& requests) {
+  for (const WriteRequest& request : requests) {
+    TEST_AND_RETURN_FALSE_ERRNO(Seek(request.offset, SEEK_SET) ==
+                                request.offset);
+    const uint8_t* buf = static_cast<const uint8_t*>(request.buf);
+    size_t bytes_written = 0;
+    while (bytes_written < request.count) {
+      ssize_t rc = Write(buf + bytes_written, request.count - bytes_written);
+      TEST_AND_RETURN_FALSE_ERRNO(rc > 0);
+      bytes_written += rc;
+    }
+  }
+  return true;
+}
+
 bool EintrSafeFileDescriptor::Open(const char* path, int flags, mode_t mode) {
   CHECK_EQ(fd_, -1);
   return ((fd_ = HANDLE_EINTR(open(path, flags, mode))) >= 0);
@@ -63,6 +96,28 @@ ssize_t EintrSafeFileDescriptor::Write(const void* buf, size_t count) {
   return written;
 }
 
+bool EintrSafeFileDescriptor::ReadBatch(
+    const std::vector<ReadRequest>& requests) {
+  CHECK_GE(fd_, 0);
+  for (const ReadRequest& request : requests) {
+    ssize_t bytes_read;
+    TEST_AND_RETURN_FALSE(utils::PReadAll(
+        fd_, request.buf, request.count, request.offset, &bytes_read));
+    TEST_AND_RETURN_FALSE(bytes_read == static_cast<ssize_t>(request.count));
+  }
+  return true;
+}
+
+bool EintrSafeFileDescriptor::WriteBatch(
+    const std::vector<WriteRequest>& requests) {
+  CHECK_GE(fd_, 0);
+  for (const WriteRequest& request : requests) {
+    TEST_AND_RETURN_FALSE(
+        utils::PWriteAll(fd_, request.buf, request.count, request.offset));
+  }
+  return true;
+}
+
 off64_t EintrSafeFileDescriptor::Seek(off64_t offset, int whence) {
   CHECK_GE(fd_, 0);
   return lseek64(fd_, offset, whence);
@@ -129,6 +184,11 @@ bool EintrSafeFileDescriptor::Flush() {
   return true;
 }
 
+bool EintrSafeFileDescriptor::Sync() {
+  CHECK_GE(fd_, 0);
+  return HANDLE_EINTR(fdatasync(fd_)) == 0;
+}
+
 bool EintrSafeFileDescriptor::Close() {
   CHECK_GE(fd_, 0);
   if (IGNORE_EINTR(close(fd_)))
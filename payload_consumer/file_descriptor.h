@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <memory>
+#include <vector>
 
 #include <base/logging.h>
 
@@ -48,6 +49,19 @@ using FileDescriptorPtr = std::shared_ptr<FileDescriptor>;
 // An abstract class defining the file descriptor API.
 class FileDescriptor {
  public:
+  // A transfer of |count| bytes between |buf| and the file at |offset|, part
+  // of a ReadBatch() or WriteBatch() call.
+  struct ReadRequest {
+    void* buf;
+    size_t count;
+    off64_t offset;
+  };
+  struct WriteRequest {
+    const void* buf;
+    size_t count;
+    off64_t offset;
+  };
+
   FileDescriptor() {}
   FileDescriptor(const FileDescriptor&) = delete;
   FileDescriptor& operator=(const FileDescriptor&) = delete;
@@ -70,6 +84,14 @@ class FileDescriptor {
   // no bytes were written. Specific implementations may set errno accordingly.
   virtual ssize_t Write(const void* buf, size_t count) = 0;
 
+  // Reads or writes all the |requests|, which implementations may issue at
+  // once and complete in any order. Returns true only if every request was
+  // fully transferred; reading past the end of the file is an error. The file
+  // offset is unspecified after these calls. The default implementations
+  // issue a Seek() and Read() or Write() for each request.
+  virtual bool ReadBatch(const std::vector<ReadRequest>& requests);
+  virtual bool WriteBatch(const std::vector<WriteRequest>& requests);
+
   // Seeks to an offset. Returns the resulting offset location as measured in
   // bytes from the beginning. On error, return -1. Specific implementations
   // may set errno accordingly.
@@ -95,6 +117,11 @@ class FileDescriptor {
   // errno accrodingly.
   virtual bool Flush() = 0;
 
+  // Flushes any cached data and waits for all the data written so far to reach
+  // the storage device. The descriptor must be opened prior to this call.
+  // Returns false on error. Implementations may set errno accordingly.
+  virtual bool Sync() = 0;
+
   // Closes a file descriptor. The descriptor must be open prior to this call.
   // Returns true on success, false otherwise. Specific implementations may set
   // errno accordingly.
@@ -117,6 +144,9 @@ class EintrSafeFileDescriptor : public FileDescriptor {
   bool Open(const char* path, int flags) override;
   ssize_t Read(void* buf, size_t count) override;
   ssize_t Write(const void* buf, size_t count) override;
+  // Issues a pread() or pwrite() for each request.
+  bool ReadBatch(const std::vector<ReadRequest>& requests) override;
+  bool WriteBatch(const std::vector<WriteRequest>& requests) override;
   off64_t Seek(off64_t offset, int whence) override;
   uint64_t BlockDevSize() override;
   bool BlkIoctl(int request,
@@ -124,6 +154,7 @@ class EintrSafeFileDescriptor : public FileDescriptor {
                 uint64_t length,
                 int* result) override;
   bool Flush() override;
+  bool Sync() override;
   bool Close() override;
   bool IsSettingErrno() override { return true; }
   bool IsOpen() override { return (fd_ >= 0); }
@@ -24,24 +24,32 @@
 #include <algorithm>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include <base/functional/bind.h>
 #include <base/logging.h>
 #include <base/strings/string_util.h>
+#include <base/time/time.h>
 #include <brillo/data_encoding.h>
 #include <brillo/streams/file_stream.h>
 
 #include "update_engine/common/utils.h"
 
+using brillo::MessageLoop;
 using brillo::data_encoding::Base64Encode;
 using std::string;
+using std::vector;
 
 namespace chromeos_update_engine {
 
 namespace {
 const off_t kReadFileBufferSize = 128 * 1024;
+// How often the progress of the partitions hashed in parallel is reported.
+constexpr base::TimeDelta kParallelProgressInterval = base::Milliseconds(100);
 }  // namespace
 
+const size_t FilesystemVerifierAction::kDefaultMaxHashThreads = 4;
+
 void FilesystemVerifierAction::PerformAction() {
   // Will tell the ActionProcessor we've failed if we return.
   ScopedActionCompleter abort_action_completer(processor_, this);
@@ -61,7 +69,9 @@ void FilesystemVerifierAction::PerformAction() {
   }
   install_plan_.Dump();
 
-  StartPartitionHashing();
+  target_verified_.assign(install_plan_.partitions.size(), false);
+  if (!StartParallelHashing())
+    StartPartitionHashing();
   abort_action_completer.set_should_complete(false);
 }
 
@@ -71,6 +81,12 @@ void FilesystemVerifierAction::TerminateProcessing() {
 }
 
 void FilesystemVerifierAction::Cleanup(ErrorCode code) {
+  if (parallel_progress_id_ != MessageLoop::kTaskIdNull) {
+    MessageLoop::current()->CancelTask(parallel_progress_id_);
+    parallel_progress_id_ = MessageLoop::kTaskIdNull;
+  }
+  // Waits for the workers to stop.
+  parallel_hasher_.reset();
   src_stream_.reset();
   // This memory is not used anymore.
   buffer_.clear();
@@ -84,11 +100,93 @@ void FilesystemVerifierAction::Cleanup(ErrorCode code) {
 }
 
 void FilesystemVerifierAction::UpdateProgress(double progress) {
+  // The partitions hashed in parallel are accounted for before the ones
+  // hashed after them, which would otherwise move the progress back.
+  last_progress_ = std::max(last_progress_, progress);
   if (delegate_ != nullptr) {
-    delegate_->OnVerifyProgressUpdate(progress);
+    delegate_->OnVerifyProgressUpdate(last_progress_);
   }
 }
 
+bool FilesystemVerifierAction::WritesVerity(
+    const InstallPlan::Partition& partition) const {
+  return install_plan_.write_verity &&
+         (partition.hash_tree_size != 0 || partition.fec_size != 0);
+}
+
+bool FilesystemVerifierAction::StartParallelHashing() {
+  if (max_hash_threads_ < 2)
+    return false;
+  // The partitions whose verity data is computed are read in order on the main
+  // loop, and the ones verified while applying the payload aren't read.
+  vector<size_t> indexes;
+  for (size_t i = 0; i < install_plan_.partitions.size(); i++) {
+    const InstallPlan::Partition& partition = install_plan_.partitions[i];
+    if (partition.target_path.empty() || partition.target_size == 0 ||
+        WritesVerity(partition) ||
+        (!partition.applied_target_hash.empty() &&
+         partition.applied_target_hash == partition.target_hash))
+      continue;
+    indexes.push_back(i);
+  }
+  if (indexes.size() < 2)
+    return false;
+
+  LOG(INFO) << "Hashing " << indexes.size() << " partitions with up to "
+            << max_hash_threads_ << " threads.";
+  parallel_hasher_ =
+      std::make_unique<ParallelPartitionHasher>(max_hash_threads_);
+  parallel_partitions_ = indexes;
+  for (size_t index : parallel_partitions_) {
+    const InstallPlan::Partition& partition = install_plan_.partitions[index];
+    parallel_hasher_->AddPartition(partition.target_path,
+                                   partition.target_size);
+  }
+  parallel_hasher_->Start();
+  OnParallelHashingProgress();
+  return true;
+}
+
+void FilesystemVerifierAction::OnParallelHashingProgress() {
+  parallel_progress_id_ = MessageLoop::kTaskIdNull;
+  if (!parallel_hasher_->IsDone()) {
+    // Every partition has the same length on the progress bar, as when they
+    // are hashed one after the other.
+    double progress = 0;
+    for (size_t i = 0; i < parallel_partitions_.size(); i++) {
+      const InstallPlan::Partition& partition =
+          install_plan_.partitions[parallel_partitions_[i]];
+      progress += static_cast<double>(parallel_hasher_->hashed_bytes(i)) /
+                  partition.target_size;
+    }
+    UpdateProgress(progress / install_plan_.partitions.size());
+    parallel_progress_id_ = MessageLoop::current()->PostDelayedTask(
+        FROM_HERE,
+        base::BindOnce(&FilesystemVerifierAction::OnParallelHashingProgress,
+                       base::Unretained(this)),
+        kParallelProgressInterval);
+    return;
+  }
+
+  // The partitions that failed to be read or mismatched are hashed again one
+  // after the other, which reports the error and checks the source partition.
+  for (size_t i = 0; i < parallel_partitions_.size(); i++) {
+    size_t index = parallel_partitions_[i];
+    const InstallPlan::Partition& partition = install_plan_.partitions[index];
+    brillo::Blob hash;
+    if (!parallel_hasher_->GetHash(i, &hash)) {
+      LOG(WARNING) << "Unable to hash partition " << partition.name
+                   << " in parallel.";
+      continue;
+    }
+    LOG(INFO) << "Hash of " << partition.name << ": " << Base64Encode(hash);
+    target_verified_[index] = hash == partition.target_hash;
+  }
+  parallel_hasher_.reset();
+  parallel_partitions_.clear();
+  StartPartitionHashing();
+}
+
 void FilesystemVerifierAction::StartPartitionHashing() {
   if (partition_index_ == install_plan_.partitions.size()) {
     if (!install_plan_.untouched_dynamic_partitions.empty()) {
@@ -111,6 +209,15 @@ void FilesystemVerifierAction::StartPartitionHashing() {
   const InstallPlan::Partition& partition =
       install_plan_.partitions[partition_index_];
 
+  if (verifier_step_ == VerifierStep::kVerifyTargetHash &&
+      target_verified_[partition_index_]) {
+    LOG(INFO) << "Partition " << partition_index_ << " (" << partition.name
+              << ") was verified in parallel.";
+    partition_index_++;
+    StartPartitionHashing();
+    return;
+  }
+
   string part_path;
   switch (verifier_step_) {
     case VerifierStep::kVerifySourceHash:
@@ -138,6 +245,25 @@ void FilesystemVerifierAction::StartPartitionHashing() {
     return;
   }
 
+  // The partition doesn't need to be read back if it was hashed while the
+  // payload was applied, unless its verity data must be computed from it. A
+  // mismatch falls back to reading it, to tell apart a bad source partition.
+  if (verifier_step_ == VerifierStep::kVerifyTargetHash &&
+      !WritesVerity(partition) &&
+      !partition.applied_target_hash.empty()) {
+    if (partition.applied_target_hash == partition.target_hash) {
+      LOG(INFO) << "Partition " << partition_index_ << " (" << partition.name
+                << ") was verified while the payload was applied.";
+      partition_index_++;
+      UpdateProgress(static_cast<double>(partition_index_) /
+                     install_plan_.partitions.size());
+      StartPartitionHashing();
+      return;
+    }
+    LOG(WARNING) << "The hash of partition " << partition.name
+                 << " computed while applying the payload mismatched.";
+  }
+
   LOG(INFO) << "Hashing partition " << partition_index_ << " ("
             << partition.name << ") on device " << part_path;
 
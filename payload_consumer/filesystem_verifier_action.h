@@ -20,15 +20,18 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include <brillo/message_loops/message_loop.h>
 #include <brillo/streams/stream.h>
 
 #include "update_engine/common/action.h"
 #include "update_engine/common/hash_calculator.h"
 #include "update_engine/payload_consumer/install_plan.h"
+#include "update_engine/payload_consumer/parallel_partition_hasher.h"
 #include "update_engine/payload_consumer/verity_writer_interface.h"
 
 // This action will hash all the partitions of the target slot involved in the
@@ -57,6 +60,9 @@ class FilesystemVerifyDelegate {
 
 class FilesystemVerifierAction : public InstallPlanAction {
  public:
+  // The default number of target partitions hashed at once.
+  static const size_t kDefaultMaxHashThreads;
+
   explicit FilesystemVerifierAction(
       DynamicPartitionControlInterface* dynamic_control)
       : verity_writer_(verity_writer::CreateVerityWriter()),
@@ -79,12 +85,34 @@ class FilesystemVerifierAction : public InstallPlanAction {
     return this->delegate_;
   }
 
+  // Sets the number of target partitions hashed at once, see
+  // ParallelPartitionHasher. The partitions are all hashed one after the other
+  // when set to 1.
+  void set_max_hash_threads(size_t max_hash_threads) {
+    max_hash_threads_ = std::max<size_t>(max_hash_threads, 1);
+  }
+
   // Debugging/logging
   static std::string StaticType() { return "FilesystemVerifierAction"; }
   std::string Type() const override { return StaticType(); }
 
  private:
   friend class FilesystemVerifierActionTestDelegate;
+
+  // Starts hashing the target partitions that can be read on their own with
+  // |parallel_hasher_|. Returns false if there aren't enough of them to hash
+  // in parallel.
+  bool StartParallelHashing();
+
+  // Called periodically from the main loop while |parallel_hasher_| runs to
+  // report the progress and, once it is done, verify the hashes and continue
+  // with the partitions left.
+  void OnParallelHashingProgress();
+
+  // Whether the verity data of |partition| must be computed while hashing its
+  // target.
+  bool WritesVerity(const InstallPlan::Partition& partition) const;
+
   // Starts the hashing of the current partition. If there aren't any partitions
   // remaining to be hashed, it finishes the action.
   void StartPartitionHashing();
@@ -106,7 +134,8 @@ class FilesystemVerifierAction : public InstallPlanAction {
   // true if TerminateProcessing() was called.
   void Cleanup(ErrorCode code);
 
-  // Invoke delegate callback to report progress, if delegate is not null
+  // Invoke delegate callback to report progress, if delegate is not null. The
+  // progress reported never goes backwards.
   void UpdateProgress(double progress);
 
   // The type of the partition that we are verifying.
@@ -145,6 +174,19 @@ class FilesystemVerifierAction : public InstallPlanAction {
 
   // An observer that observes progress updates of this action.
   FilesystemVerifyDelegate* delegate_{};
+  double last_progress_{0.0};
+
+  // Hashes the target partitions in parallel before the remaining ones are
+  // hashed one after the other. Only set while running.
+  size_t max_hash_threads_{kDefaultMaxHashThreads};
+  std::unique_ptr<ParallelPartitionHasher> parallel_hasher_;
+  brillo::MessageLoop::TaskId parallel_progress_id_{
+      brillo::MessageLoop::kTaskIdNull};
+  // The index in install_plan_.partitions of each partition added to
+  // |parallel_hasher_|.
+  std::vector<size_t> parallel_partitions_;
+  // Whether the target hash of each partition was already verified.
+  std::vector<bool> target_verified_;
 };
 
 }  // namespace chromeos_update_engine
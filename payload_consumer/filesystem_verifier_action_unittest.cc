@@ -16,9 +16,11 @@
 
 #include "update_engine/payload_consumer/filesystem_verifier_action.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <base/functional/bind.h>
 #include <base/logging.h>
@@ -49,6 +51,8 @@ class FilesystemVerifierActionTest : public ::testing::Test {
   // Returns true iff test has completed successfully.
   bool DoTest(bool terminate_early, bool hash_fail);
 
+  ErrorCode DoParallelTest(int corrupted_partition);
+
   void BuildActions(const InstallPlan& install_plan);
 
   brillo::FakeMessageLoop loop_{nullptr};
@@ -322,4 +326,130 @@ TEST_F(FilesystemVerifierActionTest, RunAsRootSkipWriteVerityTest) {
   EXPECT_TRUE(delegate.ran());
   EXPECT_EQ(ErrorCode::kSuccess, delegate.code());
 }
+
+TEST_F(FilesystemVerifierActionTest, AppliedTargetHashTest) {
+  InstallPlan install_plan;
+  InstallPlan::Partition part;
+  part.name = "part";
+  // The partition isn't read, the hash computed while applying is used.
+  part.target_path = "/non/existent/path";
+  part.target_size = 4096;
+  part.target_hash = {1, 2, 3};
+  part.applied_target_hash = part.target_hash;
+  install_plan.partitions = {part};
+
+  BuildActions(install_plan);
+
+  FilesystemVerifierActionTestDelegate delegate;
+  processor_.set_delegate(&delegate);
+
+  loop_.PostTask(
+      FROM_HERE,
+      base::BindOnce(
+          [](ActionProcessor* processor) { processor->StartProcessing(); },
+          base::Unretained(&processor_)));
+  loop_.Run();
+
+  EXPECT_TRUE(delegate.ran());
+  EXPECT_EQ(ErrorCode::kSuccess, delegate.code());
+}
+
+TEST_F(FilesystemVerifierActionTest, AppliedTargetHashMismatchTest) {
+  ScopedTempFile part_file("part_file.XXXXXX");
+  brillo::Blob part_data(16 * 4096);
+  test_utils::FillWithData(&part_data);
+  ASSERT_TRUE(test_utils::WriteFileVector(part_file.path(), part_data));
+
+  InstallPlan install_plan;
+  InstallPlan::Partition part;
+  part.name = "part";
+  part.target_path = part_file.path();
+  part.target_size = part_data.size();
+  EXPECT_TRUE(HashCalculator::RawHashOfData(part_data, &part.target_hash));
+  // A mismatch falls back to reading the partition.
+  part.applied_target_hash = {1, 2, 3};
+  install_plan.partitions = {part};
+
+  BuildActions(install_plan);
+
+  FilesystemVerifierActionTestDelegate delegate;
+  processor_.set_delegate(&delegate);
+
+  loop_.PostTask(
+      FROM_HERE,
+      base::BindOnce(
+          [](ActionProcessor* processor) { processor->StartProcessing(); },
+          base::Unretained(&processor_)));
+  loop_.Run();
+
+  EXPECT_TRUE(delegate.ran());
+  EXPECT_EQ(ErrorCode::kSuccess, delegate.code());
+}
+
+namespace {
+class ProgressRecorder : public FilesystemVerifyDelegate {
+ public:
+  void OnVerifyProgressUpdate(double progress) override {
+    progress_.push_back(progress);
+  }
+  std::vector<double> progress_;
+};
+}  // namespace
+
+// Verifies three partitions in parallel, after corrupting the target of
+// |corrupted_partition| if not negative, and returns the resulting error code.
+ErrorCode FilesystemVerifierActionTest::DoParallelTest(int corrupted_partition) {
+  std::vector<std::unique_ptr<ScopedTempFile>> files;
+  InstallPlan install_plan;
+  for (int i = 0; i < 3; i++) {
+    brillo::Blob data((i + 1) * 1024 * 1024 + 4096 * i);
+    test_utils::FillWithData(&data);
+    InstallPlan::Partition part;
+    part.name = "part" + std::to_string(i);
+    files.push_back(std::make_unique<ScopedTempFile>("part_file.XXXXXX"));
+    part.target_path = files.back()->path();
+    part.target_size = data.size();
+    EXPECT_TRUE(HashCalculator::RawHashOfData(data, &part.target_hash));
+    if (i == corrupted_partition)
+      data[data.size() / 2] ^= 0xff;
+    EXPECT_TRUE(test_utils::WriteFileVector(part.target_path, data));
+    install_plan.partitions.push_back(part);
+  }
+
+  auto feeder_action = std::make_unique<ObjectFeederAction<InstallPlan>>();
+  auto verifier_action =
+      std::make_unique<FilesystemVerifierAction>(&dynamic_control_stub_);
+  verifier_action->set_max_hash_threads(2);
+  ProgressRecorder progress_recorder;
+  verifier_action->set_delegate(&progress_recorder);
+  feeder_action->set_obj(install_plan);
+  BondActions(feeder_action.get(), verifier_action.get());
+  processor_.EnqueueAction(std::move(feeder_action));
+  processor_.EnqueueAction(std::move(verifier_action));
+
+  FilesystemVerifierActionTestDelegate delegate;
+  processor_.set_delegate(&delegate);
+
+  loop_.PostTask(
+      FROM_HERE,
+      base::BindOnce(
+          [](ActionProcessor* processor) { processor->StartProcessing(); },
+          base::Unretained(&processor_)));
+  loop_.Run();
+
+  EXPECT_TRUE(delegate.ran());
+  EXPECT_FALSE(progress_recorder.progress_.empty());
+  EXPECT_TRUE(std::is_sorted(progress_recorder.progress_.begin(),
+                             progress_recorder.progress_.end()));
+  return delegate.code();
+}
+
+TEST_F(FilesystemVerifierActionTest, ParallelHashTest) {
+  EXPECT_EQ(ErrorCode::kSuccess, DoParallelTest(-1));
+}
+
+TEST_F(FilesystemVerifierActionTest, ParallelHashFailTest) {
+  // The partition is hashed again on its own, which reports the error.
+  EXPECT_EQ(ErrorCode::kNewRootfsVerificationError, DoParallelTest(1));
+}
 }  // namespace chromeos_update_engine
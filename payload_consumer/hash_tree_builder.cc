@@ -0,0 +1,180 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/hash_tree_builder.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <base/logging.h>
+
+#include "update_engine/common/multi_hash_calculator.h"
+#include "update_engine/common/utils.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+// The size of a SHA-256 hash.
+const size_t kHashSize = 32;
+// The number of data blocks hashed together.
+const size_t kDataBlocksPerBatch = 64;
+// The number of complete blocks a level keeps before writing them.
+const size_t kMaxPendingBlocks = 32;
+}  // namespace
+
+HashTreeBuilder::HashTreeBuilder(uint32_t block_size, const brillo::Blob& salt)
+    : block_size_(block_size), salt_(salt) {}
+
+uint64_t HashTreeBuilder::CalculateSize(uint64_t data_size,
+                                        uint32_t block_size) {
+  uint64_t tree_blocks = 0;
+  uint64_t level_blocks = utils::DivRoundUp(data_size, block_size);
+  do {
+    level_blocks = utils::DivRoundUp(level_blocks * kHashSize, block_size);
+    tree_blocks += level_blocks;
+  } while (level_blocks > 1);
+  return tree_blocks * block_size;
+}
+
+bool HashTreeBuilder::Initialize(uint64_t data_size,
+                                 FileDescriptorPtr fd,
+                                 uint64_t tree_offset) {
+  TEST_AND_RETURN_FALSE(block_size_ >= kHashSize &&
+                        block_size_ % kHashSize == 0);
+  TEST_AND_RETURN_FALSE(data_size > 0 && data_size % block_size_ == 0);
+  fd_ = std::move(fd);
+  data_size_ = data_size;
+  data_received_ = 0;
+  partial_block_.clear();
+  root_hash_.clear();
+
+  levels_.clear();
+  uint64_t level_blocks = data_size / block_size_;
+  do {
+    level_blocks = utils::DivRoundUp(level_blocks * kHashSize, block_size_);
+    Level level;
+    level.num_blocks = level_blocks;
+    levels_.push_back(std::move(level));
+  } while (level_blocks > 1);
+  // The top level comes first.
+  uint64_t offset = tree_offset;
+  for (auto level = levels_.rbegin(); level != levels_.rend(); level++) {
+    level->offset = offset;
+    offset += level->num_blocks * block_size_;
+  }
+  return true;
+}
+
+bool HashTreeBuilder::Update(const uint8_t* data, size_t size) {
+  TEST_AND_RETURN_FALSE(fd_);
+  TEST_AND_RETURN_FALSE(data_received_ + size <= data_size_);
+  data_received_ += size;
+  if (!partial_block_.empty()) {
+    size_t length = std::min(size, block_size_ - partial_block_.size());
+    partial_block_.insert(partial_block_.end(), data, data + length);
+    data += length;
+    size -= length;
+    if (partial_block_.size() < block_size_)
+      return true;
+    TEST_AND_RETURN_FALSE(HashDataBlocks(partial_block_.data(), 1));
+    partial_block_.clear();
+  }
+  size_t num_blocks = size / block_size_;
+  TEST_AND_RETURN_FALSE(HashDataBlocks(data, num_blocks));
+  partial_block_.assign(data + num_blocks * block_size_, data + size);
+  return true;
+}
+
+bool HashTreeBuilder::Finalize() {
+  TEST_AND_RETURN_FALSE(fd_);
+  TEST_AND_RETURN_FALSE(data_received_ == data_size_);
+  // The levels are completed from the bottom up, since each one adds the hash
+  // of its last block to the next.
+  for (size_t level = 0; level < levels_.size(); level++) {
+    TEST_AND_RETURN_FALSE(FlushLevel(level, true));
+    TEST_AND_RETURN_FALSE(levels_[level].written_blocks ==
+                          levels_[level].num_blocks);
+  }
+  TEST_AND_RETURN_FALSE(!root_hash_.empty());
+  fd_.reset();
+  return true;
+}
+
+bool HashTreeBuilder::HashDataBlocks(const uint8_t* data, size_t num_blocks) {
+  for (size_t first = 0; first < num_blocks; first += kDataBlocksPerBatch) {
+    size_t last = std::min(first + kDataBlocksPerBatch, num_blocks);
+    MultiHashCalculator calc;
+    for (size_t i = first; i < last; i++) {
+      calc.AddStream();
+      calc.Update(salt_.data(), salt_.size());
+      calc.Update(data + i * block_size_, block_size_);
+    }
+    TEST_AND_RETURN_FALSE(calc.Finalize());
+    for (const brillo::Blob& hash : calc.raw_hashes())
+      TEST_AND_RETURN_FALSE(AddHash(0, hash.data()));
+  }
+  return true;
+}
+
+bool HashTreeBuilder::AddHash(size_t level, const uint8_t* hash) {
+  brillo::Blob& pending = levels_[level].pending;
+  pending.insert(pending.end(), hash, hash + kHashSize);
+  if (pending.size() >= kMaxPendingBlocks * block_size_)
+    return FlushLevel(level, false);
+  return true;
+}
+
+bool HashTreeBuilder::FlushLevel(size_t level, bool last) {
+  Level& current = levels_[level];
+  if (last && current.pending.size() % block_size_ != 0) {
+    current.pending.resize(
+        utils::DivRoundUp(current.pending.size(), block_size_) * block_size_);
+  }
+  size_t num_blocks = current.pending.size() / block_size_;
+  if (num_blocks == 0)
+    return true;
+  TEST_AND_RETURN_FALSE(current.written_blocks + num_blocks <=
+                        current.num_blocks);
+
+  // Moves the blocks out first, the level may receive hashes again while
+  // they are hashed.
+  brillo::Blob blocks;
+  blocks.swap(current.pending);
+  current.pending.assign(blocks.begin() + num_blocks * block_size_,
+                         blocks.end());
+  uint64_t offset = current.offset + current.written_blocks * block_size_;
+  current.written_blocks += num_blocks;
+  TEST_AND_RETURN_FALSE(
+      utils::PWriteAll(fd_, blocks.data(), num_blocks * block_size_, offset));
+
+  MultiHashCalculator calc;
+  for (size_t i = 0; i < num_blocks; i++) {
+    calc.AddStream();
+    calc.Update(salt_.data(), salt_.size());
+    calc.Update(blocks.data() + i * block_size_, block_size_);
+  }
+  TEST_AND_RETURN_FALSE(calc.Finalize());
+  if (level + 1 == levels_.size()) {
+    // The top level is a single block, whose hash is the root hash.
+    root_hash_ = calc.raw_hashes()[0];
+    return true;
+  }
+  for (const brillo::Blob& hash : calc.raw_hashes())
+    TEST_AND_RETURN_FALSE(AddHash(level + 1, hash.data()));
+  return true;
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,99 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_HASH_TREE_BUILDER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_HASH_TREE_BUILDER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+
+namespace chromeos_update_engine {
+
+// Builds the dm-verity hash tree of a partition, in the format of version 1 of
+// dm-verity with SHA-256: each block is hashed with the salt prepended, the
+// hashes of each level are packed into zero padded blocks which are hashed in
+// turn, and the levels are stored from the top one down.
+//
+// The data is streamed through Update(), in order. Each level only keeps the
+// blocks it is filling, which are written to their place in the tree as soon
+// as they are complete, so the memory used doesn't depend on the size of the
+// data. The data blocks are hashed several at a time with MultiHashCalculator.
+class HashTreeBuilder {
+ public:
+  HashTreeBuilder(uint32_t block_size, const brillo::Blob& salt);
+  HashTreeBuilder(const HashTreeBuilder&) = delete;
+  HashTreeBuilder& operator=(const HashTreeBuilder&) = delete;
+
+  // Returns the size of the hash tree of |data_size| bytes of data.
+  static uint64_t CalculateSize(uint64_t data_size, uint32_t block_size);
+
+  // Starts building the tree of |data_size| bytes of data, written to |fd| at
+  // |tree_offset|. The data size must be a multiple of the block size.
+  bool Initialize(uint64_t data_size, FileDescriptorPtr fd, uint64_t tree_offset);
+
+  // Appends |size| bytes of data.
+  bool Update(const uint8_t* data, size_t size);
+
+  // Writes the rest of the tree once all the data was passed to Update(), and
+  // computes the root hash.
+  bool Finalize();
+
+  const brillo::Blob& root_hash() const { return root_hash_; }
+
+ private:
+  // A level of the tree, from the hashes of the data blocks up.
+  struct Level {
+    // The offset of the level in the partition.
+    uint64_t offset{0};
+    uint64_t num_blocks{0};
+    // The blocks written so far.
+    uint64_t written_blocks{0};
+    // The hashes of the blocks being filled.
+    brillo::Blob pending;
+  };
+
+  // Hashes the |num_blocks| full data blocks at |data|.
+  bool HashDataBlocks(const uint8_t* data, size_t num_blocks);
+
+  // Appends |hash| to |level|, writing out the blocks it fills.
+  bool AddHash(size_t level, const uint8_t* hash);
+
+  // Writes the complete blocks pending in |level|, and pads and writes the last
+  // partial one if |last|.
+  bool FlushLevel(size_t level, bool last);
+
+  const uint32_t block_size_;
+  const brillo::Blob salt_;
+
+  FileDescriptorPtr fd_;
+  std::vector<Level> levels_;
+  uint64_t data_size_{0};
+  uint64_t data_received_{0};
+
+  // The start of a data block split across calls to Update().
+  brillo::Blob partial_block_;
+
+  brillo::Blob root_hash_;
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_HASH_TREE_BUILDER_H_
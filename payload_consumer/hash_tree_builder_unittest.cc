@@ -0,0 +1,132 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/hash_tree_builder.h"
+
+#include <fcntl.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+// Small blocks, so a few levels only take little data.
+const uint32_t kBlockSize = 1024;
+const size_t kHashesPerBlock = kBlockSize / 32;
+
+// Returns the hashes of the |block_size| blocks of |data|, with |salt|
+// prepended, packed in zero padded blocks.
+brillo::Blob HashLevel(const brillo::Blob& data, const brillo::Blob& salt) {
+  brillo::Blob level;
+  for (size_t offset = 0; offset < data.size(); offset += kBlockSize) {
+    brillo::Blob block = salt;
+    block.insert(
+        block.end(), data.begin() + offset, data.begin() + offset + kBlockSize);
+    brillo::Blob hash;
+    EXPECT_TRUE(HashCalculator::RawHashOfData(block, &hash));
+    level.insert(level.end(), hash.begin(), hash.end());
+  }
+  level.resize(utils::DivRoundUp(level.size(), kBlockSize) * kBlockSize);
+  return level;
+}
+}  // namespace
+
+class HashTreeBuilderTest : public ::testing::TestWithParam<size_t> {
+ protected:
+  // Builds the tree of |num_blocks| blocks the straightforward way, returning
+  // the tree with its top level first, and the root hash.
+  void ReferenceTree(const brillo::Blob& data,
+                     brillo::Blob* tree,
+                     brillo::Blob* root_hash) {
+    vector<brillo::Blob> levels = {HashLevel(data, salt_)};
+    while (levels.back().size() > kBlockSize)
+      levels.push_back(HashLevel(levels.back(), salt_));
+    tree->clear();
+    for (auto level = levels.rbegin(); level != levels.rend(); level++)
+      tree->insert(tree->end(), level->begin(), level->end());
+    brillo::Blob top = HashLevel(levels.back(), salt_);
+    root_hash->assign(top.begin(), top.begin() + 32);
+  }
+
+  brillo::Blob salt_{1, 2, 3, 4, 5};
+};
+
+TEST_P(HashTreeBuilderTest, BuildTest) {
+  const size_t num_blocks = GetParam();
+  brillo::Blob data(num_blocks * kBlockSize);
+  test_utils::FillWithData(&data);
+  brillo::Blob expected_tree, expected_root_hash;
+  ReferenceTree(data, &expected_tree, &expected_root_hash);
+  uint64_t tree_size = HashTreeBuilder::CalculateSize(data.size(), kBlockSize);
+  EXPECT_EQ(expected_tree.size(), tree_size);
+
+  // The tree is written after some unrelated data, and the data is passed in
+  // pieces not aligned to the blocks.
+  const uint64_t kTreeOffset = 3 * kBlockSize;
+  ScopedTempFile tree_file("hash_tree.XXXXXX");
+  FileDescriptorPtr fd(new EintrSafeFileDescriptor());
+  ASSERT_TRUE(fd->Open(tree_file.path().c_str(), O_RDWR));
+  HashTreeBuilder builder(kBlockSize, salt_);
+  ASSERT_TRUE(builder.Initialize(data.size(), fd, kTreeOffset));
+  for (size_t offset = 0; offset < data.size(); offset += 1500) {
+    size_t length = std::min<size_t>(1500, data.size() - offset);
+    EXPECT_TRUE(builder.Update(data.data() + offset, length));
+  }
+  EXPECT_TRUE(builder.Finalize());
+  EXPECT_EQ(expected_root_hash, builder.root_hash());
+
+  brillo::Blob tree(tree_size);
+  ssize_t bytes_read;
+  EXPECT_TRUE(
+      utils::PReadAll(fd, tree.data(), tree.size(), kTreeOffset, &bytes_read));
+  EXPECT_EQ(static_cast<ssize_t>(tree_size), bytes_read);
+  EXPECT_TRUE(expected_tree == tree);
+}
+
+// A single level, a full level, two levels, and three.
+INSTANTIATE_TEST_SUITE_P(Sizes,
+                         HashTreeBuilderTest,
+                         ::testing::Values(1,
+                                           kHashesPerBlock,
+                                           kHashesPerBlock + 1,
+                                           kHashesPerBlock * kHashesPerBlock *
+                                                   2 +
+                                               7));
+
+TEST(HashTreeBuilderErrorTest, DataSizeTest) {
+  ScopedTempFile tree_file("hash_tree.XXXXXX");
+  FileDescriptorPtr fd(new EintrSafeFileDescriptor());
+  ASSERT_TRUE(fd->Open(tree_file.path().c_str(), O_RDWR));
+  HashTreeBuilder builder(kBlockSize, {});
+  EXPECT_FALSE(builder.Initialize(kBlockSize + 1, fd, 0));
+  ASSERT_TRUE(builder.Initialize(2 * kBlockSize, fd, 0));
+  brillo::Blob data(3 * kBlockSize);
+  // Not all the data was passed.
+  EXPECT_TRUE(builder.Update(data.data(), kBlockSize));
+  EXPECT_FALSE(builder.Finalize());
+  // Too much data.
+  EXPECT_FALSE(builder.Update(data.data(), 2 * kBlockSize));
+}
+
+}  // namespace chromeos_update_engine
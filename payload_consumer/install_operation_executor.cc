@@ -0,0 +1,382 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/install_operation_executor.h"
+
+#include <linux/fs.h>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include <base/logging.h>
+#include <bsdiff/bspatch.h>
+#include <puffin/puffpatch.h>
+
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/bzip_extent_writer.h"
+#include "update_engine/payload_consumer/extent_reader.h"
+#include "update_engine/payload_consumer/extent_writer.h"
+#include "update_engine/payload_consumer/file_descriptor_utils.h"
+#include "update_engine/payload_consumer/xz_extent_writer.h"
+#include "update_engine/payload_consumer/zstd_extent_writer.h"
+
+using std::min;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+// The reader and writer used by the streams below belong to the PatchArena of
+// the operation, the streams only borrow them.
+class BsdiffExtentFile : public bsdiff::FileInterface {
+ public:
+  BsdiffExtentFile(ExtentReader* reader, size_t size)
+      : BsdiffExtentFile(reader, nullptr, size) {}
+  BsdiffExtentFile(ExtentWriter* writer, size_t size)
+      : BsdiffExtentFile(nullptr, writer, size) {}
+  BsdiffExtentFile(const BsdiffExtentFile&) = delete;
+  BsdiffExtentFile& operator=(const BsdiffExtentFile&) = delete;
+
+  ~BsdiffExtentFile() override = default;
+
+  bool Read(void* buf, size_t count, size_t* bytes_read) override {
+    TEST_AND_RETURN_FALSE(reader_->Read(buf, count));
+    *bytes_read = count;
+    offset_ += count;
+    return true;
+  }
+
+  bool Write(const void* buf, size_t count, size_t* bytes_written) override {
+    TEST_AND_RETURN_FALSE(writer_->Write(buf, count));
+    *bytes_written = count;
+    offset_ += count;
+    return true;
+  }
+
+  bool Seek(off_t pos) override {
+    if (reader_ != nullptr) {
+      TEST_AND_RETURN_FALSE(reader_->Seek(pos));
+      offset_ = pos;
+    } else {
+      // For writes technically there should be no change of position, or it
+      // should be equivalent of current offset.
+      TEST_AND_RETURN_FALSE(offset_ == static_cast<uint64_t>(pos));
+    }
+    return true;
+  }
+
+  bool Close() override { return true; }
+
+  bool GetSize(uint64_t* size) override {
+    *size = size_;
+    return true;
+  }
+
+ private:
+  BsdiffExtentFile(ExtentReader* reader, ExtentWriter* writer, size_t size)
+      : reader_(reader), writer_(writer), size_(size), offset_(0) {}
+
+  ExtentReader* reader_;
+  ExtentWriter* writer_;
+  uint64_t size_;
+  uint64_t offset_;
+};
+
+// A class to be passed to |puffpatch| for reading from the source partition
+// and writing into the target partition.
+class PuffinExtentStream : public puffin::StreamInterface {
+ public:
+  // Constructor for creating a stream for reading from an |ExtentReader|.
+  PuffinExtentStream(ExtentReader* reader, uint64_t size)
+      : PuffinExtentStream(reader, nullptr, size) {}
+
+  // Constructor for creating a stream for writing to an |ExtentWriter|.
+  PuffinExtentStream(ExtentWriter* writer, uint64_t size)
+      : PuffinExtentStream(nullptr, writer, size) {}
+
+  PuffinExtentStream(const PuffinExtentStream&) = delete;
+  PuffinExtentStream& operator=(const PuffinExtentStream&) = delete;
+
+  ~PuffinExtentStream() override = default;
+
+  bool GetSize(uint64_t* size) const override {
+    *size = size_;
+    return true;
+  }
+
+  bool GetOffset(uint64_t* offset) const override {
+    *offset = offset_;
+    return true;
+  }
+
+  bool Seek(uint64_t offset) override {
+    if (is_read_) {
+      TEST_AND_RETURN_FALSE(reader_->Seek(offset));
+      offset_ = offset;
+    } else {
+      // For writes technically there should be no change of position, or it
+      // should equivalent of current offset.
+      TEST_AND_RETURN_FALSE(offset_ == offset);
+    }
+    return true;
+  }
+
+  bool Read(void* buffer, size_t count) override {
+    TEST_AND_RETURN_FALSE(is_read_);
+    TEST_AND_RETURN_FALSE(reader_->Read(buffer, count));
+    offset_ += count;
+    return true;
+  }
+
+  bool Write(const void* buffer, size_t count) override {
+    TEST_AND_RETURN_FALSE(!is_read_);
+    TEST_AND_RETURN_FALSE(writer_->Write(buffer, count));
+    offset_ += count;
+    return true;
+  }
+
+  bool Close() override { return true; }
+
+ private:
+  PuffinExtentStream(ExtentReader* reader, ExtentWriter* writer, uint64_t size)
+      : reader_(reader),
+        writer_(writer),
+        size_(size),
+        offset_(0),
+        is_read_(reader_ ? true : false) {}
+
+  ExtentReader* reader_;
+  ExtentWriter* writer_;
+  uint64_t size_;
+  uint64_t offset_;
+  bool is_read_;
+};
+
+}  // namespace
+
+bool InstallOperationExecutor::ExecuteReplaceOperation(
+    const InstallOperation& operation,
+    FileDescriptorPtr target_fd,
+    const void* data,
+    size_t count) {
+  std::unique_ptr<ExtentWriter> writer;
+  TEST_AND_RETURN_FALSE(InitReplaceWriter(operation, target_fd, &writer));
+  TEST_AND_RETURN_FALSE(writer->Write(data, count));
+  return true;
+}
+
+bool InstallOperationExecutor::ExecuteReplaceOperation(
+    const InstallOperation& operation,
+    FileDescriptorPtr target_fd,
+    const PayloadBuffer& data) {
+  TEST_AND_RETURN_FALSE(data.size() >= operation.data_length());
+  std::unique_ptr<ExtentWriter> writer;
+  TEST_AND_RETURN_FALSE(InitReplaceWriter(operation, target_fd, &writer));
+  size_t left = operation.data_length();
+  for (size_t i = 0; i < data.num_segments() && left > 0; i++) {
+    size_t count = min(left, data.segment_size(i));
+    TEST_AND_RETURN_FALSE(writer->Write(data.segment_data(i), count));
+    left -= count;
+  }
+  return true;
+}
+
+bool InstallOperationExecutor::ExecuteZeroOrDiscardOperation(
+    const InstallOperation& operation, FileDescriptorPtr target_fd) {
+  TEST_AND_RETURN_FALSE(operation.type() == InstallOperation::DISCARD ||
+                        operation.type() == InstallOperation::ZERO);
+
+  // These operations have no blob.
+  TEST_AND_RETURN_FALSE(!operation.has_data_offset());
+  TEST_AND_RETURN_FALSE(!operation.has_data_length());
+
+#ifdef BLKZEROOUT
+  bool attempt_ioctl = true;
+  int request =
+      (operation.type() == InstallOperation::ZERO ? BLKZEROOUT : BLKDISCARD);
+#else   // !defined(BLKZEROOUT)
+  bool attempt_ioctl = false;
+  int request = 0;
+#endif  // !defined(BLKZEROOUT)
+
+  brillo::Blob zeros;
+  for (const Extent& extent : operation.dst_extents()) {
+    const uint64_t start = extent.start_block() * block_size_;
+    const uint64_t length = extent.num_blocks() * block_size_;
+    if (attempt_ioctl) {
+      int result = 0;
+      if (target_fd->BlkIoctl(request, start, length, &result) && result == 0)
+        continue;
+      attempt_ioctl = false;
+    }
+    // In case of failure, we fall back to writing 0 to the selected region.
+    zeros.resize(16 * block_size_);
+    for (uint64_t offset = 0; offset < length; offset += zeros.size()) {
+      uint64_t chunk_length =
+          min(length - offset, static_cast<uint64_t>(zeros.size()));
+      TEST_AND_RETURN_FALSE(utils::PWriteAll(
+          target_fd, zeros.data(), chunk_length, start + offset));
+    }
+  }
+  return true;
+}
+
+bool InstallOperationExecutor::ExecuteSourceCopyOperation(
+    const InstallOperation& operation,
+    FileDescriptorPtr target_fd,
+    FileDescriptorPtr source_fd,
+    brillo::Blob* source_hash) {
+  TEST_AND_RETURN_FALSE(source_fd != nullptr);
+  return fd_utils::CopyAndHashExtents(source_fd,
+                                      operation.src_extents(),
+                                      target_fd,
+                                      operation.dst_extents(),
+                                      block_size_,
+                                      source_hash);
+}
+
+bool InstallOperationExecutor::ExecuteSourceBsdiffOperation(
+    const InstallOperation& operation,
+    FileDescriptorPtr target_fd,
+    FileDescriptorPtr source_fd,
+    const void* data,
+    size_t count,
+    PatchArena* arena) {
+  TEST_AND_RETURN_FALSE(source_fd != nullptr);
+
+  ExtentWriter* writer =
+      arena->InitWriter(target_fd, operation.dst_extents(), block_size_);
+  TEST_AND_RETURN_FALSE(writer != nullptr);
+
+  // Sources contiguous in the mapped source partition are patched in place,
+  // whatever their size. Other small sources are read at once into the arena
+  // and patched in memory, rather than through many small reads.
+  const uint64_t source_size =
+      utils::BlocksInExtents(operation.src_extents()) * block_size_;
+  const uint8_t* source =
+      arena->MappedSource(source_fd, operation.src_extents(), block_size_);
+  if (!source && arena->CanBufferSource(operation.src_extents(), block_size_)) {
+    TEST_AND_RETURN_FALSE(
+        arena->ReadSource(source_fd, operation.src_extents(), block_size_));
+    source = arena->source().data();
+  }
+  if (source)
+    return BspatchInMemory(source, source_size, data, count, writer);
+
+  ExtentReader* reader =
+      arena->InitReader(source_fd, operation.src_extents(), block_size_);
+  TEST_AND_RETURN_FALSE(reader != nullptr);
+  auto src_file = std::make_unique<BsdiffExtentFile>(
+      reader, utils::BlocksInExtents(operation.src_extents()) * block_size_);
+  auto dst_file = std::make_unique<BsdiffExtentFile>(
+      writer, utils::BlocksInExtents(operation.dst_extents()) * block_size_);
+
+  TEST_AND_RETURN_FALSE(bsdiff::bspatch(std::move(src_file),
+                                        std::move(dst_file),
+                                        reinterpret_cast<const uint8_t*>(data),
+                                        count) == 0);
+  return true;
+}
+
+bool InstallOperationExecutor::ExecuteSourceBsdiffOperation(
+    const InstallOperation& operation,
+    FileDescriptorPtr target_fd,
+    const brillo::Blob& source,
+    const void* data,
+    size_t count,
+    PatchArena* arena) {
+  TEST_AND_RETURN_FALSE(source.size() ==
+                        utils::BlocksInExtents(operation.src_extents()) *
+                            block_size_);
+  ExtentWriter* writer =
+      arena->InitWriter(target_fd, operation.dst_extents(), block_size_);
+  TEST_AND_RETURN_FALSE(writer != nullptr);
+  return BspatchInMemory(source.data(), source.size(), data, count, writer);
+}
+
+bool InstallOperationExecutor::ExecutePuffDiffOperation(
+    const InstallOperation& operation,
+    FileDescriptorPtr target_fd,
+    FileDescriptorPtr source_fd,
+    const void* data,
+    size_t count,
+    PatchArena* arena) {
+  TEST_AND_RETURN_FALSE(source_fd != nullptr);
+
+  ExtentReader* reader =
+      arena->InitReader(source_fd, operation.src_extents(), block_size_);
+  TEST_AND_RETURN_FALSE(reader != nullptr);
+  puffin::UniqueStreamPtr src_stream(new PuffinExtentStream(
+      reader, utils::BlocksInExtents(operation.src_extents()) * block_size_));
+
+  ExtentWriter* writer =
+      arena->InitWriter(target_fd, operation.dst_extents(), block_size_);
+  TEST_AND_RETURN_FALSE(writer != nullptr);
+  puffin::UniqueStreamPtr dst_stream(new PuffinExtentStream(
+      writer, utils::BlocksInExtents(operation.dst_extents()) * block_size_));
+
+  TEST_AND_RETURN_FALSE(
+      puffin::PuffPatch(std::move(src_stream),
+                        std::move(dst_stream),
+                        reinterpret_cast<const uint8_t*>(data),
+                        count,
+                        arena->puffpatch_cache_size()));
+  return true;
+}
+
+bool InstallOperationExecutor::BspatchInMemory(const uint8_t* source,
+                                               uint64_t source_size,
+                                               const void* data,
+                                               size_t count,
+                                               ExtentWriter* writer) {
+  auto sink = [writer](const uint8_t* buf, size_t buf_size) -> size_t {
+    return writer->Write(buf, buf_size) ? buf_size : 0;
+  };
+  TEST_AND_RETURN_FALSE(bsdiff::bspatch(source,
+                                        source_size,
+                                        reinterpret_cast<const uint8_t*>(data),
+                                        count,
+                                        sink) == 0);
+  return true;
+}
+
+bool InstallOperationExecutor::InitReplaceWriter(
+    const InstallOperation& operation,
+    FileDescriptorPtr target_fd,
+    std::unique_ptr<ExtentWriter>* writer) {
+  TEST_AND_RETURN_FALSE(operation.type() == InstallOperation::REPLACE ||
+                        operation.type() == InstallOperation::REPLACE_BZ ||
+                        operation.type() == InstallOperation::REPLACE_XZ ||
+                        operation.type() == InstallOperation::REPLACE_ZSTD);
+
+  // Setup the ExtentWriter stack based on the operation type.
+  *writer = std::make_unique<DirectExtentWriter>();
+
+  if (operation.type() == InstallOperation::REPLACE_BZ) {
+    writer->reset(new BzipExtentWriter(std::move(*writer)));
+  } else if (operation.type() == InstallOperation::REPLACE_XZ) {
+    writer->reset(new XzExtentWriter(std::move(*writer)));
+  } else if (operation.type() == InstallOperation::REPLACE_ZSTD) {
+    writer->reset(new ZstdExtentWriter(std::move(*writer)));
+  }
+
+  TEST_AND_RETURN_FALSE(
+      (*writer)->Init(target_fd, operation.dst_extents(), block_size_));
+  return true;
+}
+
+}  // namespace chromeos_update_engine
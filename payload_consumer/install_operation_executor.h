@@ -0,0 +1,119 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_INSTALL_OPERATION_EXECUTOR_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_INSTALL_OPERATION_EXECUTOR_H_
+
+#include <memory>
+
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/payload_consumer/patch_arena.h"
+#include "update_engine/payload_consumer/payload_buffer.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+class ExtentWriter;
+
+// Applies a single InstallOperation to the given file descriptors. The
+// executor doesn't keep any per-partition state, so several instances can
+// apply operations at the same time as long as each one uses its own file
+// descriptors and PatchArena.
+class InstallOperationExecutor {
+ public:
+  explicit InstallOperationExecutor(uint32_t block_size)
+      : block_size_(block_size) {}
+  InstallOperationExecutor(const InstallOperationExecutor&) = delete;
+  InstallOperationExecutor& operator=(const InstallOperationExecutor&) = delete;
+
+  // Writes the |count| bytes of |data| into the |operation| dst_extents of
+  // |target_fd|, decompressing them first for REPLACE_BZ, REPLACE_XZ and
+  // REPLACE_ZSTD.
+  bool ExecuteReplaceOperation(const InstallOperation& operation,
+                               FileDescriptorPtr target_fd,
+                               const void* data,
+                               size_t count);
+
+  // Same as above for the first |operation.data_length()| bytes of |data|,
+  // which are written segment by segment.
+  bool ExecuteReplaceOperation(const InstallOperation& operation,
+                               FileDescriptorPtr target_fd,
+                               const PayloadBuffer& data);
+
+  // Sets |writer| to the ExtentWriter stack writing the decompressed data blob
+  // of the replace |operation| to its dst_extents of |target_fd|, for callers
+  // feeding the blob as it is received.
+  bool InitReplaceWriter(const InstallOperation& operation,
+                         FileDescriptorPtr target_fd,
+                         std::unique_ptr<ExtentWriter>* writer);
+
+  // Zeroes or discards the |operation| dst_extents of |target_fd|.
+  bool ExecuteZeroOrDiscardOperation(const InstallOperation& operation,
+                                     FileDescriptorPtr target_fd);
+
+  // Copies the |operation| src_extents of |source_fd| into its dst_extents of
+  // |target_fd|. If |source_hash| is not null, it is set to the hash of the
+  // data read from |source_fd|.
+  bool ExecuteSourceCopyOperation(const InstallOperation& operation,
+                                  FileDescriptorPtr target_fd,
+                                  FileDescriptorPtr source_fd,
+                                  brillo::Blob* source_hash);
+
+  // Applies the |count| bytes of bsdiff patch in |data| to the |operation|
+  // src_extents of |source_fd| and writes the result into |target_fd|, using
+  // the scratch objects of |arena|. The caller is responsible for verifying
+  // the source data first.
+  bool ExecuteSourceBsdiffOperation(const InstallOperation& operation,
+                                    FileDescriptorPtr target_fd,
+                                    FileDescriptorPtr source_fd,
+                                    const void* data,
+                                    size_t count,
+                                    PatchArena* arena);
+
+  // Same as ExecuteSourceBsdiffOperation() with the already verified source
+  // data in |source| instead of reading it from the source partition.
+  bool ExecuteSourceBsdiffOperation(const InstallOperation& operation,
+                                    FileDescriptorPtr target_fd,
+                                    const brillo::Blob& source,
+                                    const void* data,
+                                    size_t count,
+                                    PatchArena* arena);
+
+  // Same as ExecuteSourceBsdiffOperation() for a puffdiff patch.
+  bool ExecutePuffDiffOperation(const InstallOperation& operation,
+                                FileDescriptorPtr target_fd,
+                                FileDescriptorPtr source_fd,
+                                const void* data,
+                                size_t count,
+                                PatchArena* arena);
+
+ private:
+  // Applies the |count| bytes of bsdiff patch in |data| to the |source_size|
+  // bytes of |source| and writes the result through |writer|.
+  static bool BspatchInMemory(const uint8_t* source,
+                              uint64_t source_size,
+                              const void* data,
+                              size_t count,
+                              ExtentWriter* writer);
+
+  const uint32_t block_size_;
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_INSTALL_OPERATION_EXECUTOR_H_
@@ -116,6 +116,12 @@ struct InstallPlan {
     brillo::Blob target_hash;
     uint32_t block_size{0};
 
+    // The hash of the target partition computed by DeltaPerformer while
+    // applying the payload, if any. FilesystemVerifierAction only reads the
+    // partition back when it doesn't match |target_hash|. Not part of the
+    // comparison of partitions.
+    brillo::Blob applied_target_hash;
+
     // Whether we should run the postinstall script from this partition and the
     // postinstall parameters.
     bool run_postinstall{false};
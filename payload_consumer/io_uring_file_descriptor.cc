@@ -0,0 +1,326 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/io_uring_file_descriptor.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+#include "update_engine/common/utils.h"
+
+using std::max;
+using std::min;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+const unsigned IoUringFileDescriptor::kDefaultQueueDepth = 64;
+
+namespace {
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+int IoUringSetup(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int IoUringEnter(int ring_fd,
+                 unsigned to_submit,
+                 unsigned min_complete,
+                 unsigned flags) {
+  return syscall(
+      __NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+}
+#else   // !defined(__NR_io_uring_setup) || !defined(__NR_io_uring_enter)
+int IoUringSetup(unsigned entries, io_uring_params* params) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int IoUringEnter(int ring_fd,
+                 unsigned to_submit,
+                 unsigned min_complete,
+                 unsigned flags) {
+  errno = ENOSYS;
+  return -1;
+}
+#endif  // defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+
+}  // namespace
+
+IoUringFileDescriptor::~IoUringFileDescriptor() {
+  ReleaseRing();
+}
+
+bool IoUringFileDescriptor::Open(const char* path, int flags, mode_t mode) {
+  if (!EintrSafeFileDescriptor::Open(path, flags, mode))
+    return false;
+  SetupRing();
+  return true;
+}
+
+bool IoUringFileDescriptor::Open(const char* path, int flags) {
+  if (!EintrSafeFileDescriptor::Open(path, flags))
+    return false;
+  SetupRing();
+  return true;
+}
+
+bool IoUringFileDescriptor::ReadBatch(const vector<ReadRequest>& requests) {
+  CHECK_GE(fd_, 0);
+  if (!IsUsingIoUring() || requests.size() <= 1)
+    return EintrSafeFileDescriptor::ReadBatch(requests);
+
+  vector<iovec> iovecs;
+  vector<off64_t> offsets;
+  iovecs.reserve(requests.size());
+  offsets.reserve(requests.size());
+  for (const ReadRequest& request : requests) {
+    iovecs.push_back({request.buf, request.count});
+    offsets.push_back(request.offset);
+  }
+  if (SubmitBatch(IORING_OP_READV, iovecs, offsets))
+    return true;
+  return !IsUsingIoUring() && EintrSafeFileDescriptor::ReadBatch(requests);
+}
+
+bool IoUringFileDescriptor::WriteBatch(const vector<WriteRequest>& requests) {
+  CHECK_GE(fd_, 0);
+  if (!IsUsingIoUring() || requests.size() <= 1)
+    return EintrSafeFileDescriptor::WriteBatch(requests);
+
+  vector<iovec> iovecs;
+  vector<off64_t> offsets;
+  iovecs.reserve(requests.size());
+  offsets.reserve(requests.size());
+  for (const WriteRequest& request : requests) {
+    iovecs.push_back({const_cast<void*>(request.buf), request.count});
+    offsets.push_back(request.offset);
+  }
+  if (SubmitBatch(IORING_OP_WRITEV, iovecs, offsets))
+    return true;
+  return !IsUsingIoUring() && EintrSafeFileDescriptor::WriteBatch(requests);
+}
+
+bool IoUringFileDescriptor::Close() {
+  ReleaseRing();
+  return EintrSafeFileDescriptor::Close();
+}
+
+bool IoUringFileDescriptor::SetupRing() {
+  ReleaseRing();
+
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = IoUringSetup(queue_depth_, &params);
+  if (ring_fd < 0) {
+    PLOG(INFO) << "io_uring isn't available, using plain system calls";
+    return false;
+  }
+  ring_fd_ = ring_fd;
+  sq_entries_ = params.sq_entries;
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+  single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+#endif  // IORING_FEAT_SINGLE_MMAP
+  if (single_mmap)
+    sq_ring_size_ = cq_ring_size_ = max(sq_ring_size_, cq_ring_size_);
+
+  void* sq_ring = mmap(nullptr,
+                       sq_ring_size_,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       ring_fd_,
+                       IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    PLOG(ERROR) << "Unable to map the io_uring submission ring";
+    ReleaseRing();
+    return false;
+  }
+  sq_ring_ = sq_ring;
+
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    void* cq_ring = mmap(nullptr,
+                         cq_ring_size_,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE,
+                         ring_fd_,
+                         IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      PLOG(ERROR) << "Unable to map the io_uring completion ring";
+      ReleaseRing();
+      return false;
+    }
+    cq_ring_ = cq_ring;
+  }
+
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr,
+                    sqes_size_,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE,
+                    ring_fd_,
+                    IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    PLOG(ERROR) << "Unable to map the io_uring submission entries";
+    ReleaseRing();
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  uint8_t* sq_ptr = static_cast<uint8_t*>(sq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.array);
+  uint8_t* cq_ptr = static_cast<uint8_t*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ptr + params.cq_off.cqes);
+  return true;
+}
+
+void IoUringFileDescriptor::ReleaseRing() {
+  if (sqes_)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_)
+    munmap(sq_ring_, sq_ring_size_);
+  if (ring_fd_ >= 0)
+    IGNORE_EINTR(close(ring_fd_));
+
+  ring_fd_ = -1;
+  sq_ring_ = cq_ring_ = nullptr;
+  sq_ring_size_ = cq_ring_size_ = sqes_size_ = 0;
+  sqes_ = nullptr;
+  sq_entries_ = 0;
+  sq_tail_ = sq_mask_ = sq_array_ = nullptr;
+  cq_head_ = cq_tail_ = cq_mask_ = nullptr;
+  cqes_ = nullptr;
+}
+
+bool IoUringFileDescriptor::SubmitBatch(uint8_t opcode,
+                                        const vector<iovec>& iovecs,
+                                        const vector<off64_t>& offsets) {
+  vector<int32_t> results(iovecs.size());
+  for (size_t first = 0; first < iovecs.size(); first += sq_entries_) {
+    unsigned count = min<size_t>(sq_entries_, iovecs.size() - first);
+    // This is the only producer of the submission ring.
+    unsigned tail = *sq_tail_;
+    for (unsigned i = 0; i < count; i++) {
+      unsigned index = (tail + i) & *sq_mask_;
+      io_uring_sqe* sqe = &sqes_[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = opcode;
+      sqe->fd = fd_;
+      sqe->off = offsets[first + i];
+      sqe->addr = reinterpret_cast<uint64_t>(&iovecs[first + i]);
+      sqe->len = 1;
+      sqe->user_data = first + i;
+      sq_array_[index] = index;
+    }
+    __atomic_store_n(sq_tail_, tail + count, __ATOMIC_RELEASE);
+
+    if (!SubmitAndWait(count, first, &results)) {
+      LOG(WARNING) << "Unable to submit to the io_uring, using plain system "
+                   << "calls from now on";
+      ReleaseRing();
+      return false;
+    }
+  }
+
+  // Report the errors and complete the short transfers.
+  for (size_t i = 0; i < iovecs.size(); i++) {
+    if (results[i] < 0) {
+      errno = -results[i];
+      PLOG(ERROR) << "io_uring request at offset " << offsets[i] << " failed";
+      return false;
+    }
+    size_t done = results[i];
+    if (done == iovecs[i].iov_len)
+      continue;
+    uint8_t* buf = static_cast<uint8_t*>(iovecs[i].iov_base) + done;
+    size_t left = iovecs[i].iov_len - done;
+    off64_t offset = offsets[i] + done;
+    if (opcode == IORING_OP_READV) {
+      ssize_t bytes_read;
+      TEST_AND_RETURN_FALSE(utils::PReadAll(fd_, buf, left, offset, &bytes_read));
+      TEST_AND_RETURN_FALSE(bytes_read == static_cast<ssize_t>(left));
+    } else {
+      TEST_AND_RETURN_FALSE(utils::PWriteAll(fd_, buf, left, offset));
+    }
+  }
+  return true;
+}
+
+bool IoUringFileDescriptor::SubmitAndWait(unsigned count,
+                                          size_t first,
+                                          vector<int32_t>* results) {
+  unsigned submitted = 0;
+  while (submitted < count) {
+    int ret = IoUringEnter(ring_fd_, count - submitted, 0, 0);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0) {
+      PLOG(ERROR) << "io_uring_enter failed to submit the requests";
+      break;
+    }
+    submitted += ret;
+  }
+
+  // The requests submitted must complete before their buffers can be released,
+  // even if the others couldn't be submitted.
+  unsigned completed = 0;
+  while (completed < submitted) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++, completed++) {
+      const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+      (*results)[cqe.user_data] = cqe.res;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    if (completed >= submitted)
+      break;
+
+    int ret = IoUringEnter(
+        ring_fd_, 0, submitted - completed, IORING_ENTER_GETEVENTS);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      // The io_uring itself is unusable, so the caller releases it and
+      // repeats the whole batch with plain system calls.
+      PLOG(ERROR) << "Unable to wait for the io_uring requests";
+      return false;
+    }
+  }
+  DCHECK_LE(first + count, results->size());
+  return submitted == count;
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,109 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_IO_URING_FILE_DESCRIPTOR_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_IO_URING_FILE_DESCRIPTOR_H_
+
+#include <sys/uio.h>
+
+#include <vector>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+namespace chromeos_update_engine {
+
+// An EintrSafeFileDescriptor submitting the requests of ReadBatch() and
+// WriteBatch() through an io_uring, so the extents of an operation are read or
+// written with a single system call rather than one or two per extent. When
+// the kernel doesn't support io_uring, or it is disabled, the batches fall back
+// to one pread() or pwrite() per request.
+//
+// Like the other file descriptors, an instance must only be used from one
+// thread at a time. The buffers of the requests can be aligned for files
+// opened with O_DIRECT, they are used as given.
+class IoUringFileDescriptor : public EintrSafeFileDescriptor {
+ public:
+  // Number of requests submitted at once.
+  static const unsigned kDefaultQueueDepth;
+
+  explicit IoUringFileDescriptor(unsigned queue_depth = kDefaultQueueDepth)
+      : queue_depth_(queue_depth) {}
+  IoUringFileDescriptor(const IoUringFileDescriptor&) = delete;
+  IoUringFileDescriptor& operator=(const IoUringFileDescriptor&) = delete;
+
+  ~IoUringFileDescriptor() override;
+
+  // Interface methods. The io_uring is set up by Open() and released by
+  // Close().
+  bool Open(const char* path, int flags, mode_t mode) override;
+  bool Open(const char* path, int flags) override;
+  bool ReadBatch(const std::vector<ReadRequest>& requests) override;
+  bool WriteBatch(const std::vector<WriteRequest>& requests) override;
+  bool Close() override;
+
+  // Whether the batches are submitted through an io_uring.
+  bool IsUsingIoUring() const { return ring_fd_ >= 0; }
+
+ private:
+  // Sets up the io_uring, returns false if it isn't available.
+  bool SetupRing();
+  void ReleaseRing();
+
+  // Submits a read or write (|opcode|) of each of the |iovecs| at the matching
+  // |offsets| and waits for all of them to complete. Requests transferring less
+  // than asked are completed with plain system calls. If the requests can't be
+  // submitted, the io_uring is released so the caller can fall back to plain
+  // system calls.
+  bool SubmitBatch(uint8_t opcode,
+                   const std::vector<iovec>& iovecs,
+                   const std::vector<off64_t>& offsets);
+
+  // Submits the |count| requests queued in the submission ring and waits for
+  // them to complete, storing the result of request |first| + i in
+  // |results[first + i]|. Returns false if they couldn't all be submitted, or
+  // if waiting for them failed.
+  bool SubmitAndWait(unsigned count,
+                     size_t first,
+                     std::vector<int32_t>* results);
+
+  const unsigned queue_depth_;
+
+  // The io_uring and its memory mapped rings.
+  int ring_fd_{-1};
+  void* sq_ring_{nullptr};
+  size_t sq_ring_size_{0};
+  void* cq_ring_{nullptr};
+  size_t cq_ring_size_{0};
+  io_uring_sqe* sqes_{nullptr};
+  size_t sqes_size_{0};
+  unsigned sq_entries_{0};
+
+  // Pointers into the rings.
+  unsigned* sq_tail_{nullptr};
+  unsigned* sq_mask_{nullptr};
+  unsigned* sq_array_{nullptr};
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned* cq_mask_{nullptr};
+  io_uring_cqe* cqes_{nullptr};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_IO_URING_FILE_DESCRIPTOR_H_
@@ -0,0 +1,113 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/io_uring_file_descriptor.h"
+
+#include <fcntl.h>
+
+#include <vector>
+
+#include <brillo/secure_blob.h>
+#include <gtest/gtest.h>
+
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kChunkSize = 4096;
+// More chunks than fit in the io_uring used by the tests.
+const size_t kNumChunks = 10;
+}  // namespace
+
+class IoUringFileDescriptorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    EXPECT_TRUE(fd_.Open(temp_file_.path().c_str(), O_RDWR, 0));
+    // The chunks are of different sizes and written in reverse order, leaving
+    // a hole after each one.
+    for (size_t i = 0; i < kNumChunks; i++)
+      chunks_.push_back(brillo::Blob(kChunkSize + i, 'a' + i));
+  }
+
+  off64_t ChunkOffset(size_t index) {
+    return (kNumChunks - 1 - index) * 2 * kChunkSize;
+  }
+
+  ScopedTempFile temp_file_{"IoUringFileDescriptor-file.XXXXXX"};
+  // Use a small io_uring so the batches are submitted in several rounds.
+  IoUringFileDescriptor fd_{4};
+  vector<brillo::Blob> chunks_;
+};
+
+TEST_F(IoUringFileDescriptorTest, WriteAndReadBatchTest) {
+  vector<FileDescriptor::WriteRequest> writes;
+  for (size_t i = 0; i < kNumChunks; i++)
+    writes.push_back({chunks_[i].data(), chunks_[i].size(), ChunkOffset(i)});
+  EXPECT_TRUE(fd_.WriteBatch(writes));
+
+  vector<brillo::Blob> read_chunks(kNumChunks);
+  vector<FileDescriptor::ReadRequest> reads;
+  for (size_t i = 0; i < kNumChunks; i++) {
+    read_chunks[i].resize(chunks_[i].size());
+    reads.push_back(
+        {read_chunks[i].data(), read_chunks[i].size(), ChunkOffset(i)});
+  }
+  EXPECT_TRUE(fd_.ReadBatch(reads));
+  EXPECT_EQ(chunks_, read_chunks);
+  EXPECT_TRUE(fd_.Close());
+
+  // The data is where it would be with pwrite().
+  brillo::Blob file_data;
+  EXPECT_TRUE(utils::ReadFile(temp_file_.path(), &file_data));
+  ASSERT_EQ(static_cast<size_t>(ChunkOffset(0)) + chunks_[0].size(),
+            file_data.size());
+  for (size_t i = 0; i < kNumChunks; i++) {
+    EXPECT_EQ(chunks_[i],
+              brillo::Blob(file_data.begin() + ChunkOffset(i),
+                           file_data.begin() + ChunkOffset(i) +
+                               chunks_[i].size()));
+  }
+}
+
+TEST_F(IoUringFileDescriptorTest, ReadPastEndOfFileTest) {
+  EXPECT_TRUE(fd_.WriteBatch(
+      {{chunks_[0].data(), chunks_[0].size(), 0},
+       {chunks_[1].data(),
+        chunks_[1].size(),
+        static_cast<off64_t>(kChunkSize * 2)}}));
+
+  brillo::Blob buf(kChunkSize * 2);
+  // The second read is cut short by the end of the file.
+  EXPECT_FALSE(fd_.ReadBatch({{buf.data(), kChunkSize, 0},
+                              {buf.data() + kChunkSize,
+                               kChunkSize,
+                               static_cast<off64_t>(kChunkSize * 3)}}));
+  // Reading within the file still works afterwards.
+  EXPECT_TRUE(fd_.ReadBatch({{buf.data(), kChunkSize, 0},
+                             {buf.data() + kChunkSize,
+                              kChunkSize,
+                              static_cast<off64_t>(kChunkSize * 2)}}));
+  EXPECT_EQ(brillo::Blob(buf.begin(), buf.begin() + kChunkSize),
+            brillo::Blob(chunks_[0].begin(), chunks_[0].begin() + kChunkSize));
+  EXPECT_EQ(brillo::Blob(buf.begin() + kChunkSize, buf.end()),
+            brillo::Blob(chunks_[1].begin(), chunks_[1].begin() + kChunkSize));
+}
+
+}  // namespace chromeos_update_engine
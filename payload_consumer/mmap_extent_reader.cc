@@ -0,0 +1,150 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+#include "update_engine/common/utils.h"
+
+using google::protobuf::RepeatedPtrField;
+using std::string;
+
+namespace chromeos_update_engine {
+
+MappedPartition::~MappedPartition() {
+  if (munmap(data_, size_) != 0)
+    PLOG(ERROR) << "Unable to unmap the partition";
+}
+
+std::shared_ptr<MappedPartition> MappedPartition::Map(const string& path) {
+  int fd = HANDLE_EINTR(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd < 0) {
+    PLOG(ERROR) << "Unable to open " << path;
+    return nullptr;
+  }
+  // The mapping keeps its own reference to the file.
+  off_t size = utils::FileSize(fd);
+  void* data = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0)
+                        : MAP_FAILED;
+  if (data == MAP_FAILED)
+    PLOG(ERROR) << "Unable to map " << path << " of " << size << " bytes";
+  IGNORE_EINTR(close(fd));
+  if (data == MAP_FAILED)
+    return nullptr;
+  if (madvise(data, size, MADV_RANDOM) != 0)
+    PLOG(WARNING) << "Unable to disable the readahead of " << path;
+  return std::shared_ptr<MappedPartition>(
+      new MappedPartition(static_cast<uint8_t*>(data), size));
+}
+
+bool MappedPartition::Contains(const RepeatedPtrField<Extent>& extents,
+                               uint32_t block_size) const {
+  const uint64_t num_blocks = size_ / block_size;
+  for (const Extent& extent : extents) {
+    if (extent.start_block() > num_blocks ||
+        extent.num_blocks() > num_blocks - extent.start_block())
+      return false;
+  }
+  return true;
+}
+
+void MappedPartition::WillNeed(const RepeatedPtrField<Extent>& extents,
+                               uint32_t block_size) const {
+  static const uint64_t kPageSize = sysconf(_SC_PAGESIZE);
+  for (const Extent& extent : extents) {
+    uint64_t start = extent.start_block() * block_size;
+    uint64_t end = start + extent.num_blocks() * block_size;
+    if (start >= end || end > size_)
+      continue;
+    // madvise() takes page aligned addresses.
+    uint64_t aligned_start = start / kPageSize * kPageSize;
+    madvise(data_ + aligned_start, end - aligned_start, MADV_WILLNEED);
+  }
+}
+
+bool MmapExtentReader::Init(FileDescriptorPtr fd,
+                            const RepeatedPtrField<Extent>& extents,
+                            uint32_t block_size) {
+  ranges_.clear();
+  total_size_ = 0;
+  contiguous_data_ = nullptr;
+  offset_ = 0;
+  cur_range_ = 0;
+  TEST_AND_RETURN_FALSE(block_size > 0);
+  TEST_AND_RETURN_FALSE(partition_->Contains(extents, block_size));
+
+  bool contiguous = true;
+  uint64_t next_start = 0;
+  for (const Extent& extent : extents) {
+    if (extent.num_blocks() == 0)
+      continue;
+    uint64_t start = extent.start_block() * block_size;
+    uint64_t length = extent.num_blocks() * block_size;
+    if (!ranges_.empty() && start != next_start)
+      contiguous = false;
+    next_start = start + length;
+    total_size_ += length;
+    ranges_.push_back({start, total_size_});
+  }
+  if (contiguous && !ranges_.empty())
+    contiguous_data_ = partition_->data() + ranges_.front().start;
+  partition_->WillNeed(extents, block_size);
+  return true;
+}
+
+bool MmapExtentReader::Seek(uint64_t offset) {
+  TEST_AND_RETURN_FALSE(offset <= total_size_);
+  // The range whose end is past |offset|, or the end.
+  cur_range_ = std::upper_bound(ranges_.begin(),
+                                ranges_.end(),
+                                offset,
+                                [](uint64_t value, const Range& range) {
+                                  return value < range.end_offset;
+                                }) -
+               ranges_.begin();
+  offset_ = offset;
+  return true;
+}
+
+bool MmapExtentReader::Read(void* buffer, size_t count) {
+  TEST_AND_RETURN_FALSE(count <= total_size_ - offset_);
+  auto bytes = static_cast<uint8_t*>(buffer);
+  while (count > 0) {
+    const Range& range = ranges_[cur_range_];
+    uint64_t range_offset = cur_range_ ? ranges_[cur_range_ - 1].end_offset : 0;
+    size_t length = std::min<uint64_t>(count, range.end_offset - offset_);
+    memcpy(bytes,
+           partition_->data() + range.start + (offset_ - range_offset),
+           length);
+    bytes += length;
+    count -= length;
+    offset_ += length;
+    if (offset_ == range.end_offset)
+      cur_range_++;
+  }
+  return true;
+}
+
+}  // namespace chromeos_update_engine
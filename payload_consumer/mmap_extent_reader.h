@@ -0,0 +1,111 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_MMAP_EXTENT_READER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_MMAP_EXTENT_READER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/repeated_field.h>
+
+#include "update_engine/payload_consumer/extent_reader.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// A read-only memory mapping of a whole source partition, shared by the
+// readers of all the threads applying its operations.
+//
+// Reading a mapping that the kernel can't fill, because of an I/O error or a
+// file truncated meanwhile, raises SIGBUS instead of failing a read() call, so
+// it should only be used on partitions that are not modified while mapped.
+class MappedPartition {
+ public:
+  ~MappedPartition();
+  MappedPartition(const MappedPartition&) = delete;
+  MappedPartition& operator=(const MappedPartition&) = delete;
+
+  // Maps the whole file or block device at |path|. Returns null on error.
+  static std::shared_ptr<MappedPartition> Map(const std::string& path);
+
+  const uint8_t* data() const { return data_; }
+  uint64_t size() const { return size_; }
+
+  // Whether the |block_size| blocks of |extents| are all mapped.
+  bool Contains(const google::protobuf::RepeatedPtrField<Extent>& extents,
+                uint32_t block_size) const;
+
+  // Asks the kernel to start reading |extents| in the background, so they are
+  // in the page cache by the time they are accessed. The mapping is otherwise
+  // read without readahead, since patches access the source at random.
+  void WillNeed(const google::protobuf::RepeatedPtrField<Extent>& extents,
+                uint32_t block_size) const;
+
+ private:
+  MappedPartition(uint8_t* data, uint64_t size) : data_(data), size_(size) {}
+
+  uint8_t* data_;
+  uint64_t size_;
+};
+
+// An ExtentReader copying the data out of a MappedPartition instead of issuing
+// a system call for each read. The |fd| passed to Init() isn't used; it must
+// refer to the same data as the mapping.
+class MmapExtentReader : public ExtentReader {
+ public:
+  explicit MmapExtentReader(std::shared_ptr<const MappedPartition> partition)
+      : partition_(std::move(partition)) {}
+  MmapExtentReader(const MmapExtentReader&) = delete;
+  MmapExtentReader& operator=(const MmapExtentReader&) = delete;
+
+  ~MmapExtentReader() override = default;
+
+  // Fails if some of the |extents| are not mapped. Init() can be called again
+  // to read other extents.
+  bool Init(FileDescriptorPtr fd,
+            const google::protobuf::RepeatedPtrField<Extent>& extents,
+            uint32_t block_size) override;
+  bool Seek(uint64_t offset) override;
+  bool Read(void* buffer, size_t count) override;
+
+  // Returns the data of all the extents, if they are contiguous in the
+  // partition so it can be used in place, or null otherwise.
+  const uint8_t* contiguous_data() const { return contiguous_data_; }
+  uint64_t total_size() const { return total_size_; }
+
+ private:
+  std::shared_ptr<const MappedPartition> partition_;
+
+  // The start of each extent in the partition and the offset of its end if
+  // all the extents are concatenated.
+  struct Range {
+    uint64_t start;
+    uint64_t end_offset;
+  };
+  std::vector<Range> ranges_;
+  uint64_t total_size_{0};
+  const uint8_t* contiguous_data_{nullptr};
+
+  // Offset assuming all extents are concatenated, and the range it is in.
+  uint64_t offset_{0};
+  size_t cur_range_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_MMAP_EXTENT_READER_H_
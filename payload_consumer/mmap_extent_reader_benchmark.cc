@@ -0,0 +1,154 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <brillo/flag_helper.h>
+
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/extent_reader.h"
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+// This program compares the throughput of the DirectExtentReader with the
+// MmapExtentReader on a fragmented list of extents, reading the extents in
+// order as when a source is buffered, and at random offsets as bspatch does.
+// The file is in the page cache, so only the cost of the reads is measured.
+
+using google::protobuf::RepeatedPtrField;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+const uint32_t kBlockSize = 4096;
+
+// Returns the throughput in MiB/s of reading all the data of |reader| in
+// pieces of |read_size| bytes.
+double MeasureSequential(ExtentReader* reader,
+                         uint64_t total_size,
+                         size_t read_size) {
+  brillo::Blob buffer(read_size);
+  base::TimeTicks start = base::TimeTicks::Now();
+  CHECK(reader->Seek(0));
+  for (uint64_t offset = 0; offset < total_size; offset += read_size) {
+    size_t count = std::min<uint64_t>(read_size, total_size - offset);
+    CHECK(reader->Read(buffer.data(), count));
+  }
+  double seconds = (base::TimeTicks::Now() - start).InSecondsF();
+  return total_size / (1024.0 * 1024.0) / seconds;
+}
+
+// Returns the throughput in MiB/s of reading |read_size| bytes at each of
+// |offsets| through |reader|.
+double MeasureRandom(ExtentReader* reader,
+                     const vector<uint64_t>& offsets,
+                     size_t read_size) {
+  brillo::Blob buffer(read_size);
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (uint64_t offset : offsets) {
+    CHECK(reader->Seek(offset));
+    CHECK(reader->Read(buffer.data(), read_size));
+  }
+  double seconds = (base::TimeTicks::Now() - start).InSecondsF();
+  return offsets.size() * read_size / (1024.0 * 1024.0) / seconds;
+}
+
+int Main(int argc, char** argv) {
+  DEFINE_int32(data_mib, 256, "Size of the partition read, in MiB.");
+  DEFINE_int32(max_extent_blocks, 8, "Largest extent, in blocks.");
+  DEFINE_int32(read_size, 512, "Size of each read, in bytes.");
+  DEFINE_int32(random_reads, 1000000, "Number of reads at random offsets.");
+  brillo::FlagHelper::Init(
+      argc,
+      argv,
+      "Compares reading fragmented extents with DirectExtentReader and "
+      "MmapExtentReader.");
+  CHECK_GT(FLAGS_data_mib, 0);
+  CHECK_GT(FLAGS_max_extent_blocks, 0);
+  CHECK_GT(FLAGS_read_size, 0);
+
+  brillo::Blob data(static_cast<size_t>(FLAGS_data_mib) * 1024 * 1024);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = (i * 37 + i / kBlockSize) & 0xff;
+  ScopedTempFile file("extent_reader_benchmark.XXXXXX");
+  CHECK(utils::WriteFile(file.path().c_str(), data.data(), data.size()));
+
+  // Split the partition in extents of 1 to |FLAGS_max_extent_blocks| blocks
+  // and shuffle them.
+  std::mt19937 random(42);
+  vector<Extent> extents;
+  const uint64_t num_blocks = data.size() / kBlockSize;
+  for (uint64_t block = 0; block < num_blocks;) {
+    uint64_t length = std::min<uint64_t>(
+        random() % FLAGS_max_extent_blocks + 1, num_blocks - block);
+    extents.push_back(ExtentForRange(block, length));
+    block += length;
+  }
+  std::shuffle(extents.begin(), extents.end(), random);
+  RepeatedPtrField<Extent> extent_list(extents.begin(), extents.end());
+
+  const uint64_t total_size = num_blocks * kBlockSize;
+  vector<uint64_t> offsets(FLAGS_random_reads);
+  for (uint64_t& offset : offsets)
+    offset = random() % (total_size - FLAGS_read_size + 1);
+
+  FileDescriptorPtr fd(new EintrSafeFileDescriptor());
+  CHECK(fd->Open(file.path().c_str(), O_RDONLY));
+  DirectExtentReader direct_reader;
+  CHECK(direct_reader.Init(fd, extent_list, kBlockSize));
+  std::shared_ptr<MappedPartition> partition =
+      MappedPartition::Map(file.path());
+  CHECK(partition);
+  MmapExtentReader mmap_reader(partition);
+  CHECK(mmap_reader.Init(fd, extent_list, kBlockSize));
+  // Fault the mapping in, as the file is already in the page cache.
+  MeasureSequential(&mmap_reader, total_size, 1024 * 1024);
+
+  printf("%zu extents, %d bytes reads:\n", extents.size(), FLAGS_read_size);
+  double direct =
+      MeasureSequential(&direct_reader, total_size, FLAGS_read_size);
+  double mapped = MeasureSequential(&mmap_reader, total_size, FLAGS_read_size);
+  printf("  In order DirectExtentReader %10.1f MiB/s\n", direct);
+  printf("  In order MmapExtentReader   %10.1f MiB/s  x%.2f\n",
+         mapped,
+         mapped / direct);
+  direct = MeasureRandom(&direct_reader, offsets, FLAGS_read_size);
+  mapped = MeasureRandom(&mmap_reader, offsets, FLAGS_read_size);
+  printf("  Random   DirectExtentReader %10.1f MiB/s\n", direct);
+  printf("  Random   MmapExtentReader   %10.1f MiB/s  x%.2f\n",
+         mapped,
+         mapped / direct);
+  return 0;
+}
+
+}  // namespace
+
+}  // namespace chromeos_update_engine
+
+int main(int argc, char** argv) {
+  return chromeos_update_engine::Main(argc, argv);
+}
@@ -0,0 +1,140 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+using google::protobuf::RepeatedPtrField;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kBlockSize = 4096;
+const size_t kNumBlocks = 10;
+
+RepeatedPtrField<Extent> Extents(const vector<Extent>& extents) {
+  RepeatedPtrField<Extent> result;
+  for (const Extent& extent : extents)
+    *result.Add() = extent;
+  return result;
+}
+}  // namespace
+
+class MmapExtentReaderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    data_.resize(kNumBlocks * kBlockSize);
+    test_utils::FillWithData(&data_);
+    ASSERT_TRUE(test_utils::WriteFileVector(file_.path(), data_));
+    partition_ = MappedPartition::Map(file_.path());
+    ASSERT_NE(nullptr, partition_);
+  }
+
+  // The data of |extents| read straight from |data_|.
+  brillo::Blob ExtentsData(const vector<Extent>& extents) {
+    brillo::Blob result;
+    for (const Extent& extent : extents) {
+      result.insert(
+          result.end(),
+          data_.begin() + extent.start_block() * kBlockSize,
+          data_.begin() + (extent.start_block() + extent.num_blocks()) *
+                              kBlockSize);
+    }
+    return result;
+  }
+
+  brillo::Blob data_;
+  ScopedTempFile file_{"MmapExtentReaderTest.XXXXXX"};
+  std::shared_ptr<MappedPartition> partition_;
+};
+
+TEST_F(MmapExtentReaderTest, MapTest) {
+  EXPECT_EQ(data_.size(), partition_->size());
+  EXPECT_EQ(0, memcmp(data_.data(), partition_->data(), data_.size()));
+  EXPECT_TRUE(partition_->Contains(
+      Extents({ExtentForRange(0, kNumBlocks)}), kBlockSize));
+  EXPECT_FALSE(partition_->Contains(
+      Extents({ExtentForRange(2, 1), ExtentForRange(kNumBlocks - 1, 2)}),
+      kBlockSize));
+  EXPECT_EQ(nullptr, MappedPartition::Map("/non/existent/path"));
+}
+
+TEST_F(MmapExtentReaderTest, FragmentedReadTest) {
+  vector<Extent> extents = {
+      ExtentForRange(7, 2), ExtentForRange(1, 1), ExtentForRange(3, 3)};
+  MmapExtentReader reader(partition_);
+  ASSERT_TRUE(reader.Init(nullptr, Extents(extents), kBlockSize));
+  EXPECT_EQ(nullptr, reader.contiguous_data());
+  EXPECT_EQ(6 * kBlockSize, reader.total_size());
+
+  // Reads across the extents, in pieces not aligned to the blocks.
+  brillo::Blob expected = ExtentsData(extents);
+  brillo::Blob actual(expected.size());
+  const size_t kPieceSize = 1000;
+  for (size_t offset = 0; offset < actual.size(); offset += kPieceSize) {
+    EXPECT_TRUE(reader.Read(actual.data() + offset,
+                            std::min(kPieceSize, actual.size() - offset)));
+  }
+  EXPECT_EQ(expected, actual);
+  EXPECT_FALSE(reader.Read(actual.data(), 1));
+}
+
+TEST_F(MmapExtentReaderTest, SeekTest) {
+  vector<Extent> extents = {ExtentForRange(5, 2), ExtentForRange(0, 2)};
+  MmapExtentReader reader(partition_);
+  ASSERT_TRUE(reader.Init(nullptr, Extents(extents), kBlockSize));
+  brillo::Blob expected = ExtentsData(extents);
+  for (uint64_t offset :
+       {3 * kBlockSize + 10, 10UL, 2 * kBlockSize, 2 * kBlockSize - 1}) {
+    ASSERT_TRUE(reader.Seek(offset));
+    brillo::Blob actual(expected.size() - offset);
+    EXPECT_TRUE(reader.Read(actual.data(), actual.size()));
+    EXPECT_EQ(brillo::Blob(expected.begin() + offset, expected.end()), actual);
+  }
+  EXPECT_TRUE(reader.Seek(expected.size()));
+  EXPECT_FALSE(reader.Seek(expected.size() + 1));
+}
+
+TEST_F(MmapExtentReaderTest, ContiguousTest) {
+  // Adjacent extents, and empty ones, are used in place.
+  MmapExtentReader reader(partition_);
+  ASSERT_TRUE(reader.Init(nullptr,
+                          Extents({ExtentForRange(2, 3),
+                                   ExtentForRange(9, 0),
+                                   ExtentForRange(5, 1)}),
+                          kBlockSize));
+  EXPECT_EQ(partition_->data() + 2 * kBlockSize, reader.contiguous_data());
+  EXPECT_EQ(4 * kBlockSize, reader.total_size());
+
+  // Extents past the end of the mapping are rejected.
+  EXPECT_FALSE(reader.Init(
+      nullptr, Extents({ExtentForRange(kNumBlocks - 1, 2)}), kBlockSize));
+  EXPECT_EQ(nullptr, reader.contiguous_data());
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,340 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/parallel_operation_executor.h"
+
+#include <fcntl.h>
+
+#include <iterator>
+#include <utility>
+
+#include <base/logging.h>
+
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/apply_tracer.h"
+#include "update_engine/payload_consumer/cached_file_descriptor.h"
+#include "update_engine/payload_consumer/file_descriptor_utils.h"
+#include "update_engine/payload_consumer/io_uring_file_descriptor.h"
+#include "update_engine/payload_consumer/payload_constants.h"
+#include "update_engine/payload_consumer/source_data_cache.h"
+
+using std::string;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+// Size of the write cache of each worker's target file descriptor.
+const uint64_t kWorkerCacheSize = 1024 * 1024;  // 1MB
+
+// Returns whether |calculated_hash| is the source hash expected by
+// |operation|.
+bool SourceHashMatches(const InstallOperation& operation,
+                       const brillo::Blob& calculated_hash) {
+  brillo::Blob expected_hash(operation.src_sha256_hash().begin(),
+                             operation.src_sha256_hash().end());
+  return calculated_hash == expected_hash;
+}
+}  // namespace
+
+// Applies one queued operation from a worker thread.
+class ParallelOperationExecutor::OperationTask
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  OperationTask(ParallelOperationExecutor* executor, Operation* operation)
+      : executor_(executor),
+        operation_(operation),
+        queued_time_(base::TimeTicks::Now()) {}
+  OperationTask(const OperationTask&) = delete;
+  OperationTask& operator=(const OperationTask&) = delete;
+
+  ~OperationTask() override = default;
+
+  // Overrides DelegateSimpleThread::Delegate.
+  void Run() override {
+    WorkerFds* fds = executor_->AcquireFds();
+    base::TimeTicks start = base::TimeTicks::Now();
+    operation_->succeeded = executor_->ApplyOperation(*operation_, *fds);
+    executor_->ReleaseFds(fds);
+    if (executor_->apply_tracer_) {
+      executor_->apply_tracer_->AddOperation(operation_->operation,
+                                             operation_->operation_num,
+                                             executor_->block_size_,
+                                             start,
+                                             base::TimeTicks::Now(),
+                                             start - queued_time_);
+    }
+  }
+
+ private:
+  ParallelOperationExecutor* executor_;
+  Operation* operation_;
+  // When the operation was handed to the thread pool.
+  base::TimeTicks queued_time_;
+};
+
+ParallelOperationExecutor::ParallelOperationExecutor(size_t num_threads,
+                                                     uint32_t block_size)
+    : num_threads_(num_threads),
+      block_size_(block_size),
+      executor_(block_size) {
+  CHECK_GT(num_threads_, 0U);
+}
+
+ParallelOperationExecutor::~ParallelOperationExecutor() {
+  if (IsOpen())
+    Close();
+}
+
+bool ParallelOperationExecutor::Open(const string& source_path,
+                                     const string& target_path,
+                                     int target_flags) {
+  TEST_AND_RETURN_FALSE(!IsOpen());
+  for (size_t i = 0; i < num_threads_; i++) {
+    auto fds = std::make_unique<WorkerFds>();
+    if (!source_path.empty()) {
+      fds->source = std::make_shared<IoUringFileDescriptor>();
+      if (!fds->source->Open(source_path.c_str(), O_RDONLY)) {
+        PLOG(ERROR) << "Unable to open source " << source_path
+                    << " for worker " << i;
+        return false;
+      }
+    }
+    fds->target = std::make_shared<CachedFileDescriptor>(
+        std::make_shared<IoUringFileDescriptor>(), kWorkerCacheSize);
+    if (!fds->target->Open(target_path.c_str(), target_flags, 000)) {
+      PLOG(ERROR) << "Unable to open target " << target_path << " for worker "
+                  << i;
+      return false;
+    }
+    fds->arena = std::make_unique<PatchArena>(patch_arena_max_source_size_,
+                                              patch_arena_cache_size_);
+    if (source_mapping_ && fds->source)
+      fds->arena->SetSourceMapping(source_mapping_, fds->source);
+    idle_fds_.push_back(fds.get());
+    workers_fds_.push_back(std::move(fds));
+  }
+
+  thread_pool_ = std::make_unique<base::DelegateSimpleThreadPool>(
+      "apply-operation-worker", num_threads_);
+  thread_pool_->Start();
+  return true;
+}
+
+bool ParallelOperationExecutor::Close() {
+  // Operations still queued at this point belong to an aborted attempt and
+  // will be applied again on resume.
+  LOG_IF(WARNING, !queued_.empty())
+      << "Dropping " << queued_.size() << " queued operations.";
+  queued_.clear();
+  queued_blocks_.clear();
+  queued_bytes_ = 0;
+  if (thread_pool_) {
+    thread_pool_->JoinAll();
+    thread_pool_.reset();
+  }
+  bool success = true;
+  for (const auto& fds : workers_fds_) {
+    if (fds->source && fds->source->IsOpen() && !fds->source->Close()) {
+      PLOG(ERROR) << "Error closing worker source";
+      success = false;
+    }
+    if (fds->target->IsOpen() && !fds->target->Close()) {
+      PLOG(ERROR) << "Error closing worker target";
+      success = false;
+    }
+  }
+  idle_fds_.clear();
+  workers_fds_.clear();
+  return success;
+}
+
+bool ParallelOperationExecutor::IsSupported(const InstallOperation& operation) {
+  switch (operation.type()) {
+    case InstallOperation::REPLACE:
+    case InstallOperation::REPLACE_BZ:
+    case InstallOperation::REPLACE_XZ:
+    case InstallOperation::REPLACE_ZSTD:
+    case InstallOperation::ZERO:
+    case InstallOperation::DISCARD:
+      return true;
+    case InstallOperation::SOURCE_COPY:
+    case InstallOperation::SOURCE_BSDIFF:
+    case InstallOperation::BROTLI_BSDIFF:
+    case InstallOperation::PUFFDIFF:
+      return operation.has_src_sha256_hash();
+    default:
+      return false;
+  }
+}
+
+bool ParallelOperationExecutor::CanQueue(
+    const InstallOperation& operation) const {
+  if (!IsOpen() || !IsSupported(operation))
+    return false;
+  for (const Extent& extent : operation.dst_extents()) {
+    if (extent.start_block() == kSparseHole || extent.num_blocks() == 0)
+      continue;
+    uint64_t start = extent.start_block();
+    uint64_t end = start + extent.num_blocks();
+    // The first queued extent starting at or after |end| can't overlap, so
+    // only the one right before it needs to be checked.
+    auto it = queued_blocks_.lower_bound(end);
+    if (it != queued_blocks_.begin() && std::prev(it)->second > start)
+      return false;
+  }
+  return true;
+}
+
+void ParallelOperationExecutor::Queue(Operation operation) {
+  DCHECK(CanQueue(operation.operation));
+  for (const Extent& extent : operation.operation.dst_extents()) {
+    if (extent.start_block() == kSparseHole || extent.num_blocks() == 0)
+      continue;
+    queued_blocks_[extent.start_block()] =
+        extent.start_block() + extent.num_blocks();
+  }
+  queued_bytes_ += operation.data.size();
+  queued_.push_back(std::move(operation));
+}
+
+bool ParallelOperationExecutor::RunBatch(vector<Operation>* operations) {
+  operations->clear();
+  vector<std::unique_ptr<OperationTask>> tasks;
+  tasks.reserve(queued_.size());
+  {
+    base::AutoLock auto_lock(lock_);
+    pending_tasks_ = queued_.size();
+  }
+  for (Operation& operation : queued_) {
+    tasks.push_back(std::make_unique<OperationTask>(this, &operation));
+    thread_pool_->AddWork(tasks.back().get());
+  }
+  {
+    base::AutoLock auto_lock(lock_);
+    while (pending_tasks_ > 0)
+      batch_done_.Wait();
+  }
+
+  *operations = std::move(queued_);
+  queued_.clear();
+  queued_blocks_.clear();
+  queued_bytes_ = 0;
+
+  bool success = true;
+  for (const auto& fds : workers_fds_) {
+    if (!fds->target->Flush()) {
+      PLOG(ERROR) << "Failed to flush worker target";
+      success = false;
+    }
+  }
+  return success;
+}
+
+bool ParallelOperationExecutor::ApplyOperation(const Operation& operation,
+                                               const WorkerFds& fds) {
+  const InstallOperation& op = operation.operation;
+  switch (op.type()) {
+    case InstallOperation::REPLACE:
+    case InstallOperation::REPLACE_BZ:
+    case InstallOperation::REPLACE_XZ:
+    case InstallOperation::REPLACE_ZSTD:
+      return executor_.ExecuteReplaceOperation(
+          op, fds.target, operation.data.data(), operation.data.size());
+    case InstallOperation::ZERO:
+    case InstallOperation::DISCARD:
+      return executor_.ExecuteZeroOrDiscardOperation(op, fds.target);
+    case InstallOperation::SOURCE_COPY: {
+      std::shared_ptr<const brillo::Blob> source_data;
+      if (source_data_cache_)
+        source_data = source_data_cache_->Get(op, fds.source, block_size_);
+      if (source_data) {
+        ExtentWriter* writer =
+            fds.arena->InitWriter(fds.target, op.dst_extents(), block_size_);
+        return writer &&
+               writer->Write(source_data->data(), source_data->size());
+      }
+      brillo::Blob source_hash;
+      if (!executor_.ExecuteSourceCopyOperation(
+              op, fds.target, fds.source, &source_hash) ||
+          !SourceHashMatches(op, source_hash)) {
+        LOG(WARNING) << "Source data of operation " << operation.operation_num
+                     << " can't be verified, deferring it.";
+        return false;
+      }
+      return true;
+    }
+    case InstallOperation::SOURCE_BSDIFF:
+    case InstallOperation::BROTLI_BSDIFF:
+    case InstallOperation::PUFFDIFF: {
+      std::shared_ptr<const brillo::Blob> source_data;
+      if (source_data_cache_)
+        source_data = source_data_cache_->Get(op, fds.source, block_size_);
+      if (source_data) {
+        return executor_.ExecuteSourceBsdiffOperation(op,
+                                                      fds.target,
+                                                      *source_data,
+                                                      operation.data.data(),
+                                                      operation.data.size(),
+                                                      fds.arena.get());
+      }
+      brillo::Blob source_hash;
+      if (!fds.source ||
+          !fd_utils::ReadAndHashExtents(
+              fds.source, op.src_extents(), block_size_, &source_hash) ||
+          !SourceHashMatches(op, source_hash)) {
+        LOG(WARNING) << "Source data of operation " << operation.operation_num
+                     << " can't be verified, deferring it.";
+        return false;
+      }
+      if (op.type() == InstallOperation::PUFFDIFF) {
+        return executor_.ExecutePuffDiffOperation(op,
+                                                  fds.target,
+                                                  fds.source,
+                                                  operation.data.data(),
+                                                  operation.data.size(),
+                                                  fds.arena.get());
+      }
+      return executor_.ExecuteSourceBsdiffOperation(op,
+                                                    fds.target,
+                                                    fds.source,
+                                                    operation.data.data(),
+                                                    operation.data.size(),
+                                                    fds.arena.get());
+    }
+    default:
+      return false;
+  }
+}
+
+ParallelOperationExecutor::WorkerFds* ParallelOperationExecutor::AcquireFds() {
+  base::AutoLock auto_lock(lock_);
+  // There are as many sets of file descriptors as workers, so there is always
+  // an idle one for the running task.
+  CHECK(!idle_fds_.empty());
+  WorkerFds* fds = idle_fds_.back();
+  idle_fds_.pop_back();
+  return fds;
+}
+
+void ParallelOperationExecutor::ReleaseFds(WorkerFds* fds) {
+  base::AutoLock auto_lock(lock_);
+  idle_fds_.push_back(fds);
+  if (--pending_tasks_ == 0)
+    batch_done_.Signal();
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,182 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_PARALLEL_OPERATION_EXECUTOR_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_PARALLEL_OPERATION_EXECUTOR_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/payload_consumer/install_operation_executor.h"
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+#include "update_engine/payload_consumer/patch_arena.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+class ApplyTracer;
+class SourceDataCache;
+
+// Applies batches of InstallOperations of a single partition on a pool of
+// worker threads. Operations are only queued in the same batch when their
+// destination extents don't overlap, so the order in which the workers run
+// them doesn't matter. Each worker reads and writes through its own file
+// descriptors since their write cache and io_uring can't be shared between
+// threads.
+//
+// Workers only take the fast path: when the source data of an operation
+// doesn't match its expected hash, the operation is reported as failed and
+// must be retried by the caller, which knows how to fall back to the error
+// corrected source device.
+class ParallelOperationExecutor {
+ public:
+  // A single operation queued for execution.
+  struct Operation {
+    // Index of the operation in the whole payload.
+    size_t operation_num{0};
+    InstallOperation operation;
+    // The data blob of the operation, if any.
+    brillo::Blob data;
+    // Whether the operation was successfully applied. Only valid after the
+    // batch containing it ran.
+    bool succeeded{false};
+  };
+
+  ParallelOperationExecutor(size_t num_threads, uint32_t block_size);
+  ParallelOperationExecutor(const ParallelOperationExecutor&) = delete;
+  ParallelOperationExecutor& operator=(const ParallelOperationExecutor&) =
+      delete;
+
+  ~ParallelOperationExecutor();
+
+  // Sets the sizes of the PatchArena of each worker, see PatchArena. Takes
+  // effect the next time the executor is opened.
+  void set_patch_arena_sizes(size_t max_source_size,
+                             size_t puffpatch_cache_size) {
+    patch_arena_max_source_size_ = max_source_size;
+    patch_arena_cache_size_ = puffpatch_cache_size;
+  }
+
+  // Sets the mapping of the source partition the workers read the diff
+  // sources from, see PatchArena::SetSourceMapping(). Takes effect the next
+  // time the executor is opened.
+  void set_source_mapping(std::shared_ptr<const MappedPartition> mapping) {
+    source_mapping_ = std::move(mapping);
+  }
+
+  // Sets the cache the workers share the source data of the SOURCE_COPY and
+  // bsdiff operations through, see SourceDataCache. It must outlive the
+  // executor. No cache is used when null.
+  void set_source_data_cache(SourceDataCache* cache) {
+    source_data_cache_ = cache;
+  }
+
+  // Sets the tracer the workers record the operations they apply on, see
+  // ApplyTracer. It must outlive the executor. Nothing is traced when null.
+  void set_apply_tracer(ApplyTracer* tracer) { apply_tracer_ = tracer; }
+
+  // Opens one set of file descriptors per worker and starts the workers. The
+  // |source_path| may be empty when the partition has no source. The target is
+  // opened with |target_flags|. Returns whether all the files could be opened.
+  bool Open(const std::string& source_path,
+            const std::string& target_path,
+            int target_flags);
+
+  // Stops the workers and closes their file descriptors, dropping any queued
+  // operation. Returns whether all the files were closed.
+  bool Close();
+
+  // Returns whether |operation| is of a type the workers can apply. Operations
+  // reading from the source partition are only supported when they carry the
+  // source hash, since it is the only way for the workers to detect that the
+  // slow, error corrected, path is needed.
+  static bool IsSupported(const InstallOperation& operation);
+
+  // Returns whether |operation| can be added to the current batch, that is,
+  // the executor is open and the operation doesn't write to any block written
+  // by an operation already queued.
+  bool CanQueue(const InstallOperation& operation) const;
+
+  // Adds |operation| to the current batch. CanQueue() must be true.
+  void Queue(Operation operation);
+
+  // Number of operations and data bytes in the current batch.
+  size_t num_queued() const { return queued_.size(); }
+  size_t queued_bytes() const { return queued_bytes_; }
+
+  // Applies all the queued operations, waits for them to finish and flushes
+  // the target file descriptors. The operations, in queued order, are moved
+  // into |operations| with their |succeeded| field set. Returns false only if
+  // flushing the target failed; failures of individual operations are
+  // reported through |succeeded|.
+  bool RunBatch(std::vector<Operation>* operations);
+
+  bool IsOpen() const { return !workers_fds_.empty(); }
+
+ private:
+  // The file descriptors and scratch objects used by a single worker.
+  struct WorkerFds {
+    FileDescriptorPtr source;
+    FileDescriptorPtr target;
+    std::unique_ptr<PatchArena> arena;
+  };
+
+  class OperationTask;
+
+  // Applies |operation| using |fds|. Called from the worker threads.
+  bool ApplyOperation(const Operation& operation, const WorkerFds& fds);
+
+  // Called by the worker threads to get and return a set of file descriptors.
+  WorkerFds* AcquireFds();
+  void ReleaseFds(WorkerFds* fds);
+
+  const size_t num_threads_;
+  const uint32_t block_size_;
+  InstallOperationExecutor executor_;
+  size_t patch_arena_max_source_size_{PatchArena::kDefaultMaxSourceSize};
+  size_t patch_arena_cache_size_{PatchArena::kDefaultPuffpatchCacheSize};
+  std::shared_ptr<const MappedPartition> source_mapping_;
+  SourceDataCache* source_data_cache_{nullptr};
+  ApplyTracer* apply_tracer_{nullptr};
+
+  std::vector<std::unique_ptr<WorkerFds>> workers_fds_;
+  std::unique_ptr<base::DelegateSimpleThreadPool> thread_pool_;
+
+  // The current batch and the blocks it writes to, as a map from the first
+  // block of each queued destination extent to its end.
+  std::vector<Operation> queued_;
+  std::map<uint64_t, uint64_t> queued_blocks_;
+  size_t queued_bytes_{0};
+
+  // Protects the members below, which are accessed by the workers.
+  base::Lock lock_;
+  base::ConditionVariable batch_done_{&lock_};
+  std::vector<WorkerFds*> idle_fds_;
+  size_t pending_tasks_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_PARALLEL_OPERATION_EXECUTOR_H_
@@ -0,0 +1,158 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/parallel_operation_executor.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kBlockSize = 4096;
+const size_t kNumBlocks = 8;
+}  // namespace
+
+class ParallelOperationExecutorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    EXPECT_TRUE(test_utils::WriteFileVector(
+        source_file_.path(), brillo::Blob(kNumBlocks * kBlockSize, 's')));
+    EXPECT_TRUE(test_utils::WriteFileVector(
+        target_file_.path(), brillo::Blob(kNumBlocks * kBlockSize, 't')));
+    EXPECT_TRUE(
+        executor_.Open(source_file_.path(), target_file_.path(), O_RDWR));
+  }
+
+  // Returns a REPLACE operation writing |num_blocks| of |value| at
+  // |start_block|.
+  ParallelOperationExecutor::Operation ReplaceOperation(uint64_t start_block,
+                                                        uint64_t num_blocks,
+                                                        uint8_t value) {
+    ParallelOperationExecutor::Operation operation;
+    operation.operation.set_type(InstallOperation::REPLACE);
+    *operation.operation.add_dst_extents() =
+        ExtentForRange(start_block, num_blocks);
+    operation.operation.set_data_length(num_blocks * kBlockSize);
+    operation.data = brillo::Blob(num_blocks * kBlockSize, value);
+    return operation;
+  }
+
+  ScopedTempFile source_file_{"parallel_src.XXXXXX"};
+  ScopedTempFile target_file_{"parallel_tgt.XXXXXX"};
+  ParallelOperationExecutor executor_{4, kBlockSize};
+};
+
+TEST_F(ParallelOperationExecutorTest, IsSupportedTest) {
+  InstallOperation op;
+  op.set_type(InstallOperation::REPLACE_XZ);
+  EXPECT_TRUE(ParallelOperationExecutor::IsSupported(op));
+  op.set_type(InstallOperation::ZERO);
+  EXPECT_TRUE(ParallelOperationExecutor::IsSupported(op));
+
+  // Source operations are only supported when they can be verified.
+  op.set_type(InstallOperation::SOURCE_COPY);
+  EXPECT_FALSE(ParallelOperationExecutor::IsSupported(op));
+  op.set_src_sha256_hash("hash");
+  EXPECT_TRUE(ParallelOperationExecutor::IsSupported(op));
+
+  op.set_type(InstallOperation::MOVE);
+  EXPECT_FALSE(ParallelOperationExecutor::IsSupported(op));
+}
+
+TEST_F(ParallelOperationExecutorTest, OverlappingOperationsTest) {
+  executor_.Queue(ReplaceOperation(2, 2, 'a'));
+  executor_.Queue(ReplaceOperation(5, 1, 'b'));
+
+  EXPECT_FALSE(executor_.CanQueue(ReplaceOperation(3, 1, 'c').operation));
+  EXPECT_FALSE(executor_.CanQueue(ReplaceOperation(0, 3, 'c').operation));
+  EXPECT_FALSE(executor_.CanQueue(ReplaceOperation(4, 4, 'c').operation));
+  EXPECT_TRUE(executor_.CanQueue(ReplaceOperation(4, 1, 'c').operation));
+  EXPECT_TRUE(executor_.CanQueue(ReplaceOperation(0, 2, 'c').operation));
+  EXPECT_TRUE(executor_.CanQueue(ReplaceOperation(6, 2, 'c').operation));
+  EXPECT_EQ(2U, executor_.num_queued());
+  EXPECT_EQ(3 * kBlockSize, executor_.queued_bytes());
+
+  // The queue is empty after running a batch.
+  vector<ParallelOperationExecutor::Operation> operations;
+  EXPECT_TRUE(executor_.RunBatch(&operations));
+  EXPECT_EQ(0U, executor_.num_queued());
+  EXPECT_TRUE(executor_.CanQueue(ReplaceOperation(3, 1, 'c').operation));
+}
+
+TEST_F(ParallelOperationExecutorTest, RunBatchTest) {
+  brillo::Blob expected(kNumBlocks * kBlockSize, 't');
+  for (size_t i = 0; i < kNumBlocks; i += 2) {
+    executor_.Queue(ReplaceOperation(i, 1, 'a' + i));
+    std::fill(expected.begin() + i * kBlockSize,
+              expected.begin() + (i + 1) * kBlockSize,
+              'a' + i);
+  }
+  ParallelOperationExecutor::Operation zero;
+  zero.operation.set_type(InstallOperation::ZERO);
+  *zero.operation.add_dst_extents() = ExtentForRange(1, 1);
+  executor_.Queue(zero);
+  std::fill(
+      expected.begin() + kBlockSize, expected.begin() + 2 * kBlockSize, 0);
+
+  vector<ParallelOperationExecutor::Operation> operations;
+  EXPECT_TRUE(executor_.RunBatch(&operations));
+  EXPECT_EQ(kNumBlocks / 2 + 1, operations.size());
+  for (const auto& operation : operations)
+    EXPECT_TRUE(operation.succeeded);
+
+  brillo::Blob target;
+  EXPECT_TRUE(utils::ReadFile(target_file_.path(), &target));
+  EXPECT_EQ(expected, target);
+}
+
+TEST_F(ParallelOperationExecutorTest, SourceHashMismatchTest) {
+  brillo::Blob source_data(kBlockSize, 's');
+  brillo::Blob source_hash;
+  EXPECT_TRUE(HashCalculator::RawHashOfData(source_data, &source_hash));
+
+  ParallelOperationExecutor::Operation good;
+  good.operation.set_type(InstallOperation::SOURCE_COPY);
+  *good.operation.add_src_extents() = ExtentForRange(0, 1);
+  *good.operation.add_dst_extents() = ExtentForRange(0, 1);
+  good.operation.set_src_sha256_hash(source_hash.data(), source_hash.size());
+  executor_.Queue(good);
+
+  ParallelOperationExecutor::Operation bad = good;
+  *bad.operation.mutable_dst_extents(0) = ExtentForRange(1, 1);
+  bad.operation.set_src_sha256_hash("bad hash");
+  executor_.Queue(bad);
+
+  vector<ParallelOperationExecutor::Operation> operations;
+  EXPECT_TRUE(executor_.RunBatch(&operations));
+  ASSERT_EQ(2U, operations.size());
+  EXPECT_TRUE(operations[0].succeeded);
+  // Failed operations are reported to be retried by the caller.
+  EXPECT_FALSE(operations[1].succeeded);
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,218 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/parallel_partition_hasher.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <base/logging.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/io_uring_file_descriptor.h"
+
+using std::string;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+const size_t ParallelPartitionHasher::kReadSize = 1024 * 1024;  // 1 MiB
+const size_t ParallelPartitionHasher::kReadQueueDepth = 8;
+const size_t ParallelPartitionHasher::kDefaultMemoryBudget =
+    32 * 1024 * 1024;  // 32 MiB
+
+// Hashes one partition from a worker thread.
+class ParallelPartitionHasher::PartitionTask
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  PartitionTask(ParallelPartitionHasher* hasher, Partition* partition)
+      : hasher_(hasher), partition_(partition) {}
+  PartitionTask(const PartitionTask&) = delete;
+  PartitionTask& operator=(const PartitionTask&) = delete;
+
+  ~PartitionTask() override = default;
+
+  // Overrides DelegateSimpleThread::Delegate.
+  void Run() override {
+    bool succeeded = hasher_->HashPartition(partition_);
+    base::AutoLock auto_lock(hasher_->lock_);
+    partition_->succeeded = succeeded;
+    partition_->done = true;
+    hasher_->num_done_++;
+  }
+
+ private:
+  ParallelPartitionHasher* hasher_;
+  Partition* partition_;
+};
+
+ParallelPartitionHasher::ParallelPartitionHasher(size_t num_threads,
+                                                 size_t memory_budget)
+    : num_threads_(num_threads),
+      memory_budget_(std::max(memory_budget, kReadSize)),
+      available_memory_(memory_budget_) {
+  CHECK_GT(num_threads_, 0U);
+}
+
+ParallelPartitionHasher::~ParallelPartitionHasher() {
+  Cancel();
+}
+
+size_t ParallelPartitionHasher::AddPartition(const string& path,
+                                             uint64_t size) {
+  CHECK(!thread_pool_);
+  auto partition = std::make_unique<Partition>();
+  partition->path = path;
+  partition->size = size;
+  partitions_.push_back(std::move(partition));
+  return partitions_.size() - 1;
+}
+
+void ParallelPartitionHasher::Start() {
+  CHECK(!thread_pool_);
+  size_t num_threads = std::min(num_threads_, partitions_.size());
+  if (num_threads == 0)
+    return;
+  thread_pool_ = std::make_unique<base::DelegateSimpleThreadPool>(
+      "partition-hash-worker", num_threads);
+  thread_pool_->Start();
+  for (const auto& partition : partitions_) {
+    tasks_.push_back(std::make_unique<PartitionTask>(this, partition.get()));
+    thread_pool_->AddWork(tasks_.back().get());
+  }
+}
+
+void ParallelPartitionHasher::Cancel() {
+  if (!thread_pool_)
+    return;
+  {
+    base::AutoLock auto_lock(lock_);
+    cancelled_ = true;
+    memory_released_.Broadcast();
+  }
+  thread_pool_->JoinAll();
+  thread_pool_.reset();
+  tasks_.clear();
+}
+
+bool ParallelPartitionHasher::IsDone() const {
+  base::AutoLock auto_lock(lock_);
+  return num_done_ == partitions_.size();
+}
+
+uint64_t ParallelPartitionHasher::hashed_bytes(size_t index) const {
+  base::AutoLock auto_lock(lock_);
+  return partitions_[index]->hashed_bytes;
+}
+
+bool ParallelPartitionHasher::GetHash(size_t index, brillo::Blob* hash) const {
+  base::AutoLock auto_lock(lock_);
+  const Partition& partition = *partitions_[index];
+  TEST_AND_RETURN_FALSE(partition.done && partition.succeeded);
+  *hash = partition.hash;
+  return true;
+}
+
+bool ParallelPartitionHasher::HashPartition(Partition* partition) {
+  IoUringFileDescriptor fd(kReadQueueDepth);
+  if (!fd.Open(partition->path.c_str(), O_RDONLY)) {
+    PLOG(ERROR) << "Unable to open " << partition->path << " for hashing";
+    return false;
+  }
+
+  // The buffer is held until the whole partition is hashed, so it isn't
+  // reallocated for every batch.
+  size_t max_batch_size = static_cast<size_t>(std::min<uint64_t>(
+      partition->size, kReadSize * kReadQueueDepth));
+  size_t batch_size = 0;
+  if (max_batch_size > 0) {
+    batch_size =
+        AcquireMemory(std::min(max_batch_size, kReadSize), max_batch_size);
+    if (batch_size == 0) {
+      fd.Close();
+      return false;
+    }
+  }
+  brillo::Blob buffer(batch_size);
+
+  HashCalculator hasher;
+  bool success = true;
+  uint64_t offset = 0;
+  vector<FileDescriptor::ReadRequest> requests;
+  while (offset < partition->size) {
+    if (cancelled_) {
+      success = false;
+      break;
+    }
+    size_t length = static_cast<size_t>(
+        std::min<uint64_t>(partition->size - offset, buffer.size()));
+    requests.clear();
+    for (size_t done = 0; done < length; done += kReadSize) {
+      requests.push_back({buffer.data() + done,
+                          std::min(kReadSize, length - done),
+                          static_cast<off64_t>(offset + done)});
+    }
+    if (!fd.ReadBatch(requests)) {
+      PLOG(ERROR) << "Unable to read " << length << " bytes at " << offset
+                  << " from " << partition->path;
+      success = false;
+      break;
+    }
+    if (!hasher.Update(buffer.data(), length)) {
+      success = false;
+      break;
+    }
+    offset += length;
+    base::AutoLock auto_lock(lock_);
+    partition->hashed_bytes = offset;
+  }
+  buffer.clear();
+  buffer.shrink_to_fit();
+  ReleaseMemory(batch_size);
+  fd.Close();
+
+  if (!success || !hasher.Finalize())
+    return false;
+  base::AutoLock auto_lock(lock_);
+  partition->hash = hasher.raw_hash();
+  return true;
+}
+
+size_t ParallelPartitionHasher::AcquireMemory(size_t min_size,
+                                              size_t max_size) {
+  base::AutoLock auto_lock(lock_);
+  while (!cancelled_ && available_memory_ < min_size)
+    memory_released_.Wait();
+  if (cancelled_)
+    return 0;
+  size_t size = std::min(max_size, available_memory_);
+  // Whole reads only, unless the partition is smaller than one.
+  if (size > kReadSize)
+    size -= size % kReadSize;
+  available_memory_ -= size;
+  return size;
+}
+
+void ParallelPartitionHasher::ReleaseMemory(size_t size) {
+  base::AutoLock auto_lock(lock_);
+  available_memory_ += size;
+  memory_released_.Broadcast();
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,120 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_PARALLEL_PARTITION_HASHER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_PARALLEL_PARTITION_HASHER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
+#include <brillo/secure_blob.h>
+
+namespace chromeos_update_engine {
+
+// Hashes several partitions at once on a pool of worker threads, for
+// FilesystemVerifierAction. Each partition is read by a single worker in
+// batches of large reads submitted together through an io_uring, so the
+// device has several requests in flight per partition. The read buffers of the
+// workers are taken from a shared budget, which caps the memory used no matter
+// the number of threads.
+//
+// The caller adds the partitions, starts the workers and polls the progress
+// until IsDone(). The methods must all be called from the same thread.
+class ParallelPartitionHasher {
+ public:
+  // Size of each read and number of reads submitted at once per partition.
+  static const size_t kReadSize;
+  static const size_t kReadQueueDepth;
+  // Default memory budget shared by the read buffers of all the workers.
+  static const size_t kDefaultMemoryBudget;
+
+  ParallelPartitionHasher(size_t num_threads,
+                          size_t memory_budget = kDefaultMemoryBudget);
+  ParallelPartitionHasher(const ParallelPartitionHasher&) = delete;
+  ParallelPartitionHasher& operator=(const ParallelPartitionHasher&) = delete;
+
+  ~ParallelPartitionHasher();
+
+  // Adds the first |size| bytes of the file at |path| to the data to hash.
+  // Returns the index of the partition in the other methods. Must be called
+  // before Start().
+  size_t AddPartition(const std::string& path, uint64_t size);
+
+  // Starts hashing the partitions, in the order they were added.
+  void Start();
+
+  // Stops hashing and waits for the workers to return. The partitions not
+  // fully hashed yet are reported as failed.
+  void Cancel();
+
+  // Whether all the partitions were hashed, or failed to be.
+  bool IsDone() const;
+
+  // The number of bytes of partition |index| hashed so far.
+  uint64_t hashed_bytes(size_t index) const;
+
+  // Stores the hash of partition |index| in |hash|. Returns false if the
+  // partition couldn't be read, or isn't done yet.
+  bool GetHash(size_t index, brillo::Blob* hash) const;
+
+ private:
+  // A partition to hash. Only |hashed_bytes|, |done|, |succeeded| and |hash|
+  // are modified by the workers, under |lock_|.
+  struct Partition {
+    std::string path;
+    uint64_t size{0};
+    uint64_t hashed_bytes{0};
+    bool done{false};
+    bool succeeded{false};
+    brillo::Blob hash;
+  };
+
+  class PartitionTask;
+
+  // Reads and hashes |partition|. Called from the worker threads. Returns
+  // false on read errors or if cancelled.
+  bool HashPartition(Partition* partition);
+
+  // Waits until at least |min_size| bytes of the memory budget are available,
+  // then takes up to |max_size| bytes of it. Returns the size taken.
+  size_t AcquireMemory(size_t min_size, size_t max_size);
+  void ReleaseMemory(size_t size);
+
+  const size_t num_threads_;
+  const size_t memory_budget_;
+
+  std::vector<std::unique_ptr<Partition>> partitions_;
+  std::vector<std::unique_ptr<PartitionTask>> tasks_;
+  std::unique_ptr<base::DelegateSimpleThreadPool> thread_pool_;
+
+  std::atomic<bool> cancelled_{false};
+
+  // Protects the members below and the fields of |partitions_| updated by the
+  // workers.
+  mutable base::Lock lock_;
+  base::ConditionVariable memory_released_{&lock_};
+  size_t available_memory_;
+  size_t num_done_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_PARALLEL_PARTITION_HASHER_H_
@@ -0,0 +1,104 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/parallel_partition_hasher.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+
+namespace chromeos_update_engine {
+
+class ParallelPartitionHasherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // Partitions smaller, larger and not a multiple of a batch.
+    const std::vector<size_t> sizes = {
+        0,
+        100,
+        ParallelPartitionHasher::kReadSize * 3 + 5,
+        ParallelPartitionHasher::kReadSize *
+                ParallelPartitionHasher::kReadQueueDepth * 2 +
+            4096,
+    };
+    for (size_t size : sizes) {
+      brillo::Blob data(size);
+      test_utils::FillWithData(&data);
+      files_.push_back(std::make_unique<ScopedTempFile>("hasher.XXXXXX"));
+      EXPECT_TRUE(test_utils::WriteFileVector(files_.back()->path(), data));
+      data_.push_back(std::move(data));
+    }
+  }
+
+  // Hashes all the files with |hasher| and checks the results.
+  void HashAll(ParallelPartitionHasher* hasher) {
+    for (size_t i = 0; i < files_.size(); i++)
+      EXPECT_EQ(i, hasher->AddPartition(files_[i]->path(), data_[i].size()));
+    hasher->Start();
+    while (!hasher->IsDone()) {
+    }
+    for (size_t i = 0; i < files_.size(); i++) {
+      brillo::Blob expected_hash, hash;
+      EXPECT_TRUE(HashCalculator::RawHashOfData(data_[i], &expected_hash));
+      EXPECT_TRUE(hasher->GetHash(i, &hash)) << "partition " << i;
+      EXPECT_EQ(expected_hash, hash) << "partition " << i;
+      EXPECT_EQ(data_[i].size(), hasher->hashed_bytes(i));
+    }
+  }
+
+  std::vector<std::unique_ptr<ScopedTempFile>> files_;
+  std::vector<brillo::Blob> data_;
+};
+
+TEST_F(ParallelPartitionHasherTest, HashTest) {
+  ParallelPartitionHasher hasher(3);
+  HashAll(&hasher);
+}
+
+TEST_F(ParallelPartitionHasherTest, SmallMemoryBudgetTest) {
+  // The workers take turns when the budget only allows one read at a time.
+  ParallelPartitionHasher hasher(4, 1);
+  HashAll(&hasher);
+}
+
+TEST_F(ParallelPartitionHasherTest, ReadErrorTest) {
+  ParallelPartitionHasher hasher(2);
+  size_t missing = hasher.AddPartition("/non/existent/path", 4096);
+  size_t short_file = hasher.AddPartition(files_[1]->path(), 4096);
+  hasher.Start();
+  while (!hasher.IsDone()) {
+  }
+  brillo::Blob hash;
+  EXPECT_FALSE(hasher.GetHash(missing, &hash));
+  EXPECT_FALSE(hasher.GetHash(short_file, &hash));
+}
+
+TEST_F(ParallelPartitionHasherTest, CancelTest) {
+  ParallelPartitionHasher hasher(1);
+  size_t index = hasher.AddPartition(files_[3]->path(), data_[3].size());
+  hasher.Start();
+  hasher.Cancel();
+  // The partition may have been hashed before the cancellation.
+  brillo::Blob hash;
+  if (hasher.GetHash(index, &hash))
+    EXPECT_EQ(data_[3].size(), hasher.hashed_bytes(index));
+}
+
+}  // namespace chromeos_update_engine
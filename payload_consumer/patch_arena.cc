@@ -0,0 +1,89 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/patch_arena.h"
+
+#include <utility>
+
+#include "update_engine/common/utils.h"
+
+using google::protobuf::RepeatedPtrField;
+
+namespace chromeos_update_engine {
+
+const size_t PatchArena::kDefaultMaxSourceSize = 4 * 1024 * 1024;       // 4MB
+const size_t PatchArena::kDefaultPuffpatchCacheSize = 5 * 1024 * 1024;  // 5MB
+
+void PatchArena::SetSourceMapping(
+    std::shared_ptr<const MappedPartition> mapping, FileDescriptorPtr fd) {
+  if (mapping) {
+    mmap_reader_ = std::make_unique<MmapExtentReader>(std::move(mapping));
+    mapped_fd_ = fd;
+  } else {
+    mmap_reader_.reset();
+    mapped_fd_.reset();
+  }
+}
+
+ExtentReader* PatchArena::InitReader(FileDescriptorPtr fd,
+                                     const RepeatedPtrField<Extent>& extents,
+                                     uint32_t block_size) {
+  // Extents past the mapping are still read through |fd|.
+  if (mmap_reader_ && fd == mapped_fd_ &&
+      mmap_reader_->Init(fd, extents, block_size)) {
+    return mmap_reader_.get();
+  }
+  if (!reader_.Init(fd, extents, block_size))
+    return nullptr;
+  return &reader_;
+}
+
+ExtentWriter* PatchArena::InitWriter(FileDescriptorPtr fd,
+                                     const RepeatedPtrField<Extent>& extents,
+                                     uint32_t block_size) {
+  if (!writer_.Init(fd, extents, block_size))
+    return nullptr;
+  return &writer_;
+}
+
+bool PatchArena::CanBufferSource(const RepeatedPtrField<Extent>& extents,
+                                 uint32_t block_size) const {
+  return utils::BlocksInExtents(extents) * block_size <= max_source_size_;
+}
+
+bool PatchArena::ReadSource(FileDescriptorPtr fd,
+                            const RepeatedPtrField<Extent>& extents,
+                            uint32_t block_size) {
+  TEST_AND_RETURN_FALSE(CanBufferSource(extents, block_size));
+  // Resizing keeps the storage of the largest source read so far.
+  source_.resize(utils::BlocksInExtents(extents) * block_size);
+  ExtentReader* reader = InitReader(fd, extents, block_size);
+  TEST_AND_RETURN_FALSE(reader != nullptr);
+  TEST_AND_RETURN_FALSE(reader->Read(source_.data(), source_.size()));
+  return true;
+}
+
+const uint8_t* PatchArena::MappedSource(FileDescriptorPtr fd,
+                                        const RepeatedPtrField<Extent>& extents,
+                                        uint32_t block_size) {
+  if (!mmap_reader_ || fd != mapped_fd_ ||
+      !mmap_reader_->Init(fd, extents, block_size)) {
+    return nullptr;
+  }
+  return mmap_reader_->contiguous_data();
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,118 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_PATCH_ARENA_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_PATCH_ARENA_H_
+
+#include <memory>
+
+#include <brillo/secure_blob.h>
+#include <google/protobuf/repeated_field.h>
+
+#include "update_engine/payload_consumer/extent_reader.h"
+#include "update_engine/payload_consumer/extent_writer.h"
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// The extent reader and writer and the bspatch source buffer used to apply
+// the diff operations, reset between operations instead of being allocated
+// for each of them. Payloads with thousands of small SOURCE_BSDIFF and
+// PUFFDIFF operations would otherwise keep allocating and freeing them,
+// fragmenting the heap.
+//
+// Only the size of the puffpatch cache is kept here: puffpatch allocates the
+// cache itself, and both puffpatch and bspatch take ownership of the streams
+// wrapping the reader and writer, so those are still allocated per operation.
+//
+// An arena is used by a single thread, to apply one operation at a time.
+class PatchArena {
+ public:
+  // Default largest source read into memory at once for bspatch.
+  static const size_t kDefaultMaxSourceSize;
+  // Default total cache size passed to puffpatch.
+  static const size_t kDefaultPuffpatchCacheSize;
+
+  // The sources of up to |max_source_size| bytes are read into the source
+  // buffer, which never grows past it. Puffpatch is allowed to cache up to
+  // |puffpatch_cache_size| bytes.
+  explicit PatchArena(size_t max_source_size = kDefaultMaxSourceSize,
+                      size_t puffpatch_cache_size = kDefaultPuffpatchCacheSize)
+      : max_source_size_(max_source_size),
+        puffpatch_cache_size_(puffpatch_cache_size) {}
+  PatchArena(const PatchArena&) = delete;
+  PatchArena& operator=(const PatchArena&) = delete;
+
+  // Makes the sources read from |fd| be read from |mapping| instead, which
+  // maps the same partition. A null |mapping| reads all sources through their
+  // file descriptor again.
+  void SetSourceMapping(std::shared_ptr<const MappedPartition> mapping,
+                        FileDescriptorPtr fd);
+
+  // Returns the reader of the arena, set up to read |extents| of |fd|. It is
+  // only valid until the next call.
+  ExtentReader* InitReader(
+      FileDescriptorPtr fd,
+      const google::protobuf::RepeatedPtrField<Extent>& extents,
+      uint32_t block_size);
+
+  // Returns the writer of the arena, set up to write |extents| of |fd|. It is
+  // only valid until the next call.
+  ExtentWriter* InitWriter(
+      FileDescriptorPtr fd,
+      const google::protobuf::RepeatedPtrField<Extent>& extents,
+      uint32_t block_size);
+
+  // Whether the data of |extents| fits in the source buffer.
+  bool CanBufferSource(
+      const google::protobuf::RepeatedPtrField<Extent>& extents,
+      uint32_t block_size) const;
+
+  // Reads |extents| of |fd| into the source buffer. CanBufferSource() must be
+  // true. The data is available through source() until the next call.
+  bool ReadSource(FileDescriptorPtr fd,
+                  const google::protobuf::RepeatedPtrField<Extent>& extents,
+                  uint32_t block_size);
+  const brillo::Blob& source() const { return source_; }
+
+  // Returns the data of |extents| of |fd| if it can be used in place, without
+  // copying it, which is when the extents are contiguous in the source
+  // mapping. Returns null otherwise. Invalidates the reader of the arena.
+  const uint8_t* MappedSource(
+      FileDescriptorPtr fd,
+      const google::protobuf::RepeatedPtrField<Extent>& extents,
+      uint32_t block_size);
+
+  size_t max_source_size() const { return max_source_size_; }
+  size_t puffpatch_cache_size() const { return puffpatch_cache_size_; }
+
+ private:
+  const size_t max_source_size_;
+  const size_t puffpatch_cache_size_;
+
+  DirectExtentReader reader_;
+  // Used instead of |reader_| to read from |mapped_fd_|, if set.
+  std::unique_ptr<MmapExtentReader> mmap_reader_;
+  FileDescriptorPtr mapped_fd_;
+  DirectExtentWriter writer_;
+  brillo::Blob source_;
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_PATCH_ARENA_H_
@@ -0,0 +1,158 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/patch_arena.h"
+
+#include <fcntl.h>
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+using google::protobuf::RepeatedPtrField;
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kBlockSize = 4096;
+const size_t kNumBlocks = 8;
+
+RepeatedPtrField<Extent> Extents(const std::vector<Extent>& extents) {
+  RepeatedPtrField<Extent> result;
+  for (const Extent& extent : extents)
+    *result.Add() = extent;
+  return result;
+}
+}  // namespace
+
+class PatchArenaTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // Each block is filled with its block number.
+    for (size_t i = 0; i < kNumBlocks; i++)
+      data_.insert(data_.end(), kBlockSize, i);
+    EXPECT_TRUE(test_utils::WriteFileVector(file_.path(), data_));
+    fd_ = std::make_shared<EintrSafeFileDescriptor>();
+    EXPECT_TRUE(fd_->Open(file_.path().c_str(), O_RDWR));
+  }
+
+  brillo::Blob Blocks(uint64_t start_block, uint64_t num_blocks) {
+    return brillo::Blob(data_.begin() + start_block * kBlockSize,
+                        data_.begin() + (start_block + num_blocks) * kBlockSize);
+  }
+
+  brillo::Blob data_;
+  ScopedTempFile file_{"PatchArena-file.XXXXXX"};
+  FileDescriptorPtr fd_;
+  PatchArena arena_{4 * kBlockSize, 1024};
+};
+
+TEST_F(PatchArenaTest, ReaderReuseTest) {
+  brillo::Blob buf(3 * kBlockSize);
+  ExtentReader* reader = arena_.InitReader(
+      fd_, Extents({ExtentForRange(5, 2), ExtentForRange(1, 1)}), kBlockSize);
+  ASSERT_NE(nullptr, reader);
+  EXPECT_TRUE(reader->Read(buf.data(), kBlockSize));
+  EXPECT_EQ(Blocks(5, 1), brillo::Blob(buf.begin(), buf.begin() + kBlockSize));
+
+  // The reader starts over from the new extents.
+  reader = arena_.InitReader(fd_, Extents({ExtentForRange(2, 3)}), kBlockSize);
+  ASSERT_NE(nullptr, reader);
+  EXPECT_TRUE(reader->Read(buf.data(), buf.size()));
+  EXPECT_EQ(Blocks(2, 3), buf);
+  EXPECT_FALSE(reader->Read(buf.data(), kBlockSize));
+}
+
+TEST_F(PatchArenaTest, WriterReuseTest) {
+  brillo::Blob ones(kBlockSize, 1);
+  ExtentWriter* writer =
+      arena_.InitWriter(fd_, Extents({ExtentForRange(6, 2)}), kBlockSize);
+  ASSERT_NE(nullptr, writer);
+  EXPECT_TRUE(writer->Write(ones.data(), ones.size()));
+
+  // The writer starts over from the new extents.
+  brillo::Blob twos(kBlockSize, 2);
+  writer = arena_.InitWriter(fd_, Extents({ExtentForRange(0, 1)}), kBlockSize);
+  ASSERT_NE(nullptr, writer);
+  EXPECT_TRUE(writer->Write(twos.data(), twos.size()));
+  EXPECT_FALSE(writer->Write(twos.data(), twos.size()));
+
+  brillo::Blob file_data;
+  EXPECT_TRUE(utils::ReadFile(file_.path(), &file_data));
+  EXPECT_EQ(twos, brillo::Blob(file_data.begin(),
+                               file_data.begin() + kBlockSize));
+  EXPECT_EQ(ones, brillo::Blob(file_data.begin() + 6 * kBlockSize,
+                               file_data.begin() + 7 * kBlockSize));
+}
+
+TEST_F(PatchArenaTest, ReadSourceTest) {
+  auto extents = Extents({ExtentForRange(3, 3), ExtentForRange(0, 1)});
+  EXPECT_TRUE(arena_.CanBufferSource(extents, kBlockSize));
+  EXPECT_TRUE(arena_.ReadSource(fd_, extents, kBlockSize));
+  brillo::Blob expected = Blocks(3, 3);
+  brillo::Blob first_block = Blocks(0, 1);
+  expected.insert(expected.end(), first_block.begin(), first_block.end());
+  EXPECT_EQ(expected, arena_.source());
+
+  // A smaller source reuses the buffer.
+  const uint8_t* source_data = arena_.source().data();
+  EXPECT_TRUE(arena_.ReadSource(
+      fd_, Extents({ExtentForRange(7, 1)}), kBlockSize));
+  EXPECT_EQ(Blocks(7, 1), arena_.source());
+  EXPECT_EQ(source_data, arena_.source().data());
+
+  // Sources larger than the arena are left to the streaming path.
+  auto large_extents = Extents({ExtentForRange(0, 5)});
+  EXPECT_FALSE(arena_.CanBufferSource(large_extents, kBlockSize));
+  EXPECT_FALSE(arena_.ReadSource(fd_, large_extents, kBlockSize));
+}
+
+TEST_F(PatchArenaTest, SourceMappingTest) {
+  auto extents = Extents({ExtentForRange(4, 2), ExtentForRange(1, 1)});
+  EXPECT_EQ(nullptr, arena_.MappedSource(fd_, extents, kBlockSize));
+
+  std::shared_ptr<MappedPartition> mapping =
+      MappedPartition::Map(file_.path());
+  ASSERT_NE(nullptr, mapping);
+  arena_.SetSourceMapping(mapping, fd_);
+  // Non contiguous extents are read from the mapping.
+  EXPECT_EQ(nullptr, arena_.MappedSource(fd_, extents, kBlockSize));
+  EXPECT_TRUE(arena_.ReadSource(fd_, extents, kBlockSize));
+  brillo::Blob expected = Blocks(4, 2);
+  brillo::Blob block = Blocks(1, 1);
+  expected.insert(expected.end(), block.begin(), block.end());
+  EXPECT_EQ(expected, arena_.source());
+
+  // Contiguous ones are used in place, even larger than the arena.
+  auto large_extents = Extents({ExtentForRange(1, 2), ExtentForRange(3, 4)});
+  EXPECT_EQ(mapping->data() + kBlockSize,
+            arena_.MappedSource(fd_, large_extents, kBlockSize));
+
+  // Other file descriptors aren't read from the mapping.
+  FileDescriptorPtr other_fd = std::make_shared<EintrSafeFileDescriptor>();
+  ASSERT_TRUE(other_fd->Open(file_.path().c_str(), O_RDONLY));
+  EXPECT_EQ(nullptr, arena_.MappedSource(other_fd, large_extents, kBlockSize));
+
+  arena_.SetSourceMapping(nullptr, nullptr);
+  EXPECT_EQ(nullptr, arena_.MappedSource(fd_, large_extents, kBlockSize));
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,127 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/payload_buffer.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <base/logging.h>
+
+using std::max;
+using std::min;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+const size_t PayloadBuffer::kMaxSegmentSize = 1024 * 1024;  // 1 MiB
+
+void PayloadBuffer::AppendUnowned(const void* data, size_t count) {
+  if (!count)
+    return;
+  Segment segment;
+  segment.unowned_data = reinterpret_cast<const uint8_t*>(data);
+  segment.unowned_size = count;
+  segments_.push_back(std::move(segment));
+  size_ += count;
+}
+
+void PayloadBuffer::Own() {
+  vector<Segment> owned_segments;
+  owned_segments.reserve(segments_.size());
+  size_t offset = 0;
+  for (Segment& segment : segments_) {
+    if (segment.is_owned()) {
+      offset += segment.owned.size();
+      owned_segments.push_back(std::move(segment));
+      continue;
+    }
+    const uint8_t* data = segment.unowned_data;
+    size_t left = segment.unowned_size;
+    while (left > 0) {
+      if (owned_segments.empty() ||
+          owned_segments.back().owned.size() >= kMaxSegmentSize) {
+        // Allocate the new segment for all the data expected, within limits.
+        size_t expected_left =
+            expected_size_ > offset ? expected_size_ - offset : 0;
+        owned_segments.emplace_back();
+        owned_segments.back().owned.reserve(
+            min(kMaxSegmentSize, max(expected_left, left)));
+      }
+      brillo::Blob* blob = &owned_segments.back().owned;
+      size_t copy_len = min(left, kMaxSegmentSize - blob->size());
+      blob->insert(blob->end(), data, data + copy_len);
+      data += copy_len;
+      left -= copy_len;
+      offset += copy_len;
+    }
+  }
+  segments_ = std::move(owned_segments);
+}
+
+const uint8_t* PayloadBuffer::data() {
+  if (segments_.size() == 1)
+    return segment_data(0);
+  return Coalesce().data();
+}
+
+const brillo::Blob& PayloadBuffer::Coalesce() {
+  if (segments_.size() == 1 && segments_[0].is_owned())
+    return segments_[0].owned;
+
+  brillo::Blob merged;
+  size_t first = 0;
+  if (!segments_.empty() && segments_[0].is_owned()) {
+    merged = std::move(segments_[0].owned);
+    first = 1;
+  }
+  merged.reserve(size_);
+  for (size_t i = first; i < segments_.size(); i++) {
+    const uint8_t* data = segment_data(i);
+    merged.insert(merged.end(), data, data + segment_size(i));
+  }
+  segments_.clear();
+  segments_.emplace_back();
+  segments_[0].owned = std::move(merged);
+  return segments_[0].owned;
+}
+
+void PayloadBuffer::Release(brillo::Blob* blob) {
+  Coalesce();
+  *blob = std::move(segments_[0].owned);
+  Clear();
+}
+
+void PayloadBuffer::Clear() {
+  // Swap with an empty vector to ensure that all the memory is released.
+  vector<Segment>().swap(segments_);
+  size_ = 0;
+  expected_size_ = 0;
+}
+
+const uint8_t* PayloadBuffer::segment_data(size_t index) const {
+  DCHECK_LT(index, segments_.size());
+  const Segment& segment = segments_[index];
+  return segment.is_owned() ? segment.owned.data() : segment.unowned_data;
+}
+
+size_t PayloadBuffer::segment_size(size_t index) const {
+  DCHECK_LT(index, segments_.size());
+  const Segment& segment = segments_[index];
+  return segment.is_owned() ? segment.owned.size() : segment.unowned_size;
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_PAYLOAD_BUFFER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_PAYLOAD_BUFFER_H_
+
+#include <vector>
+
+#include <brillo/secure_blob.h>
+
+namespace chromeos_update_engine {
+
+// PayloadBuffer accumulates the payload data received for the next operation
+// as a list of segments, avoiding copies when possible:
+//  - Data is first appended without being copied, referencing the caller's
+//    memory. The caller must call Own() before that memory goes away, which
+//    copies only the data still in the buffer at that point.
+//  - Owned data is kept in segments of bounded size, so accumulating a large
+//    blob doesn't need a single allocation of its full size.
+//  - The segments are only merged into one contiguous blob when a consumer
+//    needs one through data() or Coalesce().
+class PayloadBuffer {
+ public:
+  // Maximum size of the owned segments, unless merged by Coalesce().
+  static const size_t kMaxSegmentSize;
+
+  PayloadBuffer() = default;
+  PayloadBuffer(const PayloadBuffer&) = delete;
+  PayloadBuffer& operator=(const PayloadBuffer&) = delete;
+
+  // Appends the |count| bytes at |data| without copying them. |data| must stay
+  // valid until the next call to Own(), Coalesce() or Clear().
+  void AppendUnowned(const void* data, size_t count);
+
+  // Hints that the buffer is expected to grow up to |size| bytes, which is
+  // used to size the owned segments.
+  void Reserve(size_t size) { expected_size_ = size; }
+
+  // Copies the data appended with AppendUnowned() into owned segments.
+  void Own();
+
+  // Returns a pointer to the whole content, merging the segments first when
+  // there is more than one. The pointer is valid until the buffer is modified.
+  const uint8_t* data();
+
+  // Merges the content into a single owned segment and returns it.
+  const brillo::Blob& Coalesce();
+
+  // Moves the whole content into |blob|, copying it only if needed, and
+  // clears the buffer.
+  void Release(brillo::Blob* blob);
+
+  // Drops the content and releases the memory.
+  void Clear();
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Gives access to the segments, in order, to consume them without merging.
+  size_t num_segments() const { return segments_.size(); }
+  const uint8_t* segment_data(size_t index) const;
+  size_t segment_size(size_t index) const;
+
+ private:
+  struct Segment {
+    // The data of owned segments. Empty for unowned ones.
+    brillo::Blob owned;
+    // The data of unowned segments.
+    const uint8_t* unowned_data{nullptr};
+    size_t unowned_size{0};
+
+    bool is_owned() const { return unowned_data == nullptr; }
+  };
+
+  std::vector<Segment> segments_;
+  size_t size_{0};
+  size_t expected_size_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_PAYLOAD_BUFFER_H_
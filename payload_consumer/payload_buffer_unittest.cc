@@ -0,0 +1,100 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/payload_buffer.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+class PayloadBufferTest : public ::testing::Test {
+ protected:
+  // Returns the content of |buffer_| by walking its segments.
+  string SegmentsContent() {
+    string content;
+    for (size_t i = 0; i < buffer_.num_segments(); i++) {
+      content.append(reinterpret_cast<const char*>(buffer_.segment_data(i)),
+                     buffer_.segment_size(i));
+    }
+    return content;
+  }
+
+  PayloadBuffer buffer_;
+};
+
+TEST_F(PayloadBufferTest, UnownedDataIsNotCopiedTest) {
+  const string data = "foobar";
+  buffer_.AppendUnowned(data.data(), data.size());
+  buffer_.AppendUnowned(data.data(), 0);
+  EXPECT_EQ(6U, buffer_.size());
+  ASSERT_EQ(1U, buffer_.num_segments());
+  // A single segment is used in place.
+  EXPECT_EQ(reinterpret_cast<const uint8_t*>(data.data()), buffer_.data());
+}
+
+TEST_F(PayloadBufferTest, OwnCopiesTheDataTest) {
+  string data = "foo";
+  buffer_.AppendUnowned(data.data(), data.size());
+  buffer_.Own();
+  data = "bar";
+  buffer_.AppendUnowned(data.data(), data.size());
+  buffer_.Own();
+  data = "xxx";
+  // The owned data is merged as long as it fits in a segment.
+  EXPECT_EQ(1U, buffer_.num_segments());
+  EXPECT_EQ("foobar", SegmentsContent());
+}
+
+TEST_F(PayloadBufferTest, OwnLimitsTheSegmentSizeTest) {
+  const size_t size = PayloadBuffer::kMaxSegmentSize * 2 + 10;
+  const string data(size, 'x');
+  buffer_.Reserve(size);
+  buffer_.AppendUnowned(data.data(), data.size());
+  buffer_.Own();
+  EXPECT_EQ(size, buffer_.size());
+  ASSERT_EQ(3U, buffer_.num_segments());
+  EXPECT_EQ(PayloadBuffer::kMaxSegmentSize, buffer_.segment_size(0));
+  EXPECT_EQ(10U, buffer_.segment_size(2));
+  EXPECT_EQ(data, SegmentsContent());
+}
+
+TEST_F(PayloadBufferTest, CoalesceTest) {
+  const string foo = "foo", bar = "bar";
+  buffer_.AppendUnowned(foo.data(), foo.size());
+  buffer_.Own();
+  buffer_.AppendUnowned(bar.data(), bar.size());
+  EXPECT_EQ(2U, buffer_.num_segments());
+  const uint8_t* data = buffer_.data();
+  EXPECT_EQ(1U, buffer_.num_segments());
+  EXPECT_EQ("foobar", string(reinterpret_cast<const char*>(data), 6));
+  EXPECT_EQ("foobar", SegmentsContent());
+}
+
+TEST_F(PayloadBufferTest, ReleaseTest) {
+  const string data = "foobar";
+  buffer_.AppendUnowned(data.data(), data.size());
+  brillo::Blob blob;
+  buffer_.Release(&blob);
+  EXPECT_EQ(brillo::Blob(data.begin(), data.end()), blob);
+  EXPECT_TRUE(buffer_.empty());
+  EXPECT_EQ(0U, buffer_.num_segments());
+}
+
+}  // namespace chromeos_update_engine
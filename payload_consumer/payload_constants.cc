@@ -38,10 +38,12 @@ const uint32_t kBrotliBsdiffMinorPayloadVersion = 4;
 const uint32_t kPuffdiffMinorPayloadVersion = 5;
 const uint32_t kVerityMinorPayloadVersion = 6;
 const uint32_t kPartialUpdateMinorPayloadVersion = 7;
+// Minor versions 8 and 9 are skipped since upstream uses them for ZUCCHINI
+// and LZ4DIFF operations, which this client doesn't support.
+const uint32_t kZstdMinorPayloadVersion = 10;
 
 const uint32_t kMinSupportedMinorPayloadVersion = kSourceMinorPayloadVersion;
-const uint32_t kMaxSupportedMinorPayloadVersion =
-    kPartialUpdateMinorPayloadVersion;
+const uint32_t kMaxSupportedMinorPayloadVersion = kZstdMinorPayloadVersion;
 
 const uint64_t kMaxPayloadHeaderSize = 24;
 
@@ -66,6 +68,8 @@ const char* InstallOperationTypeName(InstallOperation::Type op_type) {
       return "DISCARD";
     case InstallOperation::REPLACE_XZ:
       return "REPLACE_XZ";
+    case InstallOperation::REPLACE_ZSTD:
+      return "REPLACE_ZSTD";
     case InstallOperation::PUFFDIFF:
       return "PUFFDIFF";
     case InstallOperation::BROTLI_BSDIFF:
@@ -59,6 +59,9 @@ extern const uint32_t kVerityMinorPayloadVersion;
 // The minor version that allows partial update, e.g. kernel only update.
 extern const uint32_t kPartialUpdateMinorPayloadVersion;
 
+// The minor version that allows REPLACE_ZSTD operation.
+extern const uint32_t kZstdMinorPayloadVersion;
+
 // The minimum and maximum supported minor version.
 extern const uint32_t kMinSupportedMinorPayloadVersion;
 extern const uint32_t kMaxSupportedMinorPayloadVersion;
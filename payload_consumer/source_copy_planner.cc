@@ -0,0 +1,216 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/source_copy_planner.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include <base/logging.h>
+
+#include "update_engine/common/multi_hash_calculator.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/extent_writer.h"
+#include "update_engine/payload_consumer/payload_constants.h"
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+const uint64_t SourceCopyPlanner::kMaxGapBlocks = 16;
+
+SourceCopyPlanner::SourceCopyPlanner(uint32_t block_size, size_t staging_size)
+    : block_size_(block_size), staging_blocks_(staging_size / block_size) {
+  CHECK_GT(block_size_, 0U);
+}
+
+bool SourceCopyPlanner::IsSupported(const InstallOperation& operation) {
+  return operation.type() == InstallOperation::SOURCE_COPY &&
+         operation.has_src_sha256_hash() && !operation.data_length() &&
+         utils::BlocksInExtents(operation.src_extents()) ==
+             utils::BlocksInExtents(operation.dst_extents());
+}
+
+bool SourceCopyPlanner::CanAdd(const InstallOperation& operation) const {
+  if (!IsSupported(operation))
+    return false;
+  if (planned_blocks_ + utils::BlocksInExtents(operation.src_extents()) >
+      staging_blocks_) {
+    return false;
+  }
+  for (const Extent& extent : operation.dst_extents()) {
+    if (extent.start_block() == kSparseHole || extent.num_blocks() == 0)
+      continue;
+    uint64_t start = extent.start_block();
+    uint64_t end = start + extent.num_blocks();
+    // The first planned extent starting at or after |end| can't overlap, so
+    // only the one right before it needs to be checked.
+    auto it = planned_dst_blocks_.lower_bound(end);
+    if (it != planned_dst_blocks_.begin() && std::prev(it)->second > start)
+      return false;
+  }
+  return true;
+}
+
+void SourceCopyPlanner::Add(const InstallOperation& operation) {
+  DCHECK(CanAdd(operation));
+  for (const Extent& extent : operation.dst_extents()) {
+    if (extent.start_block() == kSparseHole || extent.num_blocks() == 0)
+      continue;
+    planned_dst_blocks_[extent.start_block()] =
+        extent.start_block() + extent.num_blocks();
+  }
+  planned_blocks_ += utils::BlocksInExtents(operation.src_extents());
+  operations_.push_back(operation);
+}
+
+void SourceCopyPlanner::Run(FileDescriptorPtr source_fd,
+                            FileDescriptorPtr target_fd,
+                            vector<bool>* succeeded) {
+  succeeded->assign(operations_.size(), false);
+  PlanReads();
+
+  vector<FileDescriptor::ReadRequest> requests;
+  requests.reserve(reads_.size());
+  for (const Read& read : reads_) {
+    requests.push_back({staging_.data() + read.staging_offset,
+                        static_cast<size_t>(read.num_blocks * block_size_),
+                        static_cast<off64_t>(read.start_block * block_size_)});
+  }
+  num_reads_ = requests.size();
+  if (requests.empty() || source_fd->ReadBatch(requests)) {
+    // The source data of all the operations is hashed in one pass.
+    MultiHashCalculator source_hasher;
+    for (const InstallOperation& operation : operations_) {
+      source_hasher.AddStream();
+      for (const Extent& extent : operation.src_extents()) {
+        if (extent.num_blocks() == 0)
+          continue;
+        source_hasher.Update(StagedData(extent),
+                             extent.num_blocks() * block_size_);
+      }
+    }
+    if (source_hasher.Finalize()) {
+      for (size_t i = 0; i < operations_.size(); i++) {
+        (*succeeded)[i] = ApplyOperation(
+            operations_[i], source_hasher.raw_hashes()[i], target_fd);
+      }
+    }
+  } else {
+    LOG(WARNING) << "Unable to read the source blocks of " << operations_.size()
+                 << " SOURCE_COPY operations.";
+  }
+  Clear();
+}
+
+void SourceCopyPlanner::Clear() {
+  operations_.clear();
+  planned_blocks_ = 0;
+  planned_dst_blocks_.clear();
+  reads_.clear();
+}
+
+void SourceCopyPlanner::PlanReads() {
+  vector<std::pair<uint64_t, uint64_t>> ranges;
+  for (const InstallOperation& operation : operations_) {
+    for (const Extent& extent : operation.src_extents()) {
+      if (extent.num_blocks() == 0)
+        continue;
+      ranges.emplace_back(extent.start_block(),
+                          extent.start_block() + extent.num_blocks());
+    }
+  }
+  std::sort(ranges.begin(), ranges.end());
+
+  // Merge the overlapping and adjacent ranges first, so the blocks used by
+  // several operations are only counted once.
+  vector<std::pair<uint64_t, uint64_t>> merged;
+  uint64_t merged_blocks = 0;
+  for (const auto& range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second) {
+      uint64_t end = std::max(merged.back().second, range.second);
+      merged_blocks += end - merged.back().second;
+      merged.back().second = end;
+    } else {
+      merged.push_back(range);
+      merged_blocks += range.second - range.first;
+    }
+  }
+
+  // Then read the small gaps between them as long as the staging buffer has
+  // room for them, turning several reads into a sequential one.
+  reads_.clear();
+  uint64_t staged_blocks = merged_blocks;
+  for (const auto& range : merged) {
+    if (!reads_.empty()) {
+      Read& last = reads_.back();
+      uint64_t gap = range.first - (last.start_block + last.num_blocks);
+      if (gap <= kMaxGapBlocks && staged_blocks + gap <= staging_blocks_) {
+        staged_blocks += gap;
+        last.num_blocks = range.second - last.start_block;
+        continue;
+      }
+    }
+    size_t staging_offset =
+        reads_.empty() ? 0
+                       : reads_.back().staging_offset +
+                             reads_.back().num_blocks * block_size_;
+    reads_.push_back(
+        {range.first, range.second - range.first, staging_offset});
+  }
+  if (staging_.size() < staged_blocks * block_size_)
+    staging_.resize(staged_blocks * block_size_);
+}
+
+const uint8_t* SourceCopyPlanner::StagedData(const Extent& extent) const {
+  // The last read starting at or before the extent contains it.
+  auto it = std::upper_bound(
+      reads_.begin(),
+      reads_.end(),
+      extent.start_block(),
+      [](uint64_t block, const Read& read) { return block < read.start_block; });
+  DCHECK(it != reads_.begin());
+  --it;
+  DCHECK_LE(extent.start_block() + extent.num_blocks(),
+            it->start_block + it->num_blocks);
+  return staging_.data() + it->staging_offset +
+         (extent.start_block() - it->start_block) * block_size_;
+}
+
+bool SourceCopyPlanner::ApplyOperation(const InstallOperation& operation,
+                                       const brillo::Blob& source_hash,
+                                       FileDescriptorPtr target_fd) const {
+  brillo::Blob expected_source_hash(operation.src_sha256_hash().begin(),
+                                    operation.src_sha256_hash().end());
+  if (source_hash != expected_source_hash) {
+    LOG(WARNING) << "Source hash of a planned SOURCE_COPY mismatched.";
+    return false;
+  }
+
+  DirectExtentWriter writer;
+  TEST_AND_RETURN_FALSE(
+      writer.Init(target_fd, operation.dst_extents(), block_size_));
+  for (const Extent& extent : operation.src_extents()) {
+    if (extent.num_blocks() == 0)
+      continue;
+    TEST_AND_RETURN_FALSE(
+        writer.Write(StagedData(extent), extent.num_blocks() * block_size_));
+  }
+  return true;
+}
+
+}  // namespace chromeos_update_engine
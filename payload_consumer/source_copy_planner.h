@@ -0,0 +1,119 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_COPY_PLANNER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_COPY_PLANNER_H_
+
+#include <map>
+#include <vector>
+
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// Applies a run of SOURCE_COPY operations together. Rather than reading the
+// source extents of each operation on its own, the source blocks of all the
+// operations are merged into a few large sequential reads into a staging
+// buffer, reading the blocks shared by several operations once and the small
+// gaps between the extents along with them. Each operation is then served from
+// the staging buffer, once the hash of its source data was checked.
+//
+// Operations are only planned together when their destination extents don't
+// overlap, so the ones failing can be retried afterwards by the caller, which
+// knows how to fall back to the error corrected source device.
+class SourceCopyPlanner {
+ public:
+  // Largest gap, in blocks, read between two source extents to merge their
+  // reads.
+  static const uint64_t kMaxGapBlocks;
+
+  // The source blocks of the planned operations, and the gaps read between
+  // them, fit in |staging_size| bytes.
+  SourceCopyPlanner(uint32_t block_size, size_t staging_size);
+  SourceCopyPlanner(const SourceCopyPlanner&) = delete;
+  SourceCopyPlanner& operator=(const SourceCopyPlanner&) = delete;
+
+  // Returns whether |operation| is a SOURCE_COPY the planner can apply, which
+  // requires a source hash to verify its data.
+  static bool IsSupported(const InstallOperation& operation);
+
+  // Returns whether |operation| can be added to the plan, that is, its source
+  // blocks fit in the staging buffer and it doesn't write to any block written
+  // by an operation already planned.
+  bool CanAdd(const InstallOperation& operation) const;
+
+  // Adds |operation| to the plan. CanAdd() must be true.
+  void Add(const InstallOperation& operation);
+
+  size_t num_operations() const { return operations_.size(); }
+
+  // Reads the source blocks of the planned operations from |source_fd| and
+  // writes the data of each operation whose source hash matches to
+  // |target_fd|. Whether each operation, in planned order, succeeded is
+  // stored in |succeeded|. The plan is cleared afterwards.
+  void Run(FileDescriptorPtr source_fd,
+           FileDescriptorPtr target_fd,
+           std::vector<bool>* succeeded);
+
+  // Drops the planned operations.
+  void Clear();
+
+  // Number of reads issued by the last Run().
+  size_t num_reads() const { return num_reads_; }
+
+ private:
+  // A range of source blocks read in a single request, stored at
+  // |staging_offset| in the staging buffer.
+  struct Read {
+    uint64_t start_block;
+    uint64_t num_blocks;
+    size_t staging_offset;
+  };
+
+  // Merges the source extents of the planned operations into |reads_|.
+  void PlanReads();
+
+  // Returns the data of |extent| in the staging buffer.
+  const uint8_t* StagedData(const Extent& extent) const;
+
+  // Applies |operation| from the staging buffer if |source_hash|, the hash of
+  // its staged source data, matches.
+  bool ApplyOperation(const InstallOperation& operation,
+                      const brillo::Blob& source_hash,
+                      FileDescriptorPtr target_fd) const;
+
+  const uint32_t block_size_;
+  const uint64_t staging_blocks_;
+
+  std::vector<InstallOperation> operations_;
+  // Number of source blocks of the planned operations, including the blocks
+  // shared by several operations.
+  uint64_t planned_blocks_{0};
+  // The blocks written by the planned operations, as a map from the first
+  // block of each destination extent to its end.
+  std::map<uint64_t, uint64_t> planned_dst_blocks_;
+
+  std::vector<Read> reads_;
+  brillo::Blob staging_;
+  size_t num_reads_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_COPY_PLANNER_H_
@@ -0,0 +1,175 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/source_copy_planner.h"
+
+#include <fcntl.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kBlockSize = 4096;
+const size_t kNumBlocks = 64;
+}  // namespace
+
+class SourceCopyPlannerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // Each source block is filled with its block number.
+    for (size_t i = 0; i < kNumBlocks; i++)
+      source_data_.insert(source_data_.end(), kBlockSize, i);
+    EXPECT_TRUE(
+        test_utils::WriteFileVector(source_file_.path(), source_data_));
+    EXPECT_TRUE(test_utils::WriteFileVector(
+        target_file_.path(), brillo::Blob(kNumBlocks * kBlockSize, 0xff)));
+    source_fd_ = std::make_shared<EintrSafeFileDescriptor>();
+    EXPECT_TRUE(source_fd_->Open(source_file_.path().c_str(), O_RDONLY));
+    target_fd_ = std::make_shared<EintrSafeFileDescriptor>();
+    EXPECT_TRUE(target_fd_->Open(target_file_.path().c_str(), O_RDWR));
+  }
+
+  // Returns a SOURCE_COPY operation copying the |src| extents to the |dst|
+  // ones, with the hash of the source data.
+  InstallOperation SourceCopy(const vector<Extent>& src,
+                              const vector<Extent>& dst) {
+    InstallOperation op;
+    op.set_type(InstallOperation::SOURCE_COPY);
+    HashCalculator hasher;
+    for (const Extent& extent : src) {
+      *op.add_src_extents() = extent;
+      EXPECT_TRUE(hasher.Update(
+          source_data_.data() + extent.start_block() * kBlockSize,
+          extent.num_blocks() * kBlockSize));
+    }
+    for (const Extent& extent : dst)
+      *op.add_dst_extents() = extent;
+    EXPECT_TRUE(hasher.Finalize());
+    op.set_src_sha256_hash(hasher.raw_hash().data(), hasher.raw_hash().size());
+    return op;
+  }
+
+  // Returns the data of block |block| of the target file.
+  brillo::Blob TargetBlock(uint64_t block) {
+    brillo::Blob target;
+    EXPECT_TRUE(utils::ReadFile(target_file_.path(), &target));
+    return brillo::Blob(target.begin() + block * kBlockSize,
+                        target.begin() + (block + 1) * kBlockSize);
+  }
+
+  brillo::Blob source_data_;
+  ScopedTempFile source_file_{"source_copy_planner_src.XXXXXX"};
+  ScopedTempFile target_file_{"source_copy_planner_tgt.XXXXXX"};
+  FileDescriptorPtr source_fd_;
+  FileDescriptorPtr target_fd_;
+  SourceCopyPlanner planner_{kBlockSize, 16 * kBlockSize};
+};
+
+TEST_F(SourceCopyPlannerTest, IsSupportedTest) {
+  InstallOperation op =
+      SourceCopy({ExtentForRange(0, 1)}, {ExtentForRange(0, 1)});
+  EXPECT_TRUE(SourceCopyPlanner::IsSupported(op));
+
+  // The source hash is needed to detect the sources to read from the error
+  // corrected device.
+  InstallOperation no_hash = op;
+  no_hash.clear_src_sha256_hash();
+  EXPECT_FALSE(SourceCopyPlanner::IsSupported(no_hash));
+
+  InstallOperation replace = op;
+  replace.set_type(InstallOperation::REPLACE);
+  EXPECT_FALSE(SourceCopyPlanner::IsSupported(replace));
+}
+
+TEST_F(SourceCopyPlannerTest, CanAddTest) {
+  planner_.Add(SourceCopy({ExtentForRange(0, 4)}, {ExtentForRange(2, 4)}));
+
+  // The destinations can't overlap.
+  EXPECT_FALSE(planner_.CanAdd(
+      SourceCopy({ExtentForRange(0, 1)}, {ExtentForRange(5, 1)})));
+  EXPECT_TRUE(planner_.CanAdd(
+      SourceCopy({ExtentForRange(0, 1)}, {ExtentForRange(6, 1)})));
+  // The sources must fit in the staging buffer.
+  EXPECT_TRUE(planner_.CanAdd(
+      SourceCopy({ExtentForRange(20, 12)}, {ExtentForRange(20, 12)})));
+  EXPECT_FALSE(planner_.CanAdd(
+      SourceCopy({ExtentForRange(20, 13)}, {ExtentForRange(20, 13)})));
+  EXPECT_EQ(1U, planner_.num_operations());
+}
+
+TEST_F(SourceCopyPlannerTest, MergedReadsTest) {
+  // The first two operations share a block and the small gaps between the
+  // source extents are read along with them, so their sources are read at
+  // once. The last one is too far away.
+  planner_.Add(SourceCopy({ExtentForRange(10, 2)}, {ExtentForRange(0, 2)}));
+  planner_.Add(SourceCopy({ExtentForRange(11, 2), ExtentForRange(4, 1)},
+                          {ExtentForRange(2, 3)}));
+  planner_.Add(SourceCopy({ExtentForRange(15, 1)}, {ExtentForRange(5, 1)}));
+  planner_.Add(SourceCopy({ExtentForRange(60, 1)}, {ExtentForRange(6, 1)}));
+
+  vector<bool> succeeded;
+  planner_.Run(source_fd_, target_fd_, &succeeded);
+  EXPECT_EQ(vector<bool>(4, true), succeeded);
+  EXPECT_EQ(2U, planner_.num_reads());
+  EXPECT_EQ(0U, planner_.num_operations());
+
+  const vector<uint64_t> expected_sources = {10, 11, 11, 12, 4, 15, 60};
+  for (size_t i = 0; i < expected_sources.size(); i++) {
+    EXPECT_EQ(brillo::Blob(kBlockSize, expected_sources[i]), TargetBlock(i));
+  }
+  EXPECT_EQ(brillo::Blob(kBlockSize, 0xff), TargetBlock(7));
+}
+
+TEST_F(SourceCopyPlannerTest, SourceHashMismatchTest) {
+  planner_.Add(SourceCopy({ExtentForRange(1, 1)}, {ExtentForRange(0, 1)}));
+  InstallOperation bad =
+      SourceCopy({ExtentForRange(2, 1)}, {ExtentForRange(1, 1)});
+  bad.set_src_sha256_hash("bad hash");
+  planner_.Add(bad);
+
+  vector<bool> succeeded;
+  planner_.Run(source_fd_, target_fd_, &succeeded);
+  // The failed operation is left untouched for the caller to retry it.
+  EXPECT_EQ(vector<bool>({true, false}), succeeded);
+  EXPECT_EQ(brillo::Blob(kBlockSize, 1), TargetBlock(0));
+  EXPECT_EQ(brillo::Blob(kBlockSize, 0xff), TargetBlock(1));
+}
+
+TEST_F(SourceCopyPlannerTest, ReadErrorTest) {
+  // Reading past the end of the source fails all the operations.
+  planner_.Add(SourceCopy({ExtentForRange(1, 1)}, {ExtentForRange(0, 1)}));
+  InstallOperation past_end =
+      SourceCopy({ExtentForRange(0, 1)}, {ExtentForRange(1, 1)});
+  *past_end.mutable_src_extents(0) = ExtentForRange(kNumBlocks, 1);
+  planner_.Add(past_end);
+
+  vector<bool> succeeded;
+  planner_.Run(source_fd_, target_fd_, &succeeded);
+  EXPECT_EQ(vector<bool>(2, false), succeeded);
+  EXPECT_EQ(brillo::Blob(kBlockSize, 0xff), TargetBlock(0));
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,137 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/source_data_cache.h"
+
+#include <utility>
+
+#include <base/logging.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/extent_reader.h"
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+void SourceDataCache::AddUse(const InstallOperation& operation) {
+  if (!IsCacheable(operation))
+    return;
+  base::AutoLock auto_lock(lock_);
+  entries_[operation.src_sha256_hash()].uses_left++;
+}
+
+bool SourceDataCache::IsShared(const InstallOperation& operation) const {
+  if (!IsCacheable(operation))
+    return false;
+  base::AutoLock auto_lock(lock_);
+  auto it = entries_.find(operation.src_sha256_hash());
+  return it != entries_.end() && (it->second.data || it->second.uses_left > 1);
+}
+
+std::shared_ptr<const brillo::Blob> SourceDataCache::Get(
+    const InstallOperation& operation,
+    FileDescriptorPtr source_fd,
+    uint32_t block_size) {
+  if (!IsCacheable(operation))
+    return nullptr;
+  const string& key = operation.src_sha256_hash();
+  const uint64_t size =
+      utils::BlocksInExtents(operation.src_extents()) * block_size;
+  {
+    base::AutoLock auto_lock(lock_);
+    auto it = entries_.find(key);
+    if (it == entries_.end())
+      return nullptr;
+    std::shared_ptr<const brillo::Blob> data = it->second.data;
+    // The data is only worth keeping in memory if it is used again.
+    bool keep = !data && it->second.uses_left > 1 && size > 0 &&
+                cached_bytes_ + size <= max_bytes_;
+    ConsumeUse(it);
+    if (data && data->size() == size) {
+      num_hits_++;
+      return data;
+    }
+    if (!keep)
+      return nullptr;
+  }
+
+  // Read the data without holding the lock, so other threads can use the
+  // cache meanwhile.
+  auto data = std::make_shared<brillo::Blob>(size);
+  brillo::Blob hash;
+  DirectExtentReader reader;
+  if (!reader.Init(source_fd, operation.src_extents(), block_size) ||
+      !reader.Read(data->data(), data->size()) ||
+      !HashCalculator::RawHashOfData(*data, &hash) ||
+      string(hash.begin(), hash.end()) != key) {
+    return nullptr;
+  }
+
+  base::AutoLock auto_lock(lock_);
+  auto it = entries_.find(key);
+  if (it != entries_.end() && !it->second.data &&
+      cached_bytes_ + size <= max_bytes_) {
+    it->second.data = data;
+    cached_bytes_ += size;
+  }
+  return data;
+}
+
+void SourceDataCache::SkipUse(const InstallOperation& operation) {
+  if (!IsCacheable(operation))
+    return;
+  base::AutoLock auto_lock(lock_);
+  auto it = entries_.find(operation.src_sha256_hash());
+  if (it != entries_.end())
+    ConsumeUse(it);
+}
+
+size_t SourceDataCache::num_hits() const {
+  base::AutoLock auto_lock(lock_);
+  return num_hits_;
+}
+
+size_t SourceDataCache::cached_bytes() const {
+  base::AutoLock auto_lock(lock_);
+  return cached_bytes_;
+}
+
+bool SourceDataCache::IsCacheable(const InstallOperation& operation) {
+  if (!operation.has_src_sha256_hash())
+    return false;
+  switch (operation.type()) {
+    case InstallOperation::SOURCE_COPY:
+    case InstallOperation::SOURCE_BSDIFF:
+    case InstallOperation::BROTLI_BSDIFF:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void SourceDataCache::ConsumeUse(std::map<string, Entry>::iterator it) {
+  if (it->second.uses_left > 0)
+    it->second.uses_left--;
+  if (it->second.uses_left > 0)
+    return;
+  if (it->second.data)
+    cached_bytes_ -= it->second.data->size();
+  entries_.erase(it);
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,105 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_DATA_CACHE_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_DATA_CACHE_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <base/synchronization/lock.h>
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// Keeps the source data of the operations whose source hash is shared with
+// operations applied later, so identical source data is only read and
+// verified once, whether it is used again in the same partition or in another
+// one. The data is identified by its hash rather than by its location, as the
+// same content usually sits at different blocks in each partition.
+//
+// The uses of each hash are counted from the manifest beforehand, and the
+// data is dropped after its last use. The cached data never exceeds a total
+// budget. Only SOURCE_COPY, SOURCE_BSDIFF and BROTLI_BSDIFF operations are
+// counted, as they are the ones using the cached data.
+//
+// This class is thread safe.
+class SourceDataCache {
+ public:
+  // Default amount of source data kept.
+  static constexpr size_t kDefaultMaxBytes = 32 * 1024 * 1024;
+
+  explicit SourceDataCache(size_t max_bytes = kDefaultMaxBytes)
+      : max_bytes_(max_bytes) {}
+  SourceDataCache(const SourceDataCache&) = delete;
+  SourceDataCache& operator=(const SourceDataCache&) = delete;
+
+  // Counts one more use of the source data of |operation|. Must be called for
+  // all the operations left to apply before Get() is called.
+  void AddUse(const InstallOperation& operation);
+
+  // Whether the source data of |operation| is cached or used by another
+  // operation left to apply.
+  bool IsShared(const InstallOperation& operation) const;
+
+  // Returns the source data of |operation| and counts one of its uses. When
+  // it isn't cached yet but used again later, it is read from the
+  // |block_size| blocks of |source_fd|, verified and cached if it fits in the
+  // budget. Returns null when the data isn't shared, doesn't fit or doesn't
+  // match the source hash, in which case the caller reads it itself.
+  std::shared_ptr<const brillo::Blob> Get(const InstallOperation& operation,
+                                          FileDescriptorPtr source_fd,
+                                          uint32_t block_size);
+
+  // Counts one use of the source data of |operation| without reading it, for
+  // operations applied without their source data.
+  void SkipUse(const InstallOperation& operation);
+
+  // Number of Get() calls which returned data read by an earlier one.
+  size_t num_hits() const;
+  // Amount of source data currently kept.
+  size_t cached_bytes() const;
+
+ private:
+  struct Entry {
+    // Number of Get() and SkipUse() calls expected for the data.
+    size_t uses_left{0};
+    std::shared_ptr<const brillo::Blob> data;
+  };
+
+  // Whether the cache handles the source data of |operation|.
+  static bool IsCacheable(const InstallOperation& operation);
+
+  // Counts a use of the entry at |it|, dropping it after its last one.
+  void ConsumeUse(std::map<std::string, Entry>::iterator it);
+
+  const size_t max_bytes_;
+
+  // Protects the members below.
+  mutable base::Lock lock_;
+  // The entries by source hash.
+  std::map<std::string, Entry> entries_;
+  size_t cached_bytes_{0};
+  size_t num_hits_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_DATA_CACHE_H_
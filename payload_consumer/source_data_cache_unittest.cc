@@ -0,0 +1,165 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/source_data_cache.h"
+
+#include <fcntl.h>
+
+#include <memory>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kBlockSize = 4096;
+const size_t kNumBlocks = 8;
+}  // namespace
+
+class SourceDataCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    data_.resize(kNumBlocks * kBlockSize);
+    test_utils::FillWithData(&data_);
+    ASSERT_TRUE(test_utils::WriteFileVector(file_.path(), data_));
+    fd_.reset(new EintrSafeFileDescriptor());
+    ASSERT_TRUE(fd_->Open(file_.path().c_str(), O_RDONLY));
+  }
+
+  // Returns an operation of |type| reading |num_blocks| at |start_block|,
+  // whose source hash is the one of the data at |hash_start_block|.
+  InstallOperation Operation(InstallOperation::Type type,
+                             uint64_t start_block,
+                             uint64_t num_blocks,
+                             uint64_t hash_start_block) {
+    InstallOperation op;
+    op.set_type(type);
+    *op.add_src_extents() = ExtentForRange(start_block, num_blocks);
+    *op.add_dst_extents() = ExtentForRange(start_block, num_blocks);
+    brillo::Blob hash;
+    EXPECT_TRUE(HashCalculator::RawHashOfBytes(
+        data_.data() + hash_start_block * kBlockSize,
+        num_blocks * kBlockSize,
+        &hash));
+    op.set_src_sha256_hash(hash.data(), hash.size());
+    return op;
+  }
+
+  brillo::Blob data_;
+  ScopedTempFile file_{"SourceDataCacheTest.XXXXXX"};
+  FileDescriptorPtr fd_;
+};
+
+TEST_F(SourceDataCacheTest, NotSharedTest) {
+  SourceDataCache cache;
+  InstallOperation op = Operation(InstallOperation::SOURCE_COPY, 0, 2, 0);
+  cache.AddUse(op);
+  EXPECT_FALSE(cache.IsShared(op));
+  EXPECT_EQ(nullptr, cache.Get(op, fd_, kBlockSize));
+  EXPECT_EQ(0U, cache.cached_bytes());
+
+  // Operations which aren't counted aren't cached either.
+  InstallOperation puffdiff = Operation(InstallOperation::PUFFDIFF, 0, 2, 0);
+  cache.AddUse(puffdiff);
+  cache.AddUse(puffdiff);
+  EXPECT_FALSE(cache.IsShared(puffdiff));
+  EXPECT_EQ(nullptr, cache.Get(puffdiff, fd_, kBlockSize));
+}
+
+TEST_F(SourceDataCacheTest, SharedTest) {
+  SourceDataCache cache;
+  InstallOperation copy = Operation(InstallOperation::SOURCE_COPY, 2, 3, 2);
+  // The same data, used by a diff operation of another partition where it may
+  // sit at other blocks.
+  InstallOperation diff = Operation(InstallOperation::BROTLI_BSDIFF, 5, 3, 2);
+  cache.AddUse(copy);
+  cache.AddUse(diff);
+  EXPECT_TRUE(cache.IsShared(copy));
+  EXPECT_TRUE(cache.IsShared(diff));
+
+  std::shared_ptr<const brillo::Blob> first = cache.Get(copy, fd_, kBlockSize);
+  ASSERT_NE(nullptr, first);
+  EXPECT_EQ(brillo::Blob(data_.begin() + 2 * kBlockSize,
+                         data_.begin() + 5 * kBlockSize),
+            *first);
+  EXPECT_EQ(3 * kBlockSize, cache.cached_bytes());
+  EXPECT_EQ(0U, cache.num_hits());
+
+  // The second use doesn't read the source at all.
+  std::shared_ptr<const brillo::Blob> second =
+      cache.Get(diff, nullptr, kBlockSize);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(1U, cache.num_hits());
+
+  // The data is dropped after its last use.
+  EXPECT_EQ(0U, cache.cached_bytes());
+  EXPECT_FALSE(cache.IsShared(copy));
+}
+
+TEST_F(SourceDataCacheTest, SkipUseTest) {
+  SourceDataCache cache;
+  InstallOperation op = Operation(InstallOperation::SOURCE_COPY, 2, 3, 2);
+  cache.AddUse(op);
+  cache.AddUse(op);
+  cache.AddUse(op);
+  ASSERT_NE(nullptr, cache.Get(op, fd_, kBlockSize));
+  EXPECT_EQ(3 * kBlockSize, cache.cached_bytes());
+
+  // A skipped use still counts, so the data is dropped after the last one.
+  cache.SkipUse(op);
+  EXPECT_TRUE(cache.IsShared(op));
+  ASSERT_NE(nullptr, cache.Get(op, nullptr, kBlockSize));
+  EXPECT_EQ(0U, cache.cached_bytes());
+  EXPECT_FALSE(cache.IsShared(op));
+}
+
+TEST_F(SourceDataCacheTest, MismatchTest) {
+  SourceDataCache cache;
+  InstallOperation op = Operation(InstallOperation::SOURCE_BSDIFF, 0, 2, 0);
+  brillo::Blob corrupted = data_;
+  corrupted[kBlockSize] ^= 0xff;
+  ASSERT_TRUE(test_utils::WriteFileVector(file_.path(), corrupted));
+  cache.AddUse(op);
+  cache.AddUse(op);
+  EXPECT_EQ(nullptr, cache.Get(op, fd_, kBlockSize));
+  EXPECT_EQ(0U, cache.cached_bytes());
+}
+
+TEST_F(SourceDataCacheTest, BudgetTest) {
+  SourceDataCache cache(3 * kBlockSize);
+  InstallOperation large = Operation(InstallOperation::SOURCE_COPY, 0, 4, 0);
+  InstallOperation small = Operation(InstallOperation::SOURCE_COPY, 4, 2, 4);
+  for (int i = 0; i < 2; i++) {
+    cache.AddUse(large);
+    cache.AddUse(small);
+  }
+
+  // The data over the budget is left to the caller.
+  EXPECT_EQ(nullptr, cache.Get(large, fd_, kBlockSize));
+  ASSERT_NE(nullptr, cache.Get(small, fd_, kBlockSize));
+  EXPECT_EQ(2 * kBlockSize, cache.cached_bytes());
+  EXPECT_EQ(nullptr, cache.Get(large, fd_, kBlockSize));
+  ASSERT_NE(nullptr, cache.Get(small, nullptr, kBlockSize));
+  EXPECT_EQ(1U, cache.num_hits());
+  EXPECT_EQ(0U, cache.cached_bytes());
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,234 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/source_hash_prefetcher.h"
+
+#include <utility>
+
+#include <base/logging.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/extent_reader.h"
+#include "update_engine/payload_consumer/file_descriptor_utils.h"
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+SourceHashPrefetcher::SourceHashPrefetcher(
+    uint32_t block_size,
+    FileDescriptorPtr source_fd,
+    base::OnceCallback<FileDescriptorPtr()> open_ecc_fd,
+    size_t max_entries,
+    size_t max_repaired_bytes)
+    : block_size_(block_size),
+      source_fd_(std::move(source_fd)),
+      open_ecc_fd_(std::move(open_ecc_fd)),
+      max_entries_(max_entries),
+      max_repaired_bytes_(max_repaired_bytes),
+      thread_(this, "source-hash") {
+  CHECK(source_fd_);
+  CHECK_GT(max_entries_, 0U);
+}
+
+SourceHashPrefetcher::~SourceHashPrefetcher() {
+  Stop();
+}
+
+void SourceHashPrefetcher::Prefetch(const InstallOperation& operation) {
+  DCHECK(operation.has_src_sha256_hash());
+  string key = KeyOf(operation);
+  base::AutoLock auto_lock(lock_);
+  if (stopping_)
+    return;
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    lru_.splice(lru_.end(), lru_, it->second.lru_it);
+    return;
+  }
+
+  if (!thread_started_) {
+    thread_.Start();
+    thread_started_ = true;
+  }
+  Entry& entry = entries_[key];
+  entry.operation = operation;
+  entry.lru_it = lru_.insert(lru_.end(), key);
+  queue_.push_back(std::move(key));
+  work_queued_.Signal();
+  EvictEntries();
+}
+
+SourceHashPrefetcher::Result SourceHashPrefetcher::Lookup(
+    const InstallOperation& operation, brillo::Blob* repaired_data) {
+  if (repaired_data)
+    repaired_data->clear();
+  if (!operation.has_src_sha256_hash())
+    return Result::kUnknown;
+
+  string key = KeyOf(operation);
+  base::AutoLock auto_lock(lock_);
+  auto it = entries_.find(key);
+  while (it != entries_.end() && !it->second.done && !stopped_) {
+    work_done_.Wait();
+    it = entries_.find(key);
+  }
+  if (it == entries_.end() || !it->second.done)
+    return Result::kUnknown;
+
+  Entry& entry = it->second;
+  if (repaired_data && !entry.repaired_data.empty()) {
+    repaired_bytes_ -= entry.repaired_data.size();
+    *repaired_data = std::move(entry.repaired_data);
+    entry.repaired_data.clear();
+  }
+  return entry.result;
+}
+
+void SourceHashPrefetcher::Stop() {
+  {
+    base::AutoLock auto_lock(lock_);
+    stopping_ = true;
+    for (const string& key : queue_) {
+      auto it = entries_.find(key);
+      lru_.erase(it->second.lru_it);
+      entries_.erase(it);
+    }
+    queue_.clear();
+    work_queued_.Signal();
+  }
+  if (thread_started_ && !thread_.HasBeenJoined())
+    thread_.Join();
+  if (ecc_fd_ && ecc_fd_->IsOpen())
+    ecc_fd_->Close();
+  if (source_fd_->IsOpen())
+    source_fd_->Close();
+}
+
+size_t SourceHashPrefetcher::num_mismatches() const {
+  base::AutoLock auto_lock(lock_);
+  return num_mismatches_;
+}
+
+void SourceHashPrefetcher::Run() {
+  base::AutoLock auto_lock(lock_);
+  while (true) {
+    while (queue_.empty() && !stopping_)
+      work_queued_.Wait();
+    if (queue_.empty())
+      break;
+
+    string key = std::move(queue_.front());
+    queue_.pop_front();
+    InstallOperation operation = entries_[key].operation;
+
+    // Only SOURCE_COPY operations can use the repaired data as is. Its space
+    // is reserved up front so the budget holds while unlocked.
+    size_t data_size =
+        utils::BlocksInExtents(operation.src_extents()) * block_size_;
+    bool keep_data = operation.type() == InstallOperation::SOURCE_COPY &&
+                     repaired_bytes_ + data_size <= max_repaired_bytes_;
+    if (keep_data)
+      repaired_bytes_ += data_size;
+
+    brillo::Blob repaired_data;
+    Result result;
+    {
+      base::AutoUnlock auto_unlock(lock_);
+      result = Verify(operation, keep_data, &repaired_data);
+    }
+    if (keep_data)
+      repaired_bytes_ -= data_size - repaired_data.size();
+    if (result != Result::kRawMatches)
+      num_mismatches_++;
+
+    // Pending entries are neither evicted nor dropped by Stop().
+    Entry& entry = entries_[key];
+    entry.operation.Clear();
+    entry.done = true;
+    entry.result = result;
+    entry.repaired_data = std::move(repaired_data);
+    EvictEntries();
+    work_done_.Broadcast();
+  }
+  stopped_ = true;
+  work_done_.Broadcast();
+}
+
+string SourceHashPrefetcher::KeyOf(const InstallOperation& operation) {
+  string key = operation.src_sha256_hash();
+  for (const Extent& extent : operation.src_extents()) {
+    uint64_t range[2] = {extent.start_block(), extent.num_blocks()};
+    key.append(reinterpret_cast<const char*>(range), sizeof(range));
+  }
+  return key;
+}
+
+SourceHashPrefetcher::Result SourceHashPrefetcher::Verify(
+    const InstallOperation& operation,
+    bool keep_data,
+    brillo::Blob* repaired_data) {
+  brillo::Blob expected_hash(operation.src_sha256_hash().begin(),
+                             operation.src_sha256_hash().end());
+  brillo::Blob hash;
+  if (fd_utils::ReadAndHashExtents(
+          source_fd_, operation.src_extents(), block_size_, &hash) &&
+      hash == expected_hash) {
+    return Result::kRawMatches;
+  }
+
+  if (!ecc_fd_ && open_ecc_fd_)
+    ecc_fd_ = std::move(open_ecc_fd_).Run();
+  if (!ecc_fd_)
+    return Result::kMismatch;
+
+  if (!keep_data) {
+    if (fd_utils::ReadAndHashExtents(
+            ecc_fd_, operation.src_extents(), block_size_, &hash) &&
+        hash == expected_hash) {
+      return Result::kEccMatches;
+    }
+    return Result::kMismatch;
+  }
+
+  brillo::Blob data(utils::BlocksInExtents(operation.src_extents()) *
+                    block_size_);
+  DirectExtentReader reader;
+  if (!reader.Init(ecc_fd_, operation.src_extents(), block_size_) ||
+      !reader.Read(data.data(), data.size()) ||
+      !HashCalculator::RawHashOfData(data, &hash) || hash != expected_hash) {
+    return Result::kMismatch;
+  }
+  *repaired_data = std::move(data);
+  return Result::kEccMatches;
+}
+
+void SourceHashPrefetcher::EvictEntries() {
+  auto lru_it = lru_.begin();
+  while (entries_.size() > max_entries_ && lru_it != lru_.end()) {
+    auto it = entries_.find(*lru_it);
+    if (!it->second.done) {
+      ++lru_it;
+      continue;
+    }
+    repaired_bytes_ -= it->second.repaired_data.size();
+    entries_.erase(it);
+    lru_it = lru_.erase(lru_it);
+  }
+}
+
+}  // namespace chromeos_update_engine
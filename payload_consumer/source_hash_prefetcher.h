@@ -0,0 +1,160 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_HASH_PREFETCHER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_HASH_PREFETCHER_H_
+
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+
+#include <base/functional/callback.h>
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// Verifies the source data of upcoming operations on a background thread, so
+// the apply loop doesn't have to hash it again, and more importantly doesn't
+// stall on the error corrected device when the raw source data is corrupted.
+// The results are cached by set of source extents and expected hash, so
+// operations reading the same blocks share the work.
+//
+// When the raw data doesn't match, the blocks are read through the error
+// corrected device, which is only opened the first time it is needed. The
+// recovered data is kept, up to a budget, so the caller can use it without
+// decoding it again.
+class SourceHashPrefetcher : public base::DelegateSimpleThread::Delegate {
+ public:
+  // The outcome of the verification of an operation's source data.
+  enum class Result {
+    // The operation wasn't prefetched, or its result was evicted.
+    kUnknown,
+    // The raw source device holds the expected data.
+    kRawMatches,
+    // Only the error corrected device holds the expected data.
+    kEccMatches,
+    // Neither device holds the expected data.
+    kMismatch,
+  };
+
+  // Default amount of repaired data kept for the caller.
+  static constexpr size_t kDefaultMaxRepairedBytes = 16 * 1024 * 1024;
+
+  // Default number of operations verified ahead of the one being applied.
+  static constexpr size_t kDefaultPrefetchDepth = 16;
+
+  // Reads the raw source data from |source_fd|, which is only used by the
+  // prefetcher thread. |open_ecc_fd| is run on that thread the first time a
+  // mismatch is found and returns the error corrected device, or nullptr when
+  // there is none. At most |max_entries| results are cached; the oldest ones
+  // are evicted first.
+  SourceHashPrefetcher(uint32_t block_size,
+                       FileDescriptorPtr source_fd,
+                       base::OnceCallback<FileDescriptorPtr()> open_ecc_fd,
+                       size_t max_entries,
+                       size_t max_repaired_bytes = kDefaultMaxRepairedBytes);
+  SourceHashPrefetcher(const SourceHashPrefetcher&) = delete;
+  SourceHashPrefetcher& operator=(const SourceHashPrefetcher&) = delete;
+
+  ~SourceHashPrefetcher() override;
+
+  // Queues the verification of the source data of |operation|, which must
+  // carry a source hash. Operations already cached or queued are not verified
+  // again.
+  void Prefetch(const InstallOperation& operation);
+
+  // Returns the result for the source data of |operation|, waiting for it if
+  // its verification is queued or in progress. The repaired data is only kept
+  // for SOURCE_COPY operations: when the result is kEccMatches and the data
+  // was kept, it is moved into |repaired_data|, if not null, which is
+  // otherwise left empty. The data is only returned once.
+  Result Lookup(const InstallOperation& operation, brillo::Blob* repaired_data);
+
+  // Drops the queued verifications, stops the prefetcher thread once the one
+  // in progress, if any, is done and closes the source devices. Lookup() only
+  // returns the results already available afterwards.
+  void Stop();
+
+  // Number of operations whose raw source data didn't match.
+  size_t num_mismatches() const;
+
+  // base::DelegateSimpleThread::Delegate override. Runs the prefetcher thread.
+  void Run() override;
+
+ private:
+  struct Entry {
+    InstallOperation operation;
+    bool done{false};
+    Result result{Result::kUnknown};
+    brillo::Blob repaired_data;
+    // Position of the entry in |lru_|.
+    std::list<std::string>::iterator lru_it;
+  };
+
+  // Returns the key identifying the source data of |operation|.
+  static std::string KeyOf(const InstallOperation& operation);
+
+  // Verifies the source data of |operation|. May keep the repaired data in
+  // |repaired_data| if |keep_data| is true. Called without |lock_| held.
+  Result Verify(const InstallOperation& operation,
+                bool keep_data,
+                brillo::Blob* repaired_data);
+
+  // Evicts the oldest completed entries while there are more than
+  // |max_entries_|.
+  void EvictEntries();
+
+  const uint32_t block_size_;
+  FileDescriptorPtr source_fd_;
+  base::OnceCallback<FileDescriptorPtr()> open_ecc_fd_;
+  // Only used from the prefetcher thread.
+  FileDescriptorPtr ecc_fd_;
+  const size_t max_entries_;
+  const size_t max_repaired_bytes_;
+
+  base::DelegateSimpleThread thread_;
+  bool thread_started_{false};
+
+  // Protects the members below, which are shared with the prefetcher thread.
+  mutable base::Lock lock_;
+  // Signaled when an operation is queued or the thread must stop.
+  base::ConditionVariable work_queued_{&lock_};
+  // Signaled when a verification is done or the thread stopped.
+  base::ConditionVariable work_done_{&lock_};
+
+  // The cached and pending entries by key, the keys waiting to be verified and
+  // all the keys from the least to the most recently used.
+  std::map<std::string, Entry> entries_;
+  std::deque<std::string> queue_;
+  std::list<std::string> lru_;
+
+  // Amount of repaired data held by |entries_| or being verified.
+  size_t repaired_bytes_{0};
+  size_t num_mismatches_{0};
+  bool stopping_{false};
+  bool stopped_{false};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_SOURCE_HASH_PREFETCHER_H_
@@ -0,0 +1,155 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/source_hash_prefetcher.h"
+
+#include <fcntl.h>
+
+#include <memory>
+
+#include <base/functional/bind.h>
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kBlockSize = 4096;
+const size_t kNumBlocks = 8;
+}  // namespace
+
+class SourceHashPrefetcherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // The raw source has its block 2 corrupted, the error corrected one is
+    // intact.
+    good_data_.resize(kNumBlocks * kBlockSize);
+    test_utils::FillWithData(&good_data_);
+    brillo::Blob raw_data = good_data_;
+    raw_data[2 * kBlockSize] ^= 0xff;
+    EXPECT_TRUE(test_utils::WriteFileVector(raw_file_.path(), raw_data));
+    EXPECT_TRUE(test_utils::WriteFileVector(ecc_file_.path(), good_data_));
+  }
+
+  // Returns a SOURCE_COPY operation reading |num_blocks| at |start_block|.
+  InstallOperation SourceCopy(uint64_t start_block, uint64_t num_blocks) {
+    InstallOperation op;
+    op.set_type(InstallOperation::SOURCE_COPY);
+    *op.add_src_extents() = ExtentForRange(start_block, num_blocks);
+    *op.add_dst_extents() = ExtentForRange(start_block, num_blocks);
+    brillo::Blob hash;
+    EXPECT_TRUE(HashCalculator::RawHashOfBytes(
+        good_data_.data() + start_block * kBlockSize,
+        num_blocks * kBlockSize,
+        &hash));
+    op.set_src_sha256_hash(hash.data(), hash.size());
+    return op;
+  }
+
+  static FileDescriptorPtr OpenFd(const std::string& path) {
+    FileDescriptorPtr fd(new EintrSafeFileDescriptor());
+    if (!fd->Open(path.c_str(), O_RDONLY))
+      return nullptr;
+    return fd;
+  }
+
+  std::unique_ptr<SourceHashPrefetcher> CreatePrefetcher(bool with_ecc,
+                                                         size_t max_entries) {
+    base::OnceCallback<FileDescriptorPtr()> open_ecc_fd;
+    if (with_ecc)
+      open_ecc_fd = base::BindOnce(&OpenFd, ecc_file_.path());
+    return std::make_unique<SourceHashPrefetcher>(
+        kBlockSize, OpenFd(raw_file_.path()), std::move(open_ecc_fd),
+        max_entries);
+  }
+
+  brillo::Blob good_data_;
+  ScopedTempFile raw_file_{"prefetch_raw.XXXXXX"};
+  ScopedTempFile ecc_file_{"prefetch_ecc.XXXXXX"};
+};
+
+TEST_F(SourceHashPrefetcherTest, RawMatchesTest) {
+  auto prefetcher = CreatePrefetcher(true, 16);
+  InstallOperation op = SourceCopy(0, 2);
+  prefetcher->Prefetch(op);
+  brillo::Blob repaired_data;
+  EXPECT_EQ(SourceHashPrefetcher::Result::kRawMatches,
+            prefetcher->Lookup(op, &repaired_data));
+  EXPECT_TRUE(repaired_data.empty());
+  EXPECT_EQ(0U, prefetcher->num_mismatches());
+
+  // Operations reading the same blocks share the result.
+  InstallOperation other = op;
+  other.set_type(InstallOperation::SOURCE_BSDIFF);
+  EXPECT_EQ(SourceHashPrefetcher::Result::kRawMatches,
+            prefetcher->Lookup(other, nullptr));
+}
+
+TEST_F(SourceHashPrefetcherTest, EccMatchesTest) {
+  auto prefetcher = CreatePrefetcher(true, 16);
+  InstallOperation op = SourceCopy(1, 3);
+  prefetcher->Prefetch(op);
+  brillo::Blob repaired_data;
+  EXPECT_EQ(SourceHashPrefetcher::Result::kEccMatches,
+            prefetcher->Lookup(op, &repaired_data));
+  EXPECT_EQ(brillo::Blob(good_data_.begin() + kBlockSize,
+                         good_data_.begin() + 4 * kBlockSize),
+            repaired_data);
+  EXPECT_EQ(1U, prefetcher->num_mismatches());
+
+  // The repaired data is only returned once.
+  EXPECT_EQ(SourceHashPrefetcher::Result::kEccMatches,
+            prefetcher->Lookup(op, &repaired_data));
+  EXPECT_TRUE(repaired_data.empty());
+}
+
+TEST_F(SourceHashPrefetcherTest, MismatchWithoutEccTest) {
+  auto prefetcher = CreatePrefetcher(false, 16);
+  InstallOperation op = SourceCopy(2, 1);
+  prefetcher->Prefetch(op);
+  EXPECT_EQ(SourceHashPrefetcher::Result::kMismatch,
+            prefetcher->Lookup(op, nullptr));
+}
+
+TEST_F(SourceHashPrefetcherTest, UnknownOperationsTest) {
+  auto prefetcher = CreatePrefetcher(true, 1);
+  InstallOperation first = SourceCopy(0, 1);
+  InstallOperation second = SourceCopy(4, 1);
+  EXPECT_EQ(SourceHashPrefetcher::Result::kUnknown,
+            prefetcher->Lookup(first, nullptr));
+
+  // Only the latest result is kept.
+  prefetcher->Prefetch(first);
+  EXPECT_EQ(SourceHashPrefetcher::Result::kRawMatches,
+            prefetcher->Lookup(first, nullptr));
+  prefetcher->Prefetch(second);
+  EXPECT_EQ(SourceHashPrefetcher::Result::kRawMatches,
+            prefetcher->Lookup(second, nullptr));
+  EXPECT_EQ(SourceHashPrefetcher::Result::kUnknown,
+            prefetcher->Lookup(first, nullptr));
+
+  // Nothing is verified after stopping.
+  prefetcher->Stop();
+  prefetcher->Prefetch(first);
+  EXPECT_EQ(SourceHashPrefetcher::Result::kUnknown,
+            prefetcher->Lookup(first, nullptr));
+}
+
+}  // namespace chromeos_update_engine
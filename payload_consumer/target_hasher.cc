@@ -0,0 +1,111 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/target_hasher.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include <base/logging.h>
+
+#include "update_engine/common/utils.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+// The size of the reads of the partition data.
+const size_t kReadBufferSize = 1024 * 1024;  // 1 MiB
+}  // namespace
+
+TargetHasher::TargetHasher(FileDescriptorPtr fd,
+                           uint32_t block_size,
+                           uint64_t size)
+    : fd_(std::move(fd)), block_size_(block_size), size_(size) {}
+
+void TargetHasher::AddWrittenExtents(
+    const google::protobuf::RepeatedPtrField<Extent>& extents) {
+  for (const Extent& extent : extents) {
+    uint64_t start = extent.start_block() * block_size_;
+    uint64_t end =
+        std::min(start + extent.num_blocks() * block_size_, size_);
+    if (start >= end)
+      continue;
+    if (start < hashed_end_) {
+      if (!invalid_) {
+        LOG(WARNING) << "Bytes " << start << " to " << end
+                     << " were written after they were hashed.";
+      }
+      invalid_ = true;
+      continue;
+    }
+    // Merge the range with the ones it overlaps or touches.
+    auto it = written_ranges_.upper_bound(start);
+    if (it != written_ranges_.begin() && std::prev(it)->second >= start) {
+      --it;
+      start = it->first;
+      end = std::max(end, it->second);
+      it = written_ranges_.erase(it);
+    }
+    while (it != written_ranges_.end() && it->first <= end) {
+      end = std::max(end, it->second);
+      it = written_ranges_.erase(it);
+    }
+    written_ranges_.emplace(start, end);
+  }
+}
+
+bool TargetHasher::HashWrittenData() {
+  while (!invalid_ && !written_ranges_.empty() &&
+         written_ranges_.begin()->first == hashed_end_) {
+    uint64_t end = written_ranges_.begin()->second;
+    written_ranges_.erase(written_ranges_.begin());
+    hashed_while_writing_ += end - hashed_end_;
+    TEST_AND_RETURN_FALSE(HashUpTo(end));
+  }
+  return true;
+}
+
+bool TargetHasher::Finalize() {
+  TEST_AND_RETURN_FALSE(!invalid_);
+  TEST_AND_RETURN_FALSE(HashWrittenData());
+  // The ranges still pending are read along with the gaps between them.
+  written_ranges_.clear();
+  hashed_at_finalize_ = size_ - hashed_end_;
+  TEST_AND_RETURN_FALSE(HashUpTo(size_));
+  TEST_AND_RETURN_FALSE(hash_calculator_.Finalize());
+  return true;
+}
+
+bool TargetHasher::HashUpTo(uint64_t end) {
+  buffer_.resize(kReadBufferSize);
+  while (hashed_end_ < end) {
+    size_t length = std::min<uint64_t>(end - hashed_end_, buffer_.size());
+    ssize_t bytes_read;
+    TEST_AND_RETURN_FALSE(
+        utils::PReadAll(fd_, buffer_.data(), length, hashed_end_, &bytes_read));
+    if (static_cast<size_t>(bytes_read) != length) {
+      LOG(ERROR) << "Short read of " << bytes_read << " bytes at "
+                 << hashed_end_ << ", expected " << length;
+      return false;
+    }
+    TEST_AND_RETURN_FALSE(hash_calculator_.Update(buffer_.data(), length));
+    hashed_end_ += length;
+  }
+  return true;
+}
+
+}  // namespace chromeos_update_engine
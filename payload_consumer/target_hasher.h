@@ -0,0 +1,94 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_TARGET_HASHER_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_TARGET_HASHER_H_
+
+#include <map>
+
+#include <brillo/secure_blob.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// Computes the hash of a target partition while the payload is applied, so
+// FilesystemVerifierAction doesn't have to read the whole partition back.
+//
+// The caller reports the extents of each operation once its data is written
+// and flushed. The hasher keeps the written ranges past its hashed prefix and
+// extends the prefix over them as soon as they become contiguous, reading the
+// data back through its own file descriptor while it is still in the page
+// cache. Whatever isn't reported, such as the blocks written before a resumed
+// update or the ones no operation writes, is read from the partition in
+// Finalize().
+class TargetHasher {
+ public:
+  // Hashes the first |size| bytes of the partition read through |fd|.
+  TargetHasher(FileDescriptorPtr fd, uint32_t block_size, uint64_t size);
+  TargetHasher(const TargetHasher&) = delete;
+  TargetHasher& operator=(const TargetHasher&) = delete;
+
+  // Records that |extents| were written. Writing blocks that were already
+  // hashed invalidates the hash.
+  void AddWrittenExtents(
+      const google::protobuf::RepeatedPtrField<Extent>& extents);
+
+  // Hashes the written data contiguous to the hashed prefix. Returns false on
+  // read errors.
+  bool HashWrittenData();
+
+  // Hashes the rest of the partition and finalizes the hash. Returns false if
+  // the hash was invalidated or on read errors.
+  bool Finalize();
+
+  const brillo::Blob& raw_hash() const { return hash_calculator_.raw_hash(); }
+
+  // The number of bytes hashed as they were written, and read in Finalize().
+  uint64_t hashed_while_writing() const { return hashed_while_writing_; }
+  uint64_t hashed_at_finalize() const { return hashed_at_finalize_; }
+
+ private:
+  // Reads and hashes the partition up to |end|, from the hashed prefix.
+  bool HashUpTo(uint64_t end);
+
+  FileDescriptorPtr fd_;
+  const uint32_t block_size_;
+  const uint64_t size_;
+
+  HashCalculator hash_calculator_;
+
+  // The end of the hashed prefix, in bytes.
+  uint64_t hashed_end_{0};
+
+  // The written byte ranges past |hashed_end_| not hashed yet, as a map from
+  // the start of each range to its end. The ranges don't overlap.
+  std::map<uint64_t, uint64_t> written_ranges_;
+
+  // Whether blocks were written after they were hashed.
+  bool invalid_{false};
+
+  uint64_t hashed_while_writing_{0};
+  uint64_t hashed_at_finalize_{0};
+
+  brillo::Blob buffer_;
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_TARGET_HASHER_H_
@@ -0,0 +1,127 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/target_hasher.h"
+
+#include <fcntl.h>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/test_utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+const size_t kBlockSize = 4096;
+const size_t kNumBlocks = 600;
+}  // namespace
+
+class TargetHasherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    data_.resize(kNumBlocks * kBlockSize);
+    test_utils::FillWithData(&data_);
+    EXPECT_TRUE(test_utils::WriteFileVector(file_.path(), data_));
+    fd_.reset(new EintrSafeFileDescriptor());
+    EXPECT_TRUE(fd_->Open(file_.path().c_str(), O_RDONLY));
+  }
+
+  static google::protobuf::RepeatedPtrField<Extent> Extents(
+      std::initializer_list<Extent> extents) {
+    google::protobuf::RepeatedPtrField<Extent> result;
+    for (const Extent& extent : extents)
+      *result.Add() = extent;
+    return result;
+  }
+
+  brillo::Blob ExpectedHash(size_t size) {
+    brillo::Blob hash;
+    EXPECT_TRUE(HashCalculator::RawHashOfBytes(data_.data(), size, &hash));
+    return hash;
+  }
+
+  brillo::Blob data_;
+  ScopedTempFile file_{"target_hasher.XXXXXX"};
+  FileDescriptorPtr fd_;
+};
+
+TEST_F(TargetHasherTest, InOrderTest) {
+  TargetHasher hasher(fd_, kBlockSize, data_.size());
+  hasher.AddWrittenExtents(Extents({ExtentForRange(0, 300)}));
+  EXPECT_TRUE(hasher.HashWrittenData());
+  hasher.AddWrittenExtents(Extents({ExtentForRange(300, 300)}));
+  EXPECT_TRUE(hasher.HashWrittenData());
+  EXPECT_TRUE(hasher.Finalize());
+  EXPECT_EQ(ExpectedHash(data_.size()), hasher.raw_hash());
+  EXPECT_EQ(data_.size(), hasher.hashed_while_writing());
+  EXPECT_EQ(0U, hasher.hashed_at_finalize());
+}
+
+TEST_F(TargetHasherTest, OutOfOrderTest) {
+  TargetHasher hasher(fd_, kBlockSize, data_.size());
+  // Nothing can be hashed until the first blocks are written.
+  hasher.AddWrittenExtents(
+      Extents({ExtentForRange(10, 5), ExtentForRange(20, 580)}));
+  EXPECT_TRUE(hasher.HashWrittenData());
+  EXPECT_EQ(0U, hasher.hashed_while_writing());
+  // Overlapping and touching ranges are merged.
+  hasher.AddWrittenExtents(
+      Extents({ExtentForRange(12, 8), ExtentForRange(0, 10)}));
+  EXPECT_TRUE(hasher.HashWrittenData());
+  EXPECT_EQ(data_.size(), hasher.hashed_while_writing());
+  EXPECT_TRUE(hasher.Finalize());
+  EXPECT_EQ(ExpectedHash(data_.size()), hasher.raw_hash());
+}
+
+TEST_F(TargetHasherTest, GapsTest) {
+  // The unwritten blocks, here the first ones as in a resumed update, are
+  // read at the end.
+  TargetHasher hasher(fd_, kBlockSize, data_.size());
+  hasher.AddWrittenExtents(
+      Extents({ExtentForRange(100, 100), ExtentForRange(300, 100)}));
+  EXPECT_TRUE(hasher.HashWrittenData());
+  EXPECT_TRUE(hasher.Finalize());
+  EXPECT_EQ(ExpectedHash(data_.size()), hasher.raw_hash());
+  EXPECT_EQ(0U, hasher.hashed_while_writing());
+  EXPECT_EQ(data_.size(), hasher.hashed_at_finalize());
+}
+
+TEST_F(TargetHasherTest, PartialLastBlockTest) {
+  // Extents past the hashed size are clamped.
+  const size_t kSize = data_.size() - kBlockSize - 100;
+  TargetHasher hasher(fd_, kBlockSize, kSize);
+  hasher.AddWrittenExtents(Extents({ExtentForRange(0, kNumBlocks)}));
+  EXPECT_TRUE(hasher.HashWrittenData());
+  EXPECT_EQ(kSize, hasher.hashed_while_writing());
+  EXPECT_TRUE(hasher.Finalize());
+  EXPECT_EQ(ExpectedHash(kSize), hasher.raw_hash());
+}
+
+TEST_F(TargetHasherTest, RewrittenBlocksTest) {
+  TargetHasher hasher(fd_, kBlockSize, data_.size());
+  hasher.AddWrittenExtents(Extents({ExtentForRange(0, 10)}));
+  EXPECT_TRUE(hasher.HashWrittenData());
+  hasher.AddWrittenExtents(Extents({ExtentForRange(5, 1)}));
+  EXPECT_FALSE(hasher.Finalize());
+}
+
+TEST_F(TargetHasherTest, ShortReadTest) {
+  TargetHasher hasher(fd_, kBlockSize, data_.size() + 1);
+  EXPECT_FALSE(hasher.Finalize());
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,168 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/verity_writer_chromeos.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+
+#include "update_engine/common/utils.h"
+
+namespace chromeos_update_engine {
+
+namespace verity_writer {
+std::unique_ptr<VerityWriterInterface> CreateVerityWriter() {
+  return std::make_unique<VerityWriterChromeos>();
+}
+}  // namespace verity_writer
+
+bool VerityWriterChromeos::Init(const InstallPlan::Partition& partition) {
+  partition_ = partition;
+  fd_.reset();
+  hash_tree_builder_.reset();
+  fec_encoder_.reset();
+  hash_tree_data_received_ = 0;
+  fec_data_received_ = 0;
+  if (partition_.hash_tree_size == 0 && partition_.fec_size == 0)
+    return true;
+
+  const uint32_t block_size = partition_.block_size;
+  TEST_AND_RETURN_FALSE(block_size > 0);
+  fd_ = std::make_shared<EintrSafeFileDescriptor>();
+  if (!fd_->Open(partition_.target_path.c_str(), O_RDWR)) {
+    PLOG(ERROR) << "Unable to open " << partition_.target_path
+                << " to write verity data";
+    fd_.reset();
+    return false;
+  }
+
+  if (partition_.hash_tree_size != 0) {
+    if (partition_.hash_tree_algorithm != "sha256") {
+      LOG(ERROR) << "Unsupported hash tree algorithm: "
+                 << partition_.hash_tree_algorithm;
+      return false;
+    }
+    uint64_t tree_size = HashTreeBuilder::CalculateSize(
+        partition_.hash_tree_data_size, block_size);
+    if (tree_size != partition_.hash_tree_size) {
+      LOG(ERROR) << "The hash tree of " << partition_.hash_tree_data_size
+                 << " bytes takes " << tree_size << " bytes, not "
+                 << partition_.hash_tree_size;
+      return false;
+    }
+    TEST_AND_RETURN_FALSE(partition_.hash_tree_data_offset % block_size == 0);
+    TEST_AND_RETURN_FALSE(partition_.hash_tree_offset >=
+                          partition_.hash_tree_data_offset +
+                              partition_.hash_tree_data_size);
+    hash_tree_builder_ = std::make_unique<HashTreeBuilder>(
+        block_size, partition_.hash_tree_salt);
+    TEST_AND_RETURN_FALSE(
+        hash_tree_builder_->Initialize(partition_.hash_tree_data_size,
+                                       fd_,
+                                       partition_.hash_tree_offset));
+  }
+
+  if (partition_.fec_size != 0) {
+    uint64_t fec_size = FecEncoder::CalculateSize(
+        partition_.fec_data_size, block_size, partition_.fec_roots);
+    if (fec_size != partition_.fec_size) {
+      LOG(ERROR) << "The error correction data of " << partition_.fec_data_size
+                 << " bytes with " << partition_.fec_roots << " roots takes "
+                 << fec_size << " bytes, not " << partition_.fec_size;
+      return false;
+    }
+    TEST_AND_RETURN_FALSE(partition_.fec_data_offset % block_size == 0);
+    TEST_AND_RETURN_FALSE(partition_.fec_offset >=
+                          partition_.fec_data_offset + partition_.fec_data_size);
+    fec_encoder_ =
+        std::make_unique<FecEncoder>(block_size, partition_.fec_roots);
+    TEST_AND_RETURN_FALSE(fec_encoder_->Initialize(partition_.fec_data_size));
+  }
+  return true;
+}
+
+bool VerityWriterChromeos::Update(uint64_t offset,
+                                  const uint8_t* buffer,
+                                  size_t size) {
+  if (hash_tree_builder_) {
+    uint64_t data_end =
+        partition_.hash_tree_data_offset + partition_.hash_tree_data_size;
+    uint64_t start = std::max(offset, partition_.hash_tree_data_offset);
+    uint64_t end = std::min(offset + size, data_end);
+    if (start < end) {
+      // The data must be passed in order.
+      TEST_AND_RETURN_FALSE(start == partition_.hash_tree_data_offset +
+                                         hash_tree_data_received_);
+      TEST_AND_RETURN_FALSE(
+          hash_tree_builder_->Update(buffer + (start - offset), end - start));
+      hash_tree_data_received_ += end - start;
+      if (end == data_end) {
+        TEST_AND_RETURN_FALSE(hash_tree_builder_->Finalize());
+        LOG(INFO) << "Wrote the hash tree of " << partition_.name
+                  << ", root hash: "
+                  << base::HexEncode(hash_tree_builder_->root_hash().data(),
+                                     hash_tree_builder_->root_hash().size());
+        hash_tree_builder_.reset();
+      }
+    }
+  }
+
+  if (fec_encoder_) {
+    uint64_t data_end = partition_.fec_data_offset + partition_.fec_data_size;
+    uint64_t start = std::max(offset, partition_.fec_data_offset);
+    uint64_t end = std::min(offset + size, data_end);
+    if (start < end) {
+      TEST_AND_RETURN_FALSE(start ==
+                            partition_.fec_data_offset + fec_data_received_);
+      TEST_AND_RETURN_FALSE(
+          fec_encoder_->Update(buffer + (start - offset), end - start));
+      fec_data_received_ += end - start;
+      if (end == data_end) {
+        TEST_AND_RETURN_FALSE(fec_encoder_->Finalize());
+        const brillo::Blob& parity = fec_encoder_->parity();
+        TEST_AND_RETURN_FALSE(utils::PWriteAll(
+            fd_, parity.data(), parity.size(), partition_.fec_offset));
+        LOG(INFO) << "Wrote " << parity.size()
+                  << " bytes of error correction data of " << partition_.name;
+        fec_encoder_.reset();
+      }
+    }
+  }
+  return CloseIfDone();
+}
+
+bool VerityWriterChromeos::CloseIfDone() {
+  if (!fd_ || hash_tree_builder_ || fec_encoder_)
+    return true;
+  // The verity data must be on the storage before the slot is marked
+  // bootable.
+  bool success = fd_->Sync();
+  if (!success)
+    PLOG(ERROR) << "Error syncing " << partition_.target_path;
+  if (!fd_->Close()) {
+    PLOG(ERROR) << "Error closing " << partition_.target_path;
+    success = false;
+  }
+  fd_.reset();
+  return success;
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,60 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_VERITY_WRITER_CHROMEOS_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_VERITY_WRITER_CHROMEOS_H_
+
+#include <memory>
+
+#include "update_engine/payload_consumer/fec_encoder.h"
+#include "update_engine/payload_consumer/file_descriptor.h"
+#include "update_engine/payload_consumer/hash_tree_builder.h"
+#include "update_engine/payload_consumer/verity_writer_interface.h"
+
+namespace chromeos_update_engine {
+
+// Writes the dm-verity hash tree and the error correction data of a partition
+// from its data, streamed in order through Update(), see HashTreeBuilder and
+// FecEncoder. The hash tree is written as soon as the last block it covers is
+// passed, so it can be read back as part of the error corrected data.
+class VerityWriterChromeos : public VerityWriterInterface {
+ public:
+  VerityWriterChromeos() = default;
+  VerityWriterChromeos(const VerityWriterChromeos&) = delete;
+  VerityWriterChromeos& operator=(const VerityWriterChromeos&) = delete;
+
+  ~VerityWriterChromeos() override = default;
+
+  bool Init(const InstallPlan::Partition& partition) override;
+  bool Update(uint64_t offset, const uint8_t* buffer, size_t size) override;
+
+ private:
+  // Syncs and closes |fd_| once nothing is left to write.
+  bool CloseIfDone();
+
+  InstallPlan::Partition partition_;
+  FileDescriptorPtr fd_;
+
+  std::unique_ptr<HashTreeBuilder> hash_tree_builder_;
+  uint64_t hash_tree_data_received_{0};
+
+  std::unique_ptr<FecEncoder> fec_encoder_;
+  uint64_t fec_data_received_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_VERITY_WRITER_CHROMEOS_H_
@@ -0,0 +1,156 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/verity_writer_chromeos.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+const uint32_t kBlockSize = 4096;
+const uint64_t kDataBlocks = 40;
+}  // namespace
+
+class VerityWriterChromeosTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // The data, followed by its hash tree, with the error correction data of
+    // both at the end.
+    partition_.name = "root";
+    partition_.target_path = temp_file_.path();
+    partition_.block_size = kBlockSize;
+    partition_.hash_tree_data_offset = 0;
+    partition_.hash_tree_data_size = kDataBlocks * kBlockSize;
+    partition_.hash_tree_offset = kDataBlocks * kBlockSize;
+    partition_.hash_tree_size = kBlockSize;
+    partition_.hash_tree_algorithm = "sha256";
+    partition_.hash_tree_salt = {0xaa, 0xbb};
+    partition_.fec_data_offset = 0;
+    partition_.fec_data_size = (kDataBlocks + 1) * kBlockSize;
+    partition_.fec_offset = (kDataBlocks + 1) * kBlockSize;
+    partition_.fec_size = 2 * kBlockSize;
+    partition_.fec_roots = 2;
+
+    part_data_.resize((kDataBlocks + 3) * kBlockSize);
+    test_utils::FillWithData(&part_data_);
+    ASSERT_TRUE(test_utils::WriteFileVector(partition_.target_path, part_data_));
+  }
+
+  InstallPlan::Partition partition_;
+  ScopedTempFile temp_file_{"VerityWriterChromeosTest.XXXXXX"};
+  brillo::Blob part_data_;
+};
+
+TEST_F(VerityWriterChromeosTest, SimpleTest) {
+  VerityWriterChromeos verity_writer;
+  ASSERT_TRUE(verity_writer.Init(partition_));
+  // Pass the data the way the verifier reads it, in chunks not aligned to the
+  // regions, with the hash tree read back from the partition once written.
+  const uint64_t kChunkSize = 3 * kBlockSize;
+  for (uint64_t offset = 0; offset < partition_.hash_tree_offset;
+       offset += kChunkSize) {
+    uint64_t size =
+        std::min(kChunkSize, partition_.hash_tree_offset - offset);
+    ASSERT_TRUE(verity_writer.Update(offset, part_data_.data() + offset, size));
+  }
+  brillo::Blob actual_part;
+  ASSERT_TRUE(utils::ReadFile(partition_.target_path, &actual_part));
+  ASSERT_TRUE(verity_writer.Update(partition_.hash_tree_offset,
+                                   actual_part.data() +
+                                       partition_.hash_tree_offset,
+                                   partition_.hash_tree_size));
+  ASSERT_TRUE(utils::ReadFile(partition_.target_path, &actual_part));
+  ASSERT_EQ(part_data_.size(), actual_part.size());
+
+  // The hash tree matches the one built directly.
+  ScopedTempFile tree_file("VerityWriterChromeosTest.XXXXXX");
+  FileDescriptorPtr fd(new EintrSafeFileDescriptor());
+  ASSERT_TRUE(fd->Open(tree_file.path().c_str(), O_RDWR));
+  HashTreeBuilder builder(kBlockSize, partition_.hash_tree_salt);
+  ASSERT_TRUE(builder.Initialize(partition_.hash_tree_data_size, fd, 0));
+  ASSERT_TRUE(
+      builder.Update(part_data_.data(), partition_.hash_tree_data_size));
+  ASSERT_TRUE(builder.Finalize());
+  brillo::Blob expected_tree;
+  ASSERT_TRUE(utils::ReadFile(tree_file.path(), &expected_tree));
+  EXPECT_TRUE(expected_tree ==
+              brillo::Blob(actual_part.begin() + partition_.hash_tree_offset,
+                           actual_part.begin() + partition_.hash_tree_offset +
+                               partition_.hash_tree_size));
+
+  // The error correction data covers the data and the written hash tree.
+  FecEncoder encoder(kBlockSize, partition_.fec_roots);
+  ASSERT_TRUE(encoder.Initialize(partition_.fec_data_size));
+  ASSERT_TRUE(encoder.Update(actual_part.data(), partition_.fec_data_size));
+  ASSERT_TRUE(encoder.Finalize());
+  EXPECT_TRUE(encoder.parity() ==
+              brillo::Blob(actual_part.begin() + partition_.fec_offset,
+                           actual_part.begin() + partition_.fec_offset +
+                               partition_.fec_size));
+
+  // The data itself is left untouched.
+  EXPECT_TRUE(std::equal(part_data_.begin(),
+                         part_data_.begin() + partition_.hash_tree_offset,
+                         actual_part.begin()));
+}
+
+TEST_F(VerityWriterChromeosTest, NoVerityTest) {
+  partition_.hash_tree_size = 0;
+  partition_.fec_size = 0;
+  // Even an unsupported configuration, since nothing is written.
+  partition_.hash_tree_algorithm = "sha1";
+  VerityWriterChromeos verity_writer;
+  ASSERT_TRUE(verity_writer.Init(partition_));
+  EXPECT_TRUE(verity_writer.Update(0, part_data_.data(), part_data_.size()));
+  brillo::Blob actual_part;
+  ASSERT_TRUE(utils::ReadFile(partition_.target_path, &actual_part));
+  EXPECT_TRUE(part_data_ == actual_part);
+}
+
+TEST_F(VerityWriterChromeosTest, InvalidAlgorithmTest) {
+  partition_.hash_tree_algorithm = "sha1";
+  VerityWriterChromeos verity_writer;
+  EXPECT_FALSE(verity_writer.Init(partition_));
+}
+
+TEST_F(VerityWriterChromeosTest, InvalidHashTreeSizeTest) {
+  partition_.hash_tree_size = 2 * kBlockSize;
+  VerityWriterChromeos verity_writer;
+  EXPECT_FALSE(verity_writer.Init(partition_));
+}
+
+TEST_F(VerityWriterChromeosTest, InvalidFecSizeTest) {
+  partition_.fec_roots = 3;
+  VerityWriterChromeos verity_writer;
+  EXPECT_FALSE(verity_writer.Init(partition_));
+}
+
+TEST_F(VerityWriterChromeosTest, OutOfOrderTest) {
+  VerityWriterChromeos verity_writer;
+  ASSERT_TRUE(verity_writer.Init(partition_));
+  EXPECT_FALSE(
+      verity_writer.Update(kBlockSize, part_data_.data(), kBlockSize));
+}
+
+}  // namespace chromeos_update_engine
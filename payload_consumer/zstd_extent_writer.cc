@@ -0,0 +1,70 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/zstd_extent_writer.h"
+
+#include <base/logging.h>
+
+using google::protobuf::RepeatedPtrField;
+
+namespace chromeos_update_engine {
+
+namespace {
+// Like for xz, the window the decompressor needs to keep in RAM is chosen by
+// the compressor. Streams requiring a window over 64 MiB are rejected, which
+// still allows any compression level on the chunks of the payloads.
+const int kZstdMaxWindowLog = 26;
+}  // namespace
+
+ZstdExtentWriter::~ZstdExtentWriter() {
+  ZSTD_freeDCtx(stream_);
+}
+
+bool ZstdExtentWriter::Init(FileDescriptorPtr fd,
+                            const RepeatedPtrField<Extent>& extents,
+                            uint32_t block_size) {
+  stream_ = ZSTD_createDCtx();
+  TEST_AND_RETURN_FALSE(stream_ != nullptr);
+  TEST_AND_RETURN_FALSE(!ZSTD_isError(ZSTD_DCtx_setParameter(
+      stream_, ZSTD_d_windowLogMax, kZstdMaxWindowLog)));
+  // The recommended size, enough to hold a whole zstd block.
+  output_buffer_.resize(ZSTD_DStreamOutSize());
+  return underlying_writer_->Init(fd, extents, block_size);
+}
+
+bool ZstdExtentWriter::Write(const void* bytes, size_t count) {
+  ZSTD_inBuffer input = {bytes, count, 0};
+  for (;;) {
+    ZSTD_outBuffer output = {output_buffer_.data(), output_buffer_.size(), 0};
+    size_t ret = ZSTD_decompressStream(stream_, &output, &input);
+    if (ZSTD_isError(ret)) {
+      LOG(ERROR) << "ZSTD_decompressStream failed: "
+                 << ZSTD_getErrorName(ret);
+      return false;
+    }
+    if (output.pos > 0) {
+      TEST_AND_RETURN_FALSE(
+          underlying_writer_->Write(output_buffer_.data(), output.pos));
+    }
+    // Some decompressed data may still be held in the context while the
+    // output buffer was filled.
+    if (input.pos == input.size && output.pos < output.size)
+      break;
+  }
+  return true;
+}
+
+}  // namespace chromeos_update_engine
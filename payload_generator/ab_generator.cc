@@ -48,6 +48,7 @@ bool ABGenerator::GenerateOperations(const PayloadGenerationConfig& config,
            ? -1
            : config.hard_chunk_size / config.block_size);
   size_t soft_chunk_blocks = config.soft_chunk_size / config.block_size;
+  size_t file_shard_blocks = config.file_shard_size / config.block_size;
 
   aops->clear();
   TEST_AND_RETURN_FALSE(diff_utils::DeltaReadPartition(aops,
@@ -55,8 +56,11 @@ bool ABGenerator::GenerateOperations(const PayloadGenerationConfig& config,
                                                        new_part,
                                                        hard_chunk_blocks,
                                                        soft_chunk_blocks,
+                                                       file_shard_blocks,
                                                        config.version,
-                                                       blob_file));
+                                                       blob_file,
+                                                       memory_budget_,
+                                                       diff_cache_));
   LOG(INFO) << "done reading " << new_part.name;
 
   SortOperationsByDestination(aops);
@@ -68,12 +72,29 @@ bool ABGenerator::GenerateOperations(const PayloadGenerationConfig& config,
       static_cast<size_t>(hard_chunk_blocks) < soft_chunk_blocks) {
     merge_chunk_blocks = hard_chunk_blocks;
   }
+  // Don't merge replace operations beyond the size they are split at below,
+  // which would compress them twice.
+  size_t replace_chunk_blocks = config.replace_chunk_size / kBlockSize;
 
   LOG(INFO) << "Merging " << aops->size() << " operations.";
-  TEST_AND_RETURN_FALSE(MergeOperations(
-      aops, config.version, merge_chunk_blocks, new_part.path, blob_file));
+  TEST_AND_RETURN_FALSE(MergeOperations(aops,
+                                        config.version,
+                                        merge_chunk_blocks,
+                                        new_part.path,
+                                        blob_file,
+                                        replace_chunk_blocks));
   LOG(INFO) << aops->size() << " operations after merge.";
 
+  if (config.replace_chunk_size > 0) {
+    TEST_AND_RETURN_FALSE(
+        SplitLargeReplaceOperations(config.version,
+                                    config.replace_chunk_size / kBlockSize,
+                                    aops,
+                                    new_part.path,
+                                    blob_file));
+    LOG(INFO) << aops->size() << " operations after splitting replaces.";
+  }
+
   if (config.version.minor >= kOpSrcHashMinorPayloadVersion)
     TEST_AND_RETURN_FALSE(AddSourceHash(aops, old_part.path));
 
@@ -164,33 +185,80 @@ bool ABGenerator::SplitAReplaceOp(const PayloadVersion& version,
                                   const string& target_part_path,
                                   vector<AnnotatedOperation>* result_aops,
                                   BlobFileWriter* blob_file) {
-  InstallOperation original_op = original_aop.op;
-  TEST_AND_RETURN_FALSE(IsAReplaceOperation(original_op.type()));
-  const bool is_replace = original_op.type() == InstallOperation::REPLACE;
+  TEST_AND_RETURN_FALSE(IsAReplaceOperation(original_aop.op.type()));
+  uint64_t data_offset = original_aop.op.data_offset();
+  for (int i = 0; i < original_aop.op.dst_extents_size(); i++) {
+    TEST_AND_RETURN_FALSE(AddReplaceOpPiece(version,
+                                            original_aop,
+                                            {original_aop.op.dst_extents(i)},
+                                            i,
+                                            &data_offset,
+                                            target_part_path,
+                                            result_aops,
+                                            blob_file));
+  }
+  return true;
+}
 
-  uint64_t data_offset = original_op.data_offset();
-  for (int i = 0; i < original_op.dst_extents_size(); i++) {
-    const Extent& dst_ext = original_op.dst_extents(i);
-    // Make a new operation with only one dst extent.
-    InstallOperation new_op;
-    *(new_op.add_dst_extents()) = dst_ext;
-    uint64_t data_size = dst_ext.num_blocks() * kBlockSize;
-    // If this is a REPLACE, attempt to reuse portions of the existing blob.
-    if (is_replace) {
-      new_op.set_type(InstallOperation::REPLACE);
-      new_op.set_data_length(data_size);
-      new_op.set_data_offset(data_offset);
-      data_offset += data_size;
+bool ABGenerator::SplitLargeReplaceOperations(
+    const PayloadVersion& version,
+    size_t chunk_blocks,
+    vector<AnnotatedOperation>* aops,
+    const string& target_part_path,
+    BlobFileWriter* blob_file) {
+  TEST_AND_RETURN_FALSE(chunk_blocks > 0);
+  vector<AnnotatedOperation> split_aops;
+  for (const AnnotatedOperation& aop : *aops) {
+    uint64_t num_blocks = utils::BlocksInExtents(aop.op.dst_extents());
+    if (!IsAReplaceOperation(aop.op.type()) || num_blocks <= chunk_blocks) {
+      split_aops.push_back(aop);
+      continue;
     }
+    vector<Extent> dst_extents;
+    ExtentsToVector(aop.op.dst_extents(), &dst_extents);
+    uint64_t data_offset = aop.op.data_offset();
+    for (int i = 0; i * chunk_blocks < num_blocks; i++) {
+      TEST_AND_RETURN_FALSE(AddReplaceOpPiece(
+          version,
+          aop,
+          ExtentsSublist(dst_extents, i * chunk_blocks, chunk_blocks),
+          i,
+          &data_offset,
+          target_part_path,
+          &split_aops,
+          blob_file));
+    }
+  }
+  *aops = std::move(split_aops);
+  return true;
+}
 
-    AnnotatedOperation new_aop;
-    new_aop.op = new_op;
-    new_aop.name = base::StringPrintf("%s:%d", original_aop.name.c_str(), i);
-    TEST_AND_RETURN_FALSE(
-        AddDataAndSetType(&new_aop, version, target_part_path, blob_file));
-
-    result_aops->push_back(new_aop);
+bool ABGenerator::AddReplaceOpPiece(const PayloadVersion& version,
+                                    const AnnotatedOperation& original_aop,
+                                    const vector<Extent>& dst_extents,
+                                    int index,
+                                    uint64_t* data_offset,
+                                    const string& target_part_path,
+                                    vector<AnnotatedOperation>* result_aops,
+                                    BlobFileWriter* blob_file) {
+  InstallOperation new_op;
+  StoreExtents(dst_extents, new_op.mutable_dst_extents());
+  // If this is a REPLACE, attempt to reuse portions of the existing blob.
+  if (original_aop.op.type() == InstallOperation::REPLACE) {
+    uint64_t data_size = utils::BlocksInExtents(dst_extents) * kBlockSize;
+    new_op.set_type(InstallOperation::REPLACE);
+    new_op.set_data_length(data_size);
+    new_op.set_data_offset(*data_offset);
+    *data_offset += data_size;
   }
+
+  AnnotatedOperation new_aop;
+  new_aop.op = new_op;
+  new_aop.name =
+      base::StringPrintf("%s:%d", original_aop.name.c_str(), index);
+  TEST_AND_RETURN_FALSE(
+      AddDataAndSetType(&new_aop, version, target_part_path, blob_file));
+  result_aops->push_back(new_aop);
   return true;
 }
 
@@ -198,7 +266,8 @@ bool ABGenerator::MergeOperations(vector<AnnotatedOperation>* aops,
                                   const PayloadVersion& version,
                                   size_t chunk_blocks,
                                   const string& target_part_path,
-                                  BlobFileWriter* blob_file) {
+                                  BlobFileWriter* blob_file,
+                                  size_t replace_chunk_blocks) {
   vector<AnnotatedOperation> new_aops;
   for (const AnnotatedOperation& curr_aop : *aops) {
     if (new_aops.empty()) {
@@ -222,12 +291,15 @@ bool ABGenerator::MergeOperations(vector<AnnotatedOperation>* aops,
         last_aop.op.dst_extents(last_dst_idx).num_blocks() +
         curr_aop.op.dst_extents(0).num_blocks();
     bool is_a_replace = IsAReplaceOperation(curr_aop.op.type());
+    size_t max_block_count = chunk_blocks;
+    if (is_a_replace && replace_chunk_blocks > 0)
+      max_block_count = std::min(max_block_count, replace_chunk_blocks);
 
     bool is_delta_op = curr_aop.op.type() == InstallOperation::SOURCE_COPY;
     if (((is_delta_op && (last_aop.op.type() == curr_aop.op.type())) ||
          (is_a_replace && last_is_a_replace)) &&
         last_end_block == curr_start_block &&
-        combined_block_count <= chunk_blocks) {
+        combined_block_count <= max_block_count) {
       // If the operations have the same type (which is a type that we can
       // merge), are contiguous, are fragmented to have one destination extent,
       // and their combined block count would be less than chunk size, merge
@@ -24,6 +24,8 @@
 
 #include "update_engine/payload_consumer/payload_constants.h"
 #include "update_engine/payload_generator/blob_file_writer.h"
+#include "update_engine/payload_generator/budgeted_thread_pool.h"
+#include "update_engine/payload_generator/diff_cache.h"
 #include "update_engine/payload_generator/extent_utils.h"
 #include "update_engine/payload_generator/filesystem_interface.h"
 #include "update_engine/payload_generator/operations_generator.h"
@@ -38,6 +40,11 @@ namespace chromeos_update_engine {
 class ABGenerator : public OperationsGenerator {
  public:
   ABGenerator() = default;
+  // The files are diffed within |memory_budget|, which can be shared with the
+  // generators of other partitions, reusing the diffs of |diff_cache| unless
+  // null.
+  ABGenerator(MemoryBudget* memory_budget, DiffCache* diff_cache)
+      : memory_budget_(memory_budget), diff_cache_(diff_cache) {}
   ABGenerator(const ABGenerator&) = delete;
   ABGenerator& operator=(const ABGenerator&) = delete;
 
@@ -95,20 +102,34 @@ class ABGenerator : public OperationsGenerator {
                               std::vector<AnnotatedOperation>* result_aops,
                               BlobFileWriter* blob_file);
 
+  // Splits the REPLACE, REPLACE_BZ and REPLACE_XZ operations in |aops| that
+  // write more than |chunk_blocks| blocks in operations of at most
+  // |chunk_blocks| blocks each, compressed independently so the client can
+  // apply them in parallel. The new operations may be of a different type
+  // depending on whether compression is advantageous.
+  static bool SplitLargeReplaceOperations(
+      const PayloadVersion& version,
+      size_t chunk_blocks,
+      std::vector<AnnotatedOperation>* aops,
+      const std::string& target_part_path,
+      BlobFileWriter* blob_file);
+
   // Takes a sorted (by first destination extent) vector of operations |aops|
   // and merges SOURCE_COPY, REPLACE, REPLACE_BZ and REPLACE_XZ, operations in
   // that vector.
   // It will merge two operations if:
   //   - They are both REPLACE_*, or they are both SOURCE_COPY,
   //   - Their destination blocks are contiguous.
-  //   - Their combined blocks do not exceed |chunk_blocks| blocks.
+  //   - Their combined blocks do not exceed |chunk_blocks| blocks, nor
+  //     |replace_chunk_blocks| blocks for REPLACE_* operations unless it is 0.
   // Note that unlike other methods, you can't pass a negative number in
   // |chunk_blocks|.
   static bool MergeOperations(std::vector<AnnotatedOperation>* aops,
                               const PayloadVersion& version,
                               size_t chunk_blocks,
                               const std::string& target_part,
-                              BlobFileWriter* blob_file);
+                              BlobFileWriter* blob_file,
+                              size_t replace_chunk_blocks = 0);
 
   // Takes a vector of AnnotatedOperations |aops|, adds source hash to all
   // operations that have src_extents.
@@ -127,6 +148,22 @@ class ABGenerator : public OperationsGenerator {
                                 const PayloadVersion& version,
                                 const std::string& target_part_path,
                                 BlobFileWriter* blob_file);
+
+  // Adds to |result_aops| the |index|-th piece of the replace operation
+  // |original_aop|, writing the |dst_extents| blocks. If |original_aop| is a
+  // REPLACE, the piece reuses the portion of its blob at |*data_offset|, which
+  // is advanced past it. Otherwise the piece is compressed again.
+  static bool AddReplaceOpPiece(const PayloadVersion& version,
+                                const AnnotatedOperation& original_aop,
+                                const std::vector<Extent>& dst_extents,
+                                int index,
+                                uint64_t* data_offset,
+                                const std::string& target_part_path,
+                                std::vector<AnnotatedOperation>* result_aops,
+                                BlobFileWriter* blob_file);
+
+  MemoryBudget* memory_budget_{nullptr};
+  DiffCache* diff_cache_{nullptr};
 };
 
 }  // namespace chromeos_update_engine
@@ -395,6 +395,79 @@ TEST_F(ABGeneratorTest, SplitReplaceXzIntoReplaceTest) {
   TestSplitReplaceOrReplaceXzOperation(InstallOperation::REPLACE_XZ, false);
 }
 
+TEST_F(ABGeneratorTest, SplitLargeReplaceOperationsTest) {
+  const size_t part_num_blocks = 10;
+  brillo::Blob part_data(part_num_blocks * kBlockSize);
+  test_utils::FillWithData(&part_data);
+  ScopedTempFile part_file("SplitLargeReplaceOperationsTest_part.XXXXXX");
+  ASSERT_TRUE(test_utils::WriteFileVector(part_file.path(), part_data));
+
+  // A REPLACE_XZ operation of 7 blocks and a SOURCE_COPY one, whose blobs
+  // don't matter as they are not reused.
+  vector<AnnotatedOperation> aops(2);
+  aops[0].name = "large";
+  aops[0].op.set_type(InstallOperation::REPLACE_XZ);
+  *(aops[0].op.add_dst_extents()) = ExtentForRange(0, 3);
+  *(aops[0].op.add_dst_extents()) = ExtentForRange(5, 4);
+  aops[0].op.set_data_offset(0);
+  aops[0].op.set_data_length(100);
+  aops[1].name = "copy";
+  aops[1].op.set_type(InstallOperation::SOURCE_COPY);
+  *(aops[1].op.add_src_extents()) = ExtentForRange(0, 5);
+  *(aops[1].op.add_dst_extents()) = ExtentForRange(3, 2);
+  *(aops[1].op.add_dst_extents()) = ExtentForRange(9, 3);
+
+  ScopedTempFile data_file("SplitLargeReplaceOperationsTest_data.XXXXXX");
+  int data_fd = open(data_file.path().c_str(), O_RDWR, 000);
+  EXPECT_GE(data_fd, 0);
+  ScopedFdCloser data_fd_closer(&data_fd);
+  off_t data_file_size = 0;
+  BlobFileWriter blob_file(data_fd, &data_file_size);
+
+  PayloadVersion version(kBrilloMajorPayloadVersion,
+                         kSourceMinorPayloadVersion);
+  ASSERT_TRUE(ABGenerator::SplitLargeReplaceOperations(
+      version, 3, &aops, part_file.path(), &blob_file));
+
+  // The replace is split in chunks of 3 blocks, across its dst extents.
+  ASSERT_EQ(4U, aops.size());
+  const vector<vector<Extent>> expected_extents = {
+      {ExtentForRange(0, 3)},
+      {ExtentForRange(5, 3)},
+      {ExtentForRange(8, 1)}};
+  for (size_t i = 0; i < expected_extents.size(); i++) {
+    const InstallOperation& op = aops[i].op;
+    EXPECT_EQ("large:" + std::to_string(i), aops[i].name);
+    EXPECT_EQ(InstallOperation::REPLACE_XZ, op.type());
+    vector<Extent> dst_extents;
+    ExtentsToVector(op.dst_extents(), &dst_extents);
+    EXPECT_EQ(expected_extents[i], dst_extents);
+
+    // Each chunk is compressed on its own.
+    brillo::Blob expected_data;
+    for (const Extent& extent : dst_extents) {
+      expected_data.insert(
+          expected_data.end(),
+          part_data.begin() + extent.start_block() * kBlockSize,
+          part_data.begin() +
+              (extent.start_block() + extent.num_blocks()) * kBlockSize);
+    }
+    brillo::Blob expected_blob;
+    ASSERT_TRUE(XzCompress(expected_data, &expected_blob));
+    brillo::Blob blob(op.data_length());
+    ssize_t bytes_read;
+    ASSERT_TRUE(utils::PReadAll(
+        data_fd, blob.data(), blob.size(), op.data_offset(), &bytes_read));
+    ASSERT_EQ(static_cast<ssize_t>(blob.size()), bytes_read);
+    EXPECT_EQ(expected_blob, blob);
+  }
+
+  // Other operations are left untouched, whatever their size.
+  EXPECT_EQ("copy", aops[3].name);
+  EXPECT_EQ(InstallOperation::SOURCE_COPY, aops[3].op.type());
+  EXPECT_EQ(2, aops[3].op.dst_extents_size());
+}
+
 TEST_F(ABGeneratorTest, SortOperationsByDestinationTest) {
   vector<AnnotatedOperation> aops;
   // One operation with multiple destination extents.
@@ -479,6 +552,42 @@ TEST_F(ABGeneratorTest, MergeSourceCopyOperationsTest) {
   EXPECT_EQ(aops[0].name, "1,2,3");
 }
 
+TEST_F(ABGeneratorTest, MergeOperationsReplaceChunkTest) {
+  // Two contiguous SOURCE_COPY operations followed by two contiguous REPLACE
+  // operations, of two blocks each.
+  vector<AnnotatedOperation> aops;
+  for (uint64_t start_block : {0, 2}) {
+    AnnotatedOperation aop;
+    aop.op.set_type(InstallOperation::SOURCE_COPY);
+    *(aop.op.add_src_extents()) = ExtentForRange(start_block + 10, 2);
+    *(aop.op.add_dst_extents()) = ExtentForRange(start_block, 2);
+    aops.push_back(aop);
+  }
+  for (uint64_t start_block : {4, 6}) {
+    AnnotatedOperation aop;
+    aop.op.set_type(InstallOperation::REPLACE);
+    *(aop.op.add_dst_extents()) = ExtentForRange(start_block, 2);
+    aop.op.set_data_length(2 * kBlockSize);
+    aops.push_back(aop);
+  }
+
+  BlobFileWriter blob_file(0, nullptr);
+  PayloadVersion version(kBrilloMajorPayloadVersion,
+                         kSourceMinorPayloadVersion);
+  EXPECT_TRUE(
+      ABGenerator::MergeOperations(&aops, version, 5, "", &blob_file, 2));
+
+  // Only the replace operations are limited to two blocks.
+  ASSERT_EQ(3U, aops.size());
+  EXPECT_EQ(InstallOperation::SOURCE_COPY, aops[0].op.type());
+  EXPECT_EQ(1, aops[0].op.dst_extents().size());
+  EXPECT_TRUE(ExtentEquals(aops[0].op.dst_extents(0), 0, 4));
+  EXPECT_EQ(1, aops[0].op.src_extents().size());
+  EXPECT_TRUE(ExtentEquals(aops[0].op.src_extents(0), 10, 4));
+  EXPECT_TRUE(ExtentEquals(aops[1].op.dst_extents(0), 4, 2));
+  EXPECT_TRUE(ExtentEquals(aops[2].op.dst_extents(0), 6, 2));
+}
+
 TEST_F(ABGeneratorTest, MergeReplaceOperationsTest) {
   TestMergeReplaceOrReplaceXzOperations(InstallOperation::REPLACE, false);
 }
@@ -17,32 +17,109 @@
 #include "update_engine/payload_generator/block_mapping.h"
 
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <functional>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <base/threading/simple_thread.h>
+
+#include "update_engine/common/hash_calculator.h"
 #include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+#include "update_engine/payload_generator/delta_diff_utils.h"
+#include "update_engine/payload_generator/extent_ranges.h"
 
+using google::protobuf::RepeatedPtrField;
 using std::string;
 using std::vector;
 
+namespace chromeos_update_engine {
+
 namespace {
 
-size_t HashValue(const brillo::Blob& blob) {
-  std::hash<string> hash_fn;
-  return hash_fn(string(blob.begin(), blob.end()));
-}
+// The number of blocks hashed by each task, and read ahead of the one hashed.
+const size_t kHashChunkBlocks = 4096;
+const size_t kReadaheadBlocks = 256;
+
+const size_t kInitialSlots = 1024;
+
+// Hashes a range of blocks of a mapped partition. The mapping doesn't read
+// ahead, so the blocks are requested ahead of the ones being hashed.
+class BlockHasher : public base::DelegateSimpleThread::Delegate {
+ public:
+  // |hash_block| is called with the data and number of each block.
+  BlockHasher(std::function<void(const uint8_t*, size_t)> hash_block,
+              const MappedPartition* partition,
+              size_t block_size,
+              size_t start_block,
+              size_t num_blocks)
+      : hash_block_(std::move(hash_block)),
+        partition_(partition),
+        block_size_(block_size),
+        start_block_(start_block),
+        num_blocks_(num_blocks) {}
+  BlockHasher(BlockHasher&&) = default;
+  BlockHasher(const BlockHasher&) = delete;
+  BlockHasher& operator=(const BlockHasher&) = delete;
+
+  ~BlockHasher() override = default;
+
+  void Run() override {
+    WillNeed(start_block_);
+    for (size_t block = start_block_; block < start_block_ + num_blocks_;
+         block++) {
+      if ((block - start_block_) % kReadaheadBlocks == 0)
+        WillNeed(block + kReadaheadBlocks);
+      hash_block_(partition_->data() + block * block_size_, block);
+    }
+  }
+
+ private:
+  // Requests the |kReadaheadBlocks| blocks from |block| in this range.
+  void WillNeed(size_t block) {
+    size_t end_block = start_block_ + num_blocks_;
+    if (block >= end_block)
+      return;
+    RepeatedPtrField<Extent> extents;
+    *extents.Add() = ExtentForRange(
+        block, std::min(kReadaheadBlocks, end_block - block));
+    partition_->WillNeed(extents, block_size_);
+  }
+
+  std::function<void(const uint8_t*, size_t)> hash_block_;
+  const MappedPartition* partition_;
+  size_t block_size_;
+  size_t start_block_;
+  size_t num_blocks_;
+};
 
 }  // namespace
 
-namespace chromeos_update_engine {
+BlockMapping::BlockHash BlockMapping::HashBlock(const uint8_t* block_data,
+                                                size_t block_size) {
+  brillo::Blob digest;
+  CHECK(HashCalculator::RawHashOfBytes(block_data, block_size, &digest));
+  BlockHash hash;
+  memcpy(&hash.high, digest.data(), sizeof(hash.high));
+  memcpy(&hash.low, digest.data() + sizeof(hash.high), sizeof(hash.low));
+  return hash;
+}
 
 BlockMapping::BlockId BlockMapping::AddBlock(const brillo::Blob& block_data) {
-  return AddBlock(-1, 0, block_data);
+  if (block_data.size() != block_size_)
+    return -1;
+  return AddBlock(HashBlock(block_data.data(), block_size_),
+                  block_data.data(),
+                  false,
+                  -1,
+                  0);
 }
 
 BlockMapping::BlockId BlockMapping::AddDiskBlock(int fd, off_t byte_offset) {
@@ -52,7 +129,8 @@ BlockMapping::BlockId BlockMapping::AddDiskBlock(int fd, off_t byte_offset) {
     return -1;
   if (static_cast<size_t>(bytes_read) != block_size_)
     return -1;
-  return AddBlock(fd, byte_offset, blob);
+  return AddBlock(
+      HashBlock(blob.data(), block_size_), blob.data(), false, fd, byte_offset);
 }
 
 bool BlockMapping::AddManyDiskBlocks(int fd,
@@ -69,62 +147,155 @@ bool BlockMapping::AddManyDiskBlocks(int fd,
   return ret;
 }
 
-BlockMapping::BlockId BlockMapping::AddBlock(int fd,
-                                             off_t byte_offset,
-                                             const brillo::Blob& block_data) {
-  if (block_data.size() != block_size_)
-    return -1;
-  size_t h = HashValue(block_data);
-
-  // We either reuse a UniqueBlock or create a new one. If we need a new
-  // UniqueBlock it could also be part of a new or existing bucket (if there is
-  // a hash collision).
-  vector<UniqueBlock>* bucket = nullptr;
-
-  auto mapping_it = mapping_.find(h);
-  if (mapping_it == mapping_.end()) {
-    bucket = &mapping_[h];
-  } else {
-    for (UniqueBlock& existing_block : mapping_it->second) {
-      bool equals = false;
-      if (!existing_block.CompareData(block_data, &equals))
-        return -1;
-      if (equals)
-        return existing_block.block_id;
+bool BlockMapping::AddMappedBlocks(
+    std::shared_ptr<const MappedPartition> partition,
+    size_t num_blocks,
+    size_t num_threads,
+    vector<BlockId>* block_ids) {
+  return AddMappedBlocks(std::move(partition),
+                         {ExtentForRange(0, num_blocks)},
+                         num_threads,
+                         block_ids);
+}
+
+bool BlockMapping::AddMappedBlocks(
+    std::shared_ptr<const MappedPartition> partition,
+    const vector<Extent>& extents,
+    size_t num_threads,
+    vector<BlockId>* block_ids) {
+  const uint64_t partition_blocks = partition->size() / block_size_;
+  size_t num_blocks = 0;
+  for (const Extent& extent : extents) {
+    TEST_AND_RETURN_FALSE(extent.start_block() <= partition_blocks &&
+                          extent.num_blocks() <=
+                              partition_blocks - extent.start_block());
+    num_blocks += extent.num_blocks();
+  }
+
+  // The hashes are computed in parallel, but the ids are assigned in order.
+  vector<BlockHash> hashes(num_blocks);
+  vector<BlockHasher> hashers;
+  hashers.reserve(num_blocks / kHashChunkBlocks + extents.size());
+  size_t first_hash = 0;
+  for (const Extent& extent : extents) {
+    for (size_t offset = 0; offset < extent.num_blocks();
+         offset += kHashChunkBlocks) {
+      // The hash of the partition block |start_block| + i goes to
+      // |hash_index| + i.
+      const size_t start_block = extent.start_block() + offset;
+      const size_t hash_index = first_hash + offset;
+      hashers.emplace_back(
+          [this, &hashes, start_block, hash_index](const uint8_t* block_data,
+                                                   size_t block) {
+            hashes[hash_index + block - start_block] =
+                HashBlock(block_data, block_size_);
+          },
+          partition.get(),
+          block_size_,
+          start_block,
+          std::min<size_t>(kHashChunkBlocks, extent.num_blocks() - offset));
+    }
+    first_hash += extent.num_blocks();
+  }
+  base::DelegateSimpleThreadPool thread_pool("block-mapping-hasher",
+                                             std::max<size_t>(num_threads, 1));
+  thread_pool.Start();
+  for (BlockHasher& hasher : hashers)
+    thread_pool.AddWork(&hasher);
+  thread_pool.JoinAll();
+
+  const uint8_t* data = partition->data();
+  partitions_.push_back(std::move(partition));
+  block_ids->resize(num_blocks);
+  size_t index = 0;
+  for (const Extent& extent : extents) {
+    for (uint64_t block = extent.start_block();
+         block < extent.start_block() + extent.num_blocks();
+         block++, index++) {
+      (*block_ids)[index] = AddBlock(
+          hashes[index], data + block * block_size_, true, -1, 0);
+      TEST_AND_RETURN_FALSE((*block_ids)[index] != -1);
     }
-    bucket = &mapping_it->second;
+  }
+  return true;
+}
+
+BlockMapping::BlockId BlockMapping::AddBlock(const BlockHash& hash,
+                                             const uint8_t* block_data,
+                                             bool mapped,
+                                             int fd,
+                                             off_t byte_offset) {
+  // Keep at most 3/4 of the slots used, so the probes stay short.
+  if ((blocks_.size() + 1) * 4 > slots_.size() * 3)
+    GrowSlots();
+
+  // We either reuse a UniqueBlock with the same hash and data or take the
+  // first empty slot after them for a new one.
+  const size_t mask = slots_.size() - 1;
+  size_t index = hash.low & mask;
+  for (; slots_[index].block_id != -1; index = (index + 1) & mask) {
+    if (!(slots_[index].hash == hash))
+      continue;
+    bool equals = false;
+    if (!blocks_[slots_[index].block_id].CompareData(
+            block_data, block_size_, &equals))
+      return -1;
+    if (equals)
+      return slots_[index].block_id;
   }
 
   // No existing block was found at this point, so we create and fill in a new
   // one.
-  bucket->emplace_back();
-  UniqueBlock* new_ublock = &bucket->back();
+  slots_[index].hash = hash;
+  slots_[index].block_id = blocks_.size();
+  blocks_.emplace_back();
+  UniqueBlock* new_ublock = &blocks_.back();
 
   new_ublock->times_read = 1;
   new_ublock->fd = fd;
   new_ublock->byte_offset = byte_offset;
-  new_ublock->block_id = used_block_ids++;
-  // We need to cache blocks that are not referencing any disk location.
-  if (fd == -1)
-    new_ublock->block_data = block_data;
+  if (mapped) {
+    new_ublock->mapped_data = block_data;
+  } else if (fd == -1) {
+    // We need to cache blocks that are not referencing any disk location.
+    new_ublock->block_data.assign(block_data, block_data + block_size_);
+  }
 
-  return new_ublock->block_id;
+  return slots_[index].block_id;
 }
 
-bool BlockMapping::UniqueBlock::CompareData(const brillo::Blob& other_block,
+void BlockMapping::GrowSlots() {
+  vector<Slot> old_slots = std::move(slots_);
+  slots_ = vector<Slot>(std::max(old_slots.size() * 2, kInitialSlots));
+  const size_t mask = slots_.size() - 1;
+  for (const Slot& slot : old_slots) {
+    if (slot.block_id == -1)
+      continue;
+    size_t index = slot.hash.low & mask;
+    while (slots_[index].block_id != -1)
+      index = (index + 1) & mask;
+    slots_[index] = slot;
+  }
+}
+
+bool BlockMapping::UniqueBlock::CompareData(const uint8_t* other_block,
+                                            size_t block_size,
                                             bool* equals) {
+  if (mapped_data) {
+    *equals = memcmp(mapped_data, other_block, block_size) == 0;
+    return true;
+  }
   if (!block_data.empty()) {
-    *equals = block_data == other_block;
+    *equals = memcmp(block_data.data(), other_block, block_size) == 0;
     return true;
   }
-  const size_t block_size = other_block.size();
   brillo::Blob blob(block_size);
   ssize_t bytes_read = 0;
   if (!utils::PReadAll(fd, blob.data(), block_size, byte_offset, &bytes_read))
     return false;
   if (static_cast<size_t>(bytes_read) != block_size)
     return false;
-  *equals = blob == other_block;
+  *equals = memcmp(blob.data(), other_block, block_size) == 0;
 
   // We increase the number of times we had to read this block from disk and
   // we cache this block based on that. This caching method is optimized for
@@ -147,15 +318,21 @@ bool MapPartitionBlocks(const string& old_part,
   BlockMapping mapping(block_size);
   if (mapping.AddBlock(brillo::Blob(block_size, '\0')) != 0)
     return false;
-  int old_fd = HANDLE_EINTR(open(old_part.c_str(), O_RDONLY));
-  int new_fd = HANDLE_EINTR(open(new_part.c_str(), O_RDONLY));
-  ScopedFdCloser old_fd_closer(&old_fd);
-  ScopedFdCloser new_fd_closer(&new_fd);
-
-  TEST_AND_RETURN_FALSE(mapping.AddManyDiskBlocks(
-      old_fd, 0, old_size / block_size, old_block_ids));
-  TEST_AND_RETURN_FALSE(mapping.AddManyDiskBlocks(
-      new_fd, 0, new_size / block_size, new_block_ids));
+
+  const size_t num_threads = diff_utils::GetMaxThreads();
+  auto add_partition = [&](const string& part,
+                           size_t size,
+                           vector<BlockMapping::BlockId>* block_ids) {
+    block_ids->clear();
+    if (size / block_size == 0)
+      return true;
+    std::shared_ptr<MappedPartition> partition = MappedPartition::Map(part);
+    TEST_AND_RETURN_FALSE(partition);
+    return mapping.AddMappedBlocks(
+        std::move(partition), size / block_size, num_threads, block_ids);
+  };
+  TEST_AND_RETURN_FALSE(add_partition(old_part, old_size, old_block_ids));
+  TEST_AND_RETURN_FALSE(add_partition(new_part, new_size, new_block_ids));
   return true;
 }
 
@@ -17,7 +17,7 @@
 #ifndef UPDATE_ENGINE_PAYLOAD_GENERATOR_BLOCK_MAPPING_H_
 #define UPDATE_ENGINE_PAYLOAD_GENERATOR_BLOCK_MAPPING_H_
 
-#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -28,6 +28,8 @@
 
 namespace chromeos_update_engine {
 
+class MappedPartition;
+
 // BlockMapping allows to map data blocks (brillo::Blobs of block_size size)
 // into unique integer values called "block ids". This mapping differs from a
 // hash function in that two blocks with the same data will have the same id but
@@ -58,25 +60,61 @@ class BlockMapping {
                          size_t num_blocks,
                          std::vector<BlockId>* block_ids);
 
+  // Add the first |num_blocks| blocks of the mapped |partition|, hashing them
+  // with |num_threads| threads. The block ids are the same as if the blocks
+  // were added one at a time, in order. The blocks are compared in place, so
+  // the mapping is kept until the BlockMapping is destroyed.
+  bool AddMappedBlocks(std::shared_ptr<const MappedPartition> partition,
+                       size_t num_blocks,
+                       size_t num_threads,
+                       std::vector<BlockId>* block_ids);
+
+  // Same as above, but adds the blocks of |extents| of the mapped |partition|,
+  // in order.
+  bool AddMappedBlocks(std::shared_ptr<const MappedPartition> partition,
+                       const std::vector<Extent>& extents,
+                       size_t num_threads,
+                       std::vector<BlockId>* block_ids);
+
  private:
   FRIEND_TEST(BlockMappingTest, BlocksAreNotKeptInMemory);
 
-  // Add a single block passed in |block_data|. If |fd| is not -1, the block
-  // can be discarded to save RAM and retrieved later from |fd| at the position
-  // |byte_offset|.
-  BlockId AddBlock(int fd, off_t byte_offset, const brillo::Blob& block_data);
+  // The first 128 bits of the SHA-256 of a block. Blocks with different data
+  // are not expected to ever have the same hash, but their data is compared
+  // anyway.
+  struct BlockHash {
+    uint64_t high;
+    uint64_t low;
 
-  size_t block_size_;
+    bool operator==(const BlockHash& other) const {
+      return high == other.high && low == other.low;
+    }
+  };
+
+  static BlockHash HashBlock(const uint8_t* block_data, size_t block_size);
+
+  // Add a single block with the |hash| of its |block_data|. If |mapped| is
+  // true, |block_data| points into a mapped partition and is used in place.
+  // Otherwise, if |fd| is not -1, the block can be discarded to save RAM and
+  // retrieved later from |fd| at the position |byte_offset|.
+  BlockId AddBlock(const BlockHash& hash,
+                   const uint8_t* block_data,
+                   bool mapped,
+                   int fd,
+                   off_t byte_offset);
 
-  BlockId used_block_ids{0};
+  // Doubles the number of slots of |slots_|, or creates the first ones.
+  void GrowSlots();
+
+  size_t block_size_;
 
   // The UniqueBlock represents the data of a block associated to a unique
   // block id.
   struct UniqueBlock {
     brillo::Blob block_data;
 
-    // The block id assigned to this unique block.
-    BlockId block_id;
+    // The data of this unique block in a mapped partition, if any.
+    const uint8_t* mapped_data{nullptr};
 
     // The location on this unique block on disk (if not cached in block_data).
     int fd{-1};
@@ -85,14 +123,28 @@ class BlockMapping {
     // Number of times we have seen this data block. Used for caching.
     uint32_t times_read{0};
 
-    // Compares the UniqueBlock data with the other_block data and stores if
-    // they are equal in |equals|. Returns whether there was an error reading
-    // the block from disk while comparing it.
-    bool CompareData(const brillo::Blob& other_block, bool* equals);
+    // Compares the UniqueBlock data with the |block_size| bytes of
+    // |other_block| and stores if they are equal in |equals|. Returns whether
+    // there was an error reading the block from disk while comparing it.
+    bool CompareData(const uint8_t* other_block,
+                     size_t block_size,
+                     bool* equals);
+  };
+
+  // The unique blocks, indexed by their block id.
+  std::vector<UniqueBlock> blocks_;
+
+  // An open addressing hash table, with linear probing, from the block hashes
+  // to the block ids. Blocks with the same hash but different data take
+  // separate slots. The number of slots is a power of two.
+  struct Slot {
+    BlockHash hash;
+    BlockId block_id{-1};
   };
+  std::vector<Slot> slots_;
 
-  // A mapping from hash values to possible block ids.
-  std::map<size_t, std::vector<UniqueBlock>> mapping_;
+  // The partitions the mapped unique blocks point into.
+  std::vector<std::shared_ptr<const MappedPartition>> partitions_;
 };
 
 // Maps the blocks of the old and new partitions |old_part| and |new_part| whose
@@ -101,6 +153,7 @@ class BlockMapping {
 // the partition they are on.
 // The block ids number 0 corresponds to the block with all zeros, but any
 // other block id number is assigned randomly.
+// Both partitions are mapped and their blocks hashed in parallel.
 bool MapPartitionBlocks(const std::string& old_part,
                         const std::string& new_part,
                         size_t old_size,
@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -27,6 +28,8 @@
 
 #include "update_engine/common/test_utils.h"
 #include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
+#include "update_engine/payload_generator/extent_ranges.h"
 
 using std::string;
 using std::vector;
@@ -62,10 +65,8 @@ TEST_F(BlockMappingTest, BlocksAreNotKeptInMemory) {
 
   // Check that the block_data is not stored on memory if we just used the block
   // once.
-  for (const auto& it : bm_.mapping_) {
-    for (const BlockMapping::UniqueBlock& ublock : it.second) {
-      EXPECT_TRUE(ublock.block_data.empty());
-    }
+  for (const BlockMapping::UniqueBlock& ublock : bm_.blocks_) {
+    EXPECT_TRUE(ublock.block_data.empty());
   }
 
   brillo::Blob block(block_size_, 'a');
@@ -74,13 +75,11 @@ TEST_F(BlockMappingTest, BlocksAreNotKeptInMemory) {
     EXPECT_EQ(0, bm_.AddBlock(block));
   }
 
-  for (const auto& it : bm_.mapping_) {
-    for (const BlockMapping::UniqueBlock& ublock : it.second) {
-      EXPECT_FALSE(ublock.block_data.empty());
-      // The block was loaded from disk only 4 times, and after that the counter
-      // is not updated anymore.
-      EXPECT_EQ(4U, ublock.times_read);
-    }
+  for (const BlockMapping::UniqueBlock& ublock : bm_.blocks_) {
+    EXPECT_FALSE(ublock.block_data.empty());
+    // The block was loaded from disk only 4 times, and after that the counter
+    // is not updated anymore.
+    EXPECT_EQ(4U, ublock.times_read);
   }
 }
 
@@ -112,4 +111,73 @@ TEST_F(BlockMappingTest, MapPartitionBlocks) {
   EXPECT_EQ((vector<BlockMapping::BlockId>{0, 11, 12, 13, 1, 2}), new_ids);
 }
 
+TEST_F(BlockMappingTest, MappedBlocksMatchDiskBlocks) {
+  // More blocks than hashed by each thread, with repeated blocks far apart.
+  const size_t kNumBlocks = 10000;
+  string contents(kNumBlocks * block_size_, '\0');
+  for (size_t i = 0; i < contents.size(); ++i)
+    contents[i] = (i / block_size_ % 3000) >> (i % 2 * 8);
+  test_utils::WriteFileString(old_part_.path(), contents);
+
+  int old_fd = HANDLE_EINTR(open(old_part_.path().c_str(), O_RDONLY));
+  ScopedFdCloser old_fd_closer(&old_fd);
+  vector<BlockMapping::BlockId> disk_ids;
+  EXPECT_TRUE(bm_.AddManyDiskBlocks(old_fd, 0, kNumBlocks, &disk_ids));
+
+  std::shared_ptr<MappedPartition> partition =
+      MappedPartition::Map(old_part_.path());
+  ASSERT_NE(nullptr, partition);
+  BlockMapping mapping(block_size_);
+  vector<BlockMapping::BlockId> mapped_ids;
+  EXPECT_TRUE(mapping.AddMappedBlocks(partition, kNumBlocks, 3, &mapped_ids));
+  EXPECT_EQ(disk_ids, mapped_ids);
+  EXPECT_EQ(2999, mapped_ids[2999]);
+  EXPECT_EQ(999, mapped_ids.back());
+
+  // The blocks added afterwards are compared to the mapped ones.
+  EXPECT_EQ(mapped_ids[5], mapping.AddBlock(brillo::Blob(
+                               contents.begin() + 5 * block_size_,
+                               contents.begin() + 6 * block_size_)));
+  EXPECT_EQ(3000, mapping.AddBlock(brillo::Blob(block_size_, 'x')));
+
+  // Blocks past the end of the mapping are rejected.
+  EXPECT_FALSE(
+      mapping.AddMappedBlocks(partition, kNumBlocks + 1, 1, &mapped_ids));
+}
+
+TEST_F(BlockMappingTest, MappedExtentsMatchDiskBlocks) {
+  const size_t kNumBlocks = 10000;
+  string contents(kNumBlocks * block_size_, '\0');
+  for (size_t i = 0; i < contents.size(); ++i)
+    contents[i] = (i / block_size_ % 3000) >> (i % 2 * 8);
+  test_utils::WriteFileString(old_part_.path(), contents);
+  // The first extent spans more blocks than hashed by each thread.
+  const vector<Extent> extents = {ExtentForRange(5000, 4100),
+                                  ExtentForRange(10, 20)};
+
+  int old_fd = HANDLE_EINTR(open(old_part_.path().c_str(), O_RDONLY));
+  ScopedFdCloser old_fd_closer(&old_fd);
+  vector<BlockMapping::BlockId> disk_ids;
+  for (const Extent& extent : extents) {
+    vector<BlockMapping::BlockId> extent_ids;
+    EXPECT_TRUE(bm_.AddManyDiskBlocks(old_fd,
+                                      extent.start_block() * block_size_,
+                                      extent.num_blocks(),
+                                      &extent_ids));
+    disk_ids.insert(disk_ids.end(), extent_ids.begin(), extent_ids.end());
+  }
+
+  std::shared_ptr<MappedPartition> partition =
+      MappedPartition::Map(old_part_.path());
+  ASSERT_NE(nullptr, partition);
+  BlockMapping mapping(block_size_);
+  vector<BlockMapping::BlockId> mapped_ids;
+  EXPECT_TRUE(mapping.AddMappedBlocks(partition, extents, 3, &mapped_ids));
+  EXPECT_EQ(disk_ids, mapped_ids);
+
+  // Extents past the end of the mapping are rejected.
+  EXPECT_FALSE(mapping.AddMappedBlocks(
+      partition, {ExtentForRange(kNumBlocks - 1, 2)}, 1, &mapped_ids));
+}
+
 }  // namespace chromeos_update_engine
@@ -0,0 +1,138 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_generator/budgeted_thread_pool.h"
+
+#include <algorithm>
+
+#include <base/logging.h>
+
+namespace chromeos_update_engine {
+
+bool MemoryBudget::TryAcquire(uint64_t size) {
+  base::AutoLock lock(lock_);
+  if (budget_ > 0 && used_ > 0 && used_ + size > budget_)
+    return false;
+  used_ += size;
+  peak_used_ = std::max(peak_used_, used_);
+  return true;
+}
+
+void MemoryBudget::Release(uint64_t size) {
+  base::AutoLock lock(lock_);
+  DCHECK_LE(size, used_);
+  used_ -= size;
+  num_releases_++;
+  released_.Broadcast();
+}
+
+uint64_t MemoryBudget::num_releases() const {
+  base::AutoLock lock(lock_);
+  return num_releases_;
+}
+
+void MemoryBudget::WaitForRelease(uint64_t num_releases) {
+  base::AutoLock lock(lock_);
+  while (num_releases_ <= num_releases)
+    released_.Wait();
+}
+
+uint64_t MemoryBudget::peak_used() const {
+  base::AutoLock lock(lock_);
+  return peak_used_;
+}
+
+class BudgetedThreadPool::Worker : public base::DelegateSimpleThread::Delegate {
+ public:
+  Worker(BudgetedThreadPool* pool, size_t thread_index)
+      : pool_(pool), thread_index_(thread_index) {}
+
+  void Run() override { pool_->RunTasks(thread_index_); }
+
+ private:
+  BudgetedThreadPool* pool_;
+  size_t thread_index_;
+};
+
+BudgetedThreadPool::BudgetedThreadPool(const std::string& name,
+                                       size_t num_threads,
+                                       MemoryBudget* memory_budget)
+    : name_(name),
+      memory_budget_(memory_budget),
+      thread_stats_(std::max<size_t>(num_threads, 1)) {}
+
+void BudgetedThreadPool::AddWork(base::DelegateSimpleThread::Delegate* task,
+                                 uint64_t memory) {
+  pending_tasks_.push_back({task, memory});
+}
+
+void BudgetedThreadPool::Run() {
+  std::stable_sort(pending_tasks_.begin(),
+                   pending_tasks_.end(),
+                   [](const Task& a, const Task& b) {
+                     return a.memory > b.memory;
+                   });
+  std::vector<Worker> workers;
+  workers.reserve(thread_stats_.size());
+  for (size_t i = 0; i < thread_stats_.size(); i++)
+    workers.emplace_back(this, i);
+
+  base::DelegateSimpleThreadPool thread_pool(name_, workers.size());
+  thread_pool.Start();
+  for (Worker& worker : workers)
+    thread_pool.AddWork(&worker);
+  thread_pool.JoinAll();
+}
+
+void BudgetedThreadPool::RunTasks(size_t thread_index) {
+  ThreadStats* stats = &thread_stats_[thread_index];
+  while (true) {
+    // Read before looking for a task, so a release in between isn't missed.
+    uint64_t num_releases =
+        memory_budget_ ? memory_budget_->num_releases() : 0;
+    Task task{nullptr, 0};
+    {
+      base::AutoLock lock(lock_);
+      if (pending_tasks_.empty())
+        return;
+      auto task_it = std::find_if(
+          pending_tasks_.begin(), pending_tasks_.end(), [this](const Task& t) {
+            return !memory_budget_ || memory_budget_->TryAcquire(t.memory);
+          });
+      if (task_it != pending_tasks_.end()) {
+        task = *task_it;
+        pending_tasks_.erase(task_it);
+      }
+    }
+
+    // Nothing fits, so some memory is used by a running task.
+    if (!task.delegate) {
+      base::TimeTicks wait_start = base::TimeTicks::Now();
+      memory_budget_->WaitForRelease(num_releases);
+      stats->wait_time += base::TimeTicks::Now() - wait_start;
+      continue;
+    }
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    task.delegate->Run();
+    stats->busy_time += base::TimeTicks::Now() - start;
+    stats->num_tasks++;
+    if (memory_budget_)
+      memory_budget_->Release(task.memory);
+  }
+}
+
+}  // namespace chromeos_update_engine
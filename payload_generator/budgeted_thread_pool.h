@@ -0,0 +1,118 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_GENERATOR_BUDGETED_THREAD_POOL_H_
+#define UPDATE_ENGINE_PAYLOAD_GENERATOR_BUDGETED_THREAD_POOL_H_
+
+#include <string>
+#include <vector>
+
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
+#include <base/time/time.h>
+
+namespace chromeos_update_engine {
+
+// The memory available to the tasks of one or more BudgetedThreadPool, so that
+// the memory used by the payload generation doesn't grow with the number of
+// threads. All the methods are thread safe.
+class MemoryBudget {
+ public:
+  // A |budget| of 0 means no limit.
+  explicit MemoryBudget(uint64_t budget) : budget_(budget) {}
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  // Takes |size| bytes of the budget if they are available. A task bigger
+  // than the whole budget is admitted when none of it is used, so it can run
+  // alone. Returns whether the memory was taken.
+  bool TryAcquire(uint64_t size);
+  void Release(uint64_t size);
+
+  // The number of calls to Release() so far.
+  uint64_t num_releases() const;
+  // Waits until Release() was called more than |num_releases| times.
+  void WaitForRelease(uint64_t num_releases);
+
+  uint64_t budget() const { return budget_; }
+  // The most memory taken at once.
+  uint64_t peak_used() const;
+
+ private:
+  const uint64_t budget_;
+
+  mutable base::Lock lock_;
+  base::ConditionVariable released_{&lock_};
+  uint64_t used_{0};
+  uint64_t peak_used_{0};
+  uint64_t num_releases_{0};
+};
+
+// A pool of threads running tasks with an estimate of the memory they use.
+// The tasks start largest first, each one as soon as a thread is idle and its
+// memory fits in the budget. Smaller tasks that fit are run meanwhile, so the
+// threads are kept busy while the big tasks wait for memory.
+class BudgetedThreadPool {
+ public:
+  // The time each thread spent running tasks and waiting for memory.
+  struct ThreadStats {
+    size_t num_tasks{0};
+    base::TimeDelta busy_time;
+    base::TimeDelta wait_time;
+  };
+
+  // |memory_budget| can be shared with other pools, or be null for no limit.
+  BudgetedThreadPool(const std::string& name,
+                     size_t num_threads,
+                     MemoryBudget* memory_budget);
+  BudgetedThreadPool(const BudgetedThreadPool&) = delete;
+  BudgetedThreadPool& operator=(const BudgetedThreadPool&) = delete;
+
+  // Adds a |task| using up to |memory| bytes. Must be called before Run().
+  void AddWork(base::DelegateSimpleThread::Delegate* task, uint64_t memory);
+
+  // Runs all the tasks and returns when they are done.
+  void Run();
+
+  const std::vector<ThreadStats>& thread_stats() const {
+    return thread_stats_;
+  }
+
+ private:
+  struct Task {
+    base::DelegateSimpleThread::Delegate* delegate;
+    uint64_t memory;
+  };
+
+  class Worker;
+
+  // Runs tasks on the thread |thread_index| until there are none left.
+  void RunTasks(size_t thread_index);
+
+  const std::string name_;
+  MemoryBudget* memory_budget_;
+  std::vector<ThreadStats> thread_stats_;
+
+  // The tasks not started yet, largest first. Protected by |lock_| once the
+  // pool runs.
+  base::Lock lock_;
+  std::vector<Task> pending_tasks_;
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_GENERATOR_BUDGETED_THREAD_POOL_H_
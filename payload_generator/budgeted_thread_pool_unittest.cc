@@ -0,0 +1,136 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_generator/budgeted_thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <base/synchronization/lock.h>
+#include <base/threading/platform_thread.h>
+#include <gtest/gtest.h>
+
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+// Records the memory of the tasks running at once.
+class MemoryTracker {
+ public:
+  void Start(uint64_t memory) {
+    base::AutoLock lock(lock_);
+    used_ += memory;
+    peak_used_ = std::max(peak_used_, used_);
+  }
+  void Stop(uint64_t memory) {
+    base::AutoLock lock(lock_);
+    used_ -= memory;
+  }
+  uint64_t peak_used() const { return peak_used_; }
+
+ private:
+  base::Lock lock_;
+  uint64_t used_{0};
+  uint64_t peak_used_{0};
+};
+
+class FakeTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  FakeTask(MemoryTracker* tracker, uint64_t memory)
+      : tracker_(tracker), memory_(memory) {}
+
+  void Run() override {
+    tracker_->Start(memory_);
+    base::PlatformThread::Sleep(base::Milliseconds(5));
+    tracker_->Stop(memory_);
+    runs_++;
+  }
+
+  uint64_t memory() const { return memory_; }
+  int runs() const { return runs_; }
+
+ private:
+  MemoryTracker* tracker_;
+  uint64_t memory_;
+  int runs_{0};
+};
+
+}  // namespace
+
+TEST(BudgetedThreadPoolTest, MemoryBudgetTest) {
+  MemoryBudget budget(100);
+  // Any size fits while nothing is used.
+  EXPECT_TRUE(budget.TryAcquire(150));
+  EXPECT_FALSE(budget.TryAcquire(1));
+  budget.Release(150);
+  EXPECT_EQ(1U, budget.num_releases());
+  EXPECT_TRUE(budget.TryAcquire(60));
+  EXPECT_TRUE(budget.TryAcquire(40));
+  EXPECT_FALSE(budget.TryAcquire(1));
+  budget.Release(40);
+  // Returns right away, as the release already happened.
+  budget.WaitForRelease(1);
+  EXPECT_EQ(150U, budget.peak_used());
+
+  MemoryBudget unlimited(0);
+  EXPECT_TRUE(unlimited.TryAcquire(1000));
+  EXPECT_TRUE(unlimited.TryAcquire(1000));
+}
+
+TEST(BudgetedThreadPoolTest, RunTest) {
+  // The tasks bigger than the budget run alone, and the others never use more
+  // than the budget at once.
+  MemoryTracker tracker;
+  vector<std::unique_ptr<FakeTask>> tasks;
+  for (uint64_t memory : {10, 70, 20, 200, 5, 40, 60, 30, 5, 90, 15, 50})
+    tasks.emplace_back(new FakeTask(&tracker, memory));
+
+  MemoryBudget budget(100);
+  BudgetedThreadPool pool("test-pool", 4, &budget);
+  for (const auto& task : tasks)
+    pool.AddWork(task.get(), task->memory());
+  pool.Run();
+
+  for (const auto& task : tasks)
+    EXPECT_EQ(1, task->runs());
+  EXPECT_EQ(200U, tracker.peak_used());
+  EXPECT_EQ(200U, budget.peak_used());
+  size_t num_tasks = 0;
+  for (const auto& stats : pool.thread_stats())
+    num_tasks += stats.num_tasks;
+  EXPECT_EQ(tasks.size(), num_tasks);
+  EXPECT_EQ(4U, pool.thread_stats().size());
+}
+
+TEST(BudgetedThreadPoolTest, UnlimitedTest) {
+  MemoryTracker tracker;
+  vector<std::unique_ptr<FakeTask>> tasks;
+  for (int i = 0; i < 8; i++)
+    tasks.emplace_back(new FakeTask(&tracker, 100));
+
+  BudgetedThreadPool pool("test-pool", 3, nullptr);
+  for (const auto& task : tasks)
+    pool.AddWork(task.get(), 100);
+  pool.Run();
+  for (const auto& task : tasks)
+    EXPECT_EQ(1, task->runs());
+  EXPECT_LE(tracker.peak_used(), 300U);
+}
+
+}  // namespace chromeos_update_engine
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -37,7 +38,9 @@
 #include "update_engine/payload_generator/ab_generator.h"
 #include "update_engine/payload_generator/annotated_operation.h"
 #include "update_engine/payload_generator/blob_file_writer.h"
+#include "update_engine/payload_generator/budgeted_thread_pool.h"
 #include "update_engine/payload_generator/delta_diff_utils.h"
+#include "update_engine/payload_generator/diff_cache.h"
 #include "update_engine/payload_generator/full_update_generator.h"
 #include "update_engine/payload_generator/merge_sequence_generator.h"
 #include "update_engine/payload_generator/payload_file.h"
@@ -134,6 +137,14 @@ bool GenerateUpdatePayloadFile(const PayloadGenerationConfig& config,
     all_aops.resize(config.target.partitions.size());
     std::vector<std::vector<CowMergeOperation>> all_merge_sequences;
     all_merge_sequences.resize(config.target.partitions.size());
+    // Shared by the partitions, as they are diffed at once.
+    MemoryBudget memory_budget(config.memory_budget);
+    unique_ptr<DiffCache> diff_cache;
+    if (config.is_delta && !config.diff_cache_dir.empty()) {
+      diff_cache =
+          DiffCache::Open(config.diff_cache_dir, config.diff_cache_size);
+      TEST_AND_RETURN_FALSE(diff_cache);
+    }
     std::vector<PartitionProcessor> partition_tasks{};
     auto thread_count =
         std::min(diff_utils::GetMaxThreads(), config.target.partitions.size());
@@ -152,7 +163,7 @@ bool GenerateUpdatePayloadFile(const PayloadGenerationConfig& config,
       if (!old_part.path.empty()) {
         // Delta update.
         LOG(INFO) << "Using generator ABGenerator().";
-        strategy.reset(new ABGenerator());
+        strategy.reset(new ABGenerator(&memory_budget, diff_cache.get()));
       } else {
         LOG(INFO) << "Using generator FullUpdateGenerator().";
         strategy.reset(new FullUpdateGenerator());
@@ -173,6 +184,20 @@ bool GenerateUpdatePayloadFile(const PayloadGenerationConfig& config,
     }
     thread_pool.JoinAll();
 
+    if (config.is_delta) {
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      LOG(INFO) << "Files diffed at once estimated to use at most "
+                << memory_budget.peak_used() / (1024 * 1024) << " MiB, with a "
+                << config.memory_budget / (1024 * 1024)
+                << " MiB budget. Peak RSS: " << usage.ru_maxrss / 1024
+                << " MiB.";
+    }
+    if (diff_cache) {
+      LOG(INFO) << "Reused " << diff_cache->num_hits() << " diffs from the "
+                << "diff cache, computed " << diff_cache->num_misses() << ".";
+    }
+
     for (size_t i = 0; i < config.target.partitions.size(); i++) {
       const PartitionConfig& old_part =
           config.is_delta ? config.source.partitions[i] : empty_part;
@@ -39,6 +39,7 @@
 #include <base/files/file_util.h>
 #include <base/format_macros.h>
 #include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
 #include <base/threading/simple_thread.h>
@@ -51,16 +52,20 @@
 #include "update_engine/common/hash_calculator.h"
 #include "update_engine/common/subprocess.h"
 #include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/mmap_extent_reader.h"
 #include "update_engine/payload_consumer/payload_constants.h"
 #include "update_engine/payload_generator/ab_generator.h"
 #include "update_engine/payload_generator/block_mapping.h"
+#include "update_engine/payload_generator/budgeted_thread_pool.h"
 #include "update_engine/payload_generator/bzip.h"
 #include "update_engine/payload_generator/deflate_utils.h"
 #include "update_engine/payload_generator/delta_diff_generator.h"
+#include "update_engine/payload_generator/diff_cache.h"
 #include "update_engine/payload_generator/extent_ranges.h"
 #include "update_engine/payload_generator/extent_utils.h"
 #include "update_engine/payload_generator/squashfs_filesystem.h"
 #include "update_engine/payload_generator/xz.h"
+#include "update_engine/payload_generator/zstd.h"
 
 using std::list;
 using std::map;
@@ -84,6 +89,17 @@ const uint64_t kMaxPuffdiffDestinationSize = 150 * 1024 * 1024;  // bytes
 
 const int kBrotliCompressionQuality = 9;
 
+// The memory used by the xz compressor at the preset of XzCompress(), the
+// largest of the compressors.
+const uint64_t kCompressorMemory = 96 * 1024 * 1024;  // bytes
+
+// How much bigger the data is once its deflates are decompressed by puffdiff.
+const uint64_t kPuffExpansion = 4;
+
+// The number of places of an old block used to find the window of a shard, so
+// that blocks repeated many times in the old file don't dominate.
+const size_t kMaxShardBlockPlaces = 8;
+
 // Storing a diff operation has more overhead over replace operation in the
 // manifest, we need to store an additional src_sha256_hash which is 32 bytes
 // and not compressible, and also src_extents which could use anywhere from a
@@ -132,6 +148,16 @@ int LevenshteinDistance(const string& a, const string& b) {
   }
   return distances.back();
 }
+
+// Returns the |deflates| as text, to tell apart the puffdiffs of the same data.
+string DeflatesToString(const vector<puffin::BitExtent>& deflates) {
+  string result;
+  for (const puffin::BitExtent& deflate : deflates) {
+    base::StringAppendF(
+        &result, "%" PRIu64 ":%" PRIu64 ",", deflate.offset, deflate.length);
+  }
+  return result;
+}
 }  // namespace
 
 namespace diff_utils {
@@ -150,7 +176,8 @@ class FileDeltaProcessor : public base::DelegateSimpleThread::Delegate {
                      const vector<puffin::BitExtent>& new_deflates,
                      const string& name,
                      ssize_t chunk_blocks,
-                     BlobFileWriter* blob_file)
+                     BlobFileWriter* blob_file,
+                     DiffCache* diff_cache)
       : old_part_(old_part),
         new_part_(new_part),
         version_(version),
@@ -161,7 +188,8 @@ class FileDeltaProcessor : public base::DelegateSimpleThread::Delegate {
         new_deflates_(new_deflates),
         name_(name),
         chunk_blocks_(chunk_blocks),
-        blob_file_(blob_file) {}
+        blob_file_(blob_file),
+        diff_cache_(diff_cache) {}
   FileDeltaProcessor(const FileDeltaProcessor&) = delete;
   FileDeltaProcessor& operator=(const FileDeltaProcessor&) = delete;
 
@@ -169,6 +197,16 @@ class FileDeltaProcessor : public base::DelegateSimpleThread::Delegate {
     return new_extents_blocks_ > other.new_extents_blocks_;
   }
 
+  // The memory used to diff the file, estimated from its size.
+  uint64_t EstimatedMemory() const {
+    return EstimateDeltaReadFileMemory(utils::BlocksInExtents(old_extents_),
+                                       new_extents_blocks_,
+                                       !old_deflates_.empty() &&
+                                           !new_deflates_.empty(),
+                                       chunk_blocks_,
+                                       version_);
+  }
+
   ~FileDeltaProcessor() override = default;
 
   // Overrides DelegateSimpleThread::Delegate.
@@ -194,6 +232,7 @@ class FileDeltaProcessor : public base::DelegateSimpleThread::Delegate {
   // Block limit of one aop.
   const ssize_t chunk_blocks_;
   BlobFileWriter* blob_file_;
+  DiffCache* diff_cache_;
 
   // The list of ops to reach the new file from the old file.
   vector<AnnotatedOperation> file_aops_;
@@ -215,7 +254,8 @@ void FileDeltaProcessor::Run() {
                      name_,
                      chunk_blocks_,
                      version_,
-                     blob_file_)) {
+                     blob_file_,
+                     diff_cache_)) {
     LOG(ERROR) << "Failed to generate delta for " << name_ << " ("
                << new_extents_blocks_ << " blocks)";
     failed_ = true;
@@ -274,8 +314,11 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
                         const PartitionConfig& new_part,
                         ssize_t hard_chunk_blocks,
                         size_t soft_chunk_blocks,
+                        size_t file_shard_blocks,
                         const PayloadVersion& version,
-                        BlobFileWriter* blob_file) {
+                        BlobFileWriter* blob_file,
+                        MemoryBudget* memory_budget,
+                        DiffCache* diff_cache) {
   ExtentRanges old_visited_blocks;
   ExtentRanges new_visited_blocks;
 
@@ -354,6 +397,39 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
         FilterExtentRanges(old_file.extents, old_zero_blocks);
     old_visited_blocks.AddExtents(old_file_extents);
 
+    // Files with deflates are left whole while they can use puffdiff, since
+    // their deflates can't be split.
+    uint64_t new_file_blocks = utils::BlocksInExtents(new_file_extents);
+    if (file_shard_blocks > 0 && new_file_blocks > file_shard_blocks &&
+        (new_file.deflates.empty() || !puffdiff_allowed ||
+         new_file_blocks * kBlockSize > kMaxPuffdiffDestinationSize)) {
+      vector<vector<Extent>> old_shards, new_shards;
+      TEST_AND_RETURN_FALSE(ShardFile(old_part.path,
+                                      new_part.path,
+                                      old_file_extents,
+                                      new_file_extents,
+                                      file_shard_blocks,
+                                      &old_shards,
+                                      &new_shards));
+      LOG(INFO) << "Splitting " << new_file.name << " (" << new_file_blocks
+                << " blocks) in " << new_shards.size() << " shards.";
+      for (size_t shard = 0; shard < new_shards.size(); shard++) {
+        file_delta_processors.emplace_back(
+            old_part.path,
+            new_part.path,
+            version,
+            std::move(old_shards[shard]),
+            std::move(new_shards[shard]),
+            vector<puffin::BitExtent>{},  // old_deflates
+            vector<puffin::BitExtent>{},  // new_deflates
+            base::StringPrintf("%s:%" PRIuS, new_file.name.c_str(), shard),
+            hard_chunk_blocks,
+            blob_file,
+            diff_cache);
+      }
+      continue;
+    }
+
     file_delta_processors.emplace_back(old_part.path,
                                        new_part.path,
                                        version,
@@ -363,7 +439,8 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
                                        new_file.deflates,
                                        new_file.name,  // operation name
                                        hard_chunk_blocks,
-                                       blob_file);
+                                       blob_file,
+                                       diff_cache);
   }
   // Process all the blocks not included in any file. We provided all the unused
   // blocks in the old partition as available data.
@@ -393,7 +470,8 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
         vector<puffin::BitExtent>{},  // new_deflates
         "<non-file-data>",            // operation name
         soft_chunk_blocks,
-        blob_file);
+        blob_file,
+        diff_cache);
   }
 
   size_t max_threads = GetMaxThreads();
@@ -404,13 +482,19 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
     file_delta_processors.sort(std::greater<FileDeltaProcessor>());
   }
 
-  base::DelegateSimpleThreadPool thread_pool("incremental-update-generator",
-                                             max_threads);
-  thread_pool.Start();
+  BudgetedThreadPool thread_pool(
+      "incremental-update-generator", max_threads, memory_budget);
   for (auto& processor : file_delta_processors) {
-    thread_pool.AddWork(&processor);
+    thread_pool.AddWork(&processor, processor.EstimatedMemory());
+  }
+  thread_pool.Run();
+  for (size_t i = 0; i < thread_pool.thread_stats().size(); i++) {
+    const BudgetedThreadPool::ThreadStats& stats =
+        thread_pool.thread_stats()[i];
+    LOG(INFO) << new_part.name << " thread " << i << " diffed "
+              << stats.num_tasks << " files in " << stats.busy_time
+              << " and waited for memory for " << stats.wait_time;
   }
-  thread_pool.JoinAll();
 
   for (auto& processor : file_delta_processors) {
     TEST_AND_RETURN_FALSE(processor.MergeOperation(aops));
@@ -518,7 +602,8 @@ bool DeltaMovedAndZeroBlocks(vector<AnnotatedOperation>* aops,
                                           "<zeros>",
                                           chunk_blocks,
                                           version,
-                                          blob_file));
+                                          blob_file,
+                                          nullptr));
     }
   }
   LOG(INFO) << "Produced " << (aops->size() - num_ops) << " operations for "
@@ -577,7 +662,8 @@ bool DeltaReadFile(vector<AnnotatedOperation>* aops,
                    const string& name,
                    ssize_t chunk_blocks,
                    const PayloadVersion& version,
-                   BlobFileWriter* blob_file) {
+                   BlobFileWriter* blob_file,
+                   DiffCache* diff_cache) {
   brillo::Blob data;
   InstallOperation operation;
 
@@ -610,6 +696,7 @@ bool DeltaReadFile(vector<AnnotatedOperation>* aops,
                                             old_deflates,
                                             new_deflates,
                                             version,
+                                            diff_cache,
                                             &data,
                                             &operation));
 
@@ -635,6 +722,126 @@ bool DeltaReadFile(vector<AnnotatedOperation>* aops,
   return true;
 }
 
+bool ShardFile(const string& old_part,
+               const string& new_part,
+               const vector<Extent>& old_extents,
+               const vector<Extent>& new_extents,
+               size_t shard_blocks,
+               vector<vector<Extent>>* old_shards,
+               vector<vector<Extent>>* new_shards) {
+  TEST_AND_RETURN_FALSE(shard_blocks > 0);
+  // The blocks of both files are hashed in parallel, in place in the mapped
+  // partitions.
+  BlockMapping mapping(kBlockSize);
+  const size_t num_threads = GetMaxThreads();
+  vector<BlockMapping::BlockId> old_ids, new_ids;
+  if (!old_extents.empty()) {
+    std::shared_ptr<MappedPartition> old_mapping =
+        MappedPartition::Map(old_part);
+    TEST_AND_RETURN_FALSE(old_mapping);
+    TEST_AND_RETURN_FALSE(mapping.AddMappedBlocks(
+        std::move(old_mapping), old_extents, num_threads, &old_ids));
+  }
+  std::shared_ptr<MappedPartition> new_mapping = MappedPartition::Map(new_part);
+  TEST_AND_RETURN_FALSE(new_mapping);
+  TEST_AND_RETURN_FALSE(mapping.AddMappedBlocks(
+      std::move(new_mapping), new_extents, num_threads, &new_ids));
+  const int64_t old_blocks = old_ids.size();
+  const int64_t new_blocks = new_ids.size();
+
+  // The first places in the old file of each block.
+  map<BlockMapping::BlockId, vector<int64_t>> old_places;
+  for (int64_t block = 0; block < old_blocks; block++) {
+    vector<int64_t>* places = &old_places[old_ids[block]];
+    if (places->size() < kMaxShardBlockPlaces)
+      places->push_back(block);
+  }
+
+  old_shards->clear();
+  new_shards->clear();
+  for (int64_t shard_start = 0; shard_start < new_blocks;
+       shard_start += shard_blocks) {
+    int64_t num_blocks =
+        std::min<int64_t>(shard_blocks, new_blocks - shard_start);
+    new_shards->push_back(
+        ExtentsSublist(new_extents, shard_start, num_blocks));
+    NormalizeExtents(&new_shards->back());
+    if (old_blocks == 0) {
+      old_shards->emplace_back();
+      continue;
+    }
+
+    // Each block of the shard found in the old file votes for the shift
+    // between them. Without any, the shard is assumed to have moved with the
+    // file size.
+    int64_t shift = shard_start * old_blocks / new_blocks - shard_start;
+    size_t best_votes = 0;
+    map<int64_t, size_t> votes;
+    for (int64_t block = shard_start; block < shard_start + num_blocks;
+         block++) {
+      auto places_it = old_places.find(new_ids[block]);
+      if (places_it == old_places.end())
+        continue;
+      for (int64_t place : places_it->second) {
+        size_t block_votes = ++votes[place - block];
+        if (block_votes > best_votes) {
+          best_votes = block_votes;
+          shift = place - block;
+        }
+      }
+    }
+
+    // Center a window twice the size of the shard on the old shard, so data
+    // moved a bit further is also found.
+    int64_t window_blocks = std::min(2 * num_blocks, old_blocks);
+    int64_t window_start = std::max<int64_t>(
+        0,
+        std::min(shard_start + shift - num_blocks / 2,
+                 old_blocks - window_blocks));
+    old_shards->push_back(
+        ExtentsSublist(old_extents, window_start, window_blocks));
+    NormalizeExtents(&old_shards->back());
+  }
+  return true;
+}
+
+uint64_t EstimateDeltaReadFileMemory(uint64_t old_blocks,
+                                     uint64_t new_blocks,
+                                     bool has_deflates,
+                                     ssize_t chunk_blocks,
+                                     const PayloadVersion& version) {
+  if (chunk_blocks > 0) {
+    old_blocks = std::min<uint64_t>(old_blocks, chunk_blocks);
+    new_blocks = std::min<uint64_t>(new_blocks, chunk_blocks);
+  }
+  const uint64_t old_size = old_blocks * kBlockSize;
+  const uint64_t new_size = new_blocks * kBlockSize;
+
+  // The new data and two compressed copies of it, while the full operations
+  // are compared.
+  uint64_t memory = 3 * new_size + kCompressorMemory;
+  if (old_size == 0)
+    return memory;
+
+  // Then the old data is read, while the best blob so far is kept. bsdiff
+  // sorts the old data with 64-bit suffixes and writes a patch about the size
+  // of the new data.
+  uint64_t diff_memory = old_size + 2 * new_size;
+  if (version.OperationAllowed(InstallOperation::SOURCE_BSDIFF) &&
+      old_size <= kMaxBsdiffDestinationSize) {
+    diff_memory = std::max(diff_memory, 9 * old_size + 3 * new_size);
+  }
+  // puffdiff does the same on the data with its deflates decompressed.
+  if (has_deflates && version.OperationAllowed(InstallOperation::PUFFDIFF) &&
+      old_size <= kMaxPuffdiffDestinationSize) {
+    diff_memory =
+        std::max(diff_memory,
+                 old_size + 2 * new_size +
+                     kPuffExpansion * (9 * old_size + 2 * new_size));
+  }
+  return std::max(memory, diff_memory);
+}
+
 bool GenerateBestFullOperation(const brillo::Blob& new_data,
                                const PayloadVersion& version,
                                brillo::Blob* out_blob,
@@ -678,6 +885,24 @@ bool GenerateBestFullOperation(const brillo::Blob& new_data,
     }
   }
 
+  // Try compressing it with zstd, which may be picked over a somewhat smaller
+  // blob since it decompresses faster. It is only tried when asked for, since
+  // it compresses slowly.
+  if (version.OperationAllowed(InstallOperation::REPLACE_ZSTD) &&
+      (version.zstd_size_tolerance_percent >= 0 ||
+       version.minor == kFullPayloadMinorVersion)) {
+    uint64_t tolerance_percent =
+        std::max(version.zstd_size_tolerance_percent, 0);
+    brillo::Blob new_data_zstd;
+    if (ZstdCompress(new_data, &new_data_zstd) && !new_data_zstd.empty() &&
+        (!out_blob_set || new_data_zstd.size() * 100 <=
+                              out_blob->size() * (100 + tolerance_percent))) {
+      *out_type = InstallOperation::REPLACE_ZSTD;
+      *out_blob = std::move(new_data_zstd);
+      out_blob_set = true;
+    }
+  }
+
   // If nothing else worked or it was badly compressed we try a REPLACE.
   if (!out_blob_set || out_blob->size() >= new_data.size()) {
     *out_type = InstallOperation::REPLACE;
@@ -696,6 +921,7 @@ bool ReadExtentsToDiff(const string& old_part,
                        const vector<puffin::BitExtent>& old_deflates,
                        const vector<puffin::BitExtent>& new_deflates,
                        const PayloadVersion& version,
+                       DiffCache* diff_cache,
                        brillo::Blob* out_data,
                        InstallOperation* out_op) {
   InstallOperation operation;
@@ -761,32 +987,56 @@ bool ReadExtentsToDiff(const string& old_part,
                    operation, data_blob.size(), 0, src_extents.size())) {
       // No point in trying diff if zero blob size diff operation is
       // still worse than replace.
-      if (bsdiff_allowed) {
-        base::FilePath patch;
-        TEST_AND_RETURN_FALSE(base::CreateTemporaryFile(&patch));
-        ScopedPathUnlinker unlinker(patch.value());
 
-        std::unique_ptr<bsdiff::PatchWriterInterface> bsdiff_patch_writer;
+      // The diffs are looked up by the hashes of the data they are from.
+      brillo::Blob old_hash, new_hash;
+      if (diff_cache) {
+        TEST_AND_RETURN_FALSE(
+            HashCalculator::RawHashOfData(old_data, &old_hash));
+        TEST_AND_RETURN_FALSE(
+            HashCalculator::RawHashOfData(new_data, &new_hash));
+      }
+      if (bsdiff_allowed) {
         InstallOperation::Type operation_type = InstallOperation::SOURCE_BSDIFF;
+        string cache_params;
         if (version.OperationAllowed(InstallOperation::BROTLI_BSDIFF)) {
-          bsdiff_patch_writer =
-              bsdiff::CreateBSDF2PatchWriter(patch.value(),
-                                             bsdiff::CompressorType::kBrotli,
-                                             kBrotliCompressionQuality);
           operation_type = InstallOperation::BROTLI_BSDIFF;
-        } else {
-          bsdiff_patch_writer = bsdiff::CreateBsdiffPatchWriter(patch.value());
+          cache_params = base::NumberToString(kBrotliCompressionQuality);
+        }
+        string cache_key;
+        if (diff_cache) {
+          cache_key = DiffCache::Key(
+              operation_type, version, old_hash, new_hash, cache_params);
         }
 
         brillo::Blob bsdiff_delta;
-        TEST_AND_RETURN_FALSE(0 == bsdiff::bsdiff(old_data.data(),
-                                                  old_data.size(),
-                                                  new_data.data(),
-                                                  new_data.size(),
-                                                  bsdiff_patch_writer.get(),
-                                                  nullptr));
-
-        TEST_AND_RETURN_FALSE(utils::ReadFile(patch.value(), &bsdiff_delta));
+        if (!diff_cache || !diff_cache->Get(cache_key, &bsdiff_delta)) {
+          base::FilePath patch;
+          TEST_AND_RETURN_FALSE(base::CreateTemporaryFile(&patch));
+          ScopedPathUnlinker unlinker(patch.value());
+
+          std::unique_ptr<bsdiff::PatchWriterInterface> bsdiff_patch_writer;
+          if (operation_type == InstallOperation::BROTLI_BSDIFF) {
+            bsdiff_patch_writer =
+                bsdiff::CreateBSDF2PatchWriter(patch.value(),
+                                               bsdiff::CompressorType::kBrotli,
+                                               kBrotliCompressionQuality);
+          } else {
+            bsdiff_patch_writer =
+                bsdiff::CreateBsdiffPatchWriter(patch.value());
+          }
+
+          TEST_AND_RETURN_FALSE(0 == bsdiff::bsdiff(old_data.data(),
+                                                    old_data.size(),
+                                                    new_data.data(),
+                                                    new_data.size(),
+                                                    bsdiff_patch_writer.get(),
+                                                    nullptr));
+
+          TEST_AND_RETURN_FALSE(utils::ReadFile(patch.value(), &bsdiff_delta));
+          if (diff_cache)
+            diff_cache->Put(cache_key, bsdiff_delta);
+        }
         CHECK_GT(bsdiff_delta.size(), static_cast<brillo::Blob::size_type>(0));
         if (IsDiffOperationBetter(operation,
                                   data_blob.size(),
@@ -822,15 +1072,28 @@ bool ReadExtentsToDiff(const string& old_part,
 
         // Only Puffdiff if both files have at least one deflate left.
         if (!src_deflates.empty() && !dst_deflates.empty()) {
+          string cache_key;
+          if (diff_cache) {
+            cache_key = DiffCache::Key(InstallOperation::PUFFDIFF,
+                                       version,
+                                       old_hash,
+                                       new_hash,
+                                       DeflatesToString(src_deflates) + "/" +
+                                           DeflatesToString(dst_deflates));
+          }
           brillo::Blob puffdiff_delta;
-          ScopedTempFile temp_file("puffdiff-delta.XXXXXX");
-          // Perform PuffDiff operation.
-          TEST_AND_RETURN_FALSE(puffin::PuffDiff(old_data,
-                                                 new_data,
-                                                 src_deflates,
-                                                 dst_deflates,
-                                                 temp_file.path(),
-                                                 &puffdiff_delta));
+          if (!diff_cache || !diff_cache->Get(cache_key, &puffdiff_delta)) {
+            ScopedTempFile temp_file("puffdiff-delta.XXXXXX");
+            // Perform PuffDiff operation.
+            TEST_AND_RETURN_FALSE(puffin::PuffDiff(old_data,
+                                                   new_data,
+                                                   src_deflates,
+                                                   dst_deflates,
+                                                   temp_file.path(),
+                                                   &puffdiff_delta));
+            if (diff_cache)
+              diff_cache->Put(cache_key, puffdiff_delta);
+          }
           TEST_AND_RETURN_FALSE(puffdiff_delta.size() > 0);
           if (IsDiffOperationBetter(operation,
                                     data_blob.size(),
@@ -872,7 +1135,8 @@ bool ReadExtentsToDiff(const string& old_part,
 bool IsAReplaceOperation(InstallOperation::Type op_type) {
   return (op_type == InstallOperation::REPLACE ||
           op_type == InstallOperation::REPLACE_BZ ||
-          op_type == InstallOperation::REPLACE_XZ);
+          op_type == InstallOperation::REPLACE_XZ ||
+          op_type == InstallOperation::REPLACE_ZSTD);
 }
 
 bool IsNoSourceOperation(InstallOperation::Type op_type) {
@@ -31,6 +31,9 @@
 
 namespace chromeos_update_engine {
 
+class DiffCache;
+class MemoryBudget;
+
 namespace diff_utils {
 
 // Create operations in |aops| to produce all the blocks in the |new_part|
@@ -42,14 +45,21 @@ namespace diff_utils {
 // and soft chunk limits in number of blocks respectively. The soft chunk limit
 // is used to split MOVE and SOURCE_COPY operations and REPLACE_BZ of zeroed
 // blocks, while the hard limit is used to split a file when generating other
-// operations. A value of -1 in |hard_chunk_blocks| means whole files.
+// operations. A value of -1 in |hard_chunk_blocks| means whole files. Files
+// bigger than |file_shard_blocks| blocks, unless 0, are split with ShardFile()
+// so their shards are diffed in parallel. The files are diffed at once as long
+// as their estimated memory fits in |memory_budget|, which can be null for no
+// limit. The diffs are reused from |diff_cache| when not null.
 bool DeltaReadPartition(std::vector<AnnotatedOperation>* aops,
                         const PartitionConfig& old_part,
                         const PartitionConfig& new_part,
                         ssize_t hard_chunk_blocks,
                         size_t soft_chunk_blocks,
+                        size_t file_shard_blocks,
                         const PayloadVersion& version,
-                        BlobFileWriter* blob_file);
+                        BlobFileWriter* blob_file,
+                        MemoryBudget* memory_budget,
+                        DiffCache* diff_cache);
 
 // Create operations in |aops| for identical blocks that moved around in the old
 // and new partition and also handle zeroed blocks. The old and new partition
@@ -80,7 +90,8 @@ bool DeltaMovedAndZeroBlocks(std::vector<AnnotatedOperation>* aops,
 // exists, the old version exists in |old_part| in the blocks described by
 // |old_extents|. The operations added to |aops| reference the data blob
 // in the |blob_file|. |old_deflates| and |new_deflates| are all deflate
-// locations in |old_part| and |new_part|. Returns true on success.
+// locations in |old_part| and |new_part|. The diffs are looked up in and added
+// to |diff_cache|, unless null. Returns true on success.
 bool DeltaReadFile(std::vector<AnnotatedOperation>* aops,
                    const std::string& old_part,
                    const std::string& new_part,
@@ -91,7 +102,32 @@ bool DeltaReadFile(std::vector<AnnotatedOperation>* aops,
                    const std::string& name,
                    ssize_t chunk_blocks,
                    const PayloadVersion& version,
-                   BlobFileWriter* blob_file);
+                   BlobFileWriter* blob_file,
+                   DiffCache* diff_cache);
+
+// Splits the file stored in the |new_extents| blocks of |new_part| in shards of
+// |shard_blocks| blocks stored in |new_shards|. For each shard, it stores in
+// |old_shards| a window of the old file, stored in the |old_extents| blocks of
+// |old_part|, twice as big as the shard and centered on the part of the old
+// file sharing the most blocks with it, or on the same relative position if
+// there is none. Returns true on success.
+bool ShardFile(const std::string& old_part,
+               const std::string& new_part,
+               const std::vector<Extent>& old_extents,
+               const std::vector<Extent>& new_extents,
+               size_t shard_blocks,
+               std::vector<std::vector<Extent>>* old_shards,
+               std::vector<std::vector<Extent>>* new_shards);
+
+// Returns an estimate of the peak memory used by DeltaReadFile() for a file of
+// |old_blocks| and |new_blocks| blocks split in chunks of |chunk_blocks|, or
+// -1 for whole files. |has_deflates| is whether both files have deflates for
+// puffdiff.
+uint64_t EstimateDeltaReadFileMemory(uint64_t old_blocks,
+                                     uint64_t new_blocks,
+                                     bool has_deflates,
+                                     ssize_t chunk_blocks,
+                                     const PayloadVersion& version);
 
 // Reads the blocks |old_extents| from |old_part| (if it exists) and the
 // |new_extents| from |new_part| and determines the smallest way to encode
@@ -101,7 +137,9 @@ bool DeltaReadFile(std::vector<AnnotatedOperation>* aops,
 // operations allowed in the given |version| (REPLACE, REPLACE_BZ, BSDIFF,
 // SOURCE_BSDIFF, or PUFFDIFF) wins.
 // |new_extents| must not be empty. |old_deflates| and |new_deflates| are all
-// the deflate locations in |old_part| and |new_part|. Returns true on success.
+// the deflate locations in |old_part| and |new_part|. The bsdiff and puffdiff
+// diffs are taken from |diff_cache| when found there, and added to it
+// otherwise, unless it is null. Returns true on success.
 bool ReadExtentsToDiff(const std::string& old_part,
                        const std::string& new_part,
                        const std::vector<Extent>& old_extents,
@@ -109,6 +147,7 @@ bool ReadExtentsToDiff(const std::string& old_part,
                        const std::vector<puffin::BitExtent>& old_deflates,
                        const std::vector<puffin::BitExtent>& new_deflates,
                        const PayloadVersion& version,
+                       DiffCache* diff_cache,
                        brillo::Blob* out_data,
                        InstallOperation* out_op);
 
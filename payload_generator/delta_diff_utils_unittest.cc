@@ -28,10 +28,13 @@
 
 #include "update_engine/common/test_utils.h"
 #include "update_engine/common/utils.h"
+#include "update_engine/payload_generator/bzip.h"
 #include "update_engine/payload_generator/delta_diff_generator.h"
 #include "update_engine/payload_generator/extent_ranges.h"
 #include "update_engine/payload_generator/extent_utils.h"
 #include "update_engine/payload_generator/fake_filesystem.h"
+#include "update_engine/payload_generator/xz.h"
+#include "update_engine/payload_generator/zstd.h"
 
 using std::string;
 using std::vector;
@@ -170,9 +173,12 @@ TEST_F(DeltaDiffUtilsTest, SkipVerityExtentsTest) {
       new_part_,
       -1,
       -1,
+      0,
       PayloadVersion(kMaxSupportedMajorPayloadVersion,
                      kVerityMinorPayloadVersion),
-      &blob_file));
+      &blob_file,
+      nullptr,
+      nullptr));
   for (const auto& aop : aops_) {
     new_visited_blocks_.AddRepeatedExtents(aop.op.dst_extents());
   }
@@ -216,6 +222,7 @@ TEST_F(DeltaDiffUtilsTest, ReplaceSmallTest) {
         {},  // old_deflates
         {},  // new_deflates
         PayloadVersion(kBrilloMajorPayloadVersion, kSourceMinorPayloadVersion),
+        nullptr,
         &data,
         &op));
     EXPECT_FALSE(data.empty());
@@ -258,6 +265,7 @@ TEST_F(DeltaDiffUtilsTest, SourceCopyTest) {
       {},  // old_deflates
       {},  // new_deflates
       PayloadVersion(kBrilloMajorPayloadVersion, kSourceMinorPayloadVersion),
+      nullptr,
       &data,
       &op));
   EXPECT_TRUE(data.empty());
@@ -292,6 +300,7 @@ TEST_F(DeltaDiffUtilsTest, SourceBsdiffTest) {
       {},  // old_deflates
       {},  // new_deflates
       PayloadVersion(kBrilloMajorPayloadVersion, kSourceMinorPayloadVersion),
+      nullptr,
       &data,
       &op));
 
@@ -323,6 +332,7 @@ TEST_F(DeltaDiffUtilsTest, PreferReplaceTest) {
       {},  // new_deflates
       PayloadVersion(kMaxSupportedMajorPayloadVersion,
                      kMaxSupportedMinorPayloadVersion),
+      nullptr,
       &data,
       &op));
 
@@ -331,6 +341,54 @@ TEST_F(DeltaDiffUtilsTest, PreferReplaceTest) {
   EXPECT_EQ(InstallOperation::REPLACE_BZ, op.type());
 }
 
+TEST_F(DeltaDiffUtilsTest, GenerateBestFullOperationZstdTest) {
+  brillo::Blob new_data;
+  for (int i = 0; new_data.size() < 16 * kBlockSize; i++) {
+    string line = base::StringPrintf("Line %d of %d.\n", i, i * 7 % 13);
+    new_data.insert(new_data.end(), line.begin(), line.end());
+  }
+  brillo::Blob xz_blob, bz_blob, zstd_blob;
+  ASSERT_TRUE(XzCompress(new_data, &xz_blob));
+  ASSERT_TRUE(BzipCompress(new_data, &bz_blob));
+  ASSERT_TRUE(ZstdCompress(new_data, &zstd_blob));
+
+  brillo::Blob blob;
+  InstallOperation::Type type;
+  // Not allowed before its minor version, nor in full payloads by default.
+  PayloadVersion version(kBrilloMajorPayloadVersion,
+                         kPartialUpdateMinorPayloadVersion);
+  ASSERT_TRUE(
+      diff_utils::GenerateBestFullOperation(new_data, version, &blob, &type));
+  EXPECT_NE(InstallOperation::REPLACE_ZSTD, type);
+  version.minor = kFullPayloadMinorVersion;
+  ASSERT_TRUE(
+      diff_utils::GenerateBestFullOperation(new_data, version, &blob, &type));
+  EXPECT_NE(InstallOperation::REPLACE_ZSTD, type);
+
+  // Picked only if it is the smallest, unless some tolerance is given.
+  version.full_payload_zstd_allowed = true;
+  ASSERT_TRUE(
+      diff_utils::GenerateBestFullOperation(new_data, version, &blob, &type));
+  EXPECT_EQ(zstd_blob.size() <= std::min(xz_blob.size(), bz_blob.size()),
+            type == InstallOperation::REPLACE_ZSTD);
+  version.zstd_size_tolerance_percent = 1000;
+  ASSERT_TRUE(
+      diff_utils::GenerateBestFullOperation(new_data, version, &blob, &type));
+  EXPECT_EQ(InstallOperation::REPLACE_ZSTD, type);
+  EXPECT_EQ(zstd_blob, blob);
+
+  // Delta payloads only try it when a tolerance is given.
+  version.minor = kZstdMinorPayloadVersion;
+  version.zstd_size_tolerance_percent = -1;
+  ASSERT_TRUE(
+      diff_utils::GenerateBestFullOperation(new_data, version, &blob, &type));
+  EXPECT_NE(InstallOperation::REPLACE_ZSTD, type);
+  version.zstd_size_tolerance_percent = 1000;
+  ASSERT_TRUE(
+      diff_utils::GenerateBestFullOperation(new_data, version, &blob, &type));
+  EXPECT_EQ(InstallOperation::REPLACE_ZSTD, type);
+}
+
 // Test the simple case where all the blocks are different and no new blocks are
 // zeroed.
 TEST_F(DeltaDiffUtilsTest, NoZeroedOrUniqueBlocksDetected) {
@@ -539,6 +597,88 @@ TEST_F(DeltaDiffUtilsTest, ShuffledBlocksAreTracked) {
   EXPECT_EQ(0, blob_size_);
 }
 
+TEST_F(DeltaDiffUtilsTest, ShardFileTest) {
+  // The old file is in two extents, and the new file has its blocks 10 to 39
+  // followed by 10 new blocks.
+  EXPECT_TRUE(InitializePartitionWithUniqueBlocks(old_part_, block_size_, 1));
+  EXPECT_TRUE(InitializePartitionWithUniqueBlocks(new_part_, block_size_, 2));
+  vector<Extent> old_extents = {ExtentForRange(50, 20), ExtentForRange(0, 20)};
+  vector<Extent> new_extents = {ExtentForRange(0, 40)};
+  brillo::Blob old_data;
+  EXPECT_TRUE(utils::ReadFile(old_part_.path, &old_data));
+  brillo::Blob moved_data(old_data.begin() + 60 * block_size_,
+                          old_data.begin() + 70 * block_size_);
+  moved_data.insert(moved_data.end(),
+                    old_data.begin(),
+                    old_data.begin() + 20 * block_size_);
+  EXPECT_TRUE(
+      WriteExtents(new_part_.path, new_extents, block_size_, moved_data));
+
+  vector<vector<Extent>> old_shards, new_shards;
+  EXPECT_TRUE(diff_utils::ShardFile(old_part_.path,
+                                    new_part_.path,
+                                    old_extents,
+                                    new_extents,
+                                    10,
+                                    &old_shards,
+                                    &new_shards));
+  EXPECT_EQ((vector<vector<Extent>>{{ExtentForRange(0, 10)},
+                                    {ExtentForRange(10, 10)},
+                                    {ExtentForRange(20, 10)},
+                                    {ExtentForRange(30, 10)}}),
+            new_shards);
+  // The windows are centered on the moved blocks and kept in the old file.
+  // The new blocks use the window at the same position.
+  EXPECT_EQ((vector<vector<Extent>>{
+                {ExtentForRange(55, 15), ExtentForRange(0, 5)},
+                {ExtentForRange(65, 5), ExtentForRange(0, 15)},
+                {ExtentForRange(0, 20)},
+                {ExtentForRange(0, 20)}}),
+            old_shards);
+
+  // Without an old file, the shards have no source.
+  EXPECT_TRUE(diff_utils::ShardFile(old_part_.path,
+                                    new_part_.path,
+                                    {},
+                                    new_extents,
+                                    30,
+                                    &old_shards,
+                                    &new_shards));
+  EXPECT_EQ(2U, new_shards.size());
+  EXPECT_EQ((vector<vector<Extent>>{{}, {}}), old_shards);
+}
+
+TEST_F(DeltaDiffUtilsTest, EstimateDeltaReadFileMemoryTest) {
+  PayloadVersion version(kBrilloMajorPayloadVersion,
+                         kPuffdiffMinorPayloadVersion);
+  const uint64_t kBlocks = 10000;
+  const uint64_t new_file =
+      diff_utils::EstimateDeltaReadFileMemory(0, kBlocks, false, -1, version);
+  const uint64_t bsdiff_file = diff_utils::EstimateDeltaReadFileMemory(
+      kBlocks, kBlocks, false, -1, version);
+  const uint64_t puffdiff_file = diff_utils::EstimateDeltaReadFileMemory(
+      kBlocks, kBlocks, true, -1, version);
+  EXPECT_GT(new_file, 3 * kBlocks * kBlockSize);
+  // The bsdiff suffix array takes most of the memory.
+  EXPECT_GE(bsdiff_file, 9 * kBlocks * kBlockSize);
+  EXPECT_GT(bsdiff_file, new_file);
+  EXPECT_GT(puffdiff_file, bsdiff_file);
+
+  // The chunks are diffed one at a time.
+  EXPECT_EQ(bsdiff_file,
+            diff_utils::EstimateDeltaReadFileMemory(
+                5 * kBlocks, 5 * kBlocks, false, kBlocks, version));
+  // Without bsdiff, only the data is kept.
+  EXPECT_LT(diff_utils::EstimateDeltaReadFileMemory(
+                kBlocks,
+                kBlocks,
+                false,
+                -1,
+                PayloadVersion(kBrilloMajorPayloadVersion,
+                               kFullPayloadMinorVersion)),
+            bsdiff_file);
+}
+
 TEST_F(DeltaDiffUtilsTest, IsExtFilesystemTest) {
   EXPECT_TRUE(diff_utils::IsExtFilesystem(
       test_utils::GetBuildArtifactsPath("gen/disk_ext2_1k.img")));
@@ -0,0 +1,204 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_generator/diff_cache.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <base/files/file_enumerator.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/stringprintf.h>
+#include <base/time/time.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/utils.h"
+
+using std::string;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+// Changed when the generator produces different diffs from the same data, so
+// the diffs cached by previous versions aren't used.
+const int kDiffCacheVersion = 1;
+
+// The size of the SHA-256 stored before each diff.
+const size_t kHashSize = 32;
+
+// The subdirectory where the diffs are written before being moved in the
+// cache, so Trim() doesn't count or delete the ones being written.
+const char kTempDir[] = "tmp";
+
+// How long the temporary files left by a crashed process are kept.
+const int kMaxTempFileAgeDays = 1;
+
+}  // namespace
+
+std::unique_ptr<DiffCache> DiffCache::Open(const string& dir,
+                                           uint64_t max_size) {
+  base::FilePath path(dir);
+  if (!base::CreateDirectory(path.Append(kTempDir))) {
+    PLOG(ERROR) << "Unable to create the diff cache " << dir;
+    return nullptr;
+  }
+
+  // Delete the temporary files left by processes which didn't finish writing
+  // them, leaving the recent ones which may still be in use.
+  const base::Time expiry =
+      base::Time::Now() - base::Days(kMaxTempFileAgeDays);
+  base::FileEnumerator enumerator(
+      path.Append(kTempDir), false, base::FileEnumerator::FILES);
+  for (base::FilePath temp_path = enumerator.Next(); !temp_path.empty();
+       temp_path = enumerator.Next()) {
+    if (enumerator.GetInfo().GetLastModifiedTime() < expiry)
+      base::DeleteFile(temp_path);
+  }
+
+  std::unique_ptr<DiffCache> cache(new DiffCache(path, max_size));
+  base::AutoLock lock(cache->lock_);
+  cache->Trim();
+  LOG(INFO) << "Using the diff cache " << dir << " with " << cache->size_
+            << " bytes of diffs.";
+  return cache;
+}
+
+string DiffCache::Key(InstallOperation::Type type,
+                      const PayloadVersion& version,
+                      const brillo::Blob& old_hash,
+                      const brillo::Blob& new_hash,
+                      const string& params) {
+  string key_data = base::StringPrintf("diff-cache-%d:%d:%" PRIu64 ":%u:",
+                                       kDiffCacheVersion,
+                                       static_cast<int>(type),
+                                       version.major,
+                                       version.minor);
+  key_data.append(old_hash.begin(), old_hash.end());
+  key_data.append(new_hash.begin(), new_hash.end());
+  key_data.append(params);
+  brillo::Blob key_hash;
+  CHECK(HashCalculator::RawHashOfBytes(
+      key_data.data(), key_data.size(), &key_hash));
+  return base::HexEncode(key_hash.data(), key_hash.size());
+}
+
+bool DiffCache::Get(const string& key, brillo::Blob* diff) {
+  base::FilePath path = dir_.Append(key);
+  brillo::Blob data;
+  brillo::Blob hash;
+  bool found = utils::ReadFile(path.value(), &data) &&
+               data.size() >= kHashSize &&
+               HashCalculator::RawHashOfBytes(
+                   data.data() + kHashSize, data.size() - kHashSize, &hash) &&
+               std::equal(hash.begin(), hash.end(), data.begin());
+  if (!found && !data.empty()) {
+    LOG(WARNING) << "Deleting the corrupted cached diff " << path.value();
+    base::DeleteFile(path);
+  }
+  {
+    base::AutoLock lock(lock_);
+    (found ? num_hits_ : num_misses_)++;
+  }
+  if (!found)
+    return false;
+
+  // Keep the diffs used recently.
+  base::Time now = base::Time::Now();
+  base::TouchFile(path, now, now);
+  diff->assign(data.begin() + kHashSize, data.end());
+  return true;
+}
+
+void DiffCache::Put(const string& key, const brillo::Blob& diff) {
+  brillo::Blob data;
+  TEST_AND_RETURN(HashCalculator::RawHashOfData(diff, &data));
+  data.insert(data.end(), diff.begin(), diff.end());
+
+  // The diff is written to a temporary file first, so other processes never
+  // read it partially written.
+  base::FilePath temp_path;
+  TEST_AND_RETURN(
+      base::CreateTemporaryFileInDir(dir_.Append(kTempDir), &temp_path));
+  if (!utils::WriteFile(temp_path.value().c_str(), data.data(), data.size())) {
+    LOG(WARNING) << "Unable to cache the diff " << key;
+    base::DeleteFile(temp_path);
+    return;
+  }
+
+  base::FilePath path = dir_.Append(key);
+  base::AutoLock lock(lock_);
+  // The diff may replace one already cached by another process or thread,
+  // which is no longer counted.
+  int64_t old_size = 0;
+  if (!base::GetFileSize(path, &old_size))
+    old_size = 0;
+  if (!base::ReplaceFile(temp_path, path, nullptr)) {
+    LOG(WARNING) << "Unable to cache the diff " << key;
+    base::DeleteFile(temp_path);
+    return;
+  }
+  size_ -= std::min<uint64_t>(size_, old_size);
+  size_ += data.size();
+  if (size_ > max_size_)
+    Trim();
+}
+
+uint64_t DiffCache::num_hits() const {
+  base::AutoLock lock(lock_);
+  return num_hits_;
+}
+
+uint64_t DiffCache::num_misses() const {
+  base::AutoLock lock(lock_);
+  return num_misses_;
+}
+
+void DiffCache::Trim() {
+  vector<std::pair<base::Time, base::FilePath>> files;
+  size_ = 0;
+  base::FileEnumerator enumerator(dir_, false, base::FileEnumerator::FILES);
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    files.emplace_back(enumerator.GetInfo().GetLastModifiedTime(), path);
+    size_ += enumerator.GetInfo().GetSize();
+  }
+  if (size_ <= max_size_)
+    return;
+
+  std::sort(files.begin(), files.end());
+  const uint64_t target_size = max_size_ / 10 * 9;
+  size_t num_deleted = 0;
+  for (const auto& [time, path] : files) {
+    if (size_ <= target_size)
+      break;
+    int64_t file_size = 0;
+    if (!base::GetFileSize(path, &file_size) || !base::DeleteFile(path))
+      continue;
+    size_ -= std::min<uint64_t>(size_, file_size);
+    num_deleted++;
+  }
+  LOG(INFO) << "Deleted " << num_deleted << " diffs from the diff cache, "
+            << size_ << " bytes left.";
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,93 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_GENERATOR_DIFF_CACHE_H_
+#define UPDATE_ENGINE_PAYLOAD_GENERATOR_DIFF_CACHE_H_
+
+#include <memory>
+#include <string>
+
+#include <base/files/file_path.h>
+#include <base/synchronization/lock.h>
+#include <brillo/secure_blob.h>
+
+#include "update_engine/payload_generator/payload_generation_config.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// A cache of the diffs computed by ReadExtentsToDiff(), kept on disk so the
+// payloads generated from several old versions to the same new version reuse
+// the diffs of the files that are the same in some of the old versions.
+//
+// Each diff is stored in its own file, named after its key, after the SHA-256
+// of its data so a corrupted diff is detected and dropped. The least recently
+// used diffs are deleted when the cache grows bigger than its maximum size.
+// Several processes can share a cache directory, as the diffs are written in
+// its tmp subdirectory and then moved in place. The methods are thread safe.
+class DiffCache {
+ public:
+  // Opens the cache in |dir|, creating the directory if needed. The cache is
+  // trimmed to |max_size| bytes as it grows. Returns null on error.
+  static std::unique_ptr<DiffCache> Open(const std::string& dir,
+                                         uint64_t max_size);
+
+  // Returns the key of the |type| diff from the data with SHA-256 |old_hash|
+  // to the data with SHA-256 |new_hash|, for a payload of |version|. |params|
+  // holds anything else the diff depends on, such as the compression settings
+  // or the deflates passed to puffdiff.
+  static std::string Key(InstallOperation::Type type,
+                         const PayloadVersion& version,
+                         const brillo::Blob& old_hash,
+                         const brillo::Blob& new_hash,
+                         const std::string& params);
+
+  DiffCache(const DiffCache&) = delete;
+  DiffCache& operator=(const DiffCache&) = delete;
+
+  // Stores in |diff| the diff of |key|. Returns false if it isn't cached.
+  bool Get(const std::string& key, brillo::Blob* diff);
+
+  // Adds the |diff| of |key| to the cache. The cache being only an
+  // optimization, failures are logged but otherwise ignored.
+  void Put(const std::string& key, const brillo::Blob& diff);
+
+  uint64_t num_hits() const;
+  uint64_t num_misses() const;
+
+ private:
+  DiffCache(const base::FilePath& dir, uint64_t max_size)
+      : dir_(dir), max_size_(max_size) {}
+
+  // Deletes the least recently used diffs until the cache uses at most 90% of
+  // |max_size_|, leaving room for the next ones. Also updates |size_| with the
+  // diffs added by other processes. Must be called with |lock_| held.
+  void Trim();
+
+  const base::FilePath dir_;
+  const uint64_t max_size_;
+
+  mutable base::Lock lock_;
+  // The size of the diffs in the cache, as of the last Trim() and the diffs
+  // added since.
+  uint64_t size_{0};
+  uint64_t num_hits_{0};
+  uint64_t num_misses_{0};
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_GENERATOR_DIFF_CACHE_H_
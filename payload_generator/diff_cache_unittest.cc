@@ -0,0 +1,191 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_generator/diff_cache.h"
+
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "update_engine/common/hash_calculator.h"
+#include "update_engine/common/test_utils.h"
+#include "update_engine/common/utils.h"
+#include "update_engine/payload_consumer/payload_constants.h"
+
+using std::string;
+
+namespace chromeos_update_engine {
+
+class DiffCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    cache_ = DiffCache::Open(temp_dir_.GetPath().value(), 1024 * 1024);
+    ASSERT_NE(nullptr, cache_);
+  }
+
+  // The key of a bsdiff from |old_data| to |new_data|.
+  string DataKey(const string& old_data, const string& new_data) {
+    brillo::Blob old_hash, new_hash;
+    EXPECT_TRUE(HashCalculator::RawHashOfBytes(
+        old_data.data(), old_data.size(), &old_hash));
+    EXPECT_TRUE(HashCalculator::RawHashOfBytes(
+        new_data.data(), new_data.size(), &new_hash));
+    return DiffCache::Key(InstallOperation::SOURCE_BSDIFF,
+                          PayloadVersion(kBrilloMajorPayloadVersion,
+                                         kSourceMinorPayloadVersion),
+                          old_hash,
+                          new_hash,
+                          "");
+  }
+
+  // Makes the diff of |key| look last used |age| ago.
+  void SetAge(const string& key, base::TimeDelta age) {
+    base::Time time = base::Time::Now() - age;
+    ASSERT_TRUE(
+        base::TouchFile(temp_dir_.GetPath().Append(key), time, time));
+  }
+
+  base::ScopedTempDir temp_dir_;
+  std::unique_ptr<DiffCache> cache_;
+};
+
+TEST_F(DiffCacheTest, PutGetTest) {
+  string key = DataKey("old", "new");
+  brillo::Blob diff;
+  EXPECT_FALSE(cache_->Get(key, &diff));
+
+  brillo::Blob expected(1000);
+  test_utils::FillWithData(&expected);
+  cache_->Put(key, expected);
+  EXPECT_TRUE(cache_->Get(key, &diff));
+  EXPECT_EQ(expected, diff);
+  EXPECT_EQ(1U, cache_->num_hits());
+  EXPECT_EQ(1U, cache_->num_misses());
+
+  // The diffs are kept when the cache is opened again.
+  cache_ = DiffCache::Open(temp_dir_.GetPath().value(), 1024 * 1024);
+  ASSERT_NE(nullptr, cache_);
+  diff.clear();
+  EXPECT_TRUE(cache_->Get(key, &diff));
+  EXPECT_EQ(expected, diff);
+}
+
+TEST_F(DiffCacheTest, KeyTest) {
+  string key = DataKey("old", "new");
+  EXPECT_EQ(key, DataKey("old", "new"));
+  EXPECT_NE(key, DataKey("new", "old"));
+  EXPECT_NE(key, DataKey("old", "newer"));
+
+  brillo::Blob old_hash, new_hash;
+  ASSERT_TRUE(HashCalculator::RawHashOfBytes("old", 3, &old_hash));
+  ASSERT_TRUE(HashCalculator::RawHashOfBytes("new", 3, &new_hash));
+  PayloadVersion version(kBrilloMajorPayloadVersion,
+                         kSourceMinorPayloadVersion);
+  EXPECT_EQ(key,
+            DiffCache::Key(InstallOperation::SOURCE_BSDIFF,
+                           version,
+                           old_hash,
+                           new_hash,
+                           ""));
+  EXPECT_NE(key,
+            DiffCache::Key(InstallOperation::BROTLI_BSDIFF,
+                           version,
+                           old_hash,
+                           new_hash,
+                           ""));
+  EXPECT_NE(key,
+            DiffCache::Key(InstallOperation::SOURCE_BSDIFF,
+                           version,
+                           old_hash,
+                           new_hash,
+                           "9"));
+  version.minor = kPuffdiffMinorPayloadVersion;
+  EXPECT_NE(key,
+            DiffCache::Key(InstallOperation::SOURCE_BSDIFF,
+                           version,
+                           old_hash,
+                           new_hash,
+                           ""));
+}
+
+TEST_F(DiffCacheTest, CorruptedDiffTest) {
+  string key = DataKey("old", "new");
+  brillo::Blob diff(100, 'x');
+  cache_->Put(key, diff);
+
+  // Flip a byte of the stored diff.
+  base::FilePath path = temp_dir_.GetPath().Append(key);
+  brillo::Blob data;
+  ASSERT_TRUE(utils::ReadFile(path.value(), &data));
+  data.back() ^= 1;
+  ASSERT_TRUE(test_utils::WriteFileVector(path.value(), data));
+
+  EXPECT_FALSE(cache_->Get(key, &diff));
+  EXPECT_FALSE(base::PathExists(path));
+  EXPECT_EQ(1U, cache_->num_misses());
+}
+
+TEST_F(DiffCacheTest, EvictionTest) {
+  // Room for two diffs, with their hashes.
+  cache_ = DiffCache::Open(temp_dir_.GetPath().value(), 2500);
+  ASSERT_NE(nullptr, cache_);
+  brillo::Blob diff(1000);
+  string key1 = DataKey("old", "new1");
+  string key2 = DataKey("old", "new2");
+  string key3 = DataKey("old", "new3");
+  cache_->Put(key1, diff);
+  cache_->Put(key2, diff);
+  SetAge(key1, base::Seconds(20));
+  SetAge(key2, base::Seconds(10));
+
+  // Using the oldest diff keeps it over the other one.
+  EXPECT_TRUE(cache_->Get(key1, &diff));
+  cache_->Put(key3, diff);
+  EXPECT_TRUE(cache_->Get(key1, &diff));
+  EXPECT_FALSE(cache_->Get(key2, &diff));
+  EXPECT_TRUE(cache_->Get(key3, &diff));
+}
+
+TEST_F(DiffCacheTest, TempFilesTest) {
+  // A diff being written by another process, and one left by a crash.
+  base::FilePath temp_dir = temp_dir_.GetPath().Append("tmp");
+  base::FilePath writing = temp_dir.Append("writing");
+  base::FilePath stale = temp_dir.Append("stale");
+  brillo::Blob data(2000);
+  ASSERT_TRUE(test_utils::WriteFileVector(writing.value(), data));
+  ASSERT_TRUE(test_utils::WriteFileVector(stale.value(), data));
+  base::Time time = base::Time::Now() - base::Days(2);
+  ASSERT_TRUE(base::TouchFile(stale, time, time));
+
+  cache_ = DiffCache::Open(temp_dir_.GetPath().value(), 2500);
+  ASSERT_NE(nullptr, cache_);
+  EXPECT_TRUE(base::PathExists(writing));
+  EXPECT_FALSE(base::PathExists(stale));
+
+  // The temporary files aren't counted nor deleted when trimming the cache.
+  brillo::Blob diff(1000);
+  string key1 = DataKey("old", "new1");
+  string key2 = DataKey("old", "new2");
+  cache_->Put(key1, diff);
+  cache_->Put(key2, diff);
+  EXPECT_TRUE(cache_->Get(key1, &diff));
+  EXPECT_TRUE(cache_->Get(key2, &diff));
+  EXPECT_TRUE(base::PathExists(writing));
+}
+
+}  // namespace chromeos_update_engine
@@ -134,6 +134,8 @@ bool FullUpdateGenerator::GenerateOperations(
     LOG(INFO) << "No chunk_size provided, using the default chunk_size for the "
               << "full operations: " << full_chunk_size << " bytes.";
   }
+  if (config.replace_chunk_size > 0)
+    full_chunk_size = std::min(full_chunk_size, config.replace_chunk_size);
   TEST_AND_RETURN_FALSE(full_chunk_size > 0);
   TEST_AND_RETURN_FALSE(full_chunk_size % config.block_size == 0);
 
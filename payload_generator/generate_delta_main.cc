@@ -366,6 +366,28 @@ int Main(int argc, char** argv) {
                 "e.g. /path/to/sig:/path/to/next:/path/to/last_sig .");
   DEFINE_int32(
       chunk_size, 200 * 1024 * 1024, "Payload chunk size (-1 for whole files)");
+  DEFINE_int32(replace_chunk_size,
+               0,
+               "Maximum size written by a single replace operation, so larger "
+               "ones are decompressed in parallel by the client (0 for no "
+               "limit other than chunk_size).");
+  DEFINE_int32(file_shard_size,
+               0,
+               "Size of the shards files bigger than it are split in, to diff "
+               "them in parallel (0 to diff whole files).");
+  DEFINE_int32(memory_budget_mib,
+               0,
+               "Memory the files diffed at once are estimated to use at most, "
+               "in MiB (0 for no limit other than the number of threads).");
+  DEFINE_string(diff_cache_dir,
+                "",
+                "Directory where the diffs are cached, to reuse them when "
+                "generating other payloads to the same target (empty for no "
+                "cache).");
+  DEFINE_int32(diff_cache_size_mib,
+               4096,
+               "Size the diff cache is trimmed to, in MiB, by deleting the "
+               "least recently used diffs.");
   DEFINE_uint64(rootfs_partition_size,
                 chromeos_update_engine::kRootFSPartitionSize,
                 "RootFS partition size for the image once installed");
@@ -412,6 +434,16 @@ int Main(int argc, char** argv) {
               false,
               "The payload only targets a subset of partitions on the device,"
               "e.g. generic kernel image update.");
+  DEFINE_bool(full_payload_zstd,
+              false,
+              "Allows REPLACE_ZSTD operations in a full payload. Only use it "
+              "if all the devices receiving the payload support minor version "
+              "10 or newer.");
+  DEFINE_int32(zstd_size_tolerance,
+               -1,
+               "How much larger, in percent, a REPLACE_ZSTD blob can be than "
+               "the smallest one and still be used, since it decompresses "
+               "faster. Delta payloads only try zstd if it isn't negative.");
 
   brillo::FlagHelper::Init(
       argc,
@@ -584,6 +616,17 @@ int Main(int argc, char** argv) {
 
   // Use the default soft_chunk_size defined in the config.
   payload_config.hard_chunk_size = FLAGS_chunk_size;
+  CHECK_GE(FLAGS_replace_chunk_size, 0);
+  payload_config.replace_chunk_size = FLAGS_replace_chunk_size;
+  CHECK_GE(FLAGS_file_shard_size, 0);
+  payload_config.file_shard_size = FLAGS_file_shard_size;
+  CHECK_GE(FLAGS_memory_budget_mib, 0);
+  payload_config.memory_budget =
+      static_cast<uint64_t>(FLAGS_memory_budget_mib) * 1024 * 1024;
+  payload_config.diff_cache_dir = FLAGS_diff_cache_dir;
+  CHECK_GT(FLAGS_diff_cache_size_mib, 0);
+  payload_config.diff_cache_size =
+      static_cast<uint64_t>(FLAGS_diff_cache_size_mib) * 1024 * 1024;
   payload_config.block_size = kBlockSize;
 
   // The partition size is never passed to the delta_generator, so we
@@ -656,6 +699,9 @@ int Main(int argc, char** argv) {
     LOG(FATAL) << "Unsupported minor version " << payload_config.version.minor;
     return 1;
   }
+  payload_config.version.full_payload_zstd_allowed = FLAGS_full_payload_zstd;
+  payload_config.version.zstd_size_tolerance_percent =
+      FLAGS_zstd_size_tolerance;
 
   payload_config.max_timestamp = FLAGS_max_timestamp;
   if (!FLAGS_partition_timestamps.empty()) {
@@ -230,7 +230,8 @@ bool PayloadVersion::Validate() const {
                         minor == kBrotliBsdiffMinorPayloadVersion ||
                         minor == kPuffdiffMinorPayloadVersion ||
                         minor == kVerityMinorPayloadVersion ||
-                        minor == kPartialUpdateMinorPayloadVersion);
+                        minor == kPartialUpdateMinorPayloadVersion ||
+                        minor == kZstdMinorPayloadVersion);
   return true;
 }
 
@@ -261,6 +262,10 @@ bool PayloadVersion::OperationAllowed(InstallOperation::Type operation) const {
 
     case InstallOperation::PUFFDIFF:
       return minor >= kPuffdiffMinorPayloadVersion;
+
+    case InstallOperation::REPLACE_ZSTD:
+      return minor >= kZstdMinorPayloadVersion ||
+             (minor == kFullPayloadMinorVersion && full_payload_zstd_allowed);
 #ifndef __CHROMEOS__
     case InstallOperation::MOVE:
     case InstallOperation::BSDIFF:
@@ -309,6 +314,11 @@ bool PayloadGenerationConfig::Validate() const {
   TEST_AND_RETURN_FALSE(hard_chunk_size == -1 ||
                         hard_chunk_size % block_size == 0);
   TEST_AND_RETURN_FALSE(soft_chunk_size % block_size == 0);
+  TEST_AND_RETURN_FALSE(replace_chunk_size % block_size == 0);
+  TEST_AND_RETURN_FALSE(file_shard_size % block_size == 0);
+  TEST_AND_RETURN_FALSE(hard_chunk_size == -1 ||
+                        file_shard_size <=
+                            static_cast<size_t>(hard_chunk_size));
 
   TEST_AND_RETURN_FALSE(rootfs_partition_size % block_size == 0);
 
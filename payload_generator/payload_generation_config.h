@@ -174,6 +174,17 @@ struct PayloadVersion {
 
   // The minor version of the payload.
   uint32_t minor;
+
+  // Whether REPLACE_ZSTD operations can be used in a full payload, whose minor
+  // version doesn't tell which clients support them.
+  bool full_payload_zstd_allowed = false;
+
+  // How much larger, in percent, a REPLACE_ZSTD blob can be than the smallest
+  // blob of the other compressors and still be picked, since zstd decompresses
+  // several times faster than xz and bzip2. Compressing with zstd is slow, so
+  // delta payloads only try it when this isn't negative. Full payloads try it
+  // with |full_payload_zstd_allowed| and treat a negative value as 0.
+  int32_t zstd_size_tolerance_percent = -1;
 };
 
 // The PayloadGenerationConfig struct encapsulates all the configuration to
@@ -221,6 +232,33 @@ struct PayloadGenerationConfig {
   // chunks.
   size_t soft_chunk_size = 2 * 1024 * 1024;
 
+  // The |replace_chunk_size| is the maximum size that a single REPLACE,
+  // REPLACE_BZ or REPLACE_XZ operation should write in the destination. Larger
+  // ones are split in operations compressed independently, so the client can
+  // decompress them in parallel. A value of 0 means no limit other than the
+  // chunk sizes above.
+  size_t replace_chunk_size = 0;
+
+  // The |file_shard_size| is the size of the shards files bigger than it are
+  // split in. Each shard is diffed in parallel against the part of the old
+  // file most similar to it, instead of the whole file being diffed on one
+  // thread or replaced when too big for bsdiff. It must not be bigger than
+  // the hard chunk size. A value of 0 means files are not split in shards.
+  size_t file_shard_size = 0;
+
+  // The |memory_budget| is the memory, in bytes, the files diffed at once in
+  // all the partitions are estimated to use at most. A file estimated to use
+  // more than the budget is diffed alone. A value of 0 means no limit other
+  // than the number of threads.
+  uint64_t memory_budget = 0;
+
+  // The |diff_cache_dir| is the directory where the diffs are kept to be reused
+  // by the next payloads, such as the payloads from other old versions to the
+  // same new version. The cache is trimmed to |diff_cache_size| bytes by
+  // deleting the least recently used diffs. An empty path means no cache.
+  std::string diff_cache_dir;
+  uint64_t diff_cache_size = 4ULL * 1024 * 1024 * 1024;
+
   // TODO(deymo): Remove the block_size member and maybe replace it with a
   // minimum alignment size for blocks (if needed). Algorithms should be able to
   // pick the block_size they want, but for now only 4 KiB is supported.
@@ -17,14 +17,22 @@
 #include "update_engine/payload_generator/payload_signer.h"
 
 #include <endian.h>
+#include <fcntl.h>
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
 #include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
 #include <brillo/data_encoding.h>
 #include <openssl/err.h>
 #include <openssl/pem.h>
@@ -79,59 +87,184 @@ bool ConvertSignaturesToProtobuf(const vector<brillo::Blob>& signatures,
   return true;
 }
 
-// Given an unsigned payload under |payload_path| and the |payload_signature|
-// and |metadata_signature| generates an updated payload that includes the
-// signatures. It populates |out_metadata_size| with the size of the final
-// manifest after adding the fake signature operation, and
-// |out_signatures_offset| with the expected offset for the new blob, and
-// |out_metadata_signature_size| which will be size of |metadata_signature|
-// if the payload major version supports metadata signature, 0 otherwise.
-// Returns true on success, false otherwise.
-bool AddSignatureBlobToPayload(const string& payload_path,
-                               const string& payload_signature,
-                               const string& metadata_signature,
-                               brillo::Blob* out_payload,
-                               uint64_t* out_metadata_size,
-                               uint32_t* out_metadata_signature_size,
-                               uint64_t* out_signatures_offset) {
+// Reads |size| bytes at |offset| of a file in chunks and passes them to a
+// |hasher| and to the file |out_fd|, either of which can be unset. A thread
+// hashes and writes each chunk while the next one is read, and only two chunks
+// are held at a time, so payloads of any size are streamed in constant memory.
+const size_t kPayloadDataChunkSize = 1024 * 1024;  // bytes
+
+class PayloadDataStreamer : public base::DelegateSimpleThread::Delegate {
+ public:
+  PayloadDataStreamer(HashCalculator* hasher, int out_fd)
+      : hasher_(hasher), out_fd_(out_fd) {}
+  PayloadDataStreamer(const PayloadDataStreamer&) = delete;
+  PayloadDataStreamer& operator=(const PayloadDataStreamer&) = delete;
+
+  ~PayloadDataStreamer() override = default;
+
+  // Streams the data of |in_fd|. Returns true on success.
+  bool Stream(int in_fd, uint64_t offset, uint64_t size);
+
+  // Overrides DelegateSimpleThread::Delegate.
+  // Hashes and writes the chunks as they are read.
+  void Run() override;
+
+ private:
+  struct Chunk {
+    brillo::Blob data;
+    size_t size{0};
+    // Whether |data| was read and not yet hashed and written.
+    bool full{false};
+  };
+
+  HashCalculator* hasher_;
+  int out_fd_;
+
+  base::Lock lock_;
+  base::ConditionVariable chunk_done_{&lock_};
+  Chunk chunks_[2];
+  // Whether all the chunks were read, or the reads stopped.
+  bool read_done_{false};
+  bool failed_{false};
+};
+
+bool PayloadDataStreamer::Stream(int in_fd, uint64_t offset, uint64_t size) {
+  base::DelegateSimpleThread thread(this, "payload-data-streamer");
+  thread.Start();
+  bool read_failed = false;
+  size_t index = 0;
+  for (uint64_t done = 0; done < size;
+       done += kPayloadDataChunkSize, index ^= 1) {
+    Chunk* chunk = &chunks_[index];
+    {
+      base::AutoLock auto_lock(lock_);
+      while (chunk->full && !failed_)
+        chunk_done_.Wait();
+      if (failed_)
+        break;
+    }
+    // The chunk isn't used by the other thread until marked as full.
+    chunk->size = std::min<uint64_t>(kPayloadDataChunkSize, size - done);
+    chunk->data.resize(kPayloadDataChunkSize);
+    ssize_t bytes_read;
+    if (!utils::PReadAll(in_fd,
+                         chunk->data.data(),
+                         chunk->size,
+                         offset + done,
+                         &bytes_read) ||
+        static_cast<size_t>(bytes_read) != chunk->size) {
+      PLOG(ERROR) << "Unable to read the payload data at " << offset + done;
+      read_failed = true;
+      break;
+    }
+    base::AutoLock auto_lock(lock_);
+    chunk->full = true;
+    chunk_done_.Signal();
+  }
+  {
+    base::AutoLock auto_lock(lock_);
+    read_done_ = true;
+    chunk_done_.Signal();
+  }
+  thread.Join();
+  return !read_failed && !failed_;
+}
+
+void PayloadDataStreamer::Run() {
+  for (size_t index = 0;; index ^= 1) {
+    Chunk* chunk = &chunks_[index];
+    {
+      base::AutoLock auto_lock(lock_);
+      while (!chunk->full && !read_done_)
+        chunk_done_.Wait();
+      // The chunks are read in turn, so no other chunk is full either.
+      if (!chunk->full)
+        return;
+    }
+    bool succeeded =
+        (!hasher_ || hasher_->Update(chunk->data.data(), chunk->size)) &&
+        (out_fd_ < 0 ||
+         utils::WriteAll(out_fd_, chunk->data.data(), chunk->size));
+    if (!succeeded)
+      PLOG(ERROR) << "Unable to hash or write the payload data";
+    base::AutoLock auto_lock(lock_);
+    chunk->full = false;
+    failed_ = !succeeded;
+    chunk_done_.Signal();
+    if (failed_)
+      return;
+  }
+}
+
+// Reads the metadata of the payload in |payload_path|, its header and manifest,
+// in |out_metadata|, and parses it in |payload_metadata| and |out_manifest|.
+bool ReadPayloadMetadata(const string& payload_path,
+                         PayloadMetadata* payload_metadata,
+                         brillo::Blob* out_metadata,
+                         DeltaArchiveManifest* out_manifest) {
+  out_metadata->clear();
+  TEST_AND_RETURN_FALSE(utils::ReadFileChunk(
+      payload_path, 0, kMaxPayloadHeaderSize, out_metadata));
+  TEST_AND_RETURN_FALSE(payload_metadata->ParsePayloadHeader(*out_metadata));
+  uint64_t metadata_size = payload_metadata->GetMetadataSize();
+  TEST_AND_RETURN_FALSE(metadata_size >= kMaxPayloadHeaderSize);
+  TEST_AND_RETURN_FALSE(
+      utils::ReadFileChunk(payload_path,
+                           kMaxPayloadHeaderSize,
+                           metadata_size - kMaxPayloadHeaderSize,
+                           out_metadata));
+  TEST_AND_RETURN_FALSE(out_metadata->size() == metadata_size);
+  TEST_AND_RETURN_FALSE(
+      payload_metadata->GetManifest(*out_metadata, out_manifest));
+  return true;
+}
+
+// Given an unsigned payload under |payload_path| and the sizes of the
+// |payload_signature_size| and |metadata_signature_size| signature blobs,
+// generates in |out_metadata| the metadata of the payload once signed: the
+// header, with the metadata signature size, and the manifest, with the
+// signature operation. The data blobs of the payload, up to its signature, are
+// the |out_data_size| bytes at |out_data_offset| in |payload_path|. The
+// payload itself isn't read beyond its metadata. Returns true on success,
+// false otherwise.
+bool PrepareSignedPayloadMetadata(const string& payload_path,
+                                  uint64_t payload_signature_size,
+                                  uint32_t metadata_signature_size,
+                                  brillo::Blob* out_metadata,
+                                  uint64_t* out_data_offset,
+                                  uint64_t* out_data_size) {
   uint64_t manifest_offset = 20;
   const int kProtobufSizeOffset = 12;
 
-  brillo::Blob payload;
-  TEST_AND_RETURN_FALSE(utils::ReadFile(payload_path, &payload));
   PayloadMetadata payload_metadata;
-  TEST_AND_RETURN_FALSE(payload_metadata.ParsePayloadHeader(payload));
-  uint64_t metadata_size = payload_metadata.GetMetadataSize();
-  uint32_t metadata_signature_size =
-      payload_metadata.GetMetadataSignatureSize();
+  brillo::Blob metadata;
+  DeltaArchiveManifest manifest;
+  TEST_AND_RETURN_FALSE(ReadPayloadMetadata(
+      payload_path, &payload_metadata, &metadata, &manifest));
+  const off_t payload_size = utils::FileSize(payload_path);
+  TEST_AND_RETURN_FALSE(payload_size >= 0);
+  uint64_t data_offset = payload_metadata.GetMetadataSize() +
+                         payload_metadata.GetMetadataSignatureSize();
+  TEST_AND_RETURN_FALSE(static_cast<uint64_t>(payload_size) >= data_offset);
+
   // Write metadata signature size in header.
-  uint32_t metadata_signature_size_be = htobe32(metadata_signature.size());
-  memcpy(payload.data() + manifest_offset,
+  uint32_t metadata_signature_size_be = htobe32(metadata_signature_size);
+  memcpy(metadata.data() + manifest_offset,
          &metadata_signature_size_be,
          sizeof(metadata_signature_size_be));
   manifest_offset += sizeof(metadata_signature_size_be);
-  // Replace metadata signature.
-  payload.erase(payload.begin() + metadata_size,
-                payload.begin() + metadata_size + metadata_signature_size);
-  payload.insert(payload.begin() + metadata_size,
-                 metadata_signature.begin(),
-                 metadata_signature.end());
-  metadata_signature_size = metadata_signature.size();
   LOG(INFO) << "Metadata signature size: " << metadata_signature_size;
 
-  DeltaArchiveManifest manifest;
-  TEST_AND_RETURN_FALSE(payload_metadata.GetManifest(payload, &manifest));
-
   // Is there already a signature op in place?
   if (manifest.has_signatures_size()) {
     // The signature op is tied to the size of the signature blob, but not it's
     // contents. We don't allow the manifest to change if there is already an op
     // present, because that might invalidate previously generated
     // hashes/signatures.
-    if (manifest.signatures_size() != payload_signature.size()) {
+    if (manifest.signatures_size() != payload_signature_size) {
       LOG(ERROR) << "Attempt to insert different signature sized blob. "
                  << "(current:" << manifest.signatures_size()
-                 << "new:" << payload_signature.size() << ")";
+                 << "new:" << payload_signature_size << ")";
       return false;
     }
 
@@ -139,68 +272,59 @@ bool AddSignatureBlobToPayload(const string& payload_path,
   } else {
     // Updates the manifest to include the signature operation.
     PayloadSigner::AddSignatureToManifest(
-        payload.size() - metadata_size - metadata_signature_size,
-        payload_signature.size(),
-        &manifest);
+        payload_size - data_offset, payload_signature_size, &manifest);
 
-    // Updates the payload to include the new manifest.
+    // Updates the metadata to include the new manifest.
     string serialized_manifest;
     TEST_AND_RETURN_FALSE(manifest.AppendToString(&serialized_manifest));
     LOG(INFO) << "Updated protobuf size: " << serialized_manifest.size();
-    payload.erase(payload.begin() + manifest_offset,
-                  payload.begin() + metadata_size);
-    payload.insert(payload.begin() + manifest_offset,
-                   serialized_manifest.begin(),
-                   serialized_manifest.end());
+    metadata.resize(manifest_offset);
+    metadata.insert(metadata.end(),
+                    serialized_manifest.begin(),
+                    serialized_manifest.end());
 
     // Updates the protobuf size.
     uint64_t size_be = htobe64(serialized_manifest.size());
-    memcpy(&payload[kProtobufSizeOffset], &size_be, sizeof(size_be));
-    metadata_size = serialized_manifest.size() + manifest_offset;
-
-    LOG(INFO) << "Updated payload size: " << payload.size();
-    LOG(INFO) << "Updated metadata size: " << metadata_size;
+    memcpy(&metadata[kProtobufSizeOffset], &size_be, sizeof(size_be));
+    LOG(INFO) << "Updated metadata size: " << metadata.size();
   }
-  uint64_t signatures_offset =
-      metadata_size + metadata_signature_size + manifest.signatures_offset();
-  LOG(INFO) << "Signature Blob Offset: " << signatures_offset;
-  payload.resize(signatures_offset);
-  payload.insert(payload.begin() + signatures_offset,
-                 payload_signature.begin(),
-                 payload_signature.end());
-
-  *out_payload = std::move(payload);
-  *out_metadata_size = metadata_size;
-  *out_metadata_signature_size = metadata_signature_size;
-  *out_signatures_offset = signatures_offset;
+  TEST_AND_RETURN_FALSE(manifest.signatures_offset() <=
+                        payload_size - data_offset);
+  LOG(INFO) << "Signature Blob Offset: "
+            << metadata.size() + metadata_signature_size +
+                   manifest.signatures_offset();
+
+  *out_metadata = std::move(metadata);
+  *out_data_offset = data_offset;
+  *out_data_size = manifest.signatures_offset();
   return true;
 }
 
-// Given a |payload| with correct signature op and metadata signature size in
-// header and |metadata_size|, |metadata_signature_size|, |signatures_offset|,
-// calculate hash for payload and metadata, save it to |out_hash_data| and
-// |out_metadata_hash|.
-bool CalculateHashFromPayload(const brillo::Blob& payload,
-                              const uint64_t metadata_size,
-                              const uint32_t metadata_signature_size,
-                              const uint64_t signatures_offset,
+// Calculates the hash of the payload made of |metadata| and the |data_size|
+// bytes at |data_offset| in |payload_path|, skipping the metadata signature and
+// the payload signature, and saves it to |out_hash_data|. Saves the hash of the
+// |metadata| alone to |out_metadata_hash|. Either can be null.
+bool CalculateHashFromPayload(const brillo::Blob& metadata,
+                              const string& payload_path,
+                              const uint64_t data_offset,
+                              const uint64_t data_size,
                               brillo::Blob* out_hash_data,
                               brillo::Blob* out_metadata_hash) {
   if (out_metadata_hash) {
     // Calculates the hash on the manifest.
-    TEST_AND_RETURN_FALSE(HashCalculator::RawHashOfBytes(
-        payload.data(), metadata_size, out_metadata_hash));
+    TEST_AND_RETURN_FALSE(
+        HashCalculator::RawHashOfData(metadata, out_metadata_hash));
   }
   if (out_hash_data) {
     // Calculates the hash on the updated payload. Note that we skip metadata
     // signature and payload signature.
     HashCalculator calc;
-    TEST_AND_RETURN_FALSE(calc.Update(payload.data(), metadata_size));
-    TEST_AND_RETURN_FALSE(signatures_offset >=
-                          metadata_size + metadata_signature_size);
-    TEST_AND_RETURN_FALSE(calc.Update(
-        payload.data() + metadata_size + metadata_signature_size,
-        signatures_offset - metadata_size - metadata_signature_size));
+    TEST_AND_RETURN_FALSE(calc.Update(metadata.data(), metadata.size()));
+    int fd = HANDLE_EINTR(open(payload_path.c_str(), O_RDONLY | O_CLOEXEC));
+    TEST_AND_RETURN_FALSE_ERRNO(fd >= 0);
+    ScopedFdCloser fd_closer(&fd);
+    PayloadDataStreamer streamer(&calc, -1);
+    TEST_AND_RETURN_FALSE(streamer.Stream(fd, data_offset, data_size));
     TEST_AND_RETURN_FALSE(calc.Finalize());
     *out_hash_data = calc.raw_hash();
   }
@@ -248,12 +372,11 @@ void PayloadSigner::AddSignatureToManifest(uint64_t signature_blob_offset,
 
 bool PayloadSigner::VerifySignedPayload(const string& payload_path,
                                         const string& public_key_path) {
-  brillo::Blob payload;
-  TEST_AND_RETURN_FALSE(utils::ReadFile(payload_path, &payload));
   PayloadMetadata payload_metadata;
-  TEST_AND_RETURN_FALSE(payload_metadata.ParsePayloadHeader(payload));
+  brillo::Blob metadata;
   DeltaArchiveManifest manifest;
-  TEST_AND_RETURN_FALSE(payload_metadata.GetManifest(payload, &manifest));
+  TEST_AND_RETURN_FALSE(ReadPayloadMetadata(
+      payload_path, &payload_metadata, &metadata, &manifest));
   TEST_AND_RETURN_FALSE(manifest.has_signatures_offset() &&
                         manifest.has_signatures_size());
   uint64_t metadata_size = payload_metadata.GetMetadataSize();
@@ -261,15 +384,22 @@ bool PayloadSigner::VerifySignedPayload(const string& payload_path,
       payload_metadata.GetMetadataSignatureSize();
   uint64_t signatures_offset =
       metadata_size + metadata_signature_size + manifest.signatures_offset();
-  CHECK_EQ(payload.size(), signatures_offset + manifest.signatures_size());
+  CHECK_EQ(static_cast<uint64_t>(utils::FileSize(payload_path)),
+           signatures_offset + manifest.signatures_size());
   brillo::Blob payload_hash, metadata_hash;
-  TEST_AND_RETURN_FALSE(CalculateHashFromPayload(payload,
-                                                 metadata_size,
-                                                 metadata_signature_size,
-                                                 signatures_offset,
-                                                 &payload_hash,
-                                                 &metadata_hash));
-  string signature(payload.begin() + signatures_offset, payload.end());
+  TEST_AND_RETURN_FALSE(
+      CalculateHashFromPayload(metadata,
+                               payload_path,
+                               metadata_size + metadata_signature_size,
+                               manifest.signatures_offset(),
+                               &payload_hash,
+                               &metadata_hash));
+  brillo::Blob signature_blob;
+  TEST_AND_RETURN_FALSE(utils::ReadFileChunk(payload_path,
+                                             signatures_offset,
+                                             manifest.signatures_size(),
+                                             &signature_blob));
+  string signature(signature_blob.begin(), signature_blob.end());
   string public_key;
   TEST_AND_RETURN_FALSE(utils::ReadFile(public_key_path, &public_key));
   TEST_AND_RETURN_FALSE(payload_hash.size() == kSHA256Size);
@@ -280,8 +410,12 @@ bool PayloadSigner::VerifySignedPayload(const string& payload_path,
   TEST_AND_RETURN_FALSE(
       payload_verifier->VerifySignature(signature, payload_hash));
   if (metadata_signature_size) {
-    signature.assign(payload.begin() + metadata_size,
-                     payload.begin() + metadata_size + metadata_signature_size);
+    signature_blob.clear();
+    TEST_AND_RETURN_FALSE(utils::ReadFileChunk(payload_path,
+                                               metadata_size,
+                                               metadata_signature_size,
+                                               &signature_blob));
+    signature.assign(signature_blob.begin(), signature_blob.end());
     TEST_AND_RETURN_FALSE(metadata_hash.size() == kSHA256Size);
     TEST_AND_RETURN_FALSE(
         payload_verifier->VerifySignature(signature, metadata_hash));
@@ -383,15 +517,20 @@ bool PayloadSigner::SignPayload(const string& unsigned_payload_path,
                                 const uint32_t metadata_signature_size,
                                 const uint64_t signatures_offset,
                                 string* out_serialized_signature) {
-  brillo::Blob payload;
-  TEST_AND_RETURN_FALSE(utils::ReadFile(unsigned_payload_path, &payload));
+  brillo::Blob metadata;
+  TEST_AND_RETURN_FALSE(utils::ReadFileChunk(
+      unsigned_payload_path, 0, metadata_size, &metadata));
+  TEST_AND_RETURN_FALSE(metadata.size() == metadata_size);
+  TEST_AND_RETURN_FALSE(signatures_offset >=
+                        metadata_size + metadata_signature_size);
   brillo::Blob hash_data;
-  TEST_AND_RETURN_FALSE(CalculateHashFromPayload(payload,
-                                                 metadata_size,
-                                                 metadata_signature_size,
-                                                 signatures_offset,
-                                                 &hash_data,
-                                                 nullptr));
+  TEST_AND_RETURN_FALSE(CalculateHashFromPayload(
+      metadata,
+      unsigned_payload_path,
+      metadata_size + metadata_signature_size,
+      signatures_offset - metadata_size - metadata_signature_size,
+      &hash_data,
+      nullptr));
   TEST_AND_RETURN_FALSE(
       SignHashWithKeys(hash_data, private_key_paths, out_serialized_signature));
   return true;
@@ -423,21 +562,19 @@ bool PayloadSigner::HashPayloadForSigning(const string& payload_path,
   TEST_AND_RETURN_FALSE(
       ConvertSignaturesToProtobuf(signatures, signature_sizes, &signature));
 
-  brillo::Blob payload;
-  uint64_t metadata_size, signatures_offset;
-  uint32_t metadata_signature_size;
+  brillo::Blob metadata;
+  uint64_t data_offset, data_size;
   // Prepare payload for hashing.
-  TEST_AND_RETURN_FALSE(AddSignatureBlobToPayload(payload_path,
-                                                  signature,
-                                                  signature,
-                                                  &payload,
-                                                  &metadata_size,
-                                                  &metadata_signature_size,
-                                                  &signatures_offset));
-  TEST_AND_RETURN_FALSE(CalculateHashFromPayload(payload,
-                                                 metadata_size,
-                                                 metadata_signature_size,
-                                                 signatures_offset,
+  TEST_AND_RETURN_FALSE(PrepareSignedPayloadMetadata(payload_path,
+                                                     signature.size(),
+                                                     signature.size(),
+                                                     &metadata,
+                                                     &data_offset,
+                                                     &data_size));
+  TEST_AND_RETURN_FALSE(CalculateHashFromPayload(metadata,
+                                                 payload_path,
+                                                 data_offset,
+                                                 data_size,
                                                  out_payload_hash_data,
                                                  out_metadata_hash));
   return true;
@@ -450,9 +587,7 @@ bool PayloadSigner::AddSignatureToPayload(
     const vector<brillo::Blob>& metadata_signatures,
     const string& signed_payload_path,
     uint64_t* out_metadata_size) {
-  // TODO(petkov): Reduce memory usage -- the payload is manipulated in memory.
-
-  // Loads the payload and adds the signature op to it.
+  // Adds the signature op to the payload metadata.
   string payload_signature, metadata_signature;
   TEST_AND_RETURN_FALSE(ConvertSignaturesToProtobuf(
       payload_signatures, padded_signature_sizes, &payload_signature));
@@ -460,20 +595,49 @@ bool PayloadSigner::AddSignatureToPayload(
     TEST_AND_RETURN_FALSE(ConvertSignaturesToProtobuf(
         metadata_signatures, padded_signature_sizes, &metadata_signature));
   }
-  brillo::Blob payload;
-  uint64_t signatures_offset;
-  uint32_t metadata_signature_size;
-  TEST_AND_RETURN_FALSE(AddSignatureBlobToPayload(payload_path,
-                                                  payload_signature,
-                                                  metadata_signature,
-                                                  &payload,
-                                                  out_metadata_size,
-                                                  &metadata_signature_size,
-                                                  &signatures_offset));
-
-  LOG(INFO) << "Signed payload size: " << payload.size();
-  TEST_AND_RETURN_FALSE(utils::WriteFile(
-      signed_payload_path.c_str(), payload.data(), payload.size()));
+  brillo::Blob metadata;
+  uint64_t data_offset, data_size;
+  TEST_AND_RETURN_FALSE(PrepareSignedPayloadMetadata(payload_path,
+                                                     payload_signature.size(),
+                                                     metadata_signature.size(),
+                                                     &metadata,
+                                                     &data_offset,
+                                                     &data_size));
+
+  // The signed payload is written next to |signed_payload_path| and moved over
+  // it once complete, since it may be the unsigned payload read meanwhile.
+  base::FilePath signed_path(signed_payload_path);
+  base::FilePath temp_path;
+  TEST_AND_RETURN_FALSE(
+      base::CreateTemporaryFileInDir(signed_path.DirName(), &temp_path));
+  ScopedPathUnlinker temp_unlinker(temp_path.value());
+  // Keeps the permissions of the payload replaced, if any.
+  int mode;
+  if (base::GetPosixFilePermissions(signed_path, &mode))
+    TEST_AND_RETURN_FALSE(base::SetPosixFilePermissions(temp_path, mode));
+  int in_fd = HANDLE_EINTR(open(payload_path.c_str(), O_RDONLY | O_CLOEXEC));
+  TEST_AND_RETURN_FALSE_ERRNO(in_fd >= 0);
+  ScopedFdCloser in_fd_closer(&in_fd);
+  int out_fd = HANDLE_EINTR(
+      open(temp_path.value().c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC));
+  TEST_AND_RETURN_FALSE_ERRNO(out_fd >= 0);
+  ScopedFdCloser out_fd_closer(&out_fd);
+
+  TEST_AND_RETURN_FALSE_ERRNO(
+      utils::WriteAll(out_fd, metadata.data(), metadata.size()));
+  TEST_AND_RETURN_FALSE_ERRNO(utils::WriteAll(
+      out_fd, metadata_signature.data(), metadata_signature.size()));
+  PayloadDataStreamer streamer(nullptr, out_fd);
+  TEST_AND_RETURN_FALSE(streamer.Stream(in_fd, data_offset, data_size));
+  TEST_AND_RETURN_FALSE_ERRNO(utils::WriteAll(
+      out_fd, payload_signature.data(), payload_signature.size()));
+
+  TEST_AND_RETURN_FALSE(base::ReplaceFile(temp_path, signed_path, nullptr));
+  temp_unlinker.set_should_remove(false);
+  *out_metadata_size = metadata.size();
+  LOG(INFO) << "Signed payload size: "
+            << metadata.size() + metadata_signature.size() + data_size +
+                   payload_signature.size();
   return true;
 }
 
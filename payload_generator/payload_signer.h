@@ -81,15 +81,16 @@ class PayloadSigner {
 
   // Given an unsigned payload in |payload_path|,
   // this method does two things:
-  // 1. It loads the payload into memory, and inserts placeholder signature
-  //    operations and placeholder metadata signature to make the header and
-  //    the manifest match what the final signed payload will look like based
-  //    on |signatures_sizes|, if needed.
+  // 1. It loads the payload metadata into memory, and inserts placeholder
+  //    signature operations and placeholder metadata signature to make the
+  //    header and the manifest match what the final signed payload will look
+  //    like based on |signatures_sizes|, if needed.
   // 2. It calculates the raw SHA256 hash of the payload and the metadata in
   //    |payload_path| (except signatures) and returns the result in
   //    |out_hash_data| and |out_metadata_hash| respectively.
   //
-  // The changes to payload are not preserved or written to disk.
+  // The changes to payload are not preserved or written to disk. The payload
+  // data is streamed from the file, so it is hashed in constant memory.
   static bool HashPayloadForSigning(const std::string& payload_path,
                                     const std::vector<size_t>& signature_sizes,
                                     brillo::Blob* out_payload_hash_data,
@@ -99,10 +100,11 @@ class PayloadSigner {
   // and the raw |payload_signatures| and |metadata_signatures| updates the
   // payload to include the signature thus turning it into a signed payload. The
   // new payload is stored in |signed_payload_path|. |payload_path| and
-  // |signed_payload_path| can point to the same file. Populates
-  // |out_metadata_size| with the size of the metadata after adding the
-  // signature operation in the manifest. Returns true on success, false
-  // otherwise.
+  // |signed_payload_path| can point to the same file: the signed payload is
+  // streamed to a temporary file in the same directory, which then replaces
+  // it. Populates |out_metadata_size| with the size of the metadata after
+  // adding the signature operation in the manifest. Returns true on success,
+  // false otherwise.
   static bool AddSignatureToPayload(
       const std::string& payload_path,
       const std::vector<size_t>& padded_signature_sizes,
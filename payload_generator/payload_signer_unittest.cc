@@ -28,6 +28,7 @@
 #include "update_engine/common/utils.h"
 #include "update_engine/payload_consumer/payload_constants.h"
 #include "update_engine/payload_consumer/payload_verifier.h"
+#include "update_engine/payload_generator/extent_ranges.h"
 #include "update_engine/payload_generator/payload_file.h"
 #include "update_engine/update_metadata.pb.h"
 
@@ -209,4 +210,70 @@ TEST_F(PayloadSignerTest, VerifySignedPayloadTest) {
       payload_file.path(), GetBuildArtifactsPath(kUnittestPublicKeyPath)));
 }
 
+TEST_F(PayloadSignerTest, AddSignatureToLargePayloadTest) {
+  // A payload with more data than the chunks it is streamed in.
+  const size_t kDataSize = 3 * 1024 * 1024 + 100;
+  ScopedTempFile data_file("data.XXXXXX");
+  brillo::Blob data(kDataSize);
+  test_utils::FillWithData(&data);
+  ASSERT_TRUE(test_utils::WriteFileVector(data_file.path(), data));
+  PartitionConfig new_part("root");
+  new_part.path = data_file.path();
+  new_part.size = kDataSize;
+  PayloadGenerationConfig config;
+  config.version.major = kBrilloMajorPayloadVersion;
+  AnnotatedOperation aop;
+  aop.name = "data";
+  aop.op.set_type(InstallOperation::REPLACE);
+  aop.op.set_data_offset(0);
+  aop.op.set_data_length(kDataSize);
+  *aop.op.add_dst_extents() =
+      ExtentForRange(0, utils::DivRoundUp(kDataSize, config.block_size));
+
+  PayloadFile payload;
+  EXPECT_TRUE(payload.Init(config));
+  EXPECT_TRUE(payload.AddPartition(PartitionConfig(""), new_part, {aop}, {}));
+  ScopedTempFile payload_file("payload.XXXXXX");
+  uint64_t metadata_size;
+  EXPECT_TRUE(payload.WritePayload(
+      payload_file.path(), data_file.path(), "", &metadata_size));
+  ScopedTempFile expected_file("payload.XXXXXX");
+  EXPECT_TRUE(
+      payload.WritePayload(expected_file.path(),
+                           data_file.path(),
+                           GetBuildArtifactsPath(kUnittestPrivateKeyPath),
+                           &metadata_size));
+
+  // Sign the payload in place, as done from the delta_generator.
+  const vector<size_t> sizes = {256};
+  brillo::Blob payload_hash, metadata_hash;
+  EXPECT_TRUE(PayloadSigner::HashPayloadForSigning(
+      payload_file.path(), sizes, &payload_hash, &metadata_hash));
+  brillo::Blob payload_signature, metadata_signature;
+  EXPECT_TRUE(PayloadSigner::SignHash(
+      payload_hash,
+      GetBuildArtifactsPath(kUnittestPrivateKeyPath),
+      &payload_signature));
+  EXPECT_TRUE(PayloadSigner::SignHash(
+      metadata_hash,
+      GetBuildArtifactsPath(kUnittestPrivateKeyPath),
+      &metadata_signature));
+  uint64_t signed_metadata_size;
+  EXPECT_TRUE(PayloadSigner::AddSignatureToPayload(payload_file.path(),
+                                                   sizes,
+                                                   {payload_signature},
+                                                   {metadata_signature},
+                                                   payload_file.path(),
+                                                   &signed_metadata_size));
+  EXPECT_EQ(metadata_size, signed_metadata_size);
+  EXPECT_TRUE(PayloadSigner::VerifySignedPayload(
+      payload_file.path(), GetBuildArtifactsPath(kUnittestPublicKeyPath)));
+
+  // The payload matches the one signed as it is written.
+  brillo::Blob expected, actual;
+  EXPECT_TRUE(utils::ReadFile(expected_file.path(), &expected));
+  EXPECT_TRUE(utils::ReadFile(payload_file.path(), &actual));
+  EXPECT_TRUE(expected == actual);
+}
+
 }  // namespace chromeos_update_engine
@@ -27,8 +27,10 @@
 #include "update_engine/payload_consumer/bzip_extent_writer.h"
 #include "update_engine/payload_consumer/extent_writer.h"
 #include "update_engine/payload_consumer/xz_extent_writer.h"
+#include "update_engine/payload_consumer/zstd_extent_writer.h"
 #include "update_engine/payload_generator/bzip.h"
 #include "update_engine/payload_generator/xz.h"
+#include "update_engine/payload_generator/zstd.h"
 
 using chromeos_update_engine::test_utils::kRandomString;
 using google::protobuf::RepeatedPtrField;
@@ -112,7 +114,20 @@ class ZipTest<XzTest> : public ::testing::Test {
   }
 };
 
-typedef ::testing::Types<BzipTest, XzTest> ZipTestTypes;
+class ZstdTest {};
+
+template <>
+class ZipTest<ZstdTest> : public ::testing::Test {
+ public:
+  bool ZipCompress(const brillo::Blob& in, brillo::Blob* out) const {
+    return ZstdCompress(in, out);
+  }
+  bool ZipDecompress(const brillo::Blob& in, brillo::Blob* out) const {
+    return DecompressWithWriter<ZstdExtentWriter>(in, out);
+  }
+};
+
+typedef ::testing::Types<BzipTest, XzTest, ZstdTest> ZipTestTypes;
 
 TYPED_TEST_SUITE(ZipTest, ZipTestTypes);
 
@@ -0,0 +1,64 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_generator/zstd.h"
+
+#include <zstd.h>
+
+#include <memory>
+
+#include <base/logging.h>
+
+#include "update_engine/common/utils.h"
+
+namespace chromeos_update_engine {
+
+namespace {
+// The highest level that doesn't need the "ultra" windows, which the client
+// would need more memory to decompress.
+const int kZstdCompressionLevel = 19;
+
+struct ZstdCCtxDeleter {
+  void operator()(ZSTD_CCtx* cctx) const { ZSTD_freeCCtx(cctx); }
+};
+}  // namespace
+
+bool ZstdCompress(const brillo::Blob& in, brillo::Blob* out) {
+  TEST_AND_RETURN_FALSE(out);
+  out->clear();
+  if (in.size() == 0)
+    return true;
+
+  std::unique_ptr<ZSTD_CCtx, ZstdCCtxDeleter> cctx(ZSTD_createCCtx());
+  TEST_AND_RETURN_FALSE(cctx != nullptr);
+  TEST_AND_RETURN_FALSE(!ZSTD_isError(ZSTD_CCtx_setParameter(
+      cctx.get(), ZSTD_c_compressionLevel, kZstdCompressionLevel)));
+  // The operations are already covered by the payload hashes.
+  TEST_AND_RETURN_FALSE(!ZSTD_isError(
+      ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_checksumFlag, 0)));
+
+  out->resize(ZSTD_compressBound(in.size()));
+  size_t size = ZSTD_compress2(
+      cctx.get(), out->data(), out->size(), in.data(), in.size());
+  if (ZSTD_isError(size)) {
+    LOG(ERROR) << "ZSTD_compress2 failed: " << ZSTD_getErrorName(size);
+    return false;
+  }
+  out->resize(size);
+  return true;
+}
+
+}  // namespace chromeos_update_engine
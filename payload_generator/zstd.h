@@ -1,5 +1,5 @@
 //
-// Copyright (C) 2018 The Android Open Source Project
+// Copyright (C) 2026 The Android Open Source Project
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
 // you may not use this file except in compliance with the License.
@@ -14,26 +14,17 @@
 // limitations under the License.
 //
 
-#include "update_engine/payload_consumer/verity_writer_stub.h"
+#ifndef UPDATE_ENGINE_PAYLOAD_GENERATOR_ZSTD_H_
+#define UPDATE_ENGINE_PAYLOAD_GENERATOR_ZSTD_H_
 
-#include <memory>
+#include <brillo/secure_blob.h>
 
 namespace chromeos_update_engine {
 
-namespace verity_writer {
-std::unique_ptr<VerityWriterInterface> CreateVerityWriter() {
-  return std::make_unique<VerityWriterStub>();
-}
-}  // namespace verity_writer
-
-bool VerityWriterStub::Init(const InstallPlan::Partition& partition) {
-  return partition.hash_tree_size == 0 && partition.fec_size == 0;
-}
-
-bool VerityWriterStub::Update(uint64_t offset,
-                              const uint8_t* buffer,
-                              size_t size) {
-  return true;
-}
+// Compresses the input buffer |in| into |out| with zstd. The compressed frame
+// will be the equivalent of running zstd -19 --no-check.
+bool ZstdCompress(const brillo::Blob& in, brillo::Blob* out);
 
 }  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_GENERATOR_ZSTD_H_